@@ -1,7 +1,64 @@
 #!/bin/bash
 
+# ./make.sh builds webpage, and the webpage library ( libwebpage.a and
+# libwebpage.so, see webpage.h ). ./make.sh bench [options] builds them and 
+# then runs the benchmark in tests ( see tests/webpage_bench.sh for the 
+# options ).
+
 echo Making webpage...
 
-gcc -L/usr/lib/x86_64-linux-gnu -o webpage webpage.c -lcmark
+# brotli is optional, and used if its encoder library is installed
+
+brotli=""
+brotliLibrary=""
+
+if echo "#include <brotli/encode.h>" | gcc -E - > /dev/null 2>&1
+then
+    brotli="-DWEBPAGE_BROTLI"
+    brotliLibrary="-lbrotlienc"
+fi
+
+# io_uring is optional too, and used if the kernel header is there, since it's
+# used through system calls rather than liburing
+
+ioUring=""
+
+if echo "#include <linux/io_uring.h>" | gcc -E - > /dev/null 2>&1
+then
+    ioUring="-DWEBPAGE_IO_URING"
+fi
+
+# WEBPAGE_TRACE_LEVEL, if set, is the level of trace points compiled in ( see
+# --trace )
+
+trace=""
+
+if [[ -n "${WEBPAGE_TRACE_LEVEL}" ]]
+then
+    trace="-DWEBPAGE_TRACE_LEVEL=${WEBPAGE_TRACE_LEVEL}"
+fi
+
+gcc -L/usr/lib/x86_64-linux-gnu -o webpage webpage.c ${brotli} ${ioUring} ${trace} ${brotliLibrary} -lcmark -lz -lpthread || exit -1
+
+# The library is the page making part of the same code, without main() or the
+# modes and options only the program has. Only its interface is visible from 
+# either library : everything else is hidden from the shared library, and made
+# local to the object in the static one, so none of it can clash with a name in
+# the program the library is linked into
+
+gcc -c -fPIC -fvisibility=hidden -DWEBPAGE_LIBRARY -o libwebpage.o webpage.c ${brotli} ${trace} || exit -1
+objcopy --localize-hidden libwebpage.o || exit -1
+ar rcs libwebpage.a libwebpage.o || exit -1
+gcc -shared -L/usr/lib/x86_64-linux-gnu -o libwebpage.so libwebpage.o ${brotliLibrary} -lcmark -lz -lpthread || exit -1
+rm -f libwebpage.o
 
 echo Done making webpage
+
+if [[ "$1" == "bench" ]]
+then
+    shift
+
+    echo Running benchmark...
+
+    cd tests && WEBPAGE=$(realpath ../webpage) ./webpage_bench.sh "$@"
+fi
@@ -0,0 +1,163 @@
+#! /bin/bash
+
+# Benchmark runner for webpage program.
+#
+# This script makes a synthetic markdown corpus with webpage_corpus.sh, then
+# times webpage over it in each mode of operation :
+#
+#   single  -   one webpage process per page, run in the page's directory,
+#               as webpages.sh used to
+#   batch   -   one webpage process for all the pages, names read from stdin
+#   site    -   site mode, every page made ( --force )
+#   noop    -   site mode again, when nothing has changed
+#
+# Each mode is run cold, with the page cache dropped first ( this needs root,
+# otherwise cold runs are skipped ), and then warm. For each run it reports
+# seconds, pages per second, MB of markdown per second, and peak RSS as given
+# by the webpage stats report ( the largest of any process, for single ). The
+# stats reports are kept in the results directory.
+#
+# Run this script from webpage/tests. webpage is found on the path, unless
+# WEBPAGE is set.
+#
+# opt p, s, d, f, c and t are passed to webpage_corpus.sh ( see there ), with
+#   the same defaults
+# opt j is the number of jobs for batch and site modes ( default is the number
+#   of processors )
+# opt m is the modes to run ( default "single batch site noop" )
+# opt o is the results directory ( default webpage_bench_<datetime> ), which
+#   is kept, corpus and all, for a later look
+#
+
+webpage=${WEBPAGE:-$(which webpage)}
+corpusOptions=""
+jobs=$(nproc)
+modes="single batch site noop"
+dt=$(date '+%Y:%m:%d-%H:%M:%S')
+results="webpage_bench_${dt}"
+
+while getopts "p:s:d:f:c:t:j:m:o:" option
+do
+    case "${option}" in
+        p|s|d|f|c|t) corpusOptions="${corpusOptions} -${option} ${OPTARG}";;
+        j) jobs=${OPTARG};;
+        m) modes=${OPTARG};;
+        o) results=${OPTARG};;
+        *) echo "webpage_bench.sh: unknown option"; exit -1;;
+    esac
+done
+
+if [[ ! -x "${webpage}" ]]
+then
+    echo "webpage_bench.sh: no webpage program found"
+    exit -1
+fi
+
+echo "webpage_bench.sh: benchmark run ${dt}"
+echo "webpage_bench.sh: using ${webpage} modified $(date -r ${webpage})"
+
+mkdir -p "${results}" || exit -1
+results=$(realpath "${results}")
+corpus="${results}/corpus"
+
+./webpage_corpus.sh -o "${corpus}" ${corpusOptions} || exit -1
+
+pageCount=$(find "${corpus}" -name '*.md' | wc -l)
+markdownBytes=$(find "${corpus}" -name '*.md' -printf '%s\n' | awk '{ total += $1 } END { print total }')
+
+canDrop=false
+
+if [[ -w /proc/sys/vm/drop_caches ]]
+then
+    canDrop=true
+else
+    echo "webpage_bench.sh: not root, so cold cache runs are skipped"
+fi
+
+# peak RSS, in KB, from a stats report
+
+function peakRss {
+    sed -n 's/.*"peak_rss_kb": \([0-9]*\).*/\1/p' "$1"
+}
+
+# run one mode, and report how it went
+
+function runMode {
+mode=$1
+cache=$2
+stats="${results}/${mode}_${cache}"
+peak=0
+
+    if [[ "${cache}" == "cold" ]]
+    then
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+
+    start=$(date +%s%N)
+
+    case "${mode}" in
+        single)
+            mkdir -p "${stats}"
+            index=0
+            while IFS= read -r -d '' markdown
+            do
+                ( cd "$(dirname "${markdown}")" && "${webpage}" -c "${corpus}" -T "${stats}/${index}.json" "$(basename "${markdown}")" ) || exit -1
+                index=$(( index + 1 ))
+            done < <(find "${corpus}" -name '*.md' -print0)
+            ;;
+        batch)
+            ( cd "${corpus}" && find . -name '*.md' -print0 | "${webpage}" -0 -j ${jobs} -c "${corpus}" -T "${stats}.json" - ) || exit -1
+            ;;
+        site)
+            "${webpage}" --site --force -j ${jobs} -c "${corpus}" -T "${stats}.json" "${corpus}" "${results}/html" || exit -1
+            ;;
+        noop)
+            "${webpage}" --site -j ${jobs} -c "${corpus}" -T "${stats}.json" "${corpus}" "${results}/html" || exit -1
+            ;;
+        *)
+            echo "webpage_bench.sh: unknown mode ${mode}"
+            exit -1
+            ;;
+    esac
+
+    end=$(date +%s%N)
+
+    if [[ -d "${stats}" ]]
+    then
+        for report in "${stats}"/*.json
+        do
+            rss=$(peakRss "${report}")
+            [[ ${rss} -gt ${peak} ]] && peak=${rss}
+        done
+    else
+        peak=$(peakRss "${stats}.json")
+    fi
+
+    awk -v mode="${mode}" -v cache="${cache}" -v ns=$(( end - start )) -v pages=${pageCount} -v bytes=${markdownBytes} -v peak=${peak} 'BEGIN {
+        seconds = ns / 1e9
+        printf( "%-8s %-6s %10.3f %12.1f %10.2f %12d\n", mode, cache, seconds, pages / seconds, bytes / 1048576 / seconds, peak )
+    }'
+}
+
+echo "webpage_bench.sh: ${pageCount} pages, ${markdownBytes} bytes of markdown, ${jobs} jobs"
+printf "%-8s %-6s %10s %12s %10s %12s\n" "mode" "cache" "seconds" "pages/s" "MB/s" "peak RSS KB"
+
+for mode in ${modes}
+do
+    # noop needs the site made already
+
+    if [[ "${mode}" == "noop" ]] && [[ ! -d "${results}/html" ]]
+    then
+        "${webpage}" --site -j ${jobs} -c "${corpus}" "${corpus}" "${results}/html" || exit -1
+    fi
+
+    if ${canDrop}
+    then
+        runMode ${mode} cold || exit -1
+    fi
+
+    runMode ${mode} warm || exit -1
+done
+
+echo "webpage_bench.sh: results kept in ${results}"
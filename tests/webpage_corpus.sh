@@ -0,0 +1,201 @@
+#! /bin/bash
+
+# Synthetic markdown corpus generator for benchmarking webpage.
+#
+# Makes a tree of directories, nested to a given depth with a given number of
+# subdirectories in each, and spreads the pages evenly over all of them. Each
+# page is Commonmark of roughly the given size : headings, paragraphs with
+# emphasis, inline html and links to the other pages in its directory, lists
+# and code blocks. The css files are placed as in webpage_test13, either once
+# at the root ( every page finds it some levels up ), in the deepest
+# directories only, in every directory, or not at all. Optionally every Nth
+# page has a .txt file for its head.
+#
+# The same options always give the same corpus.
+#
+# opt o is the directory to make the corpus in ( required, must not exist )
+# opt p is the number of pages ( default 1000 )
+# opt s is the size of a page in KB ( default 4 )
+# opt d is the nesting depth of the directories ( default 3 )
+# opt f is the number of subdirectories in each directory ( default 3 )
+# opt c is where the css goes : root, leaf, every or none ( default root )
+# opt t gives every <t>th page a .txt file, 0 for none ( default 0 )
+# opt r is the random seed ( default 1 )
+#
+# e.g. webpage_corpus.sh -o /tmp/corpus -p 10000 -s 8 -d 4 -c leaf
+#
+
+corpus=""
+pages=1000
+size=4
+depth=3
+fanout=3
+css="root"
+txtEvery=0
+seed=1
+
+while getopts "o:p:s:d:f:c:t:r:" option
+do
+    case "${option}" in
+        o) corpus=${OPTARG};;
+        p) pages=${OPTARG};;
+        s) size=${OPTARG};;
+        d) depth=${OPTARG};;
+        f) fanout=${OPTARG};;
+        c) css=${OPTARG};;
+        t) txtEvery=${OPTARG};;
+        r) seed=${OPTARG};;
+        *) echo "webpage_corpus.sh: unknown option"; exit -1;;
+    esac
+done
+
+if [[ -z "${corpus}" ]]
+then
+    echo "webpage_corpus.sh: a directory to make the corpus in is required ( -o )"
+    exit -1
+fi
+
+if [[ -e "${corpus}" ]]
+then
+    echo "webpage_corpus.sh: ${corpus} already exists"
+    exit -1
+fi
+
+case "${css}" in
+    root|leaf|every|none) ;;
+    *) echo "webpage_corpus.sh: css placement must be root, leaf, every or none"; exit -1;;
+esac
+
+# Make the directory tree, breadth first, noting each directory and its depth
+
+dirs=( "." )
+levels=( 0 )
+index=0
+
+mkdir -p "${corpus}" || exit -1
+
+while [[ ${index} -lt ${#dirs[@]} ]]
+do
+    if [[ ${levels[${index}]} -lt ${depth} ]]
+    then
+        for (( sub = 1; sub <= fanout; sub++ ))
+        do
+            dirs+=( "${dirs[${index}]}/dir${sub}" )
+            levels+=( $(( ${levels[${index}]} + 1 )) )
+            mkdir "${corpus}/${dirs[-1]}" || exit -1
+        done
+    fi
+    index=$(( index + 1 ))
+done
+
+# Place the css
+
+for (( index = 0; index < ${#dirs[@]}; index++ ))
+do
+    if [[ "${css}" == "every" ]] || \
+       [[ "${css}" == "root" && ${index} -eq 0 ]] || \
+       [[ "${css}" == "leaf" && ${levels[${index}]} -eq ${depth} ]]
+    then
+        printf "body { font-family: sans-serif; }\n" > "${corpus}/${dirs[${index}]}/corpus${index}.css"
+    fi
+done
+
+# Write the pages, page n going in directory n modulo the number of directories
+
+printf "%s\n" "${dirs[@]}" | awk -v corpus="${corpus}" -v pages="${pages}" -v size="$(( size * 1024 ))" \
+                                 -v txtEvery="${txtEvery}" -v seed="${seed}" '
+function word()
+{
+    return words[int( rand() * wordCount ) + 1]
+}
+
+function sentence(    text, count, n, r )
+{
+    text = word()
+    text = toupper( substr( text, 1, 1 ) ) substr( text, 2 )
+    count = 6 + int( rand() * 12 )
+
+    for( n = 1; n < count; n++ )
+    {
+        r = rand()
+
+        if( r < 0.04 )      text = text " *" word() "*"
+        else if( r < 0.06 ) text = text " **" word() " " word() "**"
+        else if( r < 0.08 ) text = text " <s>" word() "</s>"
+        else if( r < 0.10 ) text = text " `" word() "()`"
+        else if( r < 0.14 ) text = text " [" word() "](page" sibling() ".md)"
+        else                text = text " " word()
+    }
+
+    return text "."
+}
+
+# Another page in the same directory as the current one
+
+function sibling(    n )
+{
+    n = page + dirCount * ( int( rand() * 5 ) - 2 )
+
+    return ( n < 0 || n >= pages ) ? page : n
+}
+
+BEGIN {
+    srand( seed )
+    wordCount = split( "lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor " \
+                       "incididunt ut labore et dolore magna aliqua enim ad minim veniam quis nostrud " \
+                       "exercitation ullamco laboris nisi aliquip ex ea commodo consequat duis aute irure " \
+                       "in reprehenderit voluptate velit esse cillum fugiat nulla pariatur excepteur sint " \
+                       "occaecat cupidatat non proident sunt culpa qui officia deserunt mollit anim id est", words, " " )
+}
+
+{
+    dirs[dirCount++] = $0
+}
+
+END {
+    for( page = 0; page < pages; page++ )
+    {
+        file = corpus "/" dirs[page % dirCount] "/page" page ".md"
+        written = 0
+        section = 0
+
+        printf( "# Page %d\n\n", page ) > file
+
+        while( written < size )
+        {
+            r = rand()
+
+            if( r < 0.08 )
+            {
+                text = "## Section " ++section " " word()
+            }
+            else if( r < 0.16 )
+            {
+                text = "- " sentence() "\n- " sentence() "\n- " sentence()
+            }
+            else if( r < 0.20 )
+            {
+                text = "```\nint " word() " = " int( rand() * 100 ) ";\n" word() "( " word() " );\n```"
+            }
+            else
+            {
+                text = sentence() " " sentence() " " sentence()
+            }
+
+            printf( "%s\n\n", text ) > file
+            written += length( text ) + 2
+        }
+
+        close( file )
+
+        if( txtEvery > 0 && 0 == page % txtEvery )
+        {
+            file = corpus "/" dirs[page % dirCount] "/page" page ".txt"
+
+            printf( "<meta name=\"description\" content=\"Page %d\">\n", page ) > file
+            close( file )
+        }
+    }
+}' || exit -1
+
+echo "webpage_corpus.sh: ${pages} pages of ${size}KB in ${#dirs[@]} directories, css ${css}, in ${corpus}"
@@ -39,6 +39,16 @@ echo "webpage_test.sh: $1 success"
 
 }
 
+# wait up to 5 seconds for a condition to be met, for tests of watch mode
+function waitFor {
+for (( tries = 0; tries < 50; tries++ ))
+do
+    eval "$1" && return 0
+    sleep 0.1
+done
+return 1
+}
+
 # Record datetime of test and code
 dt=$(date '+%Y:%m:%d-%H:%M:%S');
 echo "webpage_test.sh: webpage test run ${dt}"
@@ -223,6 +233,1145 @@ fi
 echo "webpage_test.sh: webpage_test13b success"
 cd ../..
 
+#14
+# Several markdown files rendered by one webpage process
+echo "webpage_test.sh: Running webpage_test14"
+rm webpage_test1.html webpage_test3.html
+webpage webpage_test1.md webpage_test3.md
+
+checkResult webpage_test1
+checkResult webpage_test3
+echo "webpage_test.sh: webpage_test14 success"
+
+#15
+# Markdown files in other directories, NUL separated names read from stdin
+echo "webpage_test.sh: Running webpage_test15"
+rm webpage_test13/webpage_test13a/webpage_test13a.html webpage_test13/webpage_test13b/webpage_test13b.html
+printf "webpage_test13/webpage_test13a/webpage_test13a.md\0webpage_test13/webpage_test13b/webpage_test13b.md\0" | webpage -0 -c ${abshtmlroot} -
+
+checkResult webpage_test13/webpage_test13a/webpage_test13a
+checkResult webpage_test13/webpage_test13b/webpage_test13b
+echo "webpage_test.sh: webpage_test15 success"
+
+#16
+# Site mode, with the markdown tree rendered into a separate html tree by several threads
+echo "webpage_test.sh: Running webpage_test16"
+webpage --site -j 4 ../markdown_test webpage_test16_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test16 webpage returned ${result}"
+    exit -1
+fi
+
+for page in webpage_test1 webpage_test2 webpage_test3 webpage_test4 webpage_test11
+do
+    diff -I '.*Datetime.*' webpage_test16_html/${page}.html ../markdown_test_reference/${page}.html >webpage_test16_${page}.diff
+    result=$?
+    if [[ ${result} -ne 0 ]]
+    then
+        echo "webpage_test.sh: webpage_test16 ${page} html diff failure"
+        exit -1
+    fi
+done
+
+if [[ ! -f webpage_test16_html/webpage_test13/webpage_test13a/webpage_test13a.html ]]
+then
+    echo "webpage_test.sh: webpage_test16 nested web page missing"
+    exit -1
+fi
+
+echo "webpage_test.sh: webpage_test16 success"
+
+#17
+# Site mode rebuild only remakes web pages whose inputs have changed, and removes
+# web pages whose markdown has gone
+echo "webpage_test.sh: Running webpage_test17"
+cp -r ../markdown_test webpage_test17_md
+webpage --site webpage_test17_md webpage_test17_html
+before1=$(stat -c %y webpage_test17_html/webpage_test1.html)
+before2=$(stat -c %y webpage_test17_html/webpage_test2.html)
+
+# touched but unchanged, changed, and removed markdown
+touch webpage_test17_md/webpage_test1.md
+echo "More text" >> webpage_test17_md/webpage_test2.md
+rm webpage_test17_md/webpage_test3.md
+webpage --site webpage_test17_md webpage_test17_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test17 webpage returned ${result}"
+    exit -1
+fi
+
+if [[ "${before1}" != "$(stat -c %y webpage_test17_html/webpage_test1.html)" ]]
+then
+    echo "webpage_test.sh: webpage_test17 unchanged web page was made again"
+    exit -1
+fi
+
+if [[ "${before2}" == "$(stat -c %y webpage_test17_html/webpage_test2.html)" ]] || ! grep -q "More text" webpage_test17_html/webpage_test2.html
+then
+    echo "webpage_test.sh: webpage_test17 changed web page was not made again"
+    exit -1
+fi
+
+if [[ -f webpage_test17_html/webpage_test3.html ]]
+then
+    echo "webpage_test.sh: webpage_test17 web page for removed markdown still there"
+    exit -1
+fi
+
+echo "webpage_test.sh: webpage_test17 success"
+
+#18
+# Links to local markdown files are rewritten to link to their web pages
+echo "webpage_test.sh: Running webpage_test18"
+webpage -l webpage_test18.md
+
+checkResult webpage_test18
+echo "webpage_test.sh: webpage_test18 success"
+
+#19
+# A txt file shared by several markdown files in one batch
+echo "webpage_test.sh: Running webpage_test19"
+rm webpage_test4.html
+cp webpage_test4.md webpage_test19.md
+ln webpage_test4.txt webpage_test19.txt
+webpage webpage_test4.md webpage_test19.md
+
+checkResult webpage_test4
+checkResult webpage_test19
+echo "webpage_test.sh: webpage_test19 success"
+
+#20
+# Stats report, with an entry for every page
+echo "webpage_test.sh: Running webpage_test20"
+rm webpage_test1.html webpage_test3.html
+webpage -T webpage_test20_stats.json webpage_test1.md webpage_test3.md
+
+checkResult webpage_test1
+checkResult webpage_test3
+
+if [[ $(grep -c '"markdown": "webpage_test[13].md", "made": true' webpage_test20_stats.json) -ne 2 ]] || ! grep -q '"p99_ns"' webpage_test20_stats.json
+then
+    echo "webpage_test.sh: webpage_test20 stats report failure"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test20 success"
+
+#21
+# Watch mode keeps the site up to date, without running webpage again
+echo "webpage_test.sh: Running webpage_test21"
+mkdir webpage_test21_md
+cp webpage_test1.md webpage_test2.md webpage_test21_md
+webpage --watch webpage_test21_md webpage_test21_html &
+watchPid=$!
+
+if ! waitFor "[[ -f webpage_test21_html/webpage_test2.html ]]"
+then
+    echo "webpage_test.sh: webpage_test21 site was not made"
+    kill ${watchPid}
+    exit -1
+fi
+
+# changed, new and removed markdown, in a new directory too
+echo "More text" >> webpage_test21_md/webpage_test2.md
+mkdir webpage_test21_md/webpage_test21a
+cp webpage_test3.md webpage_test21_md/webpage_test21a
+rm webpage_test21_md/webpage_test1.md
+
+if ! waitFor "grep -q 'More text' webpage_test21_html/webpage_test2.html && [[ -f webpage_test21_html/webpage_test21a/webpage_test3.html ]] && [[ ! -f webpage_test21_html/webpage_test1.html ]]"
+then
+    echo "webpage_test.sh: webpage_test21 site was not kept up to date"
+    kill ${watchPid}
+    exit -1
+fi
+
+kill ${watchPid}
+wait ${watchPid}
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test21 webpage returned ${result}"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test21 success"
+
+#22
+# Site mode with css : directories that haven't changed aren't read again for
+# css, and a css file added to a directory only changes the pages below it
+echo "webpage_test.sh: Running webpage_test22"
+mkdir -p webpage_test22_md/webpage_test22a
+cp webpage_test1.md webpage_test22_md
+cp webpage_test2.md webpage_test22_md/webpage_test22a
+touch webpage_test22_md/webpage_test22.css
+touch -d '1 hour ago' webpage_test22_md webpage_test22_md/webpage_test22a
+webpage --site -c ${PWD} webpage_test22_md webpage_test22_html
+webpage --site -c ${PWD} -T webpage_test22_stats.json webpage_test22_md webpage_test22_html
+before1=$(stat -c %y webpage_test22_html/webpage_test1.html)
+
+if grep '"markdown"' webpage_test22_stats.json | grep -v -q '"opendir": 0,'
+then
+    echo "webpage_test.sh: webpage_test22 unchanged directory read again"
+    exit -1
+fi
+
+touch webpage_test22_md/webpage_test22a/webpage_test22a.css
+webpage --site -c ${PWD} webpage_test22_md webpage_test22_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test22 webpage returned ${result}"
+    exit -1
+fi
+
+if [[ "${before1}" != "$(stat -c %y webpage_test22_html/webpage_test1.html)" ]]
+then
+    echo "webpage_test.sh: webpage_test22 web page with unchanged css was made again"
+    exit -1
+fi
+
+if ! grep -q 'href="./webpage_test22a.css"' webpage_test22_html/webpage_test22a/webpage_test2.html
+then
+    echo "webpage_test.sh: webpage_test22 web page with new css was not made again"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test22 success"
+
+#23
+# Site mode with assets : everything but md, txt and backup files is mirrored,
+# by hard link or by copy, assets already mirrored are left alone, and assets
+# that have gone are removed
+echo "webpage_test.sh: Running webpage_test23"
+mkdir -p webpage_test23_md/webpage_test23a
+cp webpage_test4.md webpage_test4.txt webpage_test23_md
+cp webpage_test4.md webpage_test23_md/webpage_test4.backup
+echo "body { color: black; }" > webpage_test23_md/webpage_test23.css
+echo "not really an image" > webpage_test23_md/webpage_test23a/webpage_test23.png
+webpage --site --assets=link webpage_test23_md webpage_test23_link_html
+webpage --site --assets=copy webpage_test23_md webpage_test23_copy_html
+webpage --site --assets=copy -T webpage_test23_stats.json webpage_test23_md webpage_test23_copy_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test23 webpage returned ${result}"
+    exit -1
+fi
+
+if [[ $(stat -c %i webpage_test23_md/webpage_test23.css) != $(stat -c %i webpage_test23_link_html/webpage_test23.css) ]] || \
+   [[ $(stat -c %i webpage_test23_md/webpage_test23a/webpage_test23.png) != $(stat -c %i webpage_test23_link_html/webpage_test23a/webpage_test23.png) ]]
+then
+    echo "webpage_test.sh: webpage_test23 assets were not linked"
+    exit -1
+fi
+
+if ! cmp -s webpage_test23_md/webpage_test23a/webpage_test23.png webpage_test23_copy_html/webpage_test23a/webpage_test23.png || \
+   [[ $(stat -c %i webpage_test23_md/webpage_test23.css) == $(stat -c %i webpage_test23_copy_html/webpage_test23.css) ]]
+then
+    echo "webpage_test.sh: webpage_test23 assets were not copied"
+    exit -1
+fi
+
+if [[ -n $(find webpage_test23_link_html webpage_test23_copy_html -name "*.md" -o -name "*.txt" -o -name "*.backup") ]]
+then
+    echo "webpage_test.sh: webpage_test23 markdown files were mirrored"
+    exit -1
+fi
+
+if ! grep -q '"bytes_out": 0,' webpage_test23_stats.json
+then
+    echo "webpage_test.sh: webpage_test23 unchanged assets were copied again"
+    exit -1
+fi
+
+rm webpage_test23_md/webpage_test23a/webpage_test23.png
+webpage --site --assets=copy webpage_test23_md webpage_test23_copy_html
+
+if [[ -e webpage_test23_copy_html/webpage_test23a/webpage_test23.png ]]
+then
+    echo "webpage_test.sh: webpage_test23 asset that has gone was not removed"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test23 success"
+
+#24
+# Site mode with compressed copies : the copy is the page, and is only made 
+# again when the page's content changes
+echo "webpage_test.sh: Running webpage_test24"
+mkdir webpage_test24_md
+cp webpage_test4.md webpage_test4.txt webpage_test24_md
+compressOptions="--gzip"
+
+if webpage --brotli -h > /dev/null
+then
+    compressOptions="--gzip --brotli"
+fi
+
+webpage --site ${compressOptions} webpage_test24_md webpage_test24_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test24 webpage returned ${result}"
+    exit -1
+fi
+
+if ! gzip -dc webpage_test24_html/webpage_test4.html.gz | cmp -s - webpage_test24_html/webpage_test4.html
+then
+    echo "webpage_test.sh: webpage_test24 gzip copy is not the web page"
+    exit -1
+fi
+
+if [[ "${compressOptions}" == *brotli* ]] && [[ ! -s webpage_test24_html/webpage_test4.html.br ]]
+then
+    echo "webpage_test.sh: webpage_test24 brotli copy was not made"
+    exit -1
+fi
+
+before=$(stat -c %y webpage_test24_html/webpage_test4.html.gz)
+webpage --site --force ${compressOptions} webpage_test24_md webpage_test24_html
+
+if [[ "${before}" != "$(stat -c %y webpage_test24_html/webpage_test4.html.gz)" ]]
+then
+    echo "webpage_test.sh: webpage_test24 unchanged web page was compressed again"
+    exit -1
+fi
+
+echo "More text" >> webpage_test24_md/webpage_test4.md
+webpage --site ${compressOptions} webpage_test24_md webpage_test24_html
+
+if ! gzip -dc webpage_test24_html/webpage_test4.html.gz | grep -q "More text"
+then
+    echo "webpage_test.sh: webpage_test24 changed web page was not compressed again"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test24 success"
+
+#25
+# Archive mode : the site is streamed as a tar archive, pages and assets both,
+# long names included, and nothing else is written
+echo "webpage_test.sh: Running webpage_test25"
+longDir="webpage_test25_md/webpage_test25_a_directory_with_a_long_name/webpage_test25_another_directory_with_a_long_name/webpage_test25_and_one_more_directory_with_a_long_name"
+mkdir -p ${longDir} webpage_test25_html
+cp webpage_test4.md webpage_test4.txt webpage_test25_md
+cp webpage_test1.md ${longDir}
+echo "not really an image" > webpage_test25_md/webpage_test25.png
+webpage --archive - --assets=copy --gzip webpage_test25_md > webpage_test25.tar
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test25 webpage returned ${result}"
+    exit -1
+fi
+
+if ! tar -xf webpage_test25.tar -C webpage_test25_html
+then
+    echo "webpage_test.sh: webpage_test25 archive cannot be read"
+    exit -1
+fi
+
+webpage --site --assets=copy --gzip webpage_test25_md webpage_test25_site
+
+if ! diff -q <(sed '/Datetime is/d' webpage_test25_html/webpage_test4.html) <(sed '/Datetime is/d' webpage_test25_site/webpage_test4.html) || \
+   ! diff -q <(sed '/Datetime is/d' webpage_test25_html/${longDir#webpage_test25_md/}/webpage_test1.html) <(sed '/Datetime is/d' webpage_test25_site/${longDir#webpage_test25_md/}/webpage_test1.html) || \
+   ! cmp -s webpage_test25_md/webpage_test25.png webpage_test25_html/webpage_test25.png || \
+   ! gzip -t webpage_test25_html/webpage_test4.html.gz
+then
+    echo "webpage_test.sh: webpage_test25 archive is not the site"
+    exit -1
+fi
+
+if [[ -n $(find webpage_test25_md -name "*.html*") ]]
+then
+    echo "webpage_test.sh: webpage_test25 web pages were written outside the archive"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test25 success"
+
+echo "webpage_test.sh: Running webpage_test26"
+mkdir webpage_test26_md
+cp webpage_test4.md webpage_test4.txt webpage_test26_md
+webpage --site --keep-unchanged webpage_test26_md webpage_test26_html
+before=$(stat -c %y webpage_test26_html/webpage_test4.html)
+sleep 1
+webpage --site --force --keep-unchanged webpage_test26_md webpage_test26_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test26 webpage returned ${result}"
+    exit -1
+fi
+
+if [[ "${before}" != "$(stat -c %y webpage_test26_html/webpage_test4.html)" ]]
+then
+    echo "webpage_test.sh: webpage_test26 unchanged web page was written again"
+    exit -1
+fi
+
+echo "A changed last line." >> webpage_test26_md/webpage_test4.md
+webpage --site --keep-unchanged webpage_test26_md webpage_test26_html
+
+if [[ "${before}" == "$(stat -c %y webpage_test26_html/webpage_test4.html)" ]] || ! grep -q "A changed last line." webpage_test26_html/webpage_test4.html
+then
+    echo "webpage_test.sh: webpage_test26 changed web page was not written"
+    exit -1
+fi
+
+# and without a manifest, by comparing with the html file
+
+( cd webpage_test26_md && webpage webpage_test4.md )
+before=$(stat -c %y webpage_test26_md/webpage_test4.html)
+sleep 1
+( cd webpage_test26_md && webpage --keep-unchanged webpage_test4.md )
+
+if [[ "${before}" != "$(stat -c %y webpage_test26_md/webpage_test4.html)" ]]
+then
+    echo "webpage_test.sh: webpage_test26 unchanged web page was written again without a manifest"
+    exit -1
+fi
+
+( cd webpage_test26_md && webpage --keep-unchanged -f 0x02 webpage_test4.md )
+
+if [[ "${before}" == "$(stat -c %y webpage_test26_md/webpage_test4.html)" ]]
+then
+    echo "webpage_test.sh: webpage_test26 changed web page was not written without a manifest"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test26 success"
+
+echo "webpage_test.sh: Running webpage_test27"
+mkdir webpage_test27_md
+cp webpage_test4.md webpage_test4.txt webpage_test27_md
+webpage --site --cache=${PWD}/webpage_test27_cache webpage_test27_md webpage_test27_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test27 webpage returned ${result}"
+    exit -1
+fi
+
+cached=$(find webpage_test27_cache -type f)
+if [[ $(echo "${cached}" | wc -w) -ne 1 ]] || ! grep -q "Webpage Test Markdown" ${cached}
+then
+    echo "webpage_test.sh: webpage_test27 body was not cached"
+    exit -1
+fi
+
+# a cached body is used as it is, so a doctored one shows up in the page
+
+body="<p>webpage_test27 hit</p>"
+key=${cached#webpage_test27_cache/}
+tag=$(sed -n 2p ${cached})
+markdown=webpage_test27_md/webpage_test4.md
+{ printf "webpage body %s %d %d 0\n%s\n" "${key/\//}" $(stat -c %s ${markdown}) ${#body} "${tag}"; cat ${markdown}; printf "%s" "${body}"; } > ${cached}
+mv webpage_test27_html webpage_test27_html_moved
+webpage --site --cache=${PWD}/webpage_test27_cache webpage_test27_md webpage_test27_html
+
+if ! grep -q "<p>webpage_test27 hit</p>" webpage_test27_html/webpage_test4.html
+then
+    echo "webpage_test.sh: webpage_test27 cached body was not used"
+    exit -1
+fi
+
+# but not for other markdown that gives the same key
+
+{ printf "webpage body %s %d %d 0\n%s\n" "${key/\//}" $(stat -c %s ${markdown}) ${#body} "${tag}"; tr 'a-z' 'A-Z' < ${markdown}; printf "%s" "${body}"; } > ${cached}
+webpage --site --force --cache=${PWD}/webpage_test27_cache webpage_test27_md webpage_test27_html
+
+if grep -q "<p>webpage_test27 hit</p>" webpage_test27_html/webpage_test4.html
+then
+    echo "webpage_test.sh: webpage_test27 cached body for other markdown was used"
+    exit -1
+fi
+
+# but a cache file that isn't all there is made again
+
+truncate -s 10 ${cached}
+webpage --site --force --cache=${PWD}/webpage_test27_cache webpage_test27_md webpage_test27_html
+
+if ! diff -q <(sed '/Datetime is/d' webpage_test27_html/webpage_test4.html) <(sed '/Datetime is/d' webpage_test27_html_moved/webpage_test4.html)
+then
+    echo "webpage_test.sh: webpage_test27 broken cache file was used"
+    exit -1
+fi
+
+if ! grep -q "Webpage Test Markdown" ${cached}
+then
+    echo "webpage_test.sh: webpage_test27 broken cache file was not made again"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test27 success"
+
+echo "webpage_test.sh: Running webpage_test28"
+mkdir webpage_test28_md
+cp webpage_test4.md webpage_test4.txt webpage_test28_md
+printf '<nav>\n<a href="/">webpage_test28 home</a>\n</nav>\n' > webpage_test28_nav.html
+printf '<meta name="webpage_test28" content="head partial">\n' > webpage_test28_head.html
+printf '<footer>webpage_test28 footer</footer>\n' > webpage_test28_body.html
+webpage --site -n @webpage_test28_nav.html --head-partial webpage_test28_head.html --body-partial webpage_test28_body.html webpage_test28_md webpage_test28_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test28 webpage returned ${result}"
+    exit -1
+fi
+
+# the head partial comes before the txt, and the body partial before the embedding
+
+page=webpage_test28_html/webpage_test4.html
+if [[ $(grep -n 'name="webpage_test28"' ${page} | cut -d: -f1) -ge $(grep -n -F "$(head -1 webpage_test4.txt)" ${page} | cut -d: -f1) ]] || \
+   [[ $(grep -n "webpage_test28 footer" ${page} | cut -d: -f1) -ge $(grep -n "webpage_test28 home" ${page} | cut -d: -f1) ]] || \
+   [[ $(grep -n "webpage_test28 home" ${page} | cut -d: -f1) -ge $(grep -n "</body>" ${page} | cut -d: -f1) ]]
+then
+    echo "webpage_test.sh: webpage_test28 partials are not where they should be"
+    exit -1
+fi
+
+# a changed partial makes the page again
+
+printf '<footer>webpage_test28 new footer</footer>\n' > webpage_test28_body.html
+webpage --site -n @webpage_test28_nav.html --head-partial webpage_test28_head.html --body-partial webpage_test28_body.html webpage_test28_md webpage_test28_html
+
+if ! grep -q "webpage_test28 new footer" ${page}
+then
+    echo "webpage_test.sh: webpage_test28 page was not made again for a changed partial"
+    exit -1
+fi
+
+webpage --site --head-partial webpage_test28_missing.html webpage_test28_md webpage_test28_html > /dev/null
+
+result=$?
+if [[ ${result} -eq 0 ]]
+then
+    echo "webpage_test.sh: webpage_test28 missing partial was not an error"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test28 success"
+
+echo "webpage_test.sh: Running webpage_test29"
+mkdir -p "webpage_test29_md/sub dir"
+cp webpage_test4.md webpage_test4.txt webpage_test29_md
+printf '# Other Page\n\nSee [the test](../webpage_test4.md) and [the test](../webpage_test4.md) again, Zebra.\n' > "webpage_test29_md/sub dir/other page.md"
+webpage --site -l --sitemap https://example.com/ --search-index webpage_test29_md webpage_test29_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test29 webpage returned ${result}"
+    exit -1
+fi
+
+if ! grep -q "<loc>https://example.com/webpage_test4.html</loc>" webpage_test29_html/sitemap.xml || \
+   ! grep -q "<loc>https://example.com/sub%20dir/other%20page.html</loc>" webpage_test29_html/sitemap.xml
+then
+    echo "webpage_test.sh: webpage_test29 sitemap does not list every page"
+    exit -1
+fi
+
+# each link only once, and each word only once, in lower case
+
+index=webpage_test29_html/search_index.json
+if ! grep -q '"url":"sub%20dir/other%20page.html","title":"other page","headings":\["Other Page"\],"links":\["../webpage_test4.html"\],"words":"other page see the test and again zebra"' ${index} || \
+   ! grep -q '"url":"webpage_test4.html","title":"webpage_test4","headings":\["Webpage Test Markdown",' ${index}
+then
+    echo "webpage_test.sh: webpage_test29 search index is not right"
+    exit -1
+fi
+
+# a page that isn't made again keeps its part of the index, from the manifest
+
+printf '# New Page\n' > webpage_test29_md/new.md
+webpage --site --search-index --sitemap https://example.com -l webpage_test29_md webpage_test29_html
+
+if ! grep -q '"url":"webpage_test4.html","title":"webpage_test4","headings":\["Webpage Test Markdown",' ${index} || \
+   ! grep -q '"url":"new.html","title":"new","headings":\["New Page"\]' ${index} || \
+   [[ $(grep -c "<loc>" webpage_test29_html/sitemap.xml) -ne 3 ]]
+then
+    echo "webpage_test.sh: webpage_test29 search index lost a page that was not made again"
+    exit -1
+fi
+
+webpage --sitemap https://example.com webpage_test4.md > /dev/null
+
+result=$?
+if [[ ${result} -eq 0 ]]
+then
+    echo "webpage_test.sh: webpage_test29 sitemap outside site mode was not an error"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test29 success"
+
+echo "webpage_test.sh: Running webpage_test30"
+mkdir webpage_test30_md
+cp webpage_test4.md webpage_test4.txt webpage_test30_md
+awk 'BEGIN { for( n = 0; n < 5000; n++ ) printf( "## Part %d\n\nParagraph %d links to [the test](webpage_test4.md) and goes on a while.\n\n", n, n ) }' > webpage_test30_md/webpage_test30.md
+webpage --site -l webpage_test30_md webpage_test30_html
+webpage --site -l -v --stream-size 0 webpage_test30_md webpage_test30_streamed 2> webpage_test30_verbose.txt
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test30 webpage returned ${result}"
+    exit -1
+fi
+
+if [[ $(grep -c "Streaming web page" webpage_test30_verbose.txt) -ne 2 ]]
+then
+    echo "webpage_test.sh: webpage_test30 pages were not streamed"
+    exit -1
+fi
+
+# a streamed page is just the same as one made in memory
+
+for page in webpage_test4 webpage_test30
+do
+    if ! diff -q <(sed '/Datetime is/d' webpage_test30_html/${page}.html) <(sed '/Datetime is/d' webpage_test30_streamed/${page}.html)
+    then
+        echo "webpage_test.sh: webpage_test30 streamed ${page} page is different"
+        exit -1
+    fi
+done
+
+webpage --site --stream-size 12X webpage_test30_md webpage_test30_streamed > /dev/null
+
+result=$?
+if [[ ${result} -eq 0 ]]
+then
+    echo "webpage_test.sh: webpage_test30 bad stream size was not an error"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test30 success"
+
+echo "webpage_test.sh: Running webpage_test31"
+mkdir webpage_test31
+cp webpage_test1.md webpage_test31
+printf '<script>webpage_test31</script>\n' > webpage_test31/webpage_test31_nav.html
+( cd webpage_test31 && webpage -f 0x04 -l -n @webpage_test31_nav.html webpage_test1.md )
+
+# the library, as made by make.sh, makes the same page in process, on several 
+# threads at once in one context
+
+cat > webpage_test31/webpage_test31.c << 'EOF'
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "webpage.h"
+
+struct webpage_ctx  *ctxPtr = NULL;
+char                *markdownPtr = NULL;
+size_t              markdownLength = 0;
+
+void *renderPage( void *bufferPtr )
+{
+    return( ( WEBPAGE_OK == webpage_render( ctxPtr, "webpage_test1", markdownPtr, markdownLength, bufferPtr ) ) ? bufferPtr : NULL );
+}
+
+int main( int argc, char **argv )
+{
+struct webpage_options  options = { 0 };
+struct webpage_buffer   pages[4] = { { NULL, 0, 0 } };
+pthread_t               threads[4];
+void                    *resultPtr = NULL;
+FILE                    *filePtr = fopen( argv[1], "r" );
+int                     thread = 0;
+
+    markdownPtr     = malloc( 1 << 20 );
+    markdownLength  = fread( markdownPtr, 1, 1 << 20, filePtr );
+    fclose( filePtr );
+
+    options.omit            = WEBPAGE_OMIT_DATETIME;
+    options.rewrite_links   = true;
+    options.author          = argv[2];
+    options.nav_embed       = "<script>webpage_test31</script>\n";
+
+    if( ( WEBPAGE_BAD_ARGUMENT != webpage_render( NULL, NULL, markdownPtr, markdownLength, &pages[0] ) ) ||
+        ( WEBPAGE_OK != webpage_ctx_new( &options, &ctxPtr ) ) )
+    {
+        return( 1 );
+    }
+
+    for( thread = 0; thread < 4; thread++ )
+    {
+        pthread_create( &threads[thread], NULL, renderPage, &pages[thread] );
+    }
+
+    for( thread = 0; thread < 4; thread++ )
+    {
+        pthread_join( threads[thread], &resultPtr );
+
+        if( ( NULL == resultPtr ) || ( pages[thread].length != pages[0].length ) || ( 0 != memcmp( pages[thread].data, pages[0].data, pages[0].length ) ) )
+        {
+            return( 2 );
+        }
+    }
+
+    fwrite( pages[0].data, 1, pages[0].length, stdout );
+
+    for( thread = 0; thread < 4; thread++ )
+    {
+        webpage_buffer_free( &pages[thread] );
+    }
+
+    webpage_ctx_free( ctxPtr );
+
+    return( 0 );
+}
+EOF
+
+brotliLibrary=""
+if [[ -n "$(nm -u ../../libwebpage.a | grep Brotli)" ]]
+then
+    brotliLibrary="-lbrotlienc"
+fi
+
+if ! gcc -I../.. -o webpage_test31/webpage_test31 webpage_test31/webpage_test31.c ../../libwebpage.a ${brotliLibrary} -lcmark -lz -lpthread
+then
+    echo "webpage_test.sh: webpage_test31 could not build against the library"
+    exit -1
+fi
+
+webpage_test31/webpage_test31 webpage_test1.md "$(id -un)" > webpage_test31/webpage_test31.html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test31 library returned ${result}"
+    exit -1
+fi
+
+if ! diff -q webpage_test31/webpage_test31.html webpage_test31/webpage_test1.html
+then
+    echo "webpage_test.sh: webpage_test31 library page is different"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test31 success"
+
+echo "webpage_test.sh: Running webpage_test32"
+mkdir -p webpage_test32_md/sub
+cp webpage_test4.md webpage_test4.txt webpage_test32_md
+printf 'body { color: black; }\n' > webpage_test32_md/webpage_test32.css
+printf '# Sub Page\n\nBack to [the test](../webpage_test4.md).\n' > webpage_test32_md/sub/index.md
+touch -d '-2 sec' webpage_test32_md/* webpage_test32_md/sub/* webpage_test32_md/sub webpage_test32_md
+webpage --site -l -f 0x04 -c /unused webpage_test32_md webpage_test32_html
+
+# serve the same tree, on any free port, which webpage gives on stdout
+
+webpage --serve -v -l -f 0x04 -c /unused --listen 127.0.0.1:0 webpage_test32_md > webpage_test32_serve.txt 2> webpage_test32_verbose.txt &
+server=$!
+
+for wait in $(seq 50)
+do
+    port=$(sed -n 's/^Serving .*:\([0-9]*\)\/$/\1/p' webpage_test32_serve.txt)
+    [[ -n "${port}" ]] && break
+    sleep 0.1
+done
+
+if [[ -z "${port}" ]]
+then
+    echo "webpage_test.sh: webpage_test32 server did not start"
+    kill ${server}
+    exit -1
+fi
+
+url="http://127.0.0.1:${port}"
+
+# pages as site mode makes them, the second time from the cache
+
+for page in webpage_test4.html webpage_test4.html sub/index.html
+do
+    if ! diff -q <(curl -s "${url}/${page}") webpage_test32_html/${page}
+    then
+        echo "webpage_test.sh: webpage_test32 served ${page} is different"
+        kill ${server}
+        exit -1
+    fi
+done
+
+if [[ $(grep -c "Serving cached web page for webpage_test4.md" webpage_test32_verbose.txt) -ne 1 ]] || \
+   [[ $(curl -s "${url}/sub/") != $(cat webpage_test32_html/sub/index.html) ]] || \
+   [[ $(curl -s "${url}/webpage_test32.css") != $(cat webpage_test32_md/webpage_test32.css) ]]
+then
+    echo "webpage_test.sh: webpage_test32 did not serve from the cache, a directory or an asset"
+    kill ${server}
+    exit -1
+fi
+
+# a change to the markdown, or a css file coming, is seen straight away
+
+echo "A served last line." >> webpage_test32_md/webpage_test4.md
+printf 'body { color: blue; }\n' > webpage_test32_md/sub/sub.css
+
+if ! curl -s "${url}/webpage_test4.html" | grep -q "A served last line." || \
+   ! curl -s "${url}/sub/index.html" | grep -q 'href="./sub.css"'
+then
+    echo "webpage_test.sh: webpage_test32 served a stale page"
+    kill ${server}
+    exit -1
+fi
+
+# and a css file going leaves the subdirectory with the root's css again
+
+rm webpage_test32_md/sub/sub.css
+
+if ! curl -s "${url}/sub/index.html" | grep -q 'href="./../webpage_test32.css"'
+then
+    echo "webpage_test.sh: webpage_test32 kept the css of a gone css file"
+    kill ${server}
+    exit -1
+fi
+
+# an HTTP/1.0 client asking to keep the connection is told it's kept
+
+if ! curl -s -0 -H 'Connection: keep-alive' -D - -o /dev/null "${url}/webpage_test4.html" | grep -qi '^Connection: keep-alive'
+then
+    echo "webpage_test.sh: webpage_test32 did not say an HTTP/1.0 connection is kept"
+    kill ${server}
+    exit -1
+fi
+
+for request in /webpage_test4.md /missing.html /../webpage_test4.md /.hidden /sub
+do
+    status=$(curl -s --path-as-is -o /dev/null -w '%{http_code}' "${url}${request}")
+
+    if [[ ${status} -ne 404 ]] && [[ ${status} -ne 400 ]] && [[ "${request}" != "/sub" || ${status} -ne 301 ]]
+    then
+        echo "webpage_test.sh: webpage_test32 ${request} gave ${status}"
+        kill ${server}
+        exit -1
+    fi
+done
+
+kill -INT ${server}
+wait ${server}
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test32 server stopped with ${result}"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test32 success"
+
+#33
+# Site mode reads each markdown directory once : the search of the tree finds
+# the css and txt files too, so making the pages opens no more directories and
+# canonicalizes nothing beyond the two roots
+echo "webpage_test.sh: Running webpage_test33"
+mkdir -p webpage_test33_md/webpage_test33a/webpage_test33b
+cp webpage_test1.md webpage_test33_md
+cp webpage_test4.md webpage_test4.txt webpage_test33_md/webpage_test33a
+cp webpage_test2.md webpage_test33_md/webpage_test33a/webpage_test33b
+touch webpage_test33_md/webpage_test33.css
+webpage --site -c ${PWD} -T webpage_test33_stats.json webpage_test33_md webpage_test33_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test33 webpage returned ${result}"
+    exit -1
+fi
+
+if ! grep -q '"counts": .*"opendir": 3, "canonicalize": 2,' webpage_test33_stats.json
+then
+    echo "webpage_test.sh: webpage_test33 markdown directories read more than once"
+    exit -1
+fi
+
+if ! grep -q -F "$(head -1 webpage_test4.txt)" webpage_test33_html/webpage_test33a/webpage_test4.html || \
+   grep -q -F "$(head -1 webpage_test4.txt)" webpage_test33_html/webpage_test1.html
+then
+    echo "webpage_test.sh: webpage_test33 txt file not included as listed"
+    exit -1
+fi
+
+if ! grep -q 'href="./../../webpage_test33.css"' webpage_test33_html/webpage_test33a/webpage_test33b/webpage_test2.html
+then
+    echo "webpage_test.sh: webpage_test33 listed css file not linked"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test33 success"
+
+#34
+# Site mode on several threads deals the pages out largest first, each worker
+# stealing from the others once its own are made, and makes the same pages as
+# one thread does
+echo "webpage_test.sh: Running webpage_test34"
+mkdir -p webpage_test34_md/webpage_test34a
+for page in 1 2 3 5 6 7 8 9 10 11
+do
+    cp webpage_test${page}.md webpage_test34_md/webpage_test34a
+done
+for copy in $(seq 1 200)
+do
+    cat webpage_test4.md
+done > webpage_test34_md/webpage_test34_big.md
+for copy in $(seq 1 100)
+do
+    cat webpage_test4.md
+done > webpage_test34_md/webpage_test34a/webpage_test34_mid.md
+webpage --site -f 0x04 webpage_test34_md webpage_test34_one_html
+webpage --site -f 0x04 -j 3 -v webpage_test34_md webpage_test34_html > webpage_test34_verbose.txt 2>&1
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test34 webpage returned ${result}"
+    exit -1
+fi
+
+# the threads may start in any order, and one may take another's pages before
+# it starts, but the first page taken from each queue is the largest it was 
+# dealt
+
+for first in 0:webpage_test34_big.md 1:webpage_test34a/webpage_test34_mid.md
+do
+    queue=${first%%:*}
+
+    if [[ "$(sed -n "s/^Worker ${queue} took \([^ ]*\)$/\1/p; s/^Worker [0-9]* took \([^ ]*\) from worker ${queue}$/\1/p" webpage_test34_verbose.txt | head -1)" != "${first#*:}" ]]
+    then
+        echo "webpage_test.sh: webpage_test34 largest pages not made first"
+        exit -1
+    fi
+done
+
+if ! diff -r -x .webpage_manifest webpage_test34_one_html webpage_test34_html
+then
+    echo "webpage_test.sh: webpage_test34 pages made on three threads differ"
+    exit -1
+fi
+
+# on two threads, one is dealt the huge page and the third and fifth largest,
+# the other makes the second and fourth, then takes the third, not the fifth, 
+# so the pages leave the first queue largest first
+
+mkdir -p webpage_test34_steal_md
+for page in 1 2 3 4 5
+do
+    for copy in $(seq 1 $(( ( page == 1 ) ? 4000 : 6 - page )))
+    do
+        cat webpage_test4.md
+    done > webpage_test34_steal_md/webpage_test34_steal${page}.md
+done
+webpage --site -f 0x04 -j 2 -v webpage_test34_steal_md webpage_test34_steal_html > webpage_test34_steal_verbose.txt 2>&1
+
+if [[ "$(sed -n 's/^Worker 0 took \([^ ]*\)$/\1/p; s/^Worker [0-9]* took \([^ ]*\) from worker 0$/\1/p' webpage_test34_steal_verbose.txt | tr '\n' ' ')" != "webpage_test34_steal1.md webpage_test34_steal3.md webpage_test34_steal5.md " ]] || \
+   ! grep -q ' from worker 0$' webpage_test34_steal_verbose.txt
+then
+    echo "webpage_test.sh: webpage_test34 did not take the largest page left"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test34 success"
+
+#35
+# Site mode on several threads within a memory budget makes the same pages as
+# one thread does, the big page on its own, and reports the budget; a budget 
+# that isn't a size is refused
+echo "webpage_test.sh: Running webpage_test35"
+webpage --site -f 0x04 -j 3 --mem-budget 1M -T webpage_test35_stats.json webpage_test34_md webpage_test35_html
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test35 webpage returned ${result}"
+    exit -1
+fi
+
+if ! diff -r -x .webpage_manifest webpage_test34_one_html webpage_test35_html
+then
+    echo "webpage_test.sh: webpage_test35 pages made within the budget differ"
+    exit -1
+fi
+
+if ! grep -q '"mem_budget_kb": 1024,' webpage_test35_stats.json || \
+   [[ $(sed -n 's/.*"peak_reserved_kb": \([0-9]*\).*/\1/p' webpage_test35_stats.json) -le 1024 ]]
+then
+    echo "webpage_test.sh: webpage_test35 big page not reserved for on its own"
+    exit -1
+fi
+
+webpage --site -j 3 --mem-budget lots webpage_test34_md webpage_test35_html > /dev/null
+
+result=$?
+if [[ ${result} -ne 237 ]]
+then
+    echo "webpage_test.sh: webpage_test35 bad budget returned ${result}"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test35 success"
+
+echo "webpage_test.sh: Running webpage_test36"
+uringOptions=""
+
+if webpage --io-uring -h > /dev/null
+then
+    uringOptions="--io-uring"
+fi
+
+webpage --site -f 0x04 -j 3 -v ${uringOptions} -T webpage_test36_stats.json webpage_test34_md webpage_test36_html > webpage_test36_verbose.txt 2>&1
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test36 webpage returned ${result}"
+    exit -1
+fi
+
+if ! diff -r -x .webpage_manifest webpage_test34_one_html webpage_test36_html
+then
+    echo "webpage_test.sh: webpage_test36 pages made with markdown read ahead differ"
+    exit -1
+fi
+
+if grep -q "Reading markdown ahead using io_uring" webpage_test36_verbose.txt && \
+   [[ $(sed -n '0,/"read_ahead"/s/.*"read_ahead": \([0-9]*\).*/\1/p' webpage_test36_stats.json) -eq 0 ]]
+then
+    echo "webpage_test.sh: webpage_test36 no markdown was read ahead"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test36 success"
+
+#37
+# Site mode in two shards, into one html root, then a merge, makes the same 
+# pages, manifest and search index as one site mode run, and removes the 
+# shards' manifests; a merge with none to merge is refused
+echo "webpage_test.sh: Running webpage_test37"
+webpage --site -f 0x04 --search-index webpage_test34_md webpage_test37_one_html
+
+for shard in 1/2 2/2
+do
+    webpage --site -f 0x04 --search-index --shard ${shard} webpage_test34_md webpage_test37_html > /dev/null
+
+    result=$?
+    if [[ ${result} -ne 0 ]]
+    then
+        echo "webpage_test.sh: webpage_test37 shard ${shard} returned ${result}"
+        exit -1
+    fi
+done
+
+if [[ ! -f webpage_test37_html/.webpage_manifest.shard-1-of-2 ]] || [[ ! -f webpage_test37_html/.webpage_manifest.shard-2-of-2 ]] || \
+   [[ -f webpage_test37_html/.webpage_manifest ]] || [[ -f webpage_test37_html/search_index.json ]]
+then
+    echo "webpage_test.sh: webpage_test37 shards did not write their own manifests"
+    exit -1
+fi
+
+webpage --merge --search-index webpage_test34_md webpage_test37_html > /dev/null
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test37 merge returned ${result}"
+    exit -1
+fi
+
+if ! diff -r webpage_test37_one_html webpage_test37_html
+then
+    echo "webpage_test.sh: webpage_test37 pages made in shards differ"
+    exit -1
+fi
+
+webpage --merge webpage_test34_md webpage_test37_html > /dev/null
+
+result=$?
+if [[ ${result} -ne 235 ]]
+then
+    echo "webpage_test.sh: webpage_test37 merge of no shards returned ${result}"
+    exit -1
+fi
+
+# a merge has to mirror assets as the shards did
+
+webpage --site -f 0x04 --assets copy --shard 1/1 webpage_test34_md webpage_test37_assets_html > /dev/null
+webpage --merge webpage_test34_md webpage_test37_assets_html > /dev/null
+
+result=$?
+if [[ ${result} -ne 235 ]] || [[ ! -f webpage_test37_assets_html/.webpage_manifest.shard-1-of-1 ]]
+then
+    echo "webpage_test.sh: webpage_test37 merge with other assets returned ${result}"
+    exit -1
+fi
+
+webpage --merge --assets copy webpage_test34_md webpage_test37_assets_html > /dev/null
+
+result=$?
+if [[ ${result} -ne 0 ]]
+then
+    echo "webpage_test.sh: webpage_test37 merge with the same assets returned ${result}"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test37 success"
+
+#38
+# Serve mode with a trace dumps it on SIGUSR1, with the request answered in 
+# it, and keeps serving; a trace file that can't be opened is refused
+echo "webpage_test.sh: Running webpage_test38"
+webpage --serve -f 0x04 --trace webpage_test38_trace.txt --listen 127.0.0.1:0 webpage_test34_md > webpage_test38_serve.txt &
+server=$!
+
+for wait in $(seq 50)
+do
+    port=$(sed -n 's/^Serving .*:\([0-9]*\)\/$/\1/p' webpage_test38_serve.txt)
+    [[ -n "${port}" ]] && break
+    sleep 0.1
+done
+
+if [[ -z "${port}" ]]
+then
+    echo "webpage_test.sh: webpage_test38 server did not start"
+    kill ${server}
+    exit -1
+fi
+
+url="http://127.0.0.1:${port}"
+
+if ! diff -q <(curl -s "${url}/webpage_test34_big.html") webpage_test34_one_html/webpage_test34_big.html
+then
+    echo "webpage_test.sh: webpage_test38 served page is different"
+    kill ${server}
+    exit -1
+fi
+
+kill -USR1 ${server}
+
+for wait in $(seq 50)
+do
+    grep -q " served 200 " webpage_test38_trace.txt 2> /dev/null && break
+    sleep 0.1
+done
+
+if ! grep -q "^webpage trace on signal " webpage_test38_trace.txt || ! grep -q " served 200 " webpage_test38_trace.txt || \
+   [[ $(curl -s -o /dev/null -w '%{http_code}' "${url}/webpage_test34_big.html") != "200" ]]
+then
+    echo "webpage_test.sh: webpage_test38 trace not dumped"
+    kill ${server}
+    exit -1
+fi
+
+kill ${server}
+wait ${server}
+
+webpage --site --trace webpage_test38_none/trace.txt webpage_test34_md webpage_test38_html > /dev/null
+
+result=$?
+if [[ ${result} -ne 234 ]]
+then
+    echo "webpage_test.sh: webpage_test38 bad trace file returned ${result}"
+    exit -1
+fi
+echo "webpage_test.sh: webpage_test38 success"
+
 ################### Preserve the successful test #####################
 
 cd ..
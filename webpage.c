@@ -7,14 +7,182 @@ Really, brutally simple. That's the idea.
 
 Usage :
 
-webpage [-h] [-v] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] <markdown file>
+webpage [-h] [-v] [--trace <file>] [-0] [--gzip] [--brotli] [--keep-unchanged] [--cache[=<dir>]] [--stream-size <size>] [-l] [-j <jobs>] [--mem-budget <size>] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] <markdown file>...
 
-The generated HTML will be put in a file named after the provided .md file. 
+webpage --site [-v] [--trace <file>] [--force] [--assets <how>] [--gzip] [--brotli] [--keep-unchanged] [--cache[=<dir>]] [--stream-size <size>] [-l] [-j <jobs>] [--mem-budget <size>] [--io-uring] [--shard <i>/<N>] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] [--sitemap <base url>] [--search-index] <markdown root> <html root>
+
+webpage --merge [-v] [--trace <file>] [--assets <how>] [-T <stats file>] [-c <abs path to html root>] [--sitemap <base url>] [--search-index] <markdown root> <html root>
+
+webpage --watch [-v] [--trace <file>] [--force] [--assets <how>] [--gzip] [--brotli] [--keep-unchanged] [--cache[=<dir>]] [--stream-size <size>] [-l] [-j <jobs>] [--mem-budget <size>] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] [--sitemap <base url>] [--search-index] <markdown root> <html root>
+
+webpage --archive <archive file> [-v] [--trace <file>] [--assets <how>] [--gzip] [--brotli] [--cache[=<dir>]] [-l] [-j <jobs>] [--mem-budget <size>] [--io-uring] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] [--sitemap <base url>] [--search-index] <markdown root>
+
+webpage --serve [-v] [--trace <file>] [--listen [<address>:]<port>] [--serve-cache <size>] [--cache[=<dir>]] [-l] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] <markdown root>
+
+The generated HTML will be put in a file named after the provided .md file. The 
+file is replaced in a single step, so anything reading it, a web server say, 
+sees either the old page or the new one, never half a page.
+
+Any number of markdown files may be given, and they are all rendered by the 
+one process. If the only markdown file given is '-', the names of the markdown 
+files are read from stdin, one per line ( or NUL separated, given -0 ). Each 
+markdown file is processed as if webpage had been invoked in the directory 
+containing it, i.e. the html file, any .txt file and the css search all start 
+from there.
 
 -h prints help text.
 
 -v specifies verbose output on stderr. 
 
+-0 specifies that markdown file names read from stdin are NUL separated, as 
+   produced by 'find -print0'.
+
+-l rewrites links to local .md files ( e.g. [text](other.md#part) ) as links to
+   the corresponding .html files. Only link destinations are changed.
+
+-j makes up to <jobs> web pages at once, each on its own thread. In site mode the
+   largest markdown files are started first, and a thread that runs out of 
+   pages of its own takes the largest not yet started of another's, so big 
+   pages don't hold up the end of the run.
+
+--mem-budget keeps the pages being made at once, with -j, within <size> ( bytes,
+   or K, M or G ) of memory. A page is expected to need its markdown's size 
+   over again as many times as the most any page has been measured to need, 
+   and a thread only starts a page once there's room for it in the budget, 
+   making a smaller one first if that fits, or otherwise waiting. A page that 
+   needs more than the whole budget is made on its own. The stats report gives
+   the budget and the most that was reserved, next to the peak RSS.
+
+--io-uring has each thread, in site mode, read the markdown for the next page 
+   in its queue using io_uring while it makes this one, open, read and close 
+   all in one system call, so the parsing of one page overlaps the reading of
+   the next. Only a page that looks to need making is read ahead. On a kernel 
+   older than Linux 5.17 markdown is read as it's needed, as it is without the
+   option. --io-uring is only there if webpage was built with io_uring, which 
+   make.sh uses if it finds the kernel header.
+
+--gzip and --brotli write a compressed copy of each web page next to it, as 
+   .html.gz and .html.br, for a web server to serve as they are ( e.g. nginx's 
+   gzip_static and brotli_static ). They are compressed from the page in memory,
+   by the thread that made it. In site mode, a copy is only compressed again if 
+   the page's content has changed, leaving aside the datetime, which changes 
+   every run. --brotli is only there if webpage was built with libbrotlienc.
+
+--keep-unchanged leaves alone an html file that already has the web page in it,
+   leaving aside the datetime, rather than writing the same page again, so the 
+   file keeps its modification time ( and a web server or rsync sees no change ).
+   In site mode the page is compared by the hash of its content kept in the 
+   manifest, otherwise by reading the html file.
+
+--cache keeps the html rendered from each markdown file in a body cache, in 
+   <dir>, or in $XDG_CACHE_HOME/webpage ( ~/.cache/webpage ) if no <dir> is 
+   given. A page whose markdown is already in the cache isn't parsed or 
+   rendered at all. The cache is keyed by the content of the markdown, the 
+   cmark version and whether links are rewritten, so it stays good whatever 
+   happens to the html root, and can be shared by several webpages at once.
+   Each cache file has the markdown it was made from in it too, and is only 
+   used if that is the page's markdown exactly, not just one that hashes to 
+   the same key.
+
+--stream-size streams any page whose markdown file is <size> or more ( bytes,
+   or K, M or G ), 64M by default : its body is rendered a block at a time, 
+   each block written to the html file and freed as soon as it's rendered, so 
+   a huge page never has all of its html in memory. Pages that are compressed,
+   kept unchanged, cached or archived aren't streamed.
+
+-T writes a report of where the time went to <stats file>, as JSON, or to stdout
+   if <stats file> is '-'. It has the peak memory use ( and any memory budget, with
+   the most reserved of it ), the time taken by each part of the run, the 
+   bytes read and written, the directories opened and the names canonicalized,
+   the body cache hits and misses, and a summary ( total, median, 
+   99th percentile, slowest ) of each phase of making a page - finding css, 
+   including txt, parsing, rewriting links, rendering, writing, compressing and
+   indexing - over the pages made. The same times and counts are given for every
+   page.
+
+--trace keeps a trace of what each thread does - each page it starts and 
+   finishes, each request it answers, each change it sees - in a ring of the 
+   last 1024 records of its own, in memory, and adds all of them to <file>, 
+   a line a record, on SIGUSR1, or when webpage crashes. A record has the time,
+   the thread, the event and two numbers, and is written without formatting, 
+   so the tracing costs little. The events traced are those up to the level 
+   webpage was built with, 'WEBPAGE_TRACE_LEVEL=<level> ./make.sh' : 0 for no 
+   tracing at all, 1 ( the default ) for pages and requests, 2 for the phases,
+   counts and writes of every page too; the ones above it are compiled out.
+
+--site is site mode. webpage walks the markdown tree under <markdown root> itself,
+   and writes a web page for every .md file into the corresponding directory under
+   <html root>, making the directories as it goes. The css search is made in the 
+   markdown tree and stops at <markdown root>. A manifest of each page's inputs is 
+   kept in <html root>/.webpage_manifest, and only pages whose inputs have changed 
+   since the last run are made again. The manifest also records which css file, 
+   if any, is in each markdown directory, so only changed directories are read.
+
+--force makes every page in site mode, whether or not it has changed.
+
+--assets mirrors every other file in the markdown tree ( images, css and so on,
+   but not .md, .txt, .backup or hidden files ) into the corresponding directory
+   under <html root>, in site mode. <how> is link ( a hard link, so nothing is 
+   copied ), reflink ( a copy sharing the same blocks, where the filesystem can ),
+   copy, or none ( the default ). A link or reflink that can't be made falls back
+   to a copy. Assets already mirrored are left alone, and those that have gone 
+   from the markdown tree are removed from <html root>.
+
+--watch is watch mode. webpage makes the site as in site mode, then keeps 
+   watching the markdown tree ( using inotify ) and makes again, within a few 
+   milliseconds, just the web pages affected by each change : a changed .md or 
+   .txt file ( for every page sharing a hard linked .txt file ), a css file 
+   coming or going ( for the pages below it whose css link changes ), or 
+   markdown files and directories coming or going. Any assets are mirrored 
+   again as they change. The manifest
+   is saved after every change. Any stats report is for the first run only. 
+   webpage stops, cleanly, on SIGINT or SIGTERM.
+
+--archive is archive mode. webpage makes the whole site as in site mode ( with 
+   --force ), but writes every web page, compressed copy and asset straight into
+   a tar archive ( ustar, with pax headers for long names ) instead of into an 
+   html root, e.g. 'webpage --archive - --assets=copy md | ssh host tar x'. The 
+   archive is written to <archive file>, or to stdout if it is '-', in which case
+   anything else webpage would have written to stdout goes to stderr. There is 
+   no html root, and so no manifest.
+
+--sitemap and --search-index write a sitemap.xml, giving every page's url 
+   under <base url>, and a search_index.json, giving every page's url, title, 
+   headings, links and words, into <html root> ( or the archive ). Each page's 
+   part of them is taken from its parsed markdown as it is rendered, and kept in
+   the manifest ( and any body cache ), so pages that aren't made again aren't 
+   read again either.
+
+--shard <i>/<N> makes only the <i>th of <N> parts of a site, so that a big site
+   can be made on <N> hosts at once, each with its own copy of the markdown 
+   tree, into one shared html root or into <N> that are put together after. 
+   Every shard still lists the whole tree, and the pages are split by a hash of
+   their path into runs of about the same size of markdown, so every shard 
+   makes the same split, and finds the same css. A shard writes its part of the
+   manifest, index records and all, to <html root>/.webpage_manifest.shard-<i>-of-<N>
+   rather than to the manifest, and leaves removing gone pages, the sitemap and
+   the search index to --merge, which puts the <N> parts, all of which must be 
+   there, together into the manifest, removes the web pages and assets no 
+   shard made, writes any sitemap.xml and search_index.json, and deletes the 
+   parts. The shards and the merge should be given the same options, and a 
+   merge with another --assets than the shards is refused. Sharding splits 
+   the making of pages, not the search : every shard still lists the whole 
+   tree, and stats every md file in it, since the cut needs every page's size.
+
+--serve is serve mode, for previewing a site as it's edited. webpage listens 
+   for HTTP requests, on 127.0.0.1:8080 or the [<address>:]<port> given to 
+   --listen ( an empty address for every address, port 0 for any port ), and 
+   makes each web page from the markdown tree under <markdown root> as it's 
+   asked for, just as site mode would make it, with the css search made from 
+   the page's directory. /dir/page.html is made from dir/page.md, a directory 
+   gives its index.html, and any other file that would be an asset is sent as
+   it is. Pages are kept in memory, up to the --serve-cache <size> ( 64M by 
+   default ), the least recently served going first, and a page is only made 
+   again once its md file, its txt file or one of the directories up to 
+   <markdown root> has changed, which is checked with stat() every time it's 
+   asked for. All the pages have the datetime webpage was started at. Each 
+   connection has a thread of its own. webpage stops on SIGINT or SIGTERM.
+
 -f If the corresponding flag is set to 1 in <flags>, then that item will be omitted.
 
     0x01 DOCTYPE
@@ -28,7 +196,14 @@ The generated HTML will be put in a file named after the provided .md file.
 
 -n adds HTML provided via this option to the end of the body. My purpose for this 
    is for adding an embedding to use as a navigation mechanism, but it's effectively
-   general purpose. 
+   general purpose.
+   If <navembedcode> is @<file>, the HTML is read from <file> instead.
+
+--head-partial and --body-partial add the HTML in <file> to the head ( after any
+   css link, and before any .txt file ) or to the end of the body ( before any 
+   navigation embedding ) of every page. Either may be given more than once. Each
+   file is read once, at the start of the run, and copied into every page from 
+   memory. In site mode, pages are made again when a partial changes. 
 
 ===
 
@@ -40,7 +215,8 @@ Then, the program makes the head.
 It adds a 'title' tag derived from the .md file name by default, but this can 
 be omitted. This too might be a mistake, but you can do it.
 
-It adds a datetime, but this can be omitted.
+It adds a datetime, but this can be omitted. All the pages made by one run get the
+same datetime.
 
 It adds an author ( username of the user running the program ), but this can be 
 omitted. 
@@ -66,6 +242,9 @@ library in UNSAFE mode, because this allows raw html to be specified in the md
 files, which is the only way the Commonmark designers allow basic shit like 
 strikethroughs that you've been able to do safely with a typewriter for 130 years.  
 
+The same code is built by make.sh as a library, libwebpage, for making pages in
+another program's process. webpage.h describes it. 
+
 ================================================================================
 
 Licenced using MIT licence : 
@@ -93,22 +272,56 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 // Standard headers
 #include <linux/limits.h>
+#include <limits.h>
 #include <stdio.h>
-#include <unistd.h>
 #include <getopt.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdbool.h>
-// Need __USE_GNU for canonicalize_file_name() from stdlib
+#include <stdint.h>
+#include <inttypes.h>
+// Need __USE_GNU for canonicalize_file_name() from stdlib, and copy_file_range()
+// from unistd
 #define __USE_GNU  
 #include <stdlib.h>
+#include <unistd.h>
 #include <pwd.h>
 #include <assert.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <signal.h>
+#include <fcntl.h>
 #include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+// zlib, for gzip
+#include <zlib.h>
+// libbrotlienc, if make.sh found it
+#ifdef WEBPAGE_BROTLI
+#include <brotli/encode.h>
+#endif
+// io_uring, if make.sh found the kernel header, used through system calls
+#ifdef WEBPAGE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 // libcmark
 #include <cmark.h>
+// the library interface, for webpage built as a library
+#include "webpage.h"
 
 /****************************** Local types ***************************************/
 
@@ -124,6 +337,18 @@ enum flagValues
     flag_end        = 0x0
 };
 
+/**
+ * Ways of mirroring assets into the html root in site mode
+ */
+enum assetValues
+{
+    asset_none      = 0,
+    asset_copy,
+    asset_reflink,
+    asset_link,
+    asset_end
+};
+
 /**
  * Values of command line Options 
  */
@@ -137,27 +362,692 @@ struct Options
     char    *navEmbedCode;
     char    *txtFilename;
     bool    verbose;
+    bool    nulSeparatedList;
+    bool    siteMode;
+    long    jobCount;
+    char    *markdownRoot;
+    char    *webpageRoot;
+    bool    forceRebuild;
+    bool    rewriteLinks;
+    char    *statsFilename;
+    bool    watchMode;
+    enum assetValues assetMode;
+    bool    gzipOutput;
+    bool    brotliOutput;
+    char    *archiveFilename;
+    bool    keepUnchanged;
+    char    *cacheDirectory;
+    char    *sitemapUrl;
+    bool    searchIndex;
+    long long streamSize;
+    bool    serveMode;
+    char    *listenAddress;
+    long long serveCacheSize;
+    long long memoryBudget;
+    bool    ioUring;
+    long    shardIndex;
+    long    shardCount;
+    bool    mergeMode;
+    char    *traceFilename;
+};
+
+/**
+ * Growable buffer. The data is not NUL terminated, length says how much of it
+ * is in use and size how much has been allocated.
+ */
+struct Buffer
+{
+    char    *dataPtr;
+    size_t  length;
+    size_t  size;
+};
+
+/**
+ * Phases of making a web page, and of the whole run, timed for the stats 
+ * report
+ */
+enum phaseValues
+{
+    phase_css       = 0,
+    phase_txt,
+    phase_parse,
+    phase_links,
+    phase_render,
+    phase_write,
+    phase_compress,
+    phase_index,
+    phase_end
+};
+
+enum runPhaseValues
+{
+    run_options     = 0,
+    run_load_manifest,
+    run_assets,
+    run_pages,
+    run_save_manifest,
+    run_save_index,
+    run_total,
+    run_end
+};
+
+/**
+ * Things counted for the stats report
+ */
+enum countValues
+{
+    count_bytes_in  = 0,
+    count_bytes_out,
+    count_opendir,
+    count_canonicalize,
+    count_cache_hits,
+    count_cache_misses,
+    count_read_ahead,
+    count_end
+};
+
+/**
+ * Stats for making one web page : whether it was made, how long that took 
+ * altogether and in each phase, and the counts.
+ */
+struct PageStats
+{
+    bool        made;
+    uint64_t    totalNanoseconds;
+    uint64_t    phaseNanoseconds[phase_end];
+    uint64_t    counts[count_end];
+};
+
+/**
+ * Bump allocator for everything belonging to one page. Memory is taken in turn
+ * from the current block, and is only given back all at once, when the arena
+ * is reset for the next page. Blocks are one list, newest first.
+ */
+struct ArenaBlock
+{
+    struct ArenaBlock   *nextPtr;
+    size_t              size;
+    size_t              used;
+};
+
+struct Arena
+{
+    struct ArenaBlock   *blockPtr;
+    void                *lastPtr;
+};
+
+/**
+ * Header block of a ustar archive entry. Numbers are octal text, NUL 
+ * terminated where there's room.
+ */
+struct ArchiveHeader
+{
+    char    name[100];
+    char    mode[8];
+    char    uid[8];
+    char    gid[8];
+    char    size[12];
+    char    mtime[12];
+    char    checksum[8];
+    char    typeflag;
+    char    linkname[100];
+    char    magic[6];
+    char    version[2];
+    char    uname[32];
+    char    gname[32];
+    char    devmajor[8];
+    char    devminor[8];
+    char    prefix[155];
+    char    padding[12];
+};
+
+/**
+ * Everything belonging to the making of one web page. Each page being made
+ * has its own, so that several pages can be made at once.
+ *
+ * The markdown file, any .txt file and the css search are all found via 
+ * markdownDirectory. The html file is written to webpageDirectory. Both 
+ * directory names are either empty or end in '/'.
+ *
+ * The page is put together in memory, as everything up to and including the
+ * body open tag, the rendered body, and everything after it, and then written 
+ * out in one go. A txt file included in the head is normally left open and 
+ * copied by the kernel, at txtOffset in the head, as the page is written.
+ *
+ * The names, the markdown tree and the rendered body all come from the arena,
+ * which belongs to the thread making the page. Markdown already read into 
+ * memory, ahead of the page being made, is parsed from there instead of from
+ * the file.
+ */
+struct Page
+{
+    struct Options  *optionsPtr;
+    const struct webpage_ctx *contextPtr;
+    struct Arena    *arenaPtr;
+    char            *markdownFilename;
+    char            *markdownDirectory;
+    char            *webpageDirectory;
+    char            *rootFilename;
+    char            *webpageFilename;
+    char            *txtFilename;
+    char            *cssRoot;
+    char            *cssFilename;
+    struct Buffer   head;
+    int             txtFD;
+    size_t          txtOffset;
+    char            *bodyPtr;
+    size_t          bodyLength;
+    struct Buffer   tail;
+    bool            markdownHashed;
+    uint64_t        markdownHash;
+    size_t          datetimeOffset;
+    size_t          datetimeLength;
+    uint64_t        contentHash;
+    uint64_t        oldContentHash;
+    bool            bodyWanted;
+    uint64_t        bodyKey;
+    char            *bodyMarkdownPtr;
+    size_t          bodyMarkdownLength;
+    struct Buffer   indexRecord;
+    bool            streamed;
+    const char      *markdownDataPtr;
+    size_t          markdownDataLength;
+};
+
+/**
+ * Context for making web pages : what is the same for every page made in it.
+ * The parts of the head that are the same for every page : everything before 
+ * the title, and the author and datetime comments after it. Likewise the end 
+ * of the body : any body partials, the navigation embedding and the body close
+ * tag. The datetime is kept apart, since it is the only part of a page that 
+ * changes from run to run. Partials are fragments of html that go into the 
+ * head and at the end of the body of every page. 
+ *
+ * A context made by webpage_ctx_new() has its own options, and may have a css
+ * file to link every page to. The program's own context, g_Context, goes by 
+ * g_Options, and finds each page's css file for itself.
+ */
+struct webpage_ctx
+{
+    struct Options  options;
+    char            *cssFilename;
+    struct Buffer   headPrefix;
+    struct Buffer   headComments;
+    struct Buffer   headDatetime;
+    struct Buffer   headPartials;
+    struct Buffer   bodyPartials;
+    struct Buffer   bodyTail;
+};
+
+/**
+ * When a file was last modified, how big it is, a hash of its content, and 
+ * which file it is ( so that links to the same file can be found ), as recorded
+ * in the build manifest. A file that isn't there is not present. The hash is 
+ * only worked out when it's needed.
+ */
+struct FileStamp
+{
+    bool        present;
+    bool        hashed;
+    long long   mtimeSeconds;
+    long        mtimeNanoseconds;
+    long long   size;
+    uint64_t    hash;
+    long long   device;
+    long long   inode;
+};
+
+/**
+ * Css cache entry : what is known about the css for one directory. Entries 
+ * keyed by a canonical directory name record the first css file in that 
+ * directory, or the one inherited from the nearest parent that has one along 
+ * with how many levels up that is. Entries keyed by a directory name as given 
+ * for a markdown file just record its canonical name. 
+ *
+ * The css file of the directory itself is known once the directory has been 
+ * read, and stays known for as long as the directory's modification time is 
+ * the same. The time is zero if the directory changed too recently to be sure
+ * of. In site mode, what is known about the markdown directories is kept in 
+ * the build manifest, so that the next run only reads the directories that 
+ * have changed. A markdown directory read by the site mode search is listed, 
+ * and what was found then is used without the directory being looked at again.
+ *
+ * The generation goes up each time the entry is invalidated, so that an answer
+ * worked out from a directory read while it was being invalidated, without 
+ * the cache locked, is thrown away rather than kept.
+ */
+struct CssDirectory
+{
+    char                *directoryNamePtr;
+    char                *canonicalNamePtr;
+    uint64_t            generation;
+    bool                resolved;
+    bool                known;
+    bool                listed;
+    long long           mtimeSeconds;
+    long                mtimeNanoseconds;
+    char                *cssNamePtr;
+    int                 parentLevels;
+    struct CssDirectory *nextPtr;
+};
+
+/**
+ * Shared txt file cache entry. A txt file met for a second time in a batch, 
+ * as a link shared by several markdown files, is loaded into memory then, and 
+ * copied from there into every page after that. The file is known by its 
+ * device and inode, and only for as long as it hasn't changed.
+ */
+struct TxtInclude
+{
+    dev_t               device;
+    ino_t               inode;
+    struct timespec     mtime;
+    off_t               size;
+    int                 pageCount;
+    bool                loaded;
+    struct Buffer       contents;
+    struct TxtInclude   *nextPtr;
+};
+
+/**
+ * File listing entry : a markdown or txt file found by the site mode search of
+ * the markdown tree, named relative to the markdown root, and stamped as it 
+ * was found.
+ */
+struct ListedFile
+{
+    char                *filename;
+    struct FileStamp    stamp;
+    struct ListedFile   *nextPtr;
+};
+
+/**
+ * Build manifest entry : everything that went into making one web page in site
+ * mode. The markdown filename is relative to the markdown root.
+ */
+struct ManifestEntry
+{
+    char                *markdownFilename;
+    struct FileStamp    markdownStamp;
+    struct FileStamp    txtStamp;
+    char                *cssFilename;
+    uint64_t            optionsHash;
+    uint64_t            contentHash;
+    char                *indexRecord;
+};
+
+/**
+ * Asset entry : a file in the markdown tree that is mirrored as it is into the
+ * html root, and its stamp as it was when it was last mirrored. The filename 
+ * is relative to the markdown root.
+ */
+struct AssetEntry
+{
+    char                *filename;
+    struct FileStamp    stamp;
+};
+
+/**
+ * Serve mode page cache entry : a web page made for a markdown file, named 
+ * relative to the markdown root, with the stamps of everything it was made 
+ * from ( see stampServedInput() ), and the memory it takes up altogether. A 
+ * page changed too recently to be sure of isn't settled, and isn't cached. A
+ * page pushed out of the cache while it's being sent is freed by the last 
+ * connection to finish with it.
+ */
+struct ServedPage
+{
+    char                *markdownFilename;
+    struct FileStamp    *stampsPtr;
+    int                 stampCount;
+    bool                settled;
+    char                *dataPtr;
+    size_t              length;
+    size_t              memorySize;
+    int                 useCount;
+    bool                cached;
+    struct ServedPage   *nextPtr;
+    struct ServedPage   *newerPtr;
+    struct ServedPage   *olderPtr;
+};
+
+/**
+ * Work queue : the pages one worker thread is to make, as indexes into 
+ * g_PageIndexList, or into g_MarkdownFilenameList if all of them are being 
+ * made. Pages are dealt out to the queues largest markdown file first, and a
+ * worker takes from the front of its own queue until it is empty, then steals
+ * from the front of the others, where the largest pages not yet started are, 
+ * so that no worker is left making big pages at the end of the run while the 
+ * others are idle.
+ */
+struct WorkQueue
+{
+    pthread_mutex_t mutex;
+    struct WorkItem *itemsPtr;
+    size_t          head;
+    size_t          tail;
+};
+
+/**
+ * A page to be dealt out to the work queues, the size of its markdown, and 
+ * how much of the memory budget is reserved for it while it is being made
+ */
+struct WorkItem
+{
+    size_t      workIndex;
+    long long   size;
+    long long   reserved;
+};
+
+/**
+ * A page to be given to a shard of the site : its place in the markdown file 
+ * list, the hash of its name, and its weight, the size of its markdown plus 
+ * one, so that an empty page counts for something too.
+ */
+struct ShardPage
+{
+    size_t      fileIndex;
+    uint64_t    hash;
+    long long   weight;
+};
+
+#ifdef WEBPAGE_IO_URING
+/**
+ * io_uring read ahead : each worker has a ring of its own, with a slot for the
+ * page it is making and one for the next page in its queue, whose markdown is
+ * read into the slot's buffer while this page is made. A read is a chain of 
+ * three linked operations - open the file as the slot's fixed file, read it 
+ * whole, and close it - so it takes one system call to start, and results 
+ * holds what each of them gave. The read asks for a byte more than the file 
+ * was listed as having, so that a file that has grown is noticed.
+ */
+#define URING_ENTRIES   8
+#define URING_SLOTS     2
+#define URING_OPS       3
+
+struct UringRead
+{
+    bool            pending;
+    size_t          workIndex;
+    int             completions;
+    int             results[URING_OPS];
+    char            *bufferPtr;
+    size_t          bufferSize;
+    size_t          expected;
+    char            filename[PATH_MAX + 1];
+};
+
+struct UringReader
+{
+    int                 ringFD;
+    void                *sqRingPtr;
+    size_t              sqRingSize;
+    void                *cqRingPtr;
+    size_t              cqRingSize;
+    struct io_uring_sqe *sqesPtr;
+    size_t              sqesSize;
+    unsigned int        *sqTailPtr;
+    unsigned int        sqMask;
+    unsigned int        *sqArrayPtr;
+    unsigned int        *cqHeadPtr;
+    unsigned int        *cqTailPtr;
+    unsigned int        cqMask;
+    struct io_uring_cqe *cqesPtr;
+    struct UringRead    reads[URING_SLOTS];
+};
+#endif
+
+/**
+ * Trace levels. A trace point above WEBPAGE_TRACE_LEVEL, which make.sh can 
+ * set, is compiled out altogether; one at or below it costs a test of the 
+ * thread's trace ring, which threads only have with the 'trace' option. Level
+ * 1 is for pages and requests, level 2 for what goes on while a page is made.
+ */
+#ifndef WEBPAGE_TRACE_LEVEL
+#define WEBPAGE_TRACE_LEVEL     1
+#endif
+#define TRACE_PAGES             1
+#define TRACE_DETAIL            2
+
+/**
+ * Events traced
+ */
+enum traceValues
+{
+    trace_page_start    = 0,
+    trace_page_made,
+    trace_page_kept,
+    trace_work_stolen,
+    trace_read_ahead,
+    trace_served,
+    trace_change,
+    trace_phase,
+    trace_count,
+    trace_write,
+    trace_end
+};
+
+/**
+ * A trace record, of a fixed size so that it is written without formatting : 
+ * when, by which thread, what, and two values whose meaning depends on what. 
+ * Each thread writes to a ring of its own, overwriting the oldest record, and
+ * next is how many records have ever been written to it. Rings are kept in one
+ * list, and never freed, so that a signal handler can dump them; a thread that
+ * finishes hands its ring on to the next thread to start.
+ */
+#define TRACE_RING_ENTRIES      1024
+
+struct TraceRecord
+{
+    uint64_t    nanoseconds;
+    uint32_t    event;
+    uint32_t    threadNumber;
+    uint64_t    values[2];
+};
+
+struct TraceRing
+{
+    struct TraceRing    *nextPtr;
+    bool                inUse;
+    uint64_t            next;
+    struct TraceRecord  records[TRACE_RING_ENTRIES];
 };
 
 /****************************** Global variables **********************************/
 
 /**
- * Filenames
+ * All the markdown files to be processed by this run. In site mode, the
+ * names are relative to the markdown root.
+ */
+char    **g_MarkdownFilenameList    = NULL;
+size_t  g_MarkdownFilenameCount     = 0;
+
+/**
+ * The work queues of the worker threads, one each
+ */
+struct WorkQueue    *g_WorkQueuePtr     = NULL;
+long                g_WorkQueueCount    = 0;
+
+/**
+ * Memory budget : how much is reserved for the pages being made, the most 
+ * there has been, and how many times some has been given back, which workers
+ * waiting for memory watch for. A page is expected to take the arena's first
+ * block, and its markdown's size over again as many times as the expansion 
+ * ratio, which starts high and is raised to the highest measured of any page 
+ * big enough for the measurement to mean something.
+ */
+#define MEMORY_EXPANSION_START      16
+#define MEMORY_MEASURED_SIZE        ( 64LL * 1024 )
+long long           g_MemoryReserved        = 0;
+long long           g_MemoryPeakReserved    = 0;
+long long           g_MemoryExpansion       = MEMORY_EXPANSION_START;
+uint64_t            g_MemoryReleaseCount    = 0;
+pthread_mutex_t     g_MemoryMutex           = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t      g_MemoryCondition       = PTHREAD_COND_INITIALIZER;
+
+/**
+ * The web pages to be made, as indexes into g_MarkdownFilenameList, or NULL 
+ * for all of them
+ */
+size_t  *g_PageIndexList    = NULL;
+size_t  g_PageIndexCount    = 0;
+
+/**
+ * Command line options set to default values. A markdown file of 64MB or more 
+ * is streamed. Serve mode listens on port 8080 of the loopback address only, 
+ * and keeps up to 64MB of web pages.
+ */
+#define DEFAULT_STREAM_SIZE         ( 64LL * 1024 * 1024 )
+#define DEFAULT_LISTEN_ADDRESS      "127.0.0.1:8080"
+#define DEFAULT_SERVE_CACHE_SIZE    ( 64LL * 1024 * 1024 )
+struct Options g_Options = { true, true, true, true, NULL, NULL, NULL, false, false, false, 1, NULL, NULL, false, false, NULL, false, asset_none, false, false, NULL, false, NULL, NULL, false, DEFAULT_STREAM_SIZE, false, DEFAULT_LISTEN_ADDRESS, DEFAULT_SERVE_CACHE_SIZE, 0, false, 0, 0, false, NULL };
+
+/**
+ * Permissions web page files are made with, i.e. what fopen() would have given 
+ * them under the umask this process was run with.
+ */
+mode_t g_WebpageFileMode = 0644;
+
+/**
+ * Permissions that asset copies may have, i.e. what the umask allows
+ */
+mode_t g_AssetFileMask = 0755;
+
+/**
+ * Build manifest as loaded from the html root at the start of a site mode run,
+ * sorted by markdown filename, and as it will be saved at the end of the run, 
+ * with one entry per markdown file in g_MarkdownFilenameList.
+ */
+struct ManifestEntry    *g_ManifestPtr          = NULL;
+size_t                  g_ManifestCount         = 0;
+struct ManifestEntry    *g_NewManifestPtr       = NULL;
+
+/**
+ * Site mode : assets found in the markdown tree by this run, and as recorded 
+ * in the build manifest, both sorted by filename once they've been mirrored 
+ * or loaded.
+ */
+struct AssetEntry       *g_AssetPtr             = NULL;
+size_t                  g_AssetCount            = 0;
+struct AssetEntry       *g_ManifestAssetPtr     = NULL;
+size_t                  g_ManifestAssetCount    = 0;
+
+/**
+ * Merge mode : how many shards' manifests were merged
+ */
+long                    g_ShardManifestCount    = 0;
+
+/**
+ * Css cache, a hash table of directories searched for css so far. 
+ */
+#define CSS_DIRECTORY_BUCKETS   4096
+struct CssDirectory     *g_CssDirectoryPtrs[CSS_DIRECTORY_BUCKETS];
+pthread_mutex_t         g_CssDirectoryMutex     = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The arena of the page being made by this thread, for libcmark, which has no
+ * way of passing it to the allocator.
+ */
+__thread struct Arena   *g_ThreadArenaPtr       = NULL;
+
+/**
+ * Stats report, if asked for. There is one entry per markdown file in 
+ * g_MarkdownFilenameList, filled in by the thread making that page through 
+ * g_ThreadStatsPtr. Counts made outside of any page are only in the run totals.
+ */
+struct PageStats            *g_PageStatsPtr     = NULL;
+__thread struct PageStats   *g_ThreadStatsPtr   = NULL;
+uint64_t                    g_RunCounts[count_end];
+uint64_t                    g_RunNanoseconds[run_end];
+
+/**
+ * The context pages are made in by this run. The program makes its head 
+ * fragments once, by whichever page needs them first, and its partials come 
+ * from files named on the command line, each read once, at the start of the 
+ * run.
+ */
+struct webpage_ctx      g_Context;
+pthread_mutex_t         g_HeadFragmentsMutex    = PTHREAD_MUTEX_INITIALIZER;
+bool                    g_HeadFragmentsMade     = false;
+
+/**
+ * Shared txt file cache, a hash table of the txt files included so far in a 
+ * batch.
+ */
+#define TXT_INCLUDE_BUCKETS     1024
+struct TxtInclude       *g_TxtIncludePtrs[TXT_INCLUDE_BUCKETS];
+pthread_mutex_t         g_TxtIncludeMutex       = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Site mode : the markdown and txt files found by the search of the markdown 
+ * tree, a hash table which doesn't change while pages are being made. Unless 
+ * watching, when files come and go after the search, the listing stands for 
+ * the run ( g_FilesListed ) : the stamps it has are the ones that go in the 
+ * manifest, and only a page whose txt file is listed looks for it. Either way,
+ * the sizes of the markdown files decide the order pages are made in.
+ */
+#define LISTED_FILE_BUCKETS     4096
+struct ListedFile       *g_ListedFilePtrs[LISTED_FILE_BUCKETS];
+bool                    g_FilesListed           = false;
+
+/**
+ * Archive mode : where the archive is written, which the workers take turns 
+ * at, and the time given to every web page in it
+ */
+int                     g_ArchiveFD             = -1;
+pthread_mutex_t         g_ArchiveMutex          = PTHREAD_MUTEX_INITIALIZER;
+time_t                  g_ArchiveTime           = 0;
+
+/**
+ * Body cache : what, besides the markdown, the html rendered from it depends 
+ * on, which goes into the key of every body cached
  */
+char                    g_BodyCacheTag[128];
 
-char *g_MarkdownFilename    = NULL;
-char *g_RootFilename        = NULL;
-char *g_WebpageFilename     = NULL;
+/**
+ * Watch mode : the inotify instance, the directory ( relative to the markdown 
+ * root ) watched by each watch descriptor, and the markdown files that may need
+ * making again after the latest changes. Also the directories where css files 
+ * have come or gone, the assets that may need mirroring again, and whether 
+ * directories have come or gone, since the last web pages were made.
+ */
+int                     g_WatchFD                   = -1;
+char                    **g_WatchDirectoryList      = NULL;
+size_t                  g_WatchDirectoryCount       = 0;
+char                    **g_WatchCandidateList      = NULL;
+size_t                  g_WatchCandidateCount       = 0;
+char                    **g_WatchCssDirectoryList   = NULL;
+size_t                  g_WatchCssDirectoryCount    = 0;
+char                    **g_WatchAssetList          = NULL;
+size_t                  g_WatchAssetCount           = 0;
+bool                    g_WatchTreeChanged          = false;
+volatile sig_atomic_t   g_WatchStopping             = 0;
 
 /**
- * Web page ( html ) output file pointer
+ * Serve mode : the socket listened on, and the cache of web pages served, a 
+ * hash table of pages by markdown filename along with a list of them from the
+ * most to the least recently served, and the memory they take up between them.
  */
-FILE *g_WebpageFilePtr  = NULL;
+#define SERVED_PAGE_BUCKETS     1024
+int                     g_ServeFD                   = -1;
+struct ServedPage       *g_ServedPagePtrs[SERVED_PAGE_BUCKETS];
+struct ServedPage       *g_NewestServedPagePtr      = NULL;
+struct ServedPage       *g_OldestServedPagePtr      = NULL;
+size_t                  g_ServedPageBytes           = 0;
+pthread_mutex_t         g_ServedPageMutex           = PTHREAD_MUTEX_INITIALIZER;
+volatile sig_atomic_t   g_ServeStopping             = 0;
 
 /**
- * Command line options set to default values
+ * Tracing : where dumps go, or -1 if there's no tracing, every trace ring 
+ * there is, the ring of this thread, if it has one, and the number it writes 
+ * in its records, from a count of the threads that have traced.
  */
-struct Options g_Options = { true, true, true, true, NULL, NULL, NULL, false };
+int                         g_TraceFD               = -1;
+struct TraceRing            *g_TraceRingList        = NULL;
+uint32_t                    g_TraceThreadCount      = 0;
+pthread_mutex_t             g_TraceMutex            = PTHREAD_MUTEX_INITIALIZER;
+__thread struct TraceRing   *g_ThreadTracePtr       = NULL;
+__thread uint32_t           g_ThreadTraceNumber     = 0;
 
 /***** Constants *****/
 
@@ -196,594 +1086,9868 @@ const int  EXIT_UNKNOWN_OPTION              = -3;
 const int  EXIT_NO_CSS_FILE                 = -4;
 const int  EXIT_ABS_PATH_REQUIRED           = -5;
 const int  EXIT_INVOKED_OUTSIDE_HTML_ROOT   = -6;
+const int  EXIT_BAD_JOB_COUNT               = -7;
+const int  EXIT_BAD_SITE_ROOT               = -8;
+const int  EXIT_BAD_STATS_FILE              = -9;
+const int  EXIT_BAD_WATCH                   = -10;
+const int  EXIT_BAD_ASSET_MODE              = -11;
+const int  EXIT_NO_BROTLI                   = -12;
+const int  EXIT_BAD_ARCHIVE                 = -13;
+const int  EXIT_BAD_CACHE                   = -14;
+const int  EXIT_BAD_PARTIAL                 = -15;
+const int  EXIT_BAD_SITE_INDEX              = -16;
+const int  EXIT_BAD_STREAM_SIZE             = -17;
+const int  EXIT_BAD_SERVE                   = -18;
+const int  EXIT_BAD_MEM_BUDGET              = -19;
+const int  EXIT_NO_IO_URING                 = -20;
+const int  EXIT_BAD_SHARD                   = -21;
+const int  EXIT_BAD_TRACE                   = -22;
 
 /**
- * Arbitrary value for max size of relative path to css file. 
- * Note that this will contain only '../' elements, plus a css filename.
- * It's considered highly unlikely that there will be more than a handful
- * of parent directories in practice, though in the event of user error 
- * we may end up traversing all the way back up to root. 20 levels still
- * gives us 194 characters for a css filename.
+ * The build manifest lives in the html root. The header line changes whenever 
+ * the format of the manifest, or what goes into a web page, changes, so that 
+ * a manifest written by a different version is ignored.
  */
-const int  SEARCH_DIR_SIZE          = 256;
-
-/************************** Declarations ******************************************/
+const char *MANIFEST_FILENAME   = ".webpage_manifest";
+const char *MANIFEST_HEADER     = "webpage manifest 4\n";
 
-extern void   verbose( char *outputSpecifier, ... );
-extern void   copyFile( FILE *inputPtr, FILE *outputPtr );
-extern void   checked_fwrite( const char *stringToWritePtr );
-extern char   *getUserName( void );
-extern void   includeCSSFile( void );
-extern void   includeTxtFile( void );
-extern void   addWebpageHead( void );
-extern void   addWebpageBody( void );
-extern void   makeWebpageFile( void );
-extern void   makeWebpage( void );
-extern void   getOptions( int argc, char **argv );
+/**
+ * A shard of a site writes its part of the manifest as a shard manifest, 
+ * named for the shard, e.g. .webpage_manifest.shard-2-of-4, for a merge to 
+ * put together with the others. The line after its header says how the shard
+ * mirrored assets, since the merge only keeps the asset lines of a manifest 
+ * when it mirrors assets too, and must do so the same way.
+ */
+const char *SHARD_MANIFEST_FORMAT   = "%s.shard-%ld-of-%ld";
+const char *SHARD_ASSETS_FORMAT     = "m %s\n";
 
-/****************************** Code **********************************************/
+/**
+ * Every body cache file starts with a header line giving its key, the length of
+ * the markdown the body was made from, the length of the html, and the length
+ * of the site index record, which is 0 if there isn't one. Then come a line 
+ * with g_BodyCacheTag, the markdown, the html and the record. The key is only 
+ * a hash, so the tag and markdown are there to be compared, byte for byte. The
+ * version changes whenever the way a body is made, other than by cmark, 
+ * changes, so that older bodies aren't used.
+ */
+const char *BODY_CACHE_HEADER   = "webpage body %016llx %zu %zu %zu\n";
+const int  BODY_CACHE_VERSION   = 3;
 
 /**
- * void verbose( char *outputSpecifier, ... )
- * 
- * Print output on stderr if the verbose option has been specified. 
- * 
- * in   : outputSpecifier   -   a format string
- * in   : ...               -   varargs for format string
- * out  : format string written to stderr, if verbose flag true
- * err  : none
+ * The site index files, written into the html root
  */
-void verbose( char *outputSpecifier, ... )
-{
-    if( g_Options.verbose )
-    {
-    va_list args;
+const char *SITEMAP_FILENAME        = "sitemap.xml";
+const char *SEARCH_INDEX_FILENAME   = "search_index.json";
 
-        va_start( args, outputSpecifier ); 
+/**
+ * Characters left as they are in a url path in the sitemap, everything else 
+ * being percent encoded
+ */
+const char *URL_PATH_CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._~/";
 
-        vfprintf( stderr, outputSpecifier, args );
-    }
-}
+/**
+ * FNV-1a 64 bit hash parameters
+ */
+const uint64_t HASH_SEED        = 0xcbf29ce484222325ULL;
+const uint64_t HASH_PRIME       = 0x100000001b3ULL;
 
 /**
- * void copyFile( FILE *inputPtr, FILE *outputPtr )
- * 
- * Copy the whole of the input file to the output file in a moderately efficient way
- * using the block size as provided by fstat. 
- * 
- * in       : inputPtr  - FILE pointer to the input file
- * in       : outputPtr - FILE pointer to the output file
- * out      : The input file is copied into the output file
- * err      : assert if we fail to allocate a read buffer. 
- * err      : assert if we fail to write exactly as much as we have read. 
+ * Size of the chunks a markdown file is read in, when it can't be mapped
  */
-void copyFile( FILE *inputPtr, FILE *outputPtr )
-{
-struct stat inputStat;
-int         inputFD;
-char        *readBufferPtr = NULL;
-int         bytesRead = 0;
-int         written = 0;
+const size_t MARKDOWN_READ_SIZE = 1024 * 1024;
 
-    inputFD = fileno( inputPtr );
+/**
+ * A streamed page's rendered blocks are gathered up to this size before they're
+ * written
+ */
+const size_t STREAM_FLUSH_SIZE  = 256 * 1024;
 
-    fstat( inputFD, &inputStat );
+/**
+ * Most zlib takes in, or gives out, in one go
+ */
+const size_t DEFLATE_CHUNK_SIZE = 0x40000000;
 
-    readBufferPtr = (char *)malloc( inputStat.st_blksize );
+/**
+ * Smallest allocation for a growable buffer
+ */
+const size_t BUFFER_MINIMUM_SIZE = 4096;
 
-    assert( readBufferPtr );
+/**
+ * Names of the ways of mirroring assets, as given to the 'assets' option
+ */
+const char *g_AssetModeNames[asset_end] = { "none", "copy", "reflink", "link" };
 
-    while( inputStat.st_size >= ( bytesRead += fread( readBufferPtr, sizeof(char), inputStat.st_blksize, inputPtr ) ) )
-    {
-        if( bytesRead < inputStat.st_size )
-        {
-            // there's data remaining to be read, so we've read a block, so write the complete block
-            written += fwrite(readBufferPtr, inputStat.st_blksize, 1, outputPtr );
+/**
+ * Names of the phases and counts in the stats report
+ */
+const char *g_PhaseNames[phase_end]     = { "css", "txt", "parse", "links", "render", "write", "compress", "index" };
+const char *g_RunPhaseNames[run_end]    = { "options", "load_manifest", "assets", "pages", "save_manifest", "save_index", "total" };
+const char *g_CountNames[count_end]     = { "bytes_in", "bytes_out", "opendir", "canonicalize", "cache_hits", "cache_misses", "read_ahead" };
+const char *g_TraceEventNames[trace_end] = { "page_start", "page_made", "page_kept", "work_stolen", "read_ahead", "served", "change", "phase", "count", "write" };
 
-            verbose( "We've read %d and written %d and the size is %d \n", bytesRead, written, inputStat.st_blksize );
-        }
-        else
-        {
-            // up to now we've been counting writes in blocks, but now we're going to write chars,
-            // so change 'written' so we can honestly keep track. NB If the size of the file is smaller than
-            // a block, written will be zero, so this still works.
+/**
+ * Size of a block of arena memory. Every allocation from an arena is aligned
+ * for anything, and preceded by its size. 
+ */
+#define ARENA_ALIGNMENT         ( (size_t)16 )
+#define ARENA_BLOCK_HEADER_SIZE ( ( sizeof(struct ArenaBlock) + ARENA_ALIGNMENT - 1 ) & ~( ARENA_ALIGNMENT - 1 ) )
+const size_t ARENA_BLOCK_SIZE   = 256 * 1024;
 
-            written = written * inputStat.st_blksize;
+/**
+ * Most a file is copied in one go, by the kernel or through a buffer
+ */
+const size_t KERNEL_COPY_SIZE   = 0x40000000;
+const size_t COPY_BUFFER_SIZE   = 64 * 1024;
 
-            // write the remainder - bytesRead%inputStat.st_blksize
-            // We lose a little efficiency here if the file size is an exact multiple of the blocksize
-            written += fwrite( readBufferPtr, sizeof(char), bytesRead%inputStat.st_blksize, outputPtr );
+/**
+ * Compressed web pages are for serving again and again, so are made as small
+ * as they can be
+ */
+const int   GZIP_LEVEL          = Z_BEST_COMPRESSION;
+const int   GZIP_WINDOW_BITS    = 15 + 16;
+const int   GZIP_MEMORY_LEVEL   = 9;
 
-            verbose( "We've read %d and written %d and the size is %d \n", bytesRead, written, inputStat.st_blksize );
+/**
+ * Archives are made of blocks, and a file, size, user or group id too long for
+ * a ustar header goes in a pax extended header instead
+ */
+#define ARCHIVE_BLOCK_SIZE      512
+const uint64_t ARCHIVE_SIZE_LIMIT   = 077777777777ULL;
+const uint64_t ARCHIVE_ID_LIMIT     = 07777777ULL;
 
-            // we're done
-            break;
-        }
-    }
+/**
+ * Watch mode : the changes inotify is asked for, how long a burst of changes 
+ * ( an editor saving a file, say ) is given to settle before pages are made, 
+ * and the most that making them is put off for by changes that keep coming
+ */
+const uint32_t WATCH_EVENTS         = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+const int      WATCH_SETTLE_MS      = 10;
+const uint64_t WATCH_DELAY_LIMIT_NS = 100 * 1000000ULL;
+const size_t   WATCH_READ_SIZE      = 64 * 1024;
 
-    assert( bytesRead == written );
-}
+/**
+ * Serve mode : the most a request's head may take up, how long a connection 
+ * may go with nothing happening on it, how many connections may wait to be 
+ * accepted, and how long to wait before accepting again when one can't be
+ */
+#define SERVE_REQUEST_SIZE      8192
+const int      SERVE_IDLE_SECONDS   = 10;
+const int      SERVE_BACKLOG        = 64;
+const int      SERVE_RETRY_MS       = 10;
 
 /**
- * void checked_fwrite( char *stringToWritePtr, FILE *fileToWritePtr )
- * 
- * Wrapper to check that fwrite has written successfully.
- * 
- * in   : stringToWritePtr  -   points to the NULL terminated string to be written
- * out  : The supplied string has been written to the supplied file
- * err  : assert if failed to write expected number of characters.
+ * Serve mode : content types of the files served, by extension. Anything else 
+ * is just bytes.
  */
-void checked_fwrite( const char *stringToWritePtr )
+const char *g_ContentTypes[][2] =
 {
-int written = 0;
+    { ".html",  "text/html; charset=utf-8" },
+    { ".htm",   "text/html; charset=utf-8" },
+    { ".css",   "text/css" },
+    { ".js",    "text/javascript" },
+    { ".json",  "application/json" },
+    { ".xml",   "application/xml" },
+    { ".svg",   "image/svg+xml" },
+    { ".png",   "image/png" },
+    { ".jpg",   "image/jpeg" },
+    { ".jpeg",  "image/jpeg" },
+    { ".gif",   "image/gif" },
+    { ".webp",  "image/webp" },
+    { ".ico",   "image/x-icon" },
+    { ".pdf",   "application/pdf" },
+    { ".woff",  "font/woff" },
+    { ".woff2", "font/woff2" },
+    { NULL,     NULL }
+};
 
-    written = fwrite( stringToWritePtr, sizeof(char), strlen(stringToWritePtr), g_WebpageFilePtr );
+/**
+ * Command line options. Long options are for the less common modes of operation.
+ */
+const char          *g_ShortOptions = "hv0lf:c:n:j:T:sFWA:ZBX:KC::H:P:M:IS:EL:Y:U:QR:GD:";
+const struct option g_LongOptions[] =
+{
+    { "help",   no_argument,        NULL,   'h' },
+    { "force",  no_argument,        NULL,   'F' },
+    { "jobs",   required_argument,  NULL,   'j' },
+    { "site",   no_argument,        NULL,   's' },
+    { "stats",  required_argument,  NULL,   'T' },
+    { "watch",  no_argument,        NULL,   'W' },
+    { "assets", required_argument,  NULL,   'A' },
+    { "gzip",   no_argument,        NULL,   'Z' },
+    { "brotli", no_argument,        NULL,   'B' },
+    { "archive", required_argument, NULL,   'X' },
+    { "keep-unchanged", no_argument, NULL,  'K' },
+    { "cache",  optional_argument, NULL,    'C' },
+    { "head-partial", required_argument, NULL, 'H' },
+    { "body-partial", required_argument, NULL, 'P' },
+    { "sitemap", required_argument, NULL,   'M' },
+    { "search-index", no_argument, NULL,    'I' },
+    { "stream-size", required_argument, NULL, 'S' },
+    { "serve",  no_argument,        NULL,   'E' },
+    { "listen", required_argument,  NULL,   'L' },
+    { "serve-cache", required_argument, NULL, 'Y' },
+    { "mem-budget", required_argument,  NULL,   'U' },
+    { "io-uring", no_argument,      NULL,   'Q' },
+    { "shard",  required_argument,  NULL,   'R' },
+    { "merge",  no_argument,        NULL,   'G' },
+    { "trace",  required_argument,  NULL,   'D' },
+    { NULL,     0,                  NULL,   0   }
+};
 
-    verbose("Wrote %d chars to file, tried %d chars\n", written, strlen(stringToWritePtr) );
+/************************** Declarations ******************************************/
 
-    assert( written == strlen(stringToWritePtr) );
+extern void   printVerbose( char *outputSpecifier, ... ) __attribute__(( format( printf, 1, 2 ) ));
+extern void   reserveBuffer( struct Buffer *bufferPtr, size_t length );
+extern void   appendBuffer( struct Buffer *bufferPtr, const void *dataPtr, size_t length );
+extern void   appendString( struct Buffer *bufferPtr, const char *stringPtr );
+extern void   appendFile( struct Buffer *bufferPtr, int inputFD );
+extern off_t  copyFile( int inputFD, int outputFD );
+extern size_t writeVectors( int outputFD, struct iovec *vectorPtr, int vectorCount );
+extern void   *allocateFromArena( struct Arena *arenaPtr, size_t size );
+extern void   *reallocateFromArena( struct Arena *arenaPtr, void *memoryPtr, size_t size );
+extern char   *printToArena( struct Arena *arenaPtr, const char *formatPtr, ... );
+extern void   resetArena( struct Arena *arenaPtr );
+extern void   releaseArena( struct Arena *arenaPtr );
+extern size_t getArenaSize( const struct Arena *arenaPtr );
+extern void   *cmarkCalloc( size_t count, size_t size );
+extern void   *cmarkRealloc( void *memoryPtr, size_t size );
+extern void   cmarkFree( void *memoryPtr );
+extern uint64_t getNanoseconds( void );
+extern uint64_t startTiming( void );
+extern void   endTiming( enum phaseValues phase, uint64_t startTime );
+extern void   addCount( enum countValues count, uint64_t amount );
+extern void   traceEvent( enum traceValues event, uint64_t value0, uint64_t value1 );
+extern bool   startTracing( void );
+extern void   stopTracing( void );
+extern char   *putTraceNumber( char *linePtr, uint64_t value, int digits );
+extern void   dumpTrace( int signalNumber );
+extern void   openTrace( void );
+extern char   *getUserName( void );
+extern char   *makePathname( const char *prefixPtr, const char *namePtr, size_t nameLength );
+extern struct CssDirectory *findCssDirectory( const char *directoryNamePtr );
+extern struct CssDirectory *resolveCssDirectory( const char *directoryNamePtr, const char *cssRootPtr );
+extern char   *findCssFile( struct Page *pagePtr );
+extern void   includeCSSFile( struct Page *pagePtr );
+extern struct TxtInclude *findTxtInclude( const struct stat *txtStatPtr );
+extern void   includeTxtFile( struct Page *pagePtr );
+extern void   loadPartial( struct Buffer *partialsPtr, const char *filenamePtr );
+extern void   makeContext( struct webpage_ctx *contextPtr, const struct Options *optionsPtr, const char *authorPtr );
+extern void   makeHeadFragments( void );
+extern void   addWebpageHead( struct Page *pagePtr );
+extern bool   renderWebpage( struct Page *pagePtr );
+extern cmark_node *parseMarkdownFile( struct Page *pagePtr );
+extern void   rewriteMarkdownLinks( cmark_node *nodeTreePtr );
+extern bool   renderWebpageBody( struct Page *pagePtr, cmark_node *nodeTreePtr );
+extern bool   addWebpageBody( struct Page *pagePtr );
+extern char   *getCacheDirectory( void );
+extern void   openBodyCache( void );
+extern char   *makeBodyCacheFilename( struct Page *pagePtr );
+extern bool   findCachedBody( struct Page *pagePtr, const char *markdownPtr, size_t length );
+extern void   saveCachedBody( struct Page *pagePtr );
+extern bool   isSiteIndexWanted( void );
+extern void   appendJsonString( struct Buffer *bufferPtr, const char *stringPtr, size_t length );
+extern bool   addToHashSet( uint64_t *slotsPtr, size_t slotCount, uint64_t hash );
+extern void   appendIndexWords( struct Buffer *recordPtr, struct Arena *arenaPtr, const char *textPtr, size_t length );
+extern void   addIndexRecord( struct Page *pagePtr, cmark_node *nodeTreePtr );
+extern void   appendUrlPath( struct Buffer *bufferPtr, const char *markdownFilenamePtr );
+extern void   writeSiteFile( const char *filenamePtr, struct Buffer *contentPtr );
+extern void   saveSiteIndex( void );
+extern int    compareShardPages( const void *firstPtr, const void *secondPtr );
+extern void   selectShard( void );
+extern void   mergeShardManifests( void );
+extern void   removeShardManifests( void );
+extern int    createWebpageFile( struct Page *pagePtr, char **tempFilenamePtrPtr );
+extern size_t writeWebpageHead( struct Page *pagePtr, int webpageFD, struct iovec *restVectorPtr );
+extern void   finishWebpageFile( struct Page *pagePtr, int webpageFD, char *tempFilenamePtr, size_t total );
+extern void   writeWebpageFile( struct Page *pagePtr );
+extern void   openArchive( void );
+extern void   addPaxRecord( struct Buffer *paxPtr, const char *keyPtr, const char *valuePtr );
+extern void   addArchiveHeader( struct Buffer *headerPtr, const char *namePtr, mode_t mode, time_t mtime, uint64_t size );
+extern void   writeArchiveEntry( const char *namePtr, mode_t mode, time_t mtime, struct iovec *vectorPtr, int vectorCount );
+extern void   writeArchiveFile( const char *namePtr, int inputFD, const struct stat *inputStatPtr );
+extern void   finishArchive( void );
+extern uint64_t hashWebpage( struct Page *pagePtr );
+extern bool   isWholePageWanted( const struct Options *optionsPtr );
+extern bool   isWebpageUnchanged( struct Page *pagePtr );
+extern bool   isCompressedFileWanted( struct Page *pagePtr, const char *extensionPtr );
+extern void   writeCompressedFile( struct Page *pagePtr, const char *extensionPtr, const void *dataPtr, size_t length );
+extern void   compressWebpage( struct Page *pagePtr );
+extern bool   isWebpageStreamed( struct Page *pagePtr );
+extern void   streamWebpage( struct Page *pagePtr );
+extern void   makeWebpage( struct Page *pagePtr );
+extern void   addMarkdownFilename( const char *filenamePtr );
+extern void   readMarkdownFilenames( FILE *listFilePtr );
+extern bool   isAssetFilename( const char *filenamePtr );
+extern void   addAssetFilename( const char *filenamePtr );
+extern void   findMarkdownFiles( const char *relativeDirPtr, void (*foundFilePtr)( const char *filenamePtr ), void (*foundAssetPtr)( const char *filenamePtr ) );
+extern void   listMarkdownDirectory( const char *relativeDirPtr, const struct stat *directoryStatPtr, const char *cssNamePtr );
+extern void   listFile( int directoryFD, const char *namePtr, const char *filenamePtr );
+extern struct ListedFile *findListedFile( const char *filenamePtr );
+extern void   stampInputFile( const char *filenamePtr, struct FileStamp *stampPtr );
+extern void   initPage( struct Page *pagePtr, struct Arena *arenaPtr, const char *filenamePtr );
+extern void   freePage( struct Page *pagePtr );
+extern uint64_t hashBytes( uint64_t hash, const void *bytesPtr, size_t length );
+extern bool   hashFile( const char *filenamePtr, uint64_t *hashPtr );
+extern void   stampFile( const char *filenamePtr, struct FileStamp *stampPtr );
+extern bool   isSameFile( const char *filenamePtr, struct FileStamp *newStampPtr, const struct FileStamp *oldStampPtr );
+extern uint64_t hashOptions( struct Page *pagePtr );
+extern int    compareManifestEntries( const void *firstPtr, const void *secondPtr );
+extern struct ManifestEntry *findManifestEntry( const char *markdownFilenamePtr );
+extern int    compareAssetEntries( const void *firstPtr, const void *secondPtr );
+extern struct AssetEntry *findManifestAsset( const char *filenamePtr );
+extern bool   isWebpageUpToDate( struct Page *pagePtr, const char *markdownFilenamePtr, struct ManifestEntry *newEntryPtr );
+extern void   completeManifestEntry( struct Page *pagePtr, struct ManifestEntry *newEntryPtr );
+extern void   loadManifest( void );
+extern void   readManifest( FILE *manifestFilePtr, struct ManifestEntry **entryPtrPtr, size_t *entryCountPtr, struct AssetEntry **assetPtrPtr, size_t *assetCountPtr );
+extern void   loadManifestDirectory( char *linePtr );
+extern void   saveManifestDirectories( FILE *manifestFilePtr );
+extern void   loadManifestAsset( char *linePtr, struct AssetEntry **assetPtrPtr, size_t *assetCountPtr );
+extern void   mirrorAsset( struct AssetEntry *assetPtr );
+extern void   mirrorAssets( void );
+extern void   removeWebpage( const char *markdownFilenamePtr );
+extern void   saveManifest( void );
+extern int    compareNanoseconds( const void *firstPtr, const void *secondPtr );
+extern void   writeJsonString( FILE *statsFilePtr, const char *stringPtr );
+extern void   writeSummary( FILE *statsFilePtr, const char *namePtr, uint64_t *valuesPtr, size_t count, bool last );
+extern void   saveStats( uint64_t runStartTime );
+extern int    compareWorkItems( const void *firstPtr, const void *secondPtr );
+extern void   queueWebpages( size_t pageCount, long queueCount );
+extern bool   reserveMemory( struct WorkItem *itemPtr );
+extern void   releaseMemory( const struct WorkItem *itemPtr, long long measured );
+extern bool   takeWork( long queueIndex, struct WorkItem *itemPtr );
+extern bool   peekWork( long queueIndex, struct WorkItem *itemPtr );
+#ifdef WEBPAGE_IO_URING
+extern bool   openUringReader( struct UringReader *readerPtr );
+extern void   closeUringReader( struct UringReader *readerPtr );
+extern void   startUringRead( struct UringReader *readerPtr, int slot, size_t workIndex, const char *filenamePtr, size_t size );
+extern void   waitUringRead( struct UringReader *readerPtr, int slot );
+extern bool   isReadAheadWanted( size_t workIndex, const char **filenamePtrPtr, size_t *sizePtr );
+extern void   readAhead( struct UringReader *readerPtr, long queueIndex, const struct WorkItem *itemPtr, struct Page *pagePtr );
+#endif
+extern void   *makeWebpages( void *queueIndexPtr );
+extern void   makeAllWebpages( void );
+extern void   forgetWorkQueues( void );
+extern int    compareFilenames( const void *firstPtr, const void *secondPtr );
+extern void   forgetManifestEntry( struct ManifestEntry *entryPtr );
+extern void   refreshManifest( void );
+extern void   forgetCssDirectories( void );
+extern void   invalidateCssDirectories( void );
+extern void   invalidateCssDirectory( const char *directoryNamePtr );
+extern void   invalidateServedCssDirectories( const struct ServedPage *entryPtr );
+extern void   resetHeadFragments( void );
+extern bool   watchDirectory( const char *relativeDirPtr, const char *pathPtr );
+extern void   unwatchDirectories( const char *relativeDirPtr );
+extern void   addWatchCandidate( const char *filenamePtr );
+extern void   addWatchCandidatesUnder( const char *relativeDirPtr );
+extern void   addCssCandidatesUnder( const char *relativeDirPtr );
+extern void   addLinkedTxtCandidates( const char *txtFilenamePtr );
+extern void   addWatchAssetCandidate( const char *filenamePtr );
+extern void   addWatchAssetCandidatesUnder( const char *relativeDirPtr );
+extern bool   remirrorWatchedAssets( void );
+extern void   noteWatchEvent( const struct inotify_event *eventPtr );
+extern void   readWatchEvents( void );
+extern void   remakeWatchedPages( void );
+extern void   stopWatching( int signalNumber );
+extern void   watchSite( void );
+extern void   stopServing( int signalNumber );
+extern void   stampServedInput( const char *markdownFilenamePtr, int input, struct FileStamp *stampPtr );
+extern bool   isServedPageCurrent( const struct ServedPage *entryPtr );
+extern void   freeServedPage( struct ServedPage *entryPtr );
+extern void   listServedPage( struct ServedPage *entryPtr );
+extern void   unlistServedPage( struct ServedPage *entryPtr );
+extern void   uncacheServedPage( struct ServedPage *entryPtr );
+extern struct ServedPage *findServedPage( const char *markdownFilenamePtr );
+extern void   cacheServedPage( struct ServedPage *entryPtr );
+extern void   releaseServedPage( struct ServedPage *entryPtr, bool stale );
+extern struct ServedPage *makeServedPage( const char *markdownFilenamePtr, struct Arena *arenaPtr );
+extern struct ServedPage *getServedPage( const char *markdownFilenamePtr, struct Arena *arenaPtr );
+extern const char *getContentType( const char *filenamePtr );
+extern const char *getStatusText( int status );
+extern bool   sendServeResponse( int connectionFD, int status, const char *typePtr, size_t length, const char *extraPtr, bool keepAlive, const void *bodyPtr );
+extern bool   sendServeError( int connectionFD, int status, bool keepAlive, bool headOnly );
+extern bool   decodeServePath( const char *targetPtr, char *pathPtr, size_t size );
+extern bool   serveAsset( int connectionFD, const char *pathPtr, const char *targetPtr, bool keepAlive, bool headOnly );
+extern bool   serveRequest( int connectionFD, struct Arena *arenaPtr, char *requestPtr );
+extern size_t readServeRequest( int connectionFD, char *requestPtr, size_t *lengthPtr );
+extern void   *serveConnection( void *connectionPtr );
+extern void   openServeSocket( void );
+extern void   serveSite( void );
+extern void   getSiteRoots( int rootCount, char **rootsPtr );
+extern long long parseSize( const char *sizePtr );
+extern void   getOptions( int argc, char **argv );
+
+/**
+ * Trace an event, with two values, if this thread is tracing at that level. A
+ * level above WEBPAGE_TRACE_LEVEL comes to nothing at compile time. The values
+ * are only worked out when the event is traced, as verbose()'s arguments are 
+ * only worked out with the 'v' option.
+ */
+#define TRACING( level )    ( ( (level) <= WEBPAGE_TRACE_LEVEL ) && ( NULL != g_ThreadTracePtr ) )
+#define TRACE( level, event, value0, value1 ) \
+    do { if( TRACING( level ) ) { traceEvent( (event), (uint64_t)(value0), (uint64_t)(value1) ); } } while( 0 )
+#define verbose( ... ) \
+    do { if( g_Options.verbose ) { printVerbose( __VA_ARGS__ ); } } while( 0 )
+
+/**
+ * libcmark allocator, taking memory from the arena of the page being made 
+ */
+cmark_mem g_ArenaMem = { cmarkCalloc, cmarkRealloc, cmarkFree };
+
+/****************************** Code **********************************************/
+
+/**
+ * void printVerbose( char *outputSpecifier, ... )
+ * 
+ * Print output on stderr, for verbose(), which only calls this when the 
+ * verbose option has been specified. 
+ * 
+ * in   : outputSpecifier   -   a format string
+ * in   : ...               -   varargs for format string
+ * out  : format string written to stderr
+ * err  : none
+ */
+void printVerbose( char *outputSpecifier, ... )
+{
+va_list args;
+
+    va_start( args, outputSpecifier ); 
+
+    vfprintf( stderr, outputSpecifier, args );
+
+    va_end( args );
 }
 
 /**
- * char *getUserName( void )
+ * void reserveBuffer( struct Buffer *bufferPtr, size_t length )
  * 
- * Get the username of the effective user. NB - the struct passwd is not
- * intended to be freed by the caller. 
+ * Make sure there is room for some more bytes at the end of a buffer. The 
+ * buffer at least doubles in size each time it grows, so adding lots of small 
+ * pieces doesn't mean lots of reallocation.
  * 
- * in   :   none
- * out  :   username corresponding to the euid ( effective user id )
- * err  :   assert if the euid cannot be mapped to a user
+ * in   : bufferPtr -   the buffer
+ * in   : length    -   how many more bytes there must be room for
+ * out  : the buffer has room for length more bytes
+ * err  : assert if failed to grow the buffer
  */
-char *getUserName( void )
+void reserveBuffer( struct Buffer *bufferPtr, size_t length )
 {
-unsigned int    uid = geteuid();
-struct passwd   *pw = getpwuid(uid);
+    if( bufferPtr->length + length > bufferPtr->size )
+    {
+    size_t size = ( bufferPtr->size < BUFFER_MINIMUM_SIZE ) ? BUFFER_MINIMUM_SIZE : bufferPtr->size;
 
-    verbose( "Attempt to get username...\n" );
+        while( size < bufferPtr->length + length )
+        {
+            size *= 2;
+        }
 
-    assert( pw );
+        bufferPtr->dataPtr = (char *)realloc( bufferPtr->dataPtr, size );
 
-    verbose( "...gives %s\n", pw->pw_name );
+        assert( bufferPtr->dataPtr );
 
-    return( strdup( pw->pw_name ) );
+        bufferPtr->size = size;
+    }
 }
 
 /**
- * char *findCssFile()
+ * void appendBuffer( struct Buffer *bufferPtr, const void *dataPtr, size_t length )
  * 
- * Discover the css file to be linked to, if any.
- * 
- * We must know the absolute path of the html root, because we're not 
- * going to look beyond that for css files. 
+ * Add some bytes to the end of a buffer, growing it if need be.
  * 
- * So, assume that it is this path that is given via the 'c' option ( 
- * if there's no 'c' option, we're not looking for css files ). 
+ * in   : bufferPtr -   the buffer
+ * in   : dataPtr   -   the bytes to add
+ * in   : length    -   how many bytes to add
+ * out  : the bytes are at the end of the buffer
+ * err  : assert if failed to grow the buffer
+ */
+void appendBuffer( struct Buffer *bufferPtr, const void *dataPtr, size_t length )
+{
+    reserveBuffer( bufferPtr, length );
+
+    memcpy( bufferPtr->dataPtr + bufferPtr->length, dataPtr, length );
+
+    bufferPtr->length += length;
+}
+
+/**
+ * void appendString( struct Buffer *bufferPtr, const char *stringPtr )
  * 
- * We can't handle a relative path, because there's no clear way to 
- * interpret it - at the point we are invoked, we don't know how deeply 
- * nested we are.
+ * Add a string, without its NUL, to the end of a buffer.
  * 
- * Then, we need a way to discover successive parent directories and search
- * them for css. NB - we do *not* need to, and should not, change the 
- * current working directory. But, we need to know the absolute path of 
- * every directory that we traverse so that we can test it against the
- * root. 
+ * in   : bufferPtr -   the buffer
+ * in   : stringPtr -   points to the NUL terminated string to add
+ * out  : the string is at the end of the buffer
+ * err  : assert if failed to grow the buffer
+ */
+void appendString( struct Buffer *bufferPtr, const char *stringPtr )
+{
+    appendBuffer( bufferPtr, stringPtr, strlen( stringPtr ) );
+}
+
+/**
+ * void appendFile( struct Buffer *bufferPtr, int inputFD )
  * 
- * Just to make life interesting, the string we want to place in the 
- * html link ( i.e. the return value ) *is* relative to the location of 
- * the html file. 
+ * Add the rest of the input file to the end of a buffer. Room is made for
+ * the size of the file as given by fstat, and it is read straight into the 
+ * buffer. 
  * 
- * in   :   none
- * out  :   relative path to css file, else NULL if no css found
- * err  :   assert if failed to open directory
- * err  :   assert if failed to canonicalize filename
- * err  :   exit if invoked outside of specified html root.  
+ * in       : bufferPtr -   the buffer
+ * in       : inputFD   -   file descriptor of the input file
+ * out      : The contents of the input file are at the end of the buffer
+ * err      : assert if failed to grow the buffer
+ * err      : assert if failed to read the input file
  */
-char *findCssFile( void )
+void appendFile( struct Buffer *bufferPtr, int inputFD )
 {
-DIR             *dirPtr;
-struct dirent   *contentPtr;
-char            searchDir[SEARCH_DIR_SIZE + 1];
-char            *absPathPtr = NULL;
-bool            result=false;
+struct stat inputStat;
+ssize_t     bytesRead = 0;
+off_t       totalRead = 0;
+int         result;
+
+    result = fstat( inputFD, &inputStat );
 
-    // searchDir is equivalent to the relative part of the result,
-    // and is sized to allow addition of the css filename when we 
-    // find one. 
+    assert( 0 == result );
 
-    strcpy( searchDir, "./" );
+    // One more than the size, so that the end of the file is found without
+    // growing the buffer, unless the file has grown in the meantime
+
+    reserveBuffer( bufferPtr, (size_t)inputStat.st_size + 1 );
 
     do
     {
-        // is there a css file in the current directory ?
-
-        verbose( "Searching %s for css...\n", searchDir );
+        if( bufferPtr->length == bufferPtr->size )
+        {
+            reserveBuffer( bufferPtr, BUFFER_MINIMUM_SIZE );
+        }
 
-        dirPtr = opendir( searchDir );
-        
-        assert( NULL != dirPtr );
+        bytesRead = read( inputFD, bufferPtr->dataPtr + bufferPtr->length, bufferPtr->size - bufferPtr->length );
 
-        while( contentPtr = readdir( dirPtr ) )
+        if( -1 == bytesRead && EINTR == errno )
         {
-            if( NULL != strstr( contentPtr->d_name, ".css" ) )
-            {
-                // we found a css file - return the relative path
+            continue;
+        }
 
-                strcat( searchDir, contentPtr->d_name );
+        assert( bytesRead >= 0 );
 
-                verbose( "Found css, file is %s\n", searchDir );
+        bufferPtr->length   += bytesRead;
+        totalRead           += bytesRead;
+    }
+    while( 0 != bytesRead );
 
-                // yes, yes, it's naughty, so sue me...
+    verbose( "Read %lld chars, size is %lld \n", (long long)totalRead, (long long)inputStat.st_size );
+}
 
-                return( strdup(searchDir) );
-            }
-        }
+/**
+ * off_t copyFile( int inputFD, int outputFD )
+ * 
+ * Copy the rest of the input file to the output file, from and to wherever 
+ * they are at. The kernel does the copying if it can, by copy_file_range(), 
+ * which may not copy anything at all on a filesystem that shares blocks, or 
+ * failing that sendfile(). Otherwise the file is copied through a buffer. 
+ * 
+ * in       : inputFD   -   file descriptor of the input file
+ * in       : outputFD  -   file descriptor of the output file
+ * out      : The input file is copied into the output file. Returns how much
+ *            was copied.
+ * err      : assert if we fail to allocate a copy buffer
+ * err      : assert if we fail to read or write
+ */
+off_t copyFile( int inputFD, int outputFD )
+{
+off_t   total = 0;
+ssize_t copied = 0;
+char    *copyBufferPtr = NULL;
 
-        // was searchdir the html root ?
+    // Either call can refuse a pair of files ( different filesystems, a file
+    // system that doesn't support it, an old kernel ), in which case carry on
+    // with the next way of copying from wherever the last one got to
 
-        absPathPtr = canonicalize_file_name( searchDir );
+    do
+    {
+        copied = copy_file_range( inputFD, NULL, outputFD, NULL, KERNEL_COPY_SIZE, 0 );
 
-        assert( absPathPtr );
+        total += ( copied > 0 ) ? copied : 0;
+    }
+    while( copied > 0 || ( -1 == copied && EINTR == errno ) );
 
-        verbose( "Real path just searched was %s\n", absPathPtr );
+    if( 0 == copied )
+    {
+        verbose( "Copied %lld chars with copy_file_range\n", (long long)total );
+        return( total );
+    }
 
-        if( 0 == strcmp( "/", absPathPtr ) )
-        {
-            // we were not under root when we started ! 
+    do
+    {
+        copied = sendfile( outputFD, inputFD, NULL, KERNEL_COPY_SIZE );
 
-            printf( "Invoked outside of html root hierarchy.\n" );
-            exit( EXIT_INVOKED_OUTSIDE_HTML_ROOT );
-        }
+        total += ( copied > 0 ) ? copied : 0;
+    }
+    while( copied > 0 || ( -1 == copied && EINTR == errno ) );
 
-        result = ( 0 != strcmp( absPathPtr, g_Options.cssRoot ) );
+    if( 0 == copied )
+    {
+        verbose( "Copied %lld chars with sendfile\n", (long long)total );
+        return( total );
+    }
 
-        strcat( searchDir, "../" );
+    copyBufferPtr = (char *)malloc( COPY_BUFFER_SIZE );
 
-        free( absPathPtr );
-    } 
-    while ( result );
+    assert( copyBufferPtr );
 
-    verbose( "Found no css file under %s\n", g_Options.cssRoot );
+    do
+    {
+    struct iovec vector;
 
-    return( NULL );
-}
+        copied = read( inputFD, copyBufferPtr, COPY_BUFFER_SIZE );
 
-/** 
- * void includeCSSFile( FILE *webpageFilePtr )
- * 
- * Search for a css file, and include a link to it.
- * 
- * in   : none
- * out  : A link field pointing at the css file is written to the html
- * err  : exit if we do not in fact have a css file
- */
-void includeCSSFile( void )
-{
-char*   cssFilenamePtr;
+        if( -1 == copied && EINTR == errno )
+        {
+            continue;
+        }
 
-    cssFilenamePtr = findCssFile();
+        assert( copied >= 0 );
 
-    if( NULL == cssFilenamePtr )
-    {
-        printf( "No css file found under %s\n", g_Options.cssRoot );
-        exit( EXIT_NO_CSS_FILE );
+        vector.iov_base = copyBufferPtr;
+        vector.iov_len  = copied;
+
+        total += writeVectors( outputFD, &vector, 1 );
     }
+    while( 0 != copied );
 
-    verbose( "Writing link to css file %s\n", cssFilenamePtr );
+    free( copyBufferPtr );
 
-    checked_fwrite( g_LinkOpenTag );
-    checked_fwrite( " rel=\"stylesheet\" href=\"" );
-    checked_fwrite( cssFilenamePtr );
-    checked_fwrite( "\" " );
-    checked_fwrite( g_LinkCloseTag );
-}       
+    verbose( "Copied %lld chars through a buffer\n", (long long)total );
+
+    return( total );
+}
 
 /**
- * void includeTxtFile( FILE *webpageFilePtr )
+ * size_t writeVectors( int outputFD, struct iovec *vectorPtr, int vectorCount )
  * 
- * First, see if we've got a txt file with an appropriate name. If we have, copy 
- * it into the web page header verbatim.
+ * Write everything in some vectors to a file, with as few writes as possible.
+ * A write can be cut short, so carry on from wherever it got to. The vectors
+ * are used up.
  * 
- * in       :   none
- * out      :   Text from txt file is in the header.
- * err      :   assert if cannot obtain memory for text file name.
+ * in       : outputFD      -   file descriptor of the output file
+ * in       : vectorPtr     -   the vectors to be written
+ * in       : vectorCount   -   how many vectors there are
+ * out      : Everything in the vectors has been written. Returns how much.
+ * err      : assert if we fail to write
  */
-void includeTxtFile( void )
+size_t writeVectors( int outputFD, struct iovec *vectorPtr, int vectorCount )
 {
-FILE *txtFilePtr = NULL;
-int  txtFilenameSize = strlen(g_RootFilename)+strlen(".txt") + 1;
-char *txtFilenamePtr = (char *)calloc( txtFilenameSize, sizeof(char) );
+size_t total = 0;
+
+    while( vectorCount > 0 )
+    {
+    ssize_t written = writev( outputFD, vectorPtr, vectorCount );
 
-    assert( txtFilenamePtr );
+        if( -1 == written && EINTR == errno )
+        {
+            continue;
+        }
 
-    strcat( txtFilenamePtr, g_RootFilename );
-    strcat( txtFilenamePtr, ".txt" );
+        assert( written >= 0 );
 
-    verbose( "Opening txt file %s\n", txtFilenamePtr );
+        total += written;
 
-    txtFilePtr = fopen( txtFilenamePtr, "r" );
+        while( vectorCount > 0 && (size_t)written >= vectorPtr->iov_len )
+        {
+            written -= vectorPtr->iov_len;
+            vectorPtr++;
+            vectorCount--;
+        }
 
-    if( NULL == txtFilePtr )
-    {
-        verbose( "Txt file %s not provided\n", txtFilenamePtr );
-    }
-    else
-    {
-        verbose( "Copying %s into web page\n", txtFilenamePtr );
-        copyFile( txtFilePtr, g_WebpageFilePtr );
+        if( vectorCount > 0 )
+        {
+            vectorPtr->iov_base = (char *)vectorPtr->iov_base + written;
+            vectorPtr->iov_len -= written;
+        }
     }
-}       
+
+    TRACE( TRACE_DETAIL, trace_write, outputFD, total );
+
+    return( total );
+}
 
 /**
- * void addWebpageBody( FILE *htmlFile )
+ * void *allocateFromArena( struct Arena *arenaPtr, size_t size )
  * 
- * Process the markdown file, and add the rendered html to the
- * web page file. 
+ * Take some memory from the current block of an arena, starting a new block if
+ * there isn't room. The size is kept just in front of the memory, so that it
+ * can be reallocated.
  * 
- * in       : none
- * out      : html body is written to html file.
- * err      : assert on NULL mdFile file pointer
- * err      : assert on failure to parse file ( NULL node tree ptr )
- * err      : assert on failure to render ( NULL render buffer ptr )
+ * in   : arenaPtr  -   the arena
+ * in   : size      -   how many bytes are wanted
+ * out  : the memory, aligned for anything, and owned by the arena
+ * err  : assert if failed to allocate a new block
  */
-void addWebpageBody( void )
+void *allocateFromArena( struct Arena *arenaPtr, size_t size )
 {
-cmark_node* nodeTreePtr = NULL;
-char*       renderBufferPtr = NULL;
-int         htmlSize = 0;
-int         writtenSize = 0;
-FILE*       mdFilePtr;
+struct ArenaBlock   *blockPtr = arenaPtr->blockPtr;
+size_t              needed = ARENA_ALIGNMENT + ( ( size + ARENA_ALIGNMENT - 1 ) & ~( ARENA_ALIGNMENT - 1 ) );
+char                *memoryPtr = NULL;
 
-    mdFilePtr = fopen( g_MarkdownFilename, "r" );
+    assert( needed > size );
 
-    assert( mdFilePtr );
+    if( ( NULL == blockPtr ) || ( blockPtr->used + needed > blockPtr->size ) )
+    {
+    size_t blockSize = ( needed > ARENA_BLOCK_SIZE ) ? needed : ARENA_BLOCK_SIZE;
 
-    verbose("Opened markdown file %s for read only\n", g_MarkdownFilename );
+        blockPtr = (struct ArenaBlock *)malloc( ARENA_BLOCK_HEADER_SIZE + blockSize );
 
-    checked_fwrite( g_BodyOpenTag );
+        assert( blockPtr );
 
-    verbose( "Parsing markdown file\n" );
+        blockPtr->nextPtr   = arenaPtr->blockPtr;
+        blockPtr->size      = blockSize;
+        blockPtr->used      = 0;
 
-    nodeTreePtr = cmark_parse_file( mdFilePtr, CMARK_OPT_UNSAFE );
+        arenaPtr->blockPtr  = blockPtr;
+    }
 
-    assert( nodeTreePtr );
+    memoryPtr = (char *)blockPtr + ARENA_BLOCK_HEADER_SIZE + blockPtr->used;
 
-    verbose( "Rendering HTML\n" );
+    *(size_t *)memoryPtr = size;
 
-    renderBufferPtr = cmark_render_html( nodeTreePtr, CMARK_OPT_UNSAFE );
+    blockPtr->used      += needed;
+    arenaPtr->lastPtr   = memoryPtr + ARENA_ALIGNMENT;
 
-    // We own the nodeTreePtr and must free it
-    cmark_node_free( nodeTreePtr );
+    return( arenaPtr->lastPtr );
+}
 
-    assert( renderBufferPtr );
+/**
+ * void *reallocateFromArena( struct Arena *arenaPtr, void *memoryPtr, size_t size )
+ * 
+ * Change the size of some memory taken from an arena. The most recent 
+ * allocation grows where it is if there's room in the block, which is the 
+ * usual case for a buffer being added to. Anything else is copied. 
+ * 
+ * in   : arenaPtr  -   the arena
+ * in   : memoryPtr -   memory from the arena, or NULL
+ * in   : size      -   how many bytes are wanted now
+ * out  : the memory, which may have moved
+ * err  : assert if failed to allocate a new block
+ */
+void *reallocateFromArena( struct Arena *arenaPtr, void *memoryPtr, size_t size )
+{
+size_t  *sizePtr = NULL;
+void    *newMemoryPtr = NULL;
 
-    checked_fwrite( renderBufferPtr );
+    if( NULL == memoryPtr )
+    {
+        return( allocateFromArena( arenaPtr, size ) );
+    }
 
-    // We own the render buffer, and must free it.
-    free( renderBufferPtr );
+    sizePtr = (size_t *)( (char *)memoryPtr - ARENA_ALIGNMENT );
 
-    // Before closing the body, add the navigation embedding, if provided 
+    if( size <= *sizePtr )
+    {
+        return( memoryPtr );
+    }
 
-    if( NULL != g_Options.navEmbedCode )
+    if( memoryPtr == arenaPtr->lastPtr )
     {
-        verbose( "Add navigation embedding %s - FINAL FORM TBD !!! \n", g_Options.navEmbedCode );
-        checked_fwrite( g_CommentOpenTag );
-        checked_fwrite( " NAVIGATION EMBEDDING GOES HERE \n" );
-        checked_fwrite( g_Options.navEmbedCode );
-        checked_fwrite( g_CommentCloseTag );
+    struct ArenaBlock   *blockPtr = arenaPtr->blockPtr;
+    size_t              start = (char *)memoryPtr - ( (char *)blockPtr + ARENA_BLOCK_HEADER_SIZE );
+    size_t              end = start + ( ( size + ARENA_ALIGNMENT - 1 ) & ~( ARENA_ALIGNMENT - 1 ) );
+
+        if( ( end >= start + size ) && ( end <= blockPtr->size ) )
+        {
+            *sizePtr        = size;
+            blockPtr->used  = end;
+
+            return( memoryPtr );
+        }
     }
 
-    checked_fwrite( g_BodyCloseTag );
+    newMemoryPtr = allocateFromArena( arenaPtr, size );
+
+    memcpy( newMemoryPtr, memoryPtr, *sizePtr );
 
-    fflush( g_WebpageFilePtr );
+    return( newMemoryPtr );
 }
 
 /**
- * addWebpageHead( FILE *webpageFilePtr )
+ * char *printToArena( struct Arena *arenaPtr, const char *formatPtr, ... )
  * 
- * Add head tags. Between those tags add any permitted Options,
- * including CSS and raw content.   
+ * Make a string from a format, in memory taken from an arena.
  * 
- * in   :   none
- * out  :   Web page file contains a complete head.
- * err  :   assert if time string buffer is wrongly sized.
+ * in   : arenaPtr  -   the arena
+ * in   : formatPtr -   a format string
+ * in   : ...       -   varargs for format string
+ * out  : the string, owned by the arena
+ * err  : assert if failed to allocate a new block
  */
-void addWebpageHead( void )
+char *printToArena( struct Arena *arenaPtr, const char *formatPtr, ... )
 {
-int written = 0;
+va_list args;
+int     length;
+char    *stringPtr = NULL;
 
-    checked_fwrite( g_HeadOpenTag );
+    va_start( args, formatPtr );
+    length = vsnprintf( NULL, 0, formatPtr, args );
+    va_end( args );
 
-    if( g_Options.includeTitle )
-    {
-        // Title is the root part of the md file
+    assert( length >= 0 );
 
-        verbose( "Writing Title as %s\n", g_RootFilename );
+    stringPtr = (char *)allocateFromArena( arenaPtr, length + 1 );
 
-        checked_fwrite( g_TitleOpenTag );
-        checked_fwrite( g_RootFilename );
-        checked_fwrite( g_TitleCloseTag );
-    }
+    va_start( args, formatPtr );
+    vsnprintf( stringPtr, length + 1, formatPtr, args );
+    va_end( args );
 
-    if( g_Options.includeAuthor )
-    {
-    char *usernamePtr = NULL;
+    return( stringPtr );
+}
 
-        usernamePtr = getUserName();
+/**
+ * void resetArena( struct Arena *arenaPtr )
+ * 
+ * Give back everything taken from an arena, ready for the next page. If the 
+ * last page needed more than one block, they are replaced by one block as big 
+ * as all of them, so that a page like it fits in one block next time.
+ * 
+ * in   : arenaPtr  -   the arena
+ * out  : the arena is empty
+ * err  : assert if failed to allocate the combined block
+ */
+void resetArena( struct Arena *arenaPtr )
+{
+struct ArenaBlock   *blockPtr = arenaPtr->blockPtr;
+size_t              totalSize = 0;
 
-        checked_fwrite( g_CommentOpenTag );
-        checked_fwrite( "Author is " );
-        checked_fwrite( usernamePtr );
-        checked_fwrite( g_CommentCloseTag );
+    arenaPtr->lastPtr = NULL;
 
-        free( usernamePtr );
+    if( NULL == blockPtr )
+    {
+        return;
     }
 
-    if( g_Options.includeDatetime )
+    if( NULL == blockPtr->nextPtr )
     {
-    time_t      t   = time( NULL );
-    struct tm   *tm  = localtime( &t );
-    char        s[64];
-
-        verbose( "Time is %ld \n", t );
-
-        assert( strftime(s, sizeof(s), "%c", tm) );
-
-        checked_fwrite( g_CommentOpenTag );
-        checked_fwrite( "Datetime is " );
-        checked_fwrite(  s );
-        checked_fwrite( g_CommentCloseTag );        
+        blockPtr->used = 0;
+        return;
     }
 
-    if( NULL != g_Options.cssRoot )
+    for( ; NULL != blockPtr; blockPtr = blockPtr->nextPtr )
     {
-        includeCSSFile();
+        totalSize += blockPtr->size;
     }
 
-    // Include a txt file, if it's there
+    releaseArena( arenaPtr );
 
-    includeTxtFile();
+    blockPtr = (struct ArenaBlock *)malloc( ARENA_BLOCK_HEADER_SIZE + totalSize );
 
-    checked_fwrite( g_HeadCloseTag );
+    assert( blockPtr );
 
-    fflush( g_WebpageFilePtr );
+    blockPtr->nextPtr   = NULL;
+    blockPtr->size      = totalSize;
+    blockPtr->used      = 0;
+
+    arenaPtr->blockPtr  = blockPtr;
 }
 
 /**
- * FILE *makeWebpageFile( void )
+ * void releaseArena( struct Arena *arenaPtr )
  * 
- * Assume the current working directory is where the html file is required, and 
- * create it. 
+ * Free all the blocks of an arena. 
  * 
- * in       : none
- * out      : Web page file handle. The web page file has been created.
- * err      : assert if failed to allocate web page file name 
- * err      : assert if failed to open web page file for w
+ * in   : arenaPtr  -   the arena
+ * out  : the arena is empty and has no blocks
+ * err  : none
  */
-void makeWebpageFile( void )
+void releaseArena( struct Arena *arenaPtr )
 {
-FILE *webpageFilePtr = NULL;
-
-    // Make a file with the name of the .md file but with a .html extension instead.
+struct ArenaBlock *blockPtr = arenaPtr->blockPtr;
 
-    g_WebpageFilename = (char *)calloc( sizeof(char), strlen( g_RootFilename )+strlen(".html")+1 );
-
-    assert( g_WebpageFilename );
-
-    strcpy( g_WebpageFilename, g_RootFilename );
-    strcat( g_WebpageFilename, ".html" );
-
-    verbose("Using web page filename of %s\n", g_WebpageFilename );
+    while( NULL != blockPtr )
+    {
+    struct ArenaBlock *nextPtr = blockPtr->nextPtr;
 
-    g_WebpageFilePtr = fopen( g_WebpageFilename, "w" );
+        free( blockPtr );
+        blockPtr = nextPtr;
+    }
 
-    assert( g_WebpageFilePtr );
+    arenaPtr->blockPtr  = NULL;
+    arenaPtr->lastPtr   = NULL;
 }
 
 /**
- * void makeWebpage( void )
+ * size_t getArenaSize( const struct Arena *arenaPtr )
  * 
- * Create the actual html file corresponding to the markdown file, and 
- * add the required head and body information to it. 
+ * Work out how much memory an arena has in its blocks, used or not.
  * 
- * in       : none
- * out      : Web page file has been written.
- * err      : none
+ * in   : arenaPtr  -   the arena
+ * out  : the total size of its blocks
+ * err  : none
  */
-void makeWebpage( void )
+size_t getArenaSize( const struct Arena *arenaPtr )
 {
-FILE *webpageFilePtr = NULL;
-FILE *mdFilePtr = NULL;
-int  written = 0;
-
-    // Create output file
-
-    makeWebpageFile();
-
-    // Add the HTML DOCTYPE - this comes before the head ! 
-    // NB Assume HTML 5 ! Means no specific DTD.
-    // If for some bonkers reason you don't want this, you can omit it
+const struct ArenaBlock *blockPtr = arenaPtr->blockPtr;
+size_t                  totalSize = 0;
 
-    if( g_Options.includeDTD )
+    for( ; NULL != blockPtr; blockPtr = blockPtr->nextPtr )
     {
-        checked_fwrite( g_Doctype );
+        totalSize += ARENA_BLOCK_HEADER_SIZE + blockPtr->size;
     }
 
-    // but you can't omit this...
-
-    checked_fwrite( g_PageOpenTag );
-
-    // Add header info
+    return( totalSize );
+}
 
-    addWebpageHead();
+/**
+ * void *cmarkCalloc( size_t count, size_t size )
+ * void *cmarkRealloc( void *memoryPtr, size_t size )
+ * void cmarkFree( void *memoryPtr )
+ * 
+ * libcmark allocator for g_ArenaMem. Everything comes from the arena of the 
+ * page this thread is making, g_ThreadArenaPtr, and is only given back when 
+ * that is reset, so freeing does nothing.
+ * 
+ * err  : assert if the size overflows, or failed to allocate a new block
+ */
+void *cmarkCalloc( size_t count, size_t size )
+{
+void *memoryPtr = NULL;
 
-    // Add body info
+    assert( ( 0 == size ) || ( count <= SIZE_MAX / size ) );
 
-    addWebpageBody();
+    memoryPtr = allocateFromArena( g_ThreadArenaPtr, count * size );
 
-    // Add the page closing tag
+    memset( memoryPtr, 0, count * size );
 
-    checked_fwrite( g_PageCloseTag );
+    return( memoryPtr );
+}
 
-    fflush( g_WebpageFilePtr );
+void *cmarkRealloc( void *memoryPtr, size_t size )
+{
+    return( reallocateFromArena( g_ThreadArenaPtr, memoryPtr, size ) );
+}
 
-    fclose( g_WebpageFilePtr );
+void cmarkFree( void *memoryPtr )
+{
+    ( void )memoryPtr;
 }
 
 /**
- * void printHelp( void )
+ * uint64_t getNanoseconds( void )
  * 
- * Print help info.
+ * Read the monotonic clock.
  * 
- * in   :   none
- * out  :   help info on stdout
- * err  :   none
+ * in   : none
+ * out  : the time in nanoseconds, from some fixed point
+ * err  : none
  */
-void printHelp( void )
+uint64_t getNanoseconds( void )
 {
-    printf( "Usage: webpage [-h] [-v] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] <markdown file>\n\n" );
+struct timespec now;
 
-    printf( "Broadly speaking, the expectation is that this tool will be used as part of a script that\n" );
-    printf( "traverses a directory hierarchy containing md files and converts them to html. In particular,\n" );
-    printf( "it's expected that the markdown file resides in the current working directory, and that this\n" );
-    printf( "directory is underneath html root ( yes, html root not markdown root ).\n\n"); 
+    clock_gettime( CLOCK_MONOTONIC, &now );
 
-    printf( " -h                        : print this help\n" );
-    printf( " -v                        : output verbose information\n" );
-    printf( " -f <flags>                : <flags> are bitwise as follows -\n" );
-    printf( "                           : 0x01 - omit DOCTYPE \n" );
-    printf( "                           : 0x02 - omit title \n" );
-    printf( "                           : 0x04 - omit datetime\n" );
-    printf( "                           : 0x08 - omit author\n" );
-    printf( " -c <abs path to html root>: Enables linking to css file. File linked will be first found\n" );
-    printf( "                             searching from cwd towards html root. NB Requires an absolute,\n" );
-    printf( "                             not relative, path.\n" );
-    printf( " -n <navembedcode>         : Provide for ability to tack a special embedding on to the body for\n" );
-    printf( "                             navigation purposes.\n" );
-    printf( " <markdown file>           : File containing Commonmark markdown. Beware of complications if\n" );
-    printf( "                             this file is not in the cwd, particularly if using the 'c' option.\n\n");
+    return( (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec );
 }
 
 /**
- * void getOptions( int argc, char **argv )
+ * uint64_t startTiming( void )
  * 
- * Work out what the user supplied parameters are.  
+ * Start timing a phase of making the page this thread is making, if stats 
+ * are being kept, or phases traced. 
  * 
- * in       : argc  -   count of command line arguments
- * in       : argv  -   array of command line arguments
- * out      : g_Options values set if specified on command line
+ * in   : none
+ * out  : the time now, for endTiming(), or 0 if there are no stats or trace
+ * err  : none
+ */
+uint64_t startTiming( void )
+{
+    return( ( ( NULL == g_ThreadStatsPtr ) && !TRACING( TRACE_DETAIL ) ) ? 0 : getNanoseconds() );
+}
+
+/**
+ * void endTiming( enum phaseValues phase, uint64_t startTime )
+ * 
+ * Add the time since startTiming() to a phase of the page this thread is
+ * making, if stats are being kept, and trace it.
+ * 
+ * in   : phase     -   the phase being timed
+ * in   : startTime -   from startTiming()
+ * out  : the page's time for the phase is updated
+ * err  : none
+ */
+void endTiming( enum phaseValues phase, uint64_t startTime )
+{
+uint64_t    elapsed = 0;
+
+    if( 0 == startTime )
+    {
+        return;
+    }
+
+    elapsed = getNanoseconds() - startTime;
+
+    if( NULL != g_ThreadStatsPtr )
+    {
+        g_ThreadStatsPtr->phaseNanoseconds[phase] += elapsed;
+    }
+
+    TRACE( TRACE_DETAIL, trace_phase, phase, elapsed );
+}
+
+/**
+ * void addCount( enum countValues count, uint64_t amount )
+ * 
+ * Count something for the stats report, if it's being kept, and trace it. The
+ * count goes in the run totals, and for the page this thread is making, if any.
+ * 
+ * in   : count     -   what is being counted
+ * in   : amount    -   how many to add
+ * out  : the counts are updated
+ * err  : none
+ */
+void addCount( enum countValues count, uint64_t amount )
+{
+    TRACE( TRACE_DETAIL, trace_count, count, amount );
+
+    if( NULL == g_Options.statsFilename )
+    {
+        return;
+    }
+
+    __atomic_fetch_add( &g_RunCounts[count], amount, __ATOMIC_RELAXED );
+
+    if( NULL != g_ThreadStatsPtr )
+    {
+        g_ThreadStatsPtr->counts[count] += amount;
+    }
+}
+
+/**
+ * void traceEvent( enum traceValues event, uint64_t value0, uint64_t value1 )
+ * 
+ * Write a record to this thread's trace ring, for TRACE(), which only calls 
+ * this when the thread has one. Once the record is written, it's counted, so
+ * that a dump on another thread sees it whole.
+ * 
+ * in   : event     -   what happened
+ * in   : value0    -   first value recorded with it
+ * in   : value1    -   second value recorded with it
+ * out  : the record is the newest in the ring
+ * err  : none
+ */
+void traceEvent( enum traceValues event, uint64_t value0, uint64_t value1 )
+{
+struct TraceRing    *ringPtr = g_ThreadTracePtr;
+struct TraceRecord  *recordPtr = &ringPtr->records[ringPtr->next % TRACE_RING_ENTRIES];
+
+    recordPtr->nanoseconds  = getNanoseconds();
+    recordPtr->event        = event;
+    recordPtr->threadNumber = g_ThreadTraceNumber;
+    recordPtr->values[0]    = value0;
+    recordPtr->values[1]    = value1;
+
+    __atomic_store_n( &ringPtr->next, ringPtr->next + 1, __ATOMIC_RELEASE );
+}
+
+/**
+ * bool startTracing( void )
+ * 
+ * Give this thread a trace ring, if there's tracing and it hasn't one yet : 
+ * one handed back by a thread that has finished, or else a new one, added to 
+ * the list.
+ * 
+ * in   : none
+ * out  : true if this thread was given a ring, which it hands back with 
+ *        stopTracing() before it finishes
+ * err  : assert if failed to allocate a ring
+ */
+bool startTracing( void )
+{
+struct TraceRing    *ringPtr = NULL;
+
+    if( ( -1 == g_TraceFD ) || ( NULL != g_ThreadTracePtr ) )
+    {
+        return( false );
+    }
+
+    pthread_mutex_lock( &g_TraceMutex );
+
+    for( ringPtr = g_TraceRingList; ( NULL != ringPtr ) && ringPtr->inUse; ringPtr = ringPtr->nextPtr )
+    {
+    }
+
+    if( NULL == ringPtr )
+    {
+        ringPtr = (struct TraceRing *)calloc( 1, sizeof(struct TraceRing) );
+
+        assert( ringPtr );
+
+        ringPtr->nextPtr = g_TraceRingList;
+
+        __atomic_store_n( &g_TraceRingList, ringPtr, __ATOMIC_RELEASE );
+    }
+
+    ringPtr->inUse      = true;
+    g_ThreadTraceNumber = ++g_TraceThreadCount;
+
+    pthread_mutex_unlock( &g_TraceMutex );
+
+    g_ThreadTracePtr = ringPtr;
+
+    return( true );
+}
+
+/**
+ * void stopTracing( void )
+ * 
+ * Hand this thread's trace ring back, records and all, for another thread.
+ * 
+ * in   : none
+ * out  : this thread has no trace ring
+ * err  : none
+ */
+void stopTracing( void )
+{
+    pthread_mutex_lock( &g_TraceMutex );
+
+    g_ThreadTracePtr->inUse = false;
+
+    pthread_mutex_unlock( &g_TraceMutex );
+
+    g_ThreadTracePtr = NULL;
+}
+
+/**
+ * char *putTraceNumber( char *linePtr, uint64_t value, int digits )
+ * 
+ * Write a number in decimal, without printf(), which isn't safe in a signal
+ * handler.
+ * 
+ * in   : linePtr   -   where to write it, with room for 20 digits
+ * in   : value     -   the number
+ * in   : digits    -   how many digits at least, with leading zeros
+ * out  : the end of the number
+ * err  : none
+ */
+char *putTraceNumber( char *linePtr, uint64_t value, int digits )
+{
+char    reversed[20];
+int     count = 0;
+
+    do
+    {
+        reversed[count++]   = '0' + ( value % 10 );
+        value              /= 10;
+    }
+    while( ( 0 != value ) || ( count < digits ) );
+
+    while( count > 0 )
+    {
+        *linePtr++ = reversed[--count];
+    }
+
+    return( linePtr );
+}
+
+/**
+ * void dumpTrace( int signalNumber )
+ * 
+ * Signal handler : write every trace ring, oldest record first, to the trace 
+ * file, a line for each record, of the time in seconds, the thread, the event
+ * and its two values. Only what's safe in a signal handler is used. A record 
+ * being written on another thread as it is dumped may come out mixed up. On 
+ * a crash, the handler has been reset, so the signal is raised again, to end
+ * the process as it would have ended, once the dump is written.
+ * 
+ * in   : signalNumber  -   the signal
+ * out  : the trace is dumped
+ * err  : none
+ */
+void dumpTrace( int signalNumber )
+{
+int                 savedErrno = errno;
+struct TraceRing    *ringPtr = NULL;
+struct TraceRecord  *recordPtr = NULL;
+uint64_t            next = 0;
+uint64_t            recordIndex = 0;
+char                line[160];
+char                *linePtr = NULL;
+
+    linePtr = stpcpy( line, "webpage trace on signal " );
+    linePtr = putTraceNumber( linePtr, signalNumber, 1 );
+    *linePtr++ = '\n';
+
+    write( g_TraceFD, line, linePtr - line );
+
+    for( ringPtr = __atomic_load_n( &g_TraceRingList, __ATOMIC_ACQUIRE ); NULL != ringPtr; ringPtr = ringPtr->nextPtr )
+    {
+        next = __atomic_load_n( &ringPtr->next, __ATOMIC_ACQUIRE );
+
+        for( recordIndex = ( next > TRACE_RING_ENTRIES ) ? next - TRACE_RING_ENTRIES : 0; recordIndex < next; recordIndex++ )
+        {
+            recordPtr = &ringPtr->records[recordIndex % TRACE_RING_ENTRIES];
+
+            linePtr     = putTraceNumber( line, recordPtr->nanoseconds / 1000000000ULL, 1 );
+            *linePtr++  = '.';
+            linePtr     = putTraceNumber( linePtr, recordPtr->nanoseconds % 1000000000ULL, 9 );
+            *linePtr++  = ' ';
+            linePtr     = putTraceNumber( linePtr, recordPtr->threadNumber, 1 );
+            *linePtr++  = ' ';
+            linePtr     = stpcpy( linePtr, ( recordPtr->event < trace_end ) ? g_TraceEventNames[recordPtr->event] : "?" );
+            *linePtr++  = ' ';
+            linePtr     = putTraceNumber( linePtr, recordPtr->values[0], 1 );
+            *linePtr++  = ' ';
+            linePtr     = putTraceNumber( linePtr, recordPtr->values[1], 1 );
+            *linePtr++  = '\n';
+
+            write( g_TraceFD, line, linePtr - line );
+        }
+    }
+
+    if( SIGUSR1 != signalNumber )
+    {
+        raise( signalNumber );
+    }
+
+    errno = savedErrno;
+}
+
+/**
+ * void openTrace( void )
+ * 
+ * Open the file given to the 'trace' option, which dumps are added to, and 
+ * dump the trace on SIGUSR1, or on a crash, assert() included. The thread 
+ * this is called on traces from now on, as will every thread started after.
+ * 
+ * in   : none
+ * out  : g_TraceFD is open, and this thread has a trace ring
+ * err  : exit if the trace file can't be opened
+ */
+void openTrace( void )
+{
+struct sigaction    action;
+int                 crashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+size_t              signalIndex = 0;
+
+    g_TraceFD = open( g_Options.traceFilename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666 );
+
+    if( -1 == g_TraceFD )
+    {
+        printf( "Cannot open trace file %s\n", g_Options.traceFilename );
+        exit( EXIT_BAD_TRACE );
+    }
+
+    memset( &action, 0, sizeof(action) );
+
+    action.sa_handler   = dumpTrace;
+    action.sa_flags     = SA_RESTART;
+
+    sigaction( SIGUSR1, &action, NULL );
+
+    action.sa_flags     = SA_RESETHAND;
+
+    for( signalIndex = 0; signalIndex < sizeof(crashSignals) / sizeof(crashSignals[0]); signalIndex++ )
+    {
+        sigaction( crashSignals[signalIndex], &action, NULL );
+    }
+
+    startTracing();
+
+    verbose( "Tracing to %s, dumped on signal %d\n", g_Options.traceFilename, SIGUSR1 );
+}
+
+/**
+ * char *getUserName( void )
+ * 
+ * Get the username of the effective user. The caller owns the returned
+ * string. 
+ * 
+ * in   :   none
+ * out  :   username corresponding to the euid ( effective user id )
+ * err  :   assert if the euid cannot be mapped to a user
+ */
+char *getUserName( void )
+{
+unsigned int    uid = geteuid();
+struct passwd   pwBuffer;
+struct passwd   *pw = NULL;
+char            stringBuffer[4096];
+
+    verbose( "Attempt to get username...\n" );
+
+    // Pages may be made concurrently, so use the reentrant form
+
+    getpwuid_r( uid, &pwBuffer, stringBuffer, sizeof(stringBuffer), &pw );
+
+    assert( pw );
+
+    verbose( "...gives %s\n", pw->pw_name );
+
+    return( strdup( pw->pw_name ) );
+}
+
+/**
+ * struct CssDirectory *resolveCssDirectory( const char *directoryNamePtr, const char *cssRootPtr )
+ * 
+ * Work out which css file ( if any ) applies to a directory, by looking in the 
+ * directory and then, if there's nothing there, in its parent, and so on until
+ * the css root has been searched. Each directory's answer is remembered, so 
+ * that every directory is only read once however many pages share it, and 
+ * isn't read again while its modification time stays the same. A directory 
+ * listed by the site mode search isn't even stat()ed. 
+ * 
+ * The cache is only locked to look at an entry or to change it, never while a
+ * directory is stat()ed or read, so that a slow file system doesn't hold up 
+ * the threads making pages in other directories. Two threads may read the same
+ * directory at once, when the first answer is kept; one worked out while the
+ * entry was invalidated is thrown away, and worked out again. Must be called 
+ * without g_CssDirectoryMutex held.
+ * 
+ * in   :   directoryNamePtr    -   absolute, canonical, directory name
+ * in   :   cssRootPtr          -   absolute path of the css root
+ * out  :   the directory's cache entry, resolved when last looked at, which 
+ *          lasts until the cache is forgotten; its answer is only to be read 
+ *          with g_CssDirectoryMutex held
+ * err  :   assert if failed to stat or open directory
+ * err  :   exit if invoked outside of specified html root.  
+ */
+struct CssDirectory *resolveCssDirectory( const char *directoryNamePtr, const char *cssRootPtr )
+{
+struct CssDirectory *entryPtr = NULL;
+struct CssDirectory *parentPtr = NULL;
+DIR                 *dirPtr;
+struct dirent       *contentPtr;
+char                *cssNamePtr = NULL;
+char                *parentNamePtr = NULL;
+char                *slashPtr = NULL;
+struct stat         directoryStat;
+uint64_t            generation = 0;
+long long           mtimeSeconds = 0;
+long                mtimeNanoseconds = 0;
+bool                resolved = false;
+bool                listed = false;
+bool                unchanged = false;
+int                 result = 0;
+
+    while( true )
+    {
+        pthread_mutex_lock( &g_CssDirectoryMutex );
+
+        entryPtr            = findCssDirectory( directoryNamePtr );
+        resolved            = entryPtr->resolved;
+        listed              = entryPtr->listed;
+        generation          = entryPtr->generation;
+        mtimeSeconds        = entryPtr->mtimeSeconds;
+        mtimeNanoseconds    = entryPtr->mtimeNanoseconds;
+
+        pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+        if( resolved )
+        {
+            return( entryPtr );
+        }
+
+        unchanged = listed;
+
+        if( !listed )
+        {
+            // The directory is stat()ed before it is read, so a css file that 
+            // comes or goes while it is being read changes the modification 
+            // time from the one recorded
+
+            result = stat( directoryNamePtr, &directoryStat );
+
+            assert( 0 == result );
+
+            unchanged = ( 0 != mtimeSeconds ) && 
+                        ( directoryStat.st_mtim.tv_sec == mtimeSeconds ) && ( directoryStat.st_mtim.tv_nsec == mtimeNanoseconds );
+        }
+
+        if( !unchanged )
+        {
+            // is there a css file in this directory ?
+
+            verbose( "Searching %s for css...\n", directoryNamePtr );
+
+            dirPtr = opendir( directoryNamePtr );
+
+            assert( NULL != dirPtr );
+
+            addCount( count_opendir, 1 );
+
+            while( NULL != ( contentPtr = readdir( dirPtr ) ) )
+            {
+                if( NULL != strstr( contentPtr->d_name, ".css" ) )
+                {
+                    verbose( "Found css, file is %s/%s\n", directoryNamePtr, contentPtr->d_name );
+
+                    cssNamePtr = strdup( contentPtr->d_name );
+
+                    assert( cssNamePtr );
+                    break;
+                }
+            }
+
+            closedir( dirPtr );
+        }
+
+        pthread_mutex_lock( &g_CssDirectoryMutex );
+
+        if( entryPtr->resolved || ( generation != entryPtr->generation ) )
+        {
+            // resolved by another thread meanwhile, or invalidated, so start 
+            // again
+
+            pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+            free( cssNamePtr );
+
+            cssNamePtr = NULL;
+
+            continue;
+        }
+
+        if( listed )
+        {
+            verbose( "Directory %s is listed, css file is %s\n", directoryNamePtr, ( NULL == entryPtr->cssNamePtr ) ? "none" : entryPtr->cssNamePtr );
+        }
+        else if( unchanged )
+        {
+            verbose( "Directory %s is unchanged, css file is %s\n", directoryNamePtr, ( NULL == entryPtr->cssNamePtr ) ? "none" : entryPtr->cssNamePtr );
+        }
+        else
+        {
+            // an entry not resolved has no inherited css, so the name is its 
+            // own; a directory that changed within the last second may change
+            // again without its modification time changing, so it has to be 
+            // read again
+
+            free( entryPtr->cssNamePtr );
+
+            entryPtr->cssNamePtr        = cssNamePtr;
+            entryPtr->parentLevels      = 0;
+            entryPtr->mtimeSeconds      = ( directoryStat.st_mtim.tv_sec < ( time( NULL ) - 1 ) ) ? directoryStat.st_mtim.tv_sec : 0;
+            entryPtr->mtimeNanoseconds  = ( 0 != entryPtr->mtimeSeconds ) ? directoryStat.st_mtim.tv_nsec : 0;
+            cssNamePtr                  = NULL;
+        }
+
+        entryPtr->known = true;
+
+        if( ( NULL == entryPtr->cssNamePtr ) && ( 0 == strcmp( "/", directoryNamePtr ) ) )
+        {
+            // we were not under root when we started ! 
+
+            printf( "Invoked outside of html root hierarchy.\n" );
+            exit( EXIT_INVOKED_OUTSIDE_HTML_ROOT );
+        }
+
+        if( ( NULL != entryPtr->cssNamePtr ) || ( 0 == strcmp( directoryNamePtr, cssRootPtr ) ) )
+        {
+            entryPtr->resolved = true;
+
+            pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+            return( entryPtr );
+        }
+
+        pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+        // no css here, so whatever applies to the parent applies here too
+
+        slashPtr        = strrchr( directoryNamePtr, '/' );
+        parentNamePtr   = ( slashPtr == directoryNamePtr ) ? strdup( "/" ) : strndup( directoryNamePtr, slashPtr - directoryNamePtr );
+
+        assert( parentNamePtr );
+
+        parentPtr = resolveCssDirectory( parentNamePtr, cssRootPtr );
+
+        free( parentNamePtr );
+
+        // the parent may have been invalidated since, and its css file with it
+
+        pthread_mutex_lock( &g_CssDirectoryMutex );
+
+        if( parentPtr->resolved && !entryPtr->resolved && ( generation == entryPtr->generation ) )
+        {
+            if( NULL != parentPtr->cssNamePtr )
+            {
+                entryPtr->cssNamePtr    = parentPtr->cssNamePtr;
+                entryPtr->parentLevels  = parentPtr->parentLevels + 1;
+            }
+
+            entryPtr->resolved = true;
+        }
+
+        resolved = entryPtr->resolved;
+
+        pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+        if( resolved )
+        {
+            return( entryPtr );
+        }
+    }
+}
+
+/**
+ * struct CssDirectory *findCssDirectory( const char *directoryNamePtr )
+ * 
+ * Find a directory in the css cache, adding a new, unresolved, entry for it if 
+ * it isn't there yet. Must be called with g_CssDirectoryMutex held.
+ * 
+ * in   :   directoryNamePtr    -   directory name, as the key for the cache
+ * out  :   the directory's cache entry
+ * err  :   assert if failed to allocate a new entry
+ */
+struct CssDirectory *findCssDirectory( const char *directoryNamePtr )
+{
+uint64_t            bucket = hashBytes( HASH_SEED, directoryNamePtr, strlen( directoryNamePtr ) ) % CSS_DIRECTORY_BUCKETS;
+struct CssDirectory *entryPtr = g_CssDirectoryPtrs[bucket];
+
+    while( ( NULL != entryPtr ) && ( 0 != strcmp( entryPtr->directoryNamePtr, directoryNamePtr ) ) )
+    {
+        entryPtr = entryPtr->nextPtr;
+    }
+
+    if( NULL == entryPtr )
+    {
+        entryPtr = (struct CssDirectory *)calloc( 1, sizeof(struct CssDirectory) );
+
+        assert( entryPtr );
+
+        entryPtr->directoryNamePtr  = strdup( directoryNamePtr );
+        entryPtr->nextPtr           = g_CssDirectoryPtrs[bucket];
+
+        assert( entryPtr->directoryNamePtr );
+
+        g_CssDirectoryPtrs[bucket] = entryPtr;
+    }
+
+    return( entryPtr );
+}
+
+/**
+ * char *findCssFile( struct Page *pagePtr )
+ * 
+ * Discover the css file to be linked to, if any.
+ * 
+ * We must know the absolute path of the html root, because we're not 
+ * going to look beyond that for css files. 
+ * 
+ * So, assume that it is this path that is given via the 'c' option ( 
+ * if there's no 'c' option, we're not looking for css files ). 
+ * 
+ * We can't handle a relative path, because there's no clear way to 
+ * interpret it - at the point we are invoked, we don't know how deeply 
+ * nested we are.
+ * 
+ * Then, we need a way to discover successive parent directories and search
+ * them for css. NB - we do *not* need to, and should not, change the 
+ * current working directory. But, we need to know the absolute path of 
+ * every directory that we traverse so that we can test it against the
+ * root. 
+ * 
+ * Just to make life interesting, the string we want to place in the 
+ * html link ( i.e. the return value ) *is* relative to the location of 
+ * the html file, so it's made up of one '../' for every parent directory
+ * between the markdown file and the directory where the css was found.
+ * 
+ * Pages in the same directory share an answer, so the css cache remembers
+ * the answer for every directory searched, and the cache also remembers the
+ * canonical name of each markdown directory as it was given. Neither is 
+ * worked out with the cache locked ( see resolveCssDirectory() ).
+ * 
+ * in   :   pagePtr -   the page being made
+ * out  :   relative path to css file, owned by the page's arena, else NULL if 
+ *          no css found
+ * err  :   assert if failed to open directory
+ * err  :   assert if failed to canonicalize filename
+ * err  :   exit if invoked outside of specified html root.  
+ */
+char *findCssFile( struct Page *pagePtr )
+{
+struct CssDirectory *givenPtr = NULL;
+struct CssDirectory *entryPtr = NULL;
+char                *cssFilenamePtr = NULL;
+char                *cssFilenameEndPtr = NULL;
+char                *absPathPtr = NULL;
+char                *canonicalNamePtr = NULL;
+char                *searchDirPtr = NULL;
+int                 level = 0;
+bool                resolved = false;
+uint64_t            startTime = startTiming();
+
+    // the markdown directory as given ( e.g. relative to the cwd ), and its 
+    // canonical equivalent, are both kept in the cache, the canonical name 
+    // being found without the cache locked
+
+    pthread_mutex_lock( &g_CssDirectoryMutex );
+
+    givenPtr            = findCssDirectory( pagePtr->markdownDirectory );
+    canonicalNamePtr    = givenPtr->canonicalNamePtr;
+
+    pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+    if( NULL == canonicalNamePtr )
+    {
+        searchDirPtr = makePathname( pagePtr->markdownDirectory, "./", 2 );
+
+        absPathPtr = canonicalize_file_name( searchDirPtr );
+
+        assert( absPathPtr );
+
+        addCount( count_canonicalize, 1 );
+
+        verbose( "Real path of %s is %s\n", searchDirPtr, absPathPtr );
+
+        free( searchDirPtr );
+
+        pthread_mutex_lock( &g_CssDirectoryMutex );
+
+        if( NULL == givenPtr->canonicalNamePtr )
+        {
+            givenPtr->canonicalNamePtr  = absPathPtr;
+            absPathPtr                  = NULL;
+        }
+
+        canonicalNamePtr = givenPtr->canonicalNamePtr;
+
+        pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+        free( absPathPtr );
+    }
+
+    // the answer is read with the cache locked, and if the directory has been
+    // invalidated since it was resolved, it's resolved again
+
+    while( !resolved )
+    {
+        entryPtr = resolveCssDirectory( canonicalNamePtr, pagePtr->cssRoot );
+
+        pthread_mutex_lock( &g_CssDirectoryMutex );
+
+        resolved = entryPtr->resolved;
+
+        if( resolved && ( NULL != entryPtr->cssNamePtr ) )
+        {
+            cssFilenamePtr = (char *)allocateFromArena( pagePtr->arenaPtr, strlen( "./" ) + ( entryPtr->parentLevels * strlen( "../" ) ) + strlen( entryPtr->cssNamePtr ) + 1 );
+
+            cssFilenameEndPtr = stpcpy( cssFilenamePtr, "./" );
+
+            for( level = 0; level < entryPtr->parentLevels; level++ )
+            {
+                cssFilenameEndPtr = stpcpy( cssFilenameEndPtr, "../" );
+            }
+
+            strcpy( cssFilenameEndPtr, entryPtr->cssNamePtr );
+
+            verbose( "Css file for %s is %s\n", pagePtr->markdownFilename, cssFilenamePtr );
+        }
+        else if( resolved )
+        {
+            verbose( "Found no css file under %s\n", pagePtr->cssRoot );
+        }
+
+        pthread_mutex_unlock( &g_CssDirectoryMutex );
+    }
+
+    endTiming( phase_css, startTime );
+
+    return( cssFilenamePtr );
+}
+
+/** 
+ * void includeCSSFile( struct Page *pagePtr )
+ * 
+ * Search for a css file, and include a link to it.
+ * 
+ * in   : pagePtr   -   the page being made
+ * out  : A link field pointing at the css file is added to the head
+ * err  : exit if we do not in fact have a css file
+ */
+void includeCSSFile( struct Page *pagePtr )
+{
+char*   cssFilenamePtr;
+
+    // The css file may already have been found, to check whether the page
+    // needed making at all
+
+    if( NULL == pagePtr->cssFilename )
+    {
+        pagePtr->cssFilename = findCssFile( pagePtr );
+    }
+
+    cssFilenamePtr = pagePtr->cssFilename;
+
+    if( NULL == cssFilenamePtr )
+    {
+        printf( "No css file found under %s\n", pagePtr->cssRoot );
+        exit( EXIT_NO_CSS_FILE );
+    }
+
+    verbose( "Writing link to css file %s\n", cssFilenamePtr );
+
+    appendString( &pagePtr->head, g_LinkOpenTag );
+    appendString( &pagePtr->head, " rel=\"stylesheet\" href=\"" );
+    appendString( &pagePtr->head, cssFilenamePtr );
+    appendString( &pagePtr->head, "\" " );
+    appendString( &pagePtr->head, g_LinkCloseTag );
+}       
+
+/**
+ * struct TxtInclude *findTxtInclude( const struct stat *txtStatPtr )
+ * 
+ * Find a txt file in the shared txt file cache, adding a new, unloaded, entry 
+ * for it if it isn't there yet. Must be called with g_TxtIncludeMutex held.
+ * 
+ * in   :   txtStatPtr  -   fstat of the txt file
+ * out  :   the txt file's cache entry
+ * err  :   assert if failed to allocate a new entry
+ */
+struct TxtInclude *findTxtInclude( const struct stat *txtStatPtr )
+{
+uint64_t            bucket = ( (uint64_t)txtStatPtr->st_dev * HASH_PRIME ^ (uint64_t)txtStatPtr->st_ino ) % TXT_INCLUDE_BUCKETS;
+struct TxtInclude   *entryPtr = g_TxtIncludePtrs[bucket];
+
+    while( ( NULL != entryPtr ) && ( ( entryPtr->device != txtStatPtr->st_dev ) || ( entryPtr->inode != txtStatPtr->st_ino ) ) )
+    {
+        entryPtr = entryPtr->nextPtr;
+    }
+
+    if( NULL == entryPtr )
+    {
+        entryPtr = (struct TxtInclude *)calloc( 1, sizeof(struct TxtInclude) );
+
+        assert( entryPtr );
+
+        entryPtr->device    = txtStatPtr->st_dev;
+        entryPtr->inode     = txtStatPtr->st_ino;
+        entryPtr->mtime     = txtStatPtr->st_mtim;
+        entryPtr->size      = txtStatPtr->st_size;
+        entryPtr->nextPtr   = g_TxtIncludePtrs[bucket];
+
+        g_TxtIncludePtrs[bucket] = entryPtr;
+    }
+
+    return( entryPtr );
+}
+
+/**
+ * void includeTxtFile( struct Page *pagePtr )
+ * 
+ * First, see if we've got a txt file with an appropriate name. If we have, it
+ * is copied into the web page header verbatim. The kernel copies it when the 
+ * page is written, unless it's shared with another page in a batch, in which 
+ * case it's only read once, or the whole page has to be in memory.
+ * 
+ * in       :   pagePtr -   the page being made
+ * out      :   Text from txt file is in the header, or is to be copied there.
+ * err      :   assert if failed to fstat or read the txt file.
+ */
+void includeTxtFile( struct Page *pagePtr )
+{
+int                 txtFD = -1;
+char                *txtFilenamePtr = pagePtr->txtFilename;
+struct stat         txtStat;
+struct TxtInclude   *entryPtr = NULL;
+struct Buffer       *sharedPtr = NULL;
+int                 result;
+
+    verbose( "Opening txt file %s\n", txtFilenamePtr );
+
+    txtFD = open( txtFilenamePtr, O_RDONLY );
+
+    if( -1 == txtFD )
+    {
+        verbose( "Txt file %s not provided\n", txtFilenamePtr );
+        return;
+    }
+
+    result = fstat( txtFD, &txtStat );
+
+    assert( 0 == result );
+
+    addCount( count_bytes_in, txtStat.st_size );
+
+    if( g_MarkdownFilenameCount > 1 )
+    {
+        pthread_mutex_lock( &g_TxtIncludeMutex );
+
+        entryPtr = findTxtInclude( &txtStat );
+
+        // Loaded contents are never changed, so can be used once the lock has 
+        // gone. A file that has changed since it was first met is just copied.
+
+        if( ( entryPtr->mtime.tv_sec == txtStat.st_mtim.tv_sec ) && ( entryPtr->mtime.tv_nsec == txtStat.st_mtim.tv_nsec ) 
+         && ( entryPtr->size == txtStat.st_size ) && ( ++entryPtr->pageCount > 1 ) )
+        {
+            if( !entryPtr->loaded )
+            {
+                appendFile( &entryPtr->contents, txtFD );
+                entryPtr->loaded = true;
+            }
+
+            sharedPtr = &entryPtr->contents;
+        }
+
+        pthread_mutex_unlock( &g_TxtIncludeMutex );
+    }
+
+    if( NULL != sharedPtr )
+    {
+        verbose( "Copying shared %s into web page\n", txtFilenamePtr );
+        appendBuffer( &pagePtr->head, sharedPtr->dataPtr, sharedPtr->length );
+
+        close( txtFD );
+    }
+    else if( isWholePageWanted( pagePtr->optionsPtr ) )
+    {
+        verbose( "Reading %s into web page\n", txtFilenamePtr );
+        appendFile( &pagePtr->head, txtFD );
+
+        close( txtFD );
+    }
+    else
+    {
+        verbose( "Copying %s into web page\n", txtFilenamePtr );
+        pagePtr->txtFD      = txtFD;
+        pagePtr->txtOffset  = pagePtr->head.length;
+    }
+}       
+
+/**
+ * cmark_node *parseMarkdownFile( struct Page *pagePtr )
+ * 
+ * Parse the page's markdown file. The file is mapped into memory and handed to
+ * the parser in one go, with a hint to the kernel that it will be read straight
+ * through, which saves copying it through stdio buffers. Anything that can't be
+ * mapped ( an empty file, a pipe ) is read in large chunks instead. In site mode
+ * the hash of the markdown is worked out at the same time, for the manifest. 
+ * With a body cache, a mapped file is hashed before it's parsed, and isn't 
+ * parsed at all if the html rendered from it is in the cache. A streamed page's
+ * tree is the caller's to free. Markdown already read ahead into memory is 
+ * used as a mapped file would be, without the file being opened again.
+ * 
+ * in       : pagePtr   -   the page being made
+ * out      : the parsed markdown tree, owned by the caller, or NULL if the body
+ *            of the page came from the cache
+ * err      : assert on failure to open the markdown file
+ * err      : assert on failure to read the markdown file
+ * err      : assert on failure to parse file ( NULL node tree ptr )
+ */
+cmark_node *parseMarkdownFile( struct Page *pagePtr )
+{
+cmark_parser    *parserPtr = NULL;
+cmark_node      *nodeTreePtr = NULL;
+int             markdownFD = -1;
+struct stat     markdownStat;
+char            *markdownPtr = MAP_FAILED;
+char            *readBufferPtr = NULL;
+ssize_t         bytesRead = 0;
+int             result = 0;
+
+    if( NULL == pagePtr->markdownDataPtr )
+    {
+        markdownFD = open( pagePtr->markdownFilename, O_RDONLY | O_CLOEXEC );
+
+        assert( -1 != markdownFD );
+
+        verbose("Opened markdown file %s for read only\n", pagePtr->markdownFilename );
+    }
+
+    verbose( "Parsing markdown file\n" );
+
+    // The parser, the tree it makes and the html rendered from the tree all 
+    // come from the page's arena, unless the page is streamed, when they come 
+    // from cmark's own allocator so that each block can be freed once it's 
+    // written
+
+    g_ThreadArenaPtr = pagePtr->arenaPtr;
+
+    parserPtr = pagePtr->streamed ? cmark_parser_new( CMARK_OPT_UNSAFE ) : cmark_parser_new_with_mem( CMARK_OPT_UNSAFE, &g_ArenaMem );
+
+    assert( parserPtr );
+
+    pagePtr->markdownHash   = HASH_SEED;
+    pagePtr->markdownHashed = pagePtr->optionsPtr->siteMode || ( NULL != pagePtr->optionsPtr->cacheDirectory );
+
+    if( NULL != pagePtr->markdownDataPtr )
+    {
+        markdownPtr             = (char *)pagePtr->markdownDataPtr;
+        markdownStat.st_size    = pagePtr->markdownDataLength;
+    }
+    else
+    {
+        result = fstat( markdownFD, &markdownStat );
+
+        assert( 0 == result );
+
+        if( S_ISREG( markdownStat.st_mode ) && ( 0 < markdownStat.st_size ) )
+        {
+            markdownPtr = (char *)mmap( NULL, markdownStat.st_size, PROT_READ, MAP_PRIVATE, markdownFD, 0 );
+        }
+
+        if( MAP_FAILED != markdownPtr )
+        {
+            madvise( markdownPtr, markdownStat.st_size, MADV_SEQUENTIAL );
+        }
+    }
+
+    if( MAP_FAILED != markdownPtr )
+    {
+        addCount( count_bytes_in, markdownStat.st_size );
+
+        if( pagePtr->markdownHashed )
+        {
+            pagePtr->markdownHash = hashBytes( pagePtr->markdownHash, markdownPtr, markdownStat.st_size );
+        }
+
+        if( ( NULL != pagePtr->optionsPtr->cacheDirectory ) && findCachedBody( pagePtr, markdownPtr, markdownStat.st_size ) )
+        {
+            if( -1 != markdownFD )
+            {
+                munmap( markdownPtr, markdownStat.st_size );
+                close( markdownFD );
+            }
+
+            cmark_parser_free( parserPtr );
+
+            return( NULL );
+        }
+
+        cmark_parser_feed( parserPtr, markdownPtr, markdownStat.st_size );
+
+        if( -1 != markdownFD )
+        {
+            munmap( markdownPtr, markdownStat.st_size );
+        }
+    }
+    else
+    {
+        result = posix_memalign( (void **)&readBufferPtr, sysconf( _SC_PAGESIZE ), MARKDOWN_READ_SIZE );
+
+        assert( 0 == result );
+
+        while( 0 < ( bytesRead = read( markdownFD, readBufferPtr, MARKDOWN_READ_SIZE ) ) )
+        {
+            cmark_parser_feed( parserPtr, readBufferPtr, bytesRead );
+
+            addCount( count_bytes_in, bytesRead );
+
+            if( pagePtr->markdownHashed )
+            {
+                pagePtr->markdownHash = hashBytes( pagePtr->markdownHash, readBufferPtr, bytesRead );
+            }
+        }
+
+        assert( 0 == bytesRead );
+
+        free( readBufferPtr );
+    }
+
+    if( -1 != markdownFD )
+    {
+        close( markdownFD );
+    }
+
+    nodeTreePtr = cmark_parser_finish( parserPtr );
+
+    cmark_parser_free( parserPtr );
+
+    assert( nodeTreePtr );
+
+    return( nodeTreePtr );
+}
+
+/**
+ * void rewriteMarkdownLinks( cmark_node *nodeTreePtr )
+ * 
+ * Change links to local markdown files into links to the corresponding html 
+ * files, because the whole site may have been written, and cross linked, as 
+ * markdown. Only the link destinations are touched, so text that just talks 
+ * about .md files is left alone. A link is local if it has no scheme ( i.e.
+ * no ':' before the path ) and is not protocol relative ( '//' ). Any query 
+ * or fragment following the path is kept. 
+ * 
+ * in       : nodeTreePtr   -   the parsed markdown
+ * out      : links to .md files in the tree now link to .html files
+ * err      : assert if failed to allocate a new link destination
+ */
+void rewriteMarkdownLinks( cmark_node *nodeTreePtr )
+{
+cmark_iter          *iterPtr = cmark_iter_new( nodeTreePtr );
+cmark_event_type    event;
+cmark_node          *nodePtr = NULL;
+const char          *urlPtr = NULL;
+size_t              pathLength = 0;
+char                *newUrlPtr = NULL;
+
+    while( CMARK_EVENT_DONE != ( event = cmark_iter_next( iterPtr ) ) )
+    {
+        nodePtr = cmark_iter_get_node( iterPtr );
+
+        if( ( CMARK_EVENT_ENTER != event ) || ( CMARK_NODE_LINK != cmark_node_get_type( nodePtr ) ) )
+        {
+            continue;
+        }
+
+        urlPtr      = cmark_node_get_url( nodePtr );
+        pathLength  = strcspn( urlPtr, "?#" );
+
+        // a scheme is anything before a ':' that comes ahead of the path
+
+        if( ( ':' == urlPtr[strcspn( urlPtr, ":/?#" )] ) || ( 0 == strncmp( urlPtr, "//", 2 ) ) )
+        {
+            continue;
+        }
+
+        if( ( pathLength < strlen( ".md" ) ) || ( 0 != strncmp( urlPtr + pathLength - strlen( ".md" ), ".md", strlen( ".md" ) ) ) )
+        {
+            continue;
+        }
+
+        newUrlPtr = (char *)malloc( strlen( urlPtr ) - strlen( ".md" ) + strlen( ".html" ) + 1 );
+
+        assert( newUrlPtr );
+
+        sprintf( newUrlPtr, "%.*s.html%s", (int)( pathLength - strlen( ".md" ) ), urlPtr, urlPtr + pathLength );
+
+        verbose( "Rewriting link %s as %s\n", urlPtr, newUrlPtr );
+
+        cmark_node_set_url( nodePtr, newUrlPtr );
+
+        free( newUrlPtr );
+    }
+
+    cmark_iter_free( iterPtr );
+}
+
+/**
+ * bool renderWebpageBody( struct Page *pagePtr, cmark_node *nodeTreePtr )
+ * 
+ * Render a page's parsed markdown as its body, rewriting links first if asked.
+ * For a site index, the page's index record is taken from the parsed markdown,
+ * and with a body cache, the html goes into the cache.
+ * 
+ * in       : pagePtr       -   the page being made
+ * in       : nodeTreePtr   -   its parsed markdown
+ * out      : true if the page's body is rendered, false if cmark failed to 
+ *            render it
+ * err      : none
+ */
+bool renderWebpageBody( struct Page *pagePtr, cmark_node *nodeTreePtr )
+{
+char*       renderBufferPtr = NULL;
+uint64_t    startTime = 0;
+
+    if( pagePtr->optionsPtr->rewriteLinks )
+    {
+        startTime = startTiming();
+
+        rewriteMarkdownLinks( nodeTreePtr );
+
+        endTiming( phase_links, startTime );
+    }
+
+    verbose( "Rendering HTML\n" );
+
+    // The render buffer comes from the same allocator as the tree, so from 
+    // the page's arena. Neither needs freeing, they go when the arena is 
+    // reset.
+
+    startTime = startTiming();
+
+    renderBufferPtr = cmark_render_html( nodeTreePtr, CMARK_OPT_UNSAFE );
+
+    endTiming( phase_render, startTime );
+
+    if( NULL == renderBufferPtr )
+    {
+        return( false );
+    }
+
+    pagePtr->bodyPtr    = renderBufferPtr;
+    pagePtr->bodyLength = strlen( renderBufferPtr );
+
+    // and while the tree is there, what the site index needs from it
+
+    if( isSiteIndexWanted() )
+    {
+        startTime = startTiming();
+
+        addIndexRecord( pagePtr, nodeTreePtr );
+
+        endTiming( phase_index, startTime );
+    }
+
+    if( pagePtr->bodyWanted )
+    {
+        saveCachedBody( pagePtr );
+    }
+
+    return( true );
+}
+
+/**
+ * bool addWebpageBody( struct Page *pagePtr )
+ * 
+ * Process the markdown file, and add the rendered html to the
+ * web page. With a body cache, the html comes from the cache if it can, and 
+ * goes into it if it can't. For a site index, the page's index record is taken
+ * from the parsed markdown, or from the cache along with the html.
+ * 
+ * in       : pagePtr   -   the page being made
+ * out      : html body is added to the page, and true if it was rendered
+ * err      : none
+ */
+bool addWebpageBody( struct Page *pagePtr )
+{
+cmark_node* nodeTreePtr = NULL;
+uint64_t    startTime = 0;
+bool        rendered = true;
+
+    appendString( &pagePtr->head, g_BodyOpenTag );
+
+    startTime = startTiming();
+
+    nodeTreePtr = parseMarkdownFile( pagePtr );
+
+    endTiming( phase_parse, startTime );
+
+    if( NULL != nodeTreePtr )
+    {
+        rendered = renderWebpageBody( pagePtr, nodeTreePtr );
+    }
+
+    // Close the body, after any body partials and navigation embedding
+
+    appendBuffer( &pagePtr->tail, pagePtr->contextPtr->bodyTail.dataPtr, pagePtr->contextPtr->bodyTail.length );
+
+    return( rendered );
+}
+
+/**
+ * char *getCacheDirectory( void )
+ * 
+ * Work out where the body cache goes when no directory is given for it : 
+ * webpage under $XDG_CACHE_HOME, or under ~/.cache if that isn't set.
+ * 
+ * in       : none
+ * out      : the cache directory, to be freed by the caller
+ * err      : exit if there's no home directory either
+ */
+char *getCacheDirectory( void )
+{
+const char  *basePtr = getenv( "XDG_CACHE_HOME" );
+char        *directoryPtr = NULL;
+
+    if( ( NULL != basePtr ) && ( '/' == basePtr[0] ) )
+    {
+        directoryPtr = (char *)malloc( strlen( basePtr ) + strlen( "/webpage" ) + 1 );
+
+        assert( directoryPtr );
+
+        sprintf( directoryPtr, "%s/webpage", basePtr );
+    }
+    else if( ( NULL != ( basePtr = getenv( "HOME" ) ) ) && ( '/' == basePtr[0] ) )
+    {
+        directoryPtr = (char *)malloc( strlen( basePtr ) + strlen( "/.cache/webpage" ) + 1 );
+
+        assert( directoryPtr );
+
+        sprintf( directoryPtr, "%s/.cache/webpage", basePtr );
+    }
+    else
+    {
+        printf( "No XDG_CACHE_HOME or HOME for the body cache, give the cache directory instead\n" );
+        exit( EXIT_BAD_CACHE );
+    }
+
+    return( directoryPtr );
+}
+
+/**
+ * void openBodyCache( void )
+ * 
+ * Make the body cache directory, and any directories above it, if they aren't
+ * there, and work out what the bodies made this run depend on besides their 
+ * markdown : the cmark version and options, whether links are rewritten, and 
+ * the version of the cache itself. 
+ * 
+ * in       : none
+ * out      : The cache directory exists, and g_BodyCacheTag is set
+ * err      : exit if the cache directory cannot be made
+ */
+void openBodyCache( void )
+{
+char    *directoryPtr = g_Options.cacheDirectory;
+char    *slashPtr = directoryPtr;
+
+    do
+    {
+        slashPtr = strchr( slashPtr + 1, '/' );
+
+        if( NULL != slashPtr )
+        {
+            *slashPtr = '\0';
+        }
+
+        if( ( '\0' != directoryPtr[0] ) && ( 0 != mkdir( directoryPtr, 0777 ) ) && ( EEXIST != errno ) )
+        {
+            printf( "Cannot make body cache directory %s\n", directoryPtr );
+            exit( EXIT_BAD_CACHE );
+        }
+
+        if( NULL != slashPtr )
+        {
+            *slashPtr = '/';
+        }
+    }
+    while( NULL != slashPtr );
+
+    snprintf( g_BodyCacheTag, sizeof(g_BodyCacheTag), "%d cmark %s %d %d", BODY_CACHE_VERSION, 
+              cmark_version_string(), CMARK_OPT_UNSAFE, g_Options.rewriteLinks );
+
+    verbose( "Using body cache %s for %s\n", directoryPtr, g_BodyCacheTag );
+}
+
+/**
+ * char *makeBodyCacheFilename( struct Page *pagePtr )
+ * 
+ * Work out which file in the body cache has the body of a page. The key, in 
+ * hex, gives the name, with the first two digits as a directory, so that no 
+ * one directory gets too big.
+ * 
+ * in       : pagePtr   -   the page, with its body key
+ * out      : the cache filename, in the page's arena
+ * err      : none
+ */
+char *makeBodyCacheFilename( struct Page *pagePtr )
+{
+    return( printToArena( pagePtr->arenaPtr, "%s/%02llx/%014llx", pagePtr->optionsPtr->cacheDirectory, 
+                          (unsigned long long)( pagePtr->bodyKey >> 56 ), 
+                          (unsigned long long)( pagePtr->bodyKey & 0x00ffffffffffffffULL ) ) );
+}
+
+/**
+ * bool findCachedBody( struct Page *pagePtr, const char *markdownPtr, size_t length )
+ * 
+ * Look for the body of a page in the body cache. The key is the hash of the 
+ * markdown, which has been worked out already, carried on over g_BodyCacheTag.
+ * Since another markdown, or another tag, could hash to the same key, a cache
+ * file is only used if the tag and markdown in it are the page's exactly. One
+ * that isn't all there, or is for anything else, is ignored, and made again, 
+ * as is one without the index record a site index needs.
+ * 
+ * in       : pagePtr       -   the page being made, with its markdown hashed
+ * in       : markdownPtr   -   the markdown
+ * in       : length        -   how long it is
+ * out      : true if the page's body is now the cached one, else the page's 
+ *            body is wanted for the cache once it's made, and a copy of the 
+ *            markdown is kept in the page's arena to go with it
+ * err      : none
+ */
+bool findCachedBody( struct Page *pagePtr, const char *markdownPtr, size_t length )
+{
+char                *cacheFilenamePtr = NULL;
+int                 cacheFD = -1;
+struct stat         cacheStat;
+char                *cachePtr = NULL;
+ssize_t             bytesRead = 0;
+size_t              total = 0;
+char                *newlinePtr = NULL;
+unsigned long long  key = 0;
+size_t              markdownLength = 0;
+size_t              bodyLength = 0;
+size_t              recordLength = 0;
+size_t              headerLength = 0;
+size_t              tagLength = strlen( g_BodyCacheTag );
+bool                found = false;
+
+    pagePtr->bodyKey = hashBytes( pagePtr->markdownHash, g_BodyCacheTag, tagLength );
+
+    cacheFilenamePtr = makeBodyCacheFilename( pagePtr );
+
+    cacheFD = open( cacheFilenamePtr, O_RDONLY | O_CLOEXEC );
+
+    if( ( -1 != cacheFD ) && ( 0 == fstat( cacheFD, &cacheStat ) ) && S_ISREG( cacheStat.st_mode ) )
+    {
+        cachePtr = (char *)allocateFromArena( pagePtr->arenaPtr, cacheStat.st_size + 1 );
+
+        while( ( total < (size_t)cacheStat.st_size ) && ( 0 < ( bytesRead = read( cacheFD, cachePtr + total, cacheStat.st_size - total ) ) ) )
+        {
+            total += bytesRead;
+        }
+
+        addCount( count_bytes_in, total );
+
+        cachePtr[total] = '\0';
+
+        if( NULL != ( newlinePtr = memchr( cachePtr, '\n', total ) ) )
+        {
+            headerLength = newlinePtr + 1 - cachePtr;
+        }
+
+        // the lengths are checked one at a time, so that a doctored header 
+        // can't add up to the file's length by overflowing
+
+        if( ( 0 == headerLength ) || ( 4 != sscanf( cachePtr, BODY_CACHE_HEADER, &key, &markdownLength, &bodyLength, &recordLength ) ) || 
+            ( key != pagePtr->bodyKey ) || ( markdownLength != length ) || ( total - headerLength < tagLength + 1 + length ) ||
+            ( bodyLength > total - headerLength - tagLength - 1 - length ) || 
+            ( recordLength != total - headerLength - tagLength - 1 - length - bodyLength ) ||
+            ( 0 != memcmp( cachePtr + headerLength, g_BodyCacheTag, tagLength ) ) || ( '\n' != cachePtr[headerLength + tagLength] ) ||
+            ( 0 != memcmp( cachePtr + headerLength + tagLength + 1, markdownPtr, length ) ) )
+        {
+            verbose( "Body cache file %s is not for this page\n", cacheFilenamePtr );
+        }
+        else if( isSiteIndexWanted() && ( 0 == recordLength ) )
+        {
+            verbose( "Body cache file %s has no index record\n", cacheFilenamePtr );
+        }
+        else
+        {
+            found = true;
+        }
+    }
+
+    if( -1 != cacheFD )
+    {
+        close( cacheFD );
+    }
+
+    if( !found )
+    {
+        addCount( count_cache_misses, 1 );
+
+        // the markdown may be unmapped by the time the body is saved
+
+        pagePtr->bodyMarkdownPtr    = (char *)allocateFromArena( pagePtr->arenaPtr, length );
+        pagePtr->bodyMarkdownLength = length;
+        pagePtr->bodyWanted         = true;
+
+        memcpy( pagePtr->bodyMarkdownPtr, markdownPtr, length );
+
+        return( false );
+    }
+
+    verbose( "Using cached body %s\n", cacheFilenamePtr );
+
+    pagePtr->bodyPtr    = cachePtr + headerLength + tagLength + 1 + length;
+    pagePtr->bodyLength = bodyLength;
+
+    if( isSiteIndexWanted() )
+    {
+        appendBuffer( &pagePtr->indexRecord, pagePtr->bodyPtr + bodyLength, recordLength );
+    }
+
+    addCount( count_cache_hits, 1 );
+
+    return( true );
+}
+
+/**
+ * void saveCachedBody( struct Page *pagePtr )
+ * 
+ * Put the body of a page into the body cache. The cache file is written under
+ * a temporary name and then renamed, so anything else using the cache, another
+ * webpage on another machine say, sees either the whole file or none of it. 
+ * Two at once just write the same thing. The cache only saves time, so a body 
+ * that can't be saved ( a cache that is read only, say ) is left out.
+ * 
+ * in       : pagePtr   -   the page, with its body ( and any index record ) made 
+ *                          from its markdown, and the markdown kept by 
+ *                          findCachedBody()
+ * out      : the body is in the cache
+ * err      : assert if failed to write the cache file
+ */
+void saveCachedBody( struct Page *pagePtr )
+{
+char            *cacheFilenamePtr = makeBodyCacheFilename( pagePtr );
+char            *tempFilenamePtr = NULL;
+char            *slashPtr = NULL;
+char            header[64 + sizeof(g_BodyCacheTag)];
+struct iovec    vectors[4];
+int             cacheFD = -1;
+size_t          total = 0;
+
+    tempFilenamePtr = printToArena( pagePtr->arenaPtr, "%s.XXXXXX", cacheFilenamePtr );
+    slashPtr        = strrchr( tempFilenamePtr, '/' );
+
+    *slashPtr = '\0';
+
+    if( ( 0 != mkdir( tempFilenamePtr, 0777 ) ) && ( EEXIST != errno ) )
+    {
+        verbose( "Cannot make body cache directory %s\n", tempFilenamePtr );
+        return;
+    }
+
+    *slashPtr = '/';
+
+    if( -1 == ( cacheFD = mkstemp( tempFilenamePtr ) ) )
+    {
+        verbose( "Cannot make body cache file %s\n", tempFilenamePtr );
+        return;
+    }
+
+    vectors[0].iov_base = header;
+    vectors[0].iov_len  = snprintf( header, sizeof(header), BODY_CACHE_HEADER, (unsigned long long)pagePtr->bodyKey, 
+                                    pagePtr->bodyMarkdownLength, pagePtr->bodyLength, pagePtr->indexRecord.length );
+    vectors[0].iov_len += snprintf( header + vectors[0].iov_len, sizeof(header) - vectors[0].iov_len, "%s\n", g_BodyCacheTag );
+    vectors[1].iov_base = pagePtr->bodyMarkdownPtr;
+    vectors[1].iov_len  = pagePtr->bodyMarkdownLength;
+    vectors[2].iov_base = pagePtr->bodyPtr;
+    vectors[2].iov_len  = pagePtr->bodyLength;
+    vectors[3].iov_base = pagePtr->indexRecord.dataPtr;
+    vectors[3].iov_len  = pagePtr->indexRecord.length;
+
+    total = writeVectors( cacheFD, vectors, 4 );
+
+    addCount( count_bytes_out, total );
+
+    if( ( 0 != fchmod( cacheFD, g_WebpageFileMode ) ) || ( 0 != close( cacheFD ) ) || ( 0 != rename( tempFilenamePtr, cacheFilenamePtr ) ) )
+    {
+        verbose( "Cannot save body cache file %s\n", cacheFilenamePtr );
+        unlink( tempFilenamePtr );
+        return;
+    }
+
+    verbose( "Saved body in cache as %s\n", cacheFilenamePtr );
+}
+
+/**
+ * bool isSiteIndexWanted( void )
+ * 
+ * Work out whether a sitemap or search index is to be made, so that each page
+ * needs an index record.
+ * 
+ * in       : none
+ * out      : true if there is a site index to make
+ * err      : none
+ */
+bool isSiteIndexWanted( void )
+{
+    return( ( NULL != g_Options.sitemapUrl ) || g_Options.searchIndex );
+}
+
+/**
+ * void appendJsonString( struct Buffer *bufferPtr, const char *stringPtr, size_t length )
+ * 
+ * Add some text to the end of a buffer as a quoted JSON string, as for 
+ * writeJsonString().
+ * 
+ * in       : bufferPtr -   the buffer
+ * in       : stringPtr -   the text
+ * in       : length    -   how long it is
+ * out      : the JSON string is at the end of the buffer
+ * err      : assert if failed to grow the buffer
+ */
+void appendJsonString( struct Buffer *bufferPtr, const char *stringPtr, size_t length )
+{
+char    escape[8];
+size_t  start = 0;
+size_t  index = 0;
+
+    appendString( bufferPtr, "\"" );
+
+    for( index = 0; index < length; index++ )
+    {
+    unsigned char c = (unsigned char)stringPtr[index];
+
+        if( ( '"' == c ) || ( '\\' == c ) || ( c < 0x20 ) )
+        {
+            appendBuffer( bufferPtr, stringPtr + start, index - start );
+
+            snprintf( escape, sizeof(escape), ( c < 0x20 ) ? "\\u%04x" : "\\%c", c );
+            appendString( bufferPtr, escape );
+
+            start = index + 1;
+        }
+    }
+
+    appendBuffer( bufferPtr, stringPtr + start, length - start );
+    appendString( bufferPtr, "\"" );
+}
+
+/**
+ * bool addToHashSet( uint64_t *slotsPtr, size_t slotCount, uint64_t hash )
+ * 
+ * Add a hash to a set of them, an open addressed table with a power of two 
+ * slots, at least one of them empty. An empty slot is 0, so a hash of 0 is 
+ * taken as 1.
+ * 
+ * in       : slotsPtr  -   the table
+ * in       : slotCount -   how many slots it has
+ * in       : hash      -   the hash to add
+ * out      : true if the hash wasn't in the set already
+ * err      : none
+ */
+bool addToHashSet( uint64_t *slotsPtr, size_t slotCount, uint64_t hash )
+{
+size_t slot = 0;
+
+    hash = ( 0 == hash ) ? 1 : hash;
+
+    for( slot = hash & ( slotCount - 1 ); 0 != slotsPtr[slot]; slot = ( slot + 1 ) & ( slotCount - 1 ) )
+    {
+        if( hash == slotsPtr[slot] )
+        {
+            return( false );
+        }
+    }
+
+    slotsPtr[slot] = hash;
+
+    return( true );
+}
+
+/**
+ * void appendIndexWords( struct Buffer *recordPtr, struct Arena *arenaPtr, const char *textPtr, size_t length )
+ * 
+ * Add the words in the plain text of a page to its index record, each only 
+ * once, in the order they first come, in lower case and separated by spaces. 
+ * A word is a run of two or more letters and digits, anything not ASCII being
+ * taken as a letter so that UTF-8 words stay whole.
+ * 
+ * in       : recordPtr -   the index record so far
+ * in       : arenaPtr  -   the page's arena, for the set of words seen
+ * in       : textPtr   -   the plain text
+ * in       : length    -   how long it is
+ * out      : the words are at the end of the index record
+ * err      : assert if failed to grow the record
+ */
+void appendIndexWords( struct Buffer *recordPtr, struct Arena *arenaPtr, const char *textPtr, size_t length )
+{
+size_t      slotCount = 16;
+uint64_t    *slotsPtr = NULL;
+size_t      index = 0;
+size_t      wordStart = 0;
+size_t      separatorLength = 0;
+bool        first = true;
+
+    // every word takes at least three characters, with what follows it
+
+    while( slotCount < length / 3 * 2 )
+    {
+        slotCount *= 2;
+    }
+
+    slotsPtr = (uint64_t *)allocateFromArena( arenaPtr, slotCount * sizeof(uint64_t) );
+
+    memset( slotsPtr, 0, slotCount * sizeof(uint64_t) );
+
+    for( index = 0; index < length; )
+    {
+        if( !isalnum( (unsigned char)textPtr[index] ) && !( 0x80 & textPtr[index] ) )
+        {
+            index++;
+            continue;
+        }
+
+        separatorLength = first ? 0 : 1;
+
+        if( !first )
+        {
+            appendString( recordPtr, " " );
+        }
+
+        wordStart = recordPtr->length;
+
+        for( ; ( index < length ) && ( isalnum( (unsigned char)textPtr[index] ) || ( 0x80 & textPtr[index] ) ); index++ )
+        {
+        char c = (char)tolower( (unsigned char)textPtr[index] );
+
+            appendBuffer( recordPtr, &c, 1 );
+        }
+
+        if( ( recordPtr->length - wordStart < 2 ) || 
+            !addToHashSet( slotsPtr, slotCount, hashBytes( HASH_SEED, recordPtr->dataPtr + wordStart, recordPtr->length - wordStart ) ) )
+        {
+            recordPtr->length = wordStart - separatorLength;
+            continue;
+        }
+
+        first = false;
+    }
+}
+
+/**
+ * void addIndexRecord( struct Page *pagePtr, cmark_node *nodeTreePtr )
+ * 
+ * Make a page's index record, for the site index, from its parsed markdown : 
+ * the text of its headings, the destinations of its links, each only once, 
+ * and the words in its text, as described for appendIndexWords(). The record
+ * is the inside of a JSON object, 
+ *
+ *      "headings":["..."],"links":["..."],"words":"..."
+ *
+ * with no tabs or newlines in it, to which the page's url and title are added 
+ * when the site index is written. It depends only on the markdown and the 
+ * options that change the parsed markdown, so it can be cached with the body.
+ * 
+ * in       : pagePtr       -   the page being made
+ * in       : nodeTreePtr   -   its parsed markdown, links already rewritten
+ * out      : pagePtr->indexRecord is the page's index record
+ * err      : assert if failed to grow the buffers
+ */
+void addIndexRecord( struct Page *pagePtr, cmark_node *nodeTreePtr )
+{
+cmark_iter          *iterPtr = cmark_iter_new( nodeTreePtr );
+cmark_event_type    event;
+cmark_node          *nodePtr = NULL;
+struct Buffer       text = { NULL, 0, 0 };
+struct Buffer       links = { NULL, 0, 0 };
+size_t              linkCount = 0;
+size_t              headingStart = 0;
+size_t              headingEnd = 0;
+size_t              headingCount = 0;
+size_t              slotCount = 16;
+uint64_t            *slotsPtr = NULL;
+const char          *urlPtr = NULL;
+struct Buffer       *recordPtr = &pagePtr->indexRecord;
+
+    appendString( recordPtr, "\"headings\":[" );
+
+    while( CMARK_EVENT_DONE != ( event = cmark_iter_next( iterPtr ) ) )
+    {
+        nodePtr = cmark_iter_get_node( iterPtr );
+
+        switch( cmark_node_get_type( nodePtr ) )
+        {
+            case CMARK_NODE_TEXT :
+            case CMARK_NODE_CODE :
+            {
+                appendString( &text, cmark_node_get_literal( nodePtr ) );
+                break;
+            }
+            case CMARK_NODE_CODE_BLOCK :
+            case CMARK_NODE_SOFTBREAK :
+            case CMARK_NODE_LINEBREAK :
+            {
+                appendString( &text, ( CMARK_NODE_CODE_BLOCK == cmark_node_get_type( nodePtr ) ) ? cmark_node_get_literal( nodePtr ) : " " );
+                appendString( &text, " " );
+                break;
+            }
+            case CMARK_NODE_HEADING :
+            {
+                if( CMARK_EVENT_ENTER == event )
+                {
+                    headingStart = text.length;
+                    break;
+                }
+
+                for( headingEnd = text.length; ( headingEnd > headingStart ) && isspace( (unsigned char)text.dataPtr[headingEnd - 1] ); headingEnd-- );
+                for( ; ( headingStart < headingEnd ) && isspace( (unsigned char)text.dataPtr[headingStart] ); headingStart++ );
+
+                appendString( recordPtr, ( 0 == headingCount++ ) ? "" : "," );
+                appendJsonString( recordPtr, text.dataPtr + headingStart, headingEnd - headingStart );
+                appendString( &text, " " );
+                break;
+            }
+            case CMARK_NODE_PARAGRAPH :
+            case CMARK_NODE_ITEM :
+            {
+                if( CMARK_EVENT_EXIT == event )
+                {
+                    appendString( &text, " " );
+                }
+                break;
+            }
+            case CMARK_NODE_LINK :
+            {
+                if( CMARK_EVENT_ENTER == event )
+                {
+                    urlPtr = cmark_node_get_url( nodePtr );
+
+                    appendBuffer( &links, urlPtr, strlen( urlPtr ) + 1 );
+                    linkCount++;
+                }
+                break;
+            }
+            default :
+            {
+                break;
+            }
+        }
+    }
+
+    cmark_iter_free( iterPtr );
+
+    appendString( recordPtr, "],\"links\":[" );
+
+    while( slotCount < linkCount * 2 )
+    {
+        slotCount *= 2;
+    }
+
+    slotsPtr = (uint64_t *)allocateFromArena( pagePtr->arenaPtr, slotCount * sizeof(uint64_t) );
+
+    memset( slotsPtr, 0, slotCount * sizeof(uint64_t) );
+
+    for( urlPtr = links.dataPtr, headingCount = 0; linkCount > 0; urlPtr += strlen( urlPtr ) + 1, linkCount-- )
+    {
+        if( addToHashSet( slotsPtr, slotCount, hashBytes( HASH_SEED, urlPtr, strlen( urlPtr ) ) ) )
+        {
+            appendString( recordPtr, ( 0 == headingCount++ ) ? "" : "," );
+            appendJsonString( recordPtr, urlPtr, strlen( urlPtr ) );
+        }
+    }
+
+    appendString( recordPtr, "],\"words\":\"" );
+
+    appendIndexWords( recordPtr, pagePtr->arenaPtr, text.dataPtr, text.length );
+
+    appendString( recordPtr, "\"" );
+
+    free( text.dataPtr );
+    free( links.dataPtr );
+}
+
+/**
+ * void loadPartial( struct Buffer *partialsPtr, const char *filenamePtr )
+ * 
+ * Read a partial, or a navigation embedding given as '@file', into memory, 
+ * after any others for the same part of the page. It is read once, here, and
+ * copied into every page from memory.
+ * 
+ * in       : partialsPtr   -   the partials so far
+ * in       : filenamePtr   -   the partial's file
+ * out      : the partial is at the end of the partials
+ * err      : exit if the file cannot be read
+ */
+void loadPartial( struct Buffer *partialsPtr, const char *filenamePtr )
+{
+int partialFD = open( filenamePtr, O_RDONLY | O_CLOEXEC );
+
+    if( -1 == partialFD )
+    {
+        printf( "Cannot read partial %s\n", filenamePtr );
+        exit( EXIT_BAD_PARTIAL );
+    }
+
+    appendFile( partialsPtr, partialFD );
+
+    close( partialFD );
+}
+
+/**
+ * void makeContext( struct webpage_ctx *contextPtr, const struct Options *optionsPtr, const char *authorPtr )
+ * 
+ * Make the parts of the head that don't depend on the page, so that they can 
+ * just be copied into every page made in the context. The user name and the 
+ * time are only looked up once, which matters when the user name lookup goes 
+ * over the network. 
+ * 
+ * in   :   contextPtr  -   the context, with any partials
+ * in   :   optionsPtr  -   options for the pages made in it
+ * in   :   authorPtr   -   the author, if the options include one
+ * out  :   the context's head prefix, comments, datetime and body tail are made
+ * err  :   assert if time string buffer is wrongly sized.
+ */
+void makeContext( struct webpage_ctx *contextPtr, const struct Options *optionsPtr, const char *authorPtr )
+{
+    // Add the HTML DOCTYPE - this comes before the head ! 
+    // NB Assume HTML 5 ! Means no specific DTD.
+    // If for some bonkers reason you don't want this, you can omit it
+
+    if( optionsPtr->includeDTD )
+    {
+        appendString( &contextPtr->headPrefix, g_Doctype );
+    }
+
+    // but you can't omit this...
+
+    appendString( &contextPtr->headPrefix, g_PageOpenTag );
+    appendString( &contextPtr->headPrefix, g_HeadOpenTag );
+
+    if( optionsPtr->includeAuthor && ( NULL != authorPtr ) )
+    {
+        appendString( &contextPtr->headComments, g_CommentOpenTag );
+        appendString( &contextPtr->headComments, "Author is " );
+        appendString( &contextPtr->headComments, authorPtr );
+        appendString( &contextPtr->headComments, g_CommentCloseTag );
+    }
+
+    if( optionsPtr->includeDatetime )
+    {
+    time_t      t   = time( NULL );
+    struct tm   tm;
+    char        s[64];
+    size_t      length;
+
+        localtime_r( &t, &tm );
+
+        verbose( "Time is %ld \n", t );
+
+        length = strftime( s, sizeof(s), "%c", &tm );
+
+        assert( length );
+
+        appendString( &contextPtr->headDatetime, g_CommentOpenTag );
+        appendString( &contextPtr->headDatetime, "Datetime is " );
+        appendString( &contextPtr->headDatetime, s );
+        appendString( &contextPtr->headDatetime, g_CommentCloseTag );        
+    }
+
+    appendBuffer( &contextPtr->bodyTail, contextPtr->bodyPartials.dataPtr, contextPtr->bodyPartials.length );
+
+    // Before closing the body, add the navigation embedding, if provided 
+
+    if( NULL != optionsPtr->navEmbedCode )
+    {
+        verbose( "Add navigation embedding %s - FINAL FORM TBD !!! \n", optionsPtr->navEmbedCode );
+        appendString( &contextPtr->bodyTail, g_CommentOpenTag );
+        appendString( &contextPtr->bodyTail, " NAVIGATION EMBEDDING GOES HERE \n" );
+        appendString( &contextPtr->bodyTail, optionsPtr->navEmbedCode );
+        appendString( &contextPtr->bodyTail, g_CommentCloseTag );
+    }
+
+    appendString( &contextPtr->bodyTail, g_BodyCloseTag );
+}
+
+/**
+ * void makeHeadFragments( void )
+ * 
+ * Make the program's own context, g_Context, from the command line options, if
+ * it isn't made yet. Called by every page, so the first to need it makes it.
+ * 
+ * in   :   none
+ * out  :   g_Context is made
+ * err  :   assert if the user name can't be found
+ */
+void makeHeadFragments( void )
+{
+char *usernamePtr = NULL;
+
+    pthread_mutex_lock( &g_HeadFragmentsMutex );
+
+    if( !g_HeadFragmentsMade )
+    {
+        usernamePtr = g_Options.includeAuthor ? getUserName() : NULL;
+
+        makeContext( &g_Context, &g_Options, usernamePtr );
+
+        free( usernamePtr );
+
+        g_HeadFragmentsMade = true;
+    }
+
+    pthread_mutex_unlock( &g_HeadFragmentsMutex );
+}
+
+/**
+ * void addWebpageHead( struct Page *pagePtr )
+ * 
+ * Add everything up to the end of the head. Between the head tags add any 
+ * permitted Options, including CSS and raw content.   
+ * 
+ * in   :   pagePtr -   the page being made
+ * out  :   Web page contains a complete head.
+ * err  :   none
+ */
+void addWebpageHead( struct Page *pagePtr )
+{
+uint64_t startTime = 0;
+
+    appendBuffer( &pagePtr->head, pagePtr->contextPtr->headPrefix.dataPtr, pagePtr->contextPtr->headPrefix.length );
+
+    if( pagePtr->optionsPtr->includeTitle && ( NULL != pagePtr->rootFilename ) )
+    {
+        // Title is the root part of the md file
+
+        verbose( "Writing Title as %s\n", pagePtr->rootFilename );
+
+        appendString( &pagePtr->head, g_TitleOpenTag );
+        appendString( &pagePtr->head, pagePtr->rootFilename );
+        appendString( &pagePtr->head, g_TitleCloseTag );
+    }
+
+    appendBuffer( &pagePtr->head, pagePtr->contextPtr->headComments.dataPtr, pagePtr->contextPtr->headComments.length );
+
+    pagePtr->datetimeOffset = pagePtr->head.length;
+    pagePtr->datetimeLength = pagePtr->contextPtr->headDatetime.length;
+
+    appendBuffer( &pagePtr->head, pagePtr->contextPtr->headDatetime.dataPtr, pagePtr->contextPtr->headDatetime.length );
+
+    if( ( NULL != pagePtr->cssRoot ) || ( NULL != pagePtr->cssFilename ) )
+    {
+        includeCSSFile( pagePtr );
+    }
+
+    // Then anything for every page, ahead of anything for this one
+
+    appendBuffer( &pagePtr->head, pagePtr->contextPtr->headPartials.dataPtr, pagePtr->contextPtr->headPartials.length );
+
+    // Include a txt file, if it's there
+
+    if( NULL != pagePtr->txtFilename )
+    {
+        startTime = startTiming();
+
+        includeTxtFile( pagePtr );
+
+        endTiming( phase_txt, startTime );
+    }
+
+    appendString( &pagePtr->head, g_HeadCloseTag );
+}
+
+/**
+ * bool renderWebpage( struct Page *pagePtr )
+ * 
+ * Make a whole page in memory : its head, its body, from markdown read from 
+ * its file unless it's in memory already, and its tail. Every page the program
+ * makes that isn't streamed is made this way, and so is every page the 
+ * library makes.
+ * 
+ * in   :   pagePtr -   the page being made, its context's head fragments made
+ * out  :   the page's head, body and tail, and true if the body was rendered
+ * err  :   assert on failure to open or read the markdown file
+ */
+bool renderWebpage( struct Page *pagePtr )
+{
+bool rendered = false;
+
+    addWebpageHead( pagePtr );
+
+    rendered = addWebpageBody( pagePtr );
+
+    appendString( &pagePtr->tail, g_PageCloseTag );
+
+    return( rendered );
+}
+
+// Writing the archive and the html files, which the library leaves to its
+// caller
+
+#ifndef WEBPAGE_LIBRARY
+
+/**
+ * void openArchive( void )
+ * 
+ * Archive mode : open the archive that web pages and assets are written to. 
+ * If it's stdout, anything else that would go to stdout goes to stderr 
+ * instead, so the archive is all that's on stdout.
+ * 
+ * in       : none
+ * out      : g_ArchiveFD open for writing, g_ArchiveTime set
+ * err      : exit if the archive cannot be made
+ */
+void openArchive( void )
+{
+    if( 0 == strcmp( "-", g_Options.archiveFilename ) )
+    {
+        g_ArchiveFD = dup( STDOUT_FILENO );
+
+        if( -1 != g_ArchiveFD )
+        {
+            fflush( stdout );
+            dup2( STDERR_FILENO, STDOUT_FILENO );
+        }
+    }
+    else
+    {
+        g_ArchiveFD = open( g_Options.archiveFilename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 );
+    }
+
+    if( -1 == g_ArchiveFD )
+    {
+        printf( "Cannot make archive %s\n", g_Options.archiveFilename );
+        exit( EXIT_BAD_ARCHIVE );
+    }
+
+    g_ArchiveTime = time( NULL );
+
+    verbose( "Writing archive to %s\n", g_Options.archiveFilename );
+}
+
+/**
+ * void addPaxRecord( struct Buffer *paxPtr, const char *keyPtr, const char *valuePtr )
+ * 
+ * Add a record to the data of a pax extended header. Each record starts with
+ * its own length, counting the digits of the length.
+ * 
+ * in       : paxPtr    -   the extended header data so far
+ * in       : keyPtr    -   what the record is for, e.g. "path"
+ * in       : valuePtr  -   its value
+ * out      : the record is at the end of the data
+ * err      : assert if failed to grow the buffer
+ */
+void addPaxRecord( struct Buffer *paxPtr, const char *keyPtr, const char *valuePtr )
+{
+char    lengthText[24];
+size_t  length = strlen( keyPtr ) + strlen( valuePtr ) + strlen( " =\n" );
+size_t  recordLength = length;
+size_t  previousLength = 0;
+
+    // the digits of the length add to the length, which may need more digits
+
+    do
+    {
+        previousLength  = recordLength;
+        recordLength    = length + snprintf( lengthText, sizeof(lengthText), "%zu", previousLength );
+    }
+    while( recordLength != previousLength );
+
+    appendString( paxPtr, lengthText );
+    appendString( paxPtr, " " );
+    appendString( paxPtr, keyPtr );
+    appendString( paxPtr, "=" );
+    appendString( paxPtr, valuePtr );
+    appendString( paxPtr, "\n" );
+}
+
+/**
+ * void addArchiveHeader( struct Buffer *headerPtr, const char *namePtr, mode_t mode, time_t mtime, uint64_t size )
+ * 
+ * Add the header blocks for a regular file to an archive being written : a 
+ * ustar header, preceded by a pax extended header if the name, the size, or 
+ * the user or group id won't fit in a ustar header. A long name is split 
+ * between the prefix and name fields at a '/' if it can be.
+ * 
+ * in       : headerPtr -   where the header blocks go
+ * in       : namePtr   -   name of the file in the archive
+ * in       : mode      -   its permissions
+ * in       : mtime     -   its modification time
+ * in       : size      -   its size
+ * out      : the header blocks are at the end of headerPtr
+ * err      : assert if failed to grow the buffer
+ */
+void addArchiveHeader( struct Buffer *headerPtr, const char *namePtr, mode_t mode, time_t mtime, uint64_t size )
+{
+struct ArchiveHeader    header;
+struct Buffer           pax = { NULL, 0, 0 };
+size_t                  nameLength = strlen( namePtr );
+const char              *splitPtr = NULL;
+char                    sizeText[24];
+uint64_t                userId = geteuid();
+uint64_t                groupId = getegid();
+unsigned int            checksum = 0;
+size_t                  offset = 0;
+
+    memset( &header, 0, sizeof(header) );
+
+    if( nameLength <= sizeof(header.name) )
+    {
+        memcpy( header.name, namePtr, nameLength );
+    }
+    else
+    {
+        // the last '/' that leaves a prefix and a name that both fit
+
+        for( splitPtr = namePtr + nameLength - sizeof(header.name) - 1; ( '\0' != *splitPtr ) && ( '/' != *splitPtr ); splitPtr++ );
+
+        if( ( '/' == *splitPtr ) && ( (size_t)( splitPtr - namePtr ) <= sizeof(header.prefix) ) && ( '\0' != splitPtr[1] ) )
+        {
+            memcpy( header.prefix, namePtr, splitPtr - namePtr );
+            memcpy( header.name, splitPtr + 1, nameLength - ( splitPtr - namePtr ) - 1 );
+        }
+        else
+        {
+            addPaxRecord( &pax, "path", namePtr );
+            memcpy( header.name, namePtr, sizeof(header.name) );
+        }
+    }
+
+    if( size > ARCHIVE_SIZE_LIMIT )
+    {
+        snprintf( sizeText, sizeof(sizeText), "%" PRIu64, size );
+        addPaxRecord( &pax, "size", sizeText );
+    }
+
+    if( userId > ARCHIVE_ID_LIMIT )
+    {
+        snprintf( sizeText, sizeof(sizeText), "%" PRIu64, userId );
+        addPaxRecord( &pax, "uid", sizeText );
+        userId = 0;
+    }
+
+    if( groupId > ARCHIVE_ID_LIMIT )
+    {
+        snprintf( sizeText, sizeof(sizeText), "%" PRIu64, groupId );
+        addPaxRecord( &pax, "gid", sizeText );
+        groupId = 0;
+    }
+
+    snprintf( header.mode, sizeof(header.mode), "%07o", (unsigned int)( mode & 07777 ) );
+    snprintf( header.uid, sizeof(header.uid), "%07" PRIo64, userId & ARCHIVE_ID_LIMIT );
+    snprintf( header.gid, sizeof(header.gid), "%07" PRIo64, groupId & ARCHIVE_ID_LIMIT );
+    snprintf( header.size, sizeof(header.size), "%011" PRIo64, ( size > ARCHIVE_SIZE_LIMIT ) ? 0 : size );
+    snprintf( header.mtime, sizeof(header.mtime), "%011llo", (unsigned long long)mtime & 077777777777ULL );
+    memcpy( header.magic, "ustar", strlen( "ustar" ) + 1 );
+    memcpy( header.version, "00", strlen( "00" ) );
+
+    header.typeflag = '0';
+
+    if( pax.length > 0 )
+    {
+    struct ArchiveHeader    paxHeader = header;
+    char                    zeros[ARCHIVE_BLOCK_SIZE] = { 0 };
+
+        memset( paxHeader.name, 0, sizeof(paxHeader.name) );
+        memset( paxHeader.prefix, 0, sizeof(paxHeader.prefix) );
+        memcpy( paxHeader.name, "././@PaxHeader", strlen( "././@PaxHeader" ) );
+
+        // a name, a size and two ids come nowhere near the size limit
+        snprintf( paxHeader.size, sizeof(paxHeader.size), "%011" PRIo64, (uint64_t)pax.length & ARCHIVE_SIZE_LIMIT );
+
+        paxHeader.typeflag = 'x';
+
+        memset( paxHeader.checksum, ' ', sizeof(paxHeader.checksum) );
+
+        for( offset = 0, checksum = 0; offset < sizeof(paxHeader); offset++ )
+        {
+            checksum += ((unsigned char *)&paxHeader)[offset];
+        }
+
+        snprintf( paxHeader.checksum, sizeof(paxHeader.checksum), "%06o", checksum );
+
+        appendBuffer( headerPtr, &paxHeader, sizeof(paxHeader) );
+        appendBuffer( headerPtr, pax.dataPtr, pax.length );
+        appendBuffer( headerPtr, zeros, ( ARCHIVE_BLOCK_SIZE - pax.length % ARCHIVE_BLOCK_SIZE ) % ARCHIVE_BLOCK_SIZE );
+
+        free( pax.dataPtr );
+    }
+
+    memset( header.checksum, ' ', sizeof(header.checksum) );
+
+    for( offset = 0, checksum = 0; offset < sizeof(header); offset++ )
+    {
+        checksum += ((unsigned char *)&header)[offset];
+    }
+
+    snprintf( header.checksum, sizeof(header.checksum), "%06o", checksum );
+
+    appendBuffer( headerPtr, &header, sizeof(header) );
+}
+
+/**
+ * void writeArchiveEntry( const char *namePtr, mode_t mode, time_t mtime, struct iovec *vectorPtr, int vectorCount )
+ * 
+ * Write a file that is in memory to the archive, as a single write of its 
+ * header, its data and the padding to the end of the block, so that entries 
+ * written by different workers are never mixed up. The vectors are used up.
+ * 
+ * in       : namePtr       -   name of the file in the archive
+ * in       : mode          -   its permissions
+ * in       : mtime         -   its modification time
+ * in       : vectorPtr     -   its data, at most 8 vectors
+ * in       : vectorCount   -   how many vectors there are
+ * out      : the file has been written to the archive
+ * err      : assert if failed to write the archive
+ */
+void writeArchiveEntry( const char *namePtr, mode_t mode, time_t mtime, struct iovec *vectorPtr, int vectorCount )
+{
+struct Buffer   header = { NULL, 0, 0 };
+struct iovec    vectors[10];
+char            zeros[ARCHIVE_BLOCK_SIZE] = { 0 };
+uint64_t        size = 0;
+size_t          total = 0;
+int             vector = 0;
+
+    assert( vectorCount <= 8 );
+
+    for( vector = 0; vector < vectorCount; vector++ )
+    {
+        size += vectorPtr[vector].iov_len;
+
+        vectors[vector + 1] = vectorPtr[vector];
+    }
+
+    addArchiveHeader( &header, namePtr, mode, mtime, size );
+
+    vectors[0].iov_base             = header.dataPtr;
+    vectors[0].iov_len              = header.length;
+    vectors[vectorCount + 1].iov_base = zeros;
+    vectors[vectorCount + 1].iov_len  = ( ARCHIVE_BLOCK_SIZE - size % ARCHIVE_BLOCK_SIZE ) % ARCHIVE_BLOCK_SIZE;
+
+    pthread_mutex_lock( &g_ArchiveMutex );
+
+    total = writeVectors( g_ArchiveFD, vectors, vectorCount + 2 );
+
+    pthread_mutex_unlock( &g_ArchiveMutex );
+
+    verbose( "Archived %s, %" PRIu64 " chars\n", namePtr, size );
+
+    addCount( count_bytes_out, total );
+
+    free( header.dataPtr );
+}
+
+/**
+ * void writeArchiveFile( const char *namePtr, int inputFD, const struct stat *inputStatPtr )
+ * 
+ * Write a file to the archive straight from where it is, by sendfile() if the
+ * kernel can, else through a buffer. The archive says how big the file is 
+ * before it's copied, so exactly that much is copied : if the file shrinks 
+ * meanwhile, the rest is zeros, and if it grows, the rest is left out.
+ * 
+ * in       : namePtr       -   name of the file in the archive
+ * in       : inputFD       -   the file, read from the start
+ * in       : inputStatPtr  -   its permissions, modification time and size
+ * out      : the file has been written to the archive
+ * err      : assert if failed to read the file or write the archive
+ */
+void writeArchiveFile( const char *namePtr, int inputFD, const struct stat *inputStatPtr )
+{
+struct Buffer   header = { NULL, 0, 0 };
+struct iovec    vector;
+char            zeros[ARCHIVE_BLOCK_SIZE] = { 0 };
+char            *copyBufferPtr = NULL;
+uint64_t        size = inputStatPtr->st_size;
+uint64_t        remaining = size;
+size_t          total = 0;
+ssize_t         copied = 0;
+
+    addArchiveHeader( &header, namePtr, inputStatPtr->st_mode & g_AssetFileMask, inputStatPtr->st_mtim.tv_sec, size );
+
+    pthread_mutex_lock( &g_ArchiveMutex );
+
+    vector.iov_base = header.dataPtr;
+    vector.iov_len  = header.length;
+
+    total += writeVectors( g_ArchiveFD, &vector, 1 );
+
+    do
+    {
+        copied = sendfile( g_ArchiveFD, inputFD, NULL, ( remaining < KERNEL_COPY_SIZE ) ? remaining : KERNEL_COPY_SIZE );
+
+        remaining -= ( copied > 0 ) ? copied : 0;
+    }
+    while( ( remaining > 0 ) && ( copied > 0 || ( -1 == copied && EINTR == errno ) ) );
+
+    if( ( remaining > 0 ) && ( -1 == copied ) )
+    {
+        copyBufferPtr = (char *)malloc( COPY_BUFFER_SIZE );
+
+        assert( copyBufferPtr );
+
+        do
+        {
+            copied = read( inputFD, copyBufferPtr, ( remaining < COPY_BUFFER_SIZE ) ? remaining : COPY_BUFFER_SIZE );
+
+            if( -1 == copied && EINTR == errno )
+            {
+                continue;
+            }
+
+            assert( copied >= 0 );
+
+            vector.iov_base = copyBufferPtr;
+            vector.iov_len  = copied;
+
+            remaining -= writeVectors( g_ArchiveFD, &vector, 1 );
+        }
+        while( ( remaining > 0 ) && ( 0 != copied ) );
+
+        free( copyBufferPtr );
+    }
+
+    // whatever couldn't be copied, and then the padding to the end of the block
+
+    total += size - remaining;
+
+    remaining += ( ARCHIVE_BLOCK_SIZE - size % ARCHIVE_BLOCK_SIZE ) % ARCHIVE_BLOCK_SIZE;
+
+    while( remaining > 0 )
+    {
+        vector.iov_base = zeros;
+        vector.iov_len  = ( remaining < sizeof(zeros) ) ? remaining : sizeof(zeros);
+
+        remaining   -= vector.iov_len;
+        total       += writeVectors( g_ArchiveFD, &vector, 1 );
+    }
+
+    pthread_mutex_unlock( &g_ArchiveMutex );
+
+    verbose( "Archived %s, %" PRIu64 " chars\n", namePtr, size );
+
+    addCount( count_bytes_out, total );
+
+    free( header.dataPtr );
+}
+
+/**
+ * void finishArchive( void )
+ * 
+ * Archive mode : end the archive with the two empty blocks that mark its end,
+ * and close it.
+ * 
+ * in       : none
+ * out      : the archive is complete
+ * err      : assert if failed to write or close the archive
+ */
+void finishArchive( void )
+{
+char            zeros[2 * ARCHIVE_BLOCK_SIZE] = { 0 };
+struct iovec    vector = { zeros, sizeof(zeros) };
+int             result = 0;
+
+    addCount( count_bytes_out, writeVectors( g_ArchiveFD, &vector, 1 ) );
+
+    result = close( g_ArchiveFD );
+
+    assert( 0 == result );
+
+    g_ArchiveFD = -1;
+
+    verbose( "Finished archive %s\n", g_Options.archiveFilename );
+}
+
+/**
+ * int createWebpageFile( struct Page *pagePtr, char **tempFilenamePtrPtr )
+ * 
+ * Make the temporary file a page is written to, in the same directory as the 
+ * html file, so that it can be renamed over it.
+ * 
+ * in       : pagePtr               -   the page being made
+ * out      : tempFilenamePtrPtr    -   name of the temporary file, to be freed
+ *                                      by finishWebpageFile()
+ * out      : file descriptor of the temporary file, open for writing
+ * err      : assert if failed to make the temporary file
+ */
+int createWebpageFile( struct Page *pagePtr, char **tempFilenamePtrPtr )
+{
+char    *tempFilenamePtr = NULL;
+int     webpageFD = -1;
+int     result;
+
+    tempFilenamePtr = (char *)malloc( strlen( pagePtr->webpageDirectory ) + strlen( pagePtr->rootFilename ) + strlen( "..html.XXXXXX" ) + 1 );
+
+    assert( tempFilenamePtr );
+
+    sprintf( tempFilenamePtr, "%s.%s.html.XXXXXX", pagePtr->webpageDirectory, pagePtr->rootFilename );
+
+    webpageFD = mkstemp( tempFilenamePtr );
+
+    assert( -1 != webpageFD );
+
+    // mkstemp() makes the file readable by its owner only
+
+    result = fchmod( webpageFD, g_WebpageFileMode );
+
+    assert( 0 == result );
+
+    *tempFilenamePtrPtr = tempFilenamePtr;
+
+    return( webpageFD );
+}
+
+/**
+ * size_t writeWebpageHead( struct Page *pagePtr, int webpageFD, struct iovec *restVectorPtr )
+ * 
+ * Write as much of a page's head as must go ahead of whatever follows it. Any 
+ * txt file still to be included goes in the head at txtOffset, so is copied in
+ * between writing the head up to there and the rest of the head.
+ * 
+ * in       : pagePtr       -   the page being made
+ * in       : webpageFD     -   file descriptor of the temporary file
+ * out      : restVectorPtr -   the rest of the head, not yet written
+ * out      : how much was written
+ * err      : assert if failed to write
+ */
+size_t writeWebpageHead( struct Page *pagePtr, int webpageFD, struct iovec *restVectorPtr )
+{
+struct iovec    headVector;
+size_t          total = 0;
+
+    restVectorPtr->iov_base = pagePtr->head.dataPtr;
+    restVectorPtr->iov_len  = pagePtr->head.length;
+
+    if( -1 != pagePtr->txtFD )
+    {
+        headVector.iov_base = pagePtr->head.dataPtr;
+        headVector.iov_len  = pagePtr->txtOffset;
+
+        restVectorPtr->iov_base = pagePtr->head.dataPtr + pagePtr->txtOffset;
+        restVectorPtr->iov_len  = pagePtr->head.length - pagePtr->txtOffset;
+
+        total += writeVectors( webpageFD, &headVector, 1 );
+        total += copyFile( pagePtr->txtFD, webpageFD );
+
+        close( pagePtr->txtFD );
+        pagePtr->txtFD = -1;
+    }
+
+    return( total );
+}
+
+/**
+ * void finishWebpageFile( struct Page *pagePtr, int webpageFD, char *tempFilenamePtr, size_t total )
+ * 
+ * Close a page's temporary file, now that all of the page has been written to
+ * it, and rename it over the html file.
+ * 
+ * in       : pagePtr           -   the page being made
+ * in       : webpageFD         -   file descriptor of the temporary file
+ * in       : tempFilenamePtr   -   its name, which is freed
+ * in       : total             -   how much was written to it
+ * out      : The web page file has been written.
+ * err      : assert if failed to close or rename the temporary file
+ */
+void finishWebpageFile( struct Page *pagePtr, int webpageFD, char *tempFilenamePtr, size_t total )
+{
+int result;
+
+    result = close( webpageFD );
+
+    assert( 0 == result );
+
+    result = rename( tempFilenamePtr, pagePtr->webpageFilename );
+
+    assert( 0 == result );
+
+    verbose( "Wrote %zu chars to %s\n", total, pagePtr->webpageFilename );
+
+    addCount( count_bytes_out, total );
+
+    free( tempFilenamePtr );
+}
+
+/**
+ * void writeWebpageFile( struct Page *pagePtr )
+ * 
+ * Write the page out to the html file in the page's web page directory. The 
+ * page is written to a temporary file in the same directory, which is then 
+ * renamed over the html file, so that anything reading the html file sees 
+ * either the old page or the new one, never part of a page. When archiving, 
+ * the page goes into the archive instead. If asked, a page that is no 
+ * different from the html file, apart from the datetime, isn't written at all,
+ * so the html file keeps its modification time.
+ * 
+ * in       : pagePtr   -   the page being made
+ * out      : The web page file has been written.
+ * err      : assert if failed to make, write or rename the temporary file
+ */
+void writeWebpageFile( struct Page *pagePtr )
+{
+char            *tempFilenamePtr = NULL;
+int             webpageFD = -1;
+struct iovec    vectors[3];
+size_t          total = 0;
+
+    // The file has the name of the .md file but with a .html extension instead.
+
+    verbose("Using web page filename of %s\n", pagePtr->webpageFilename );
+
+    vectors[0].iov_base = pagePtr->head.dataPtr;
+    vectors[0].iov_len  = pagePtr->head.length;
+    vectors[1].iov_base = pagePtr->bodyPtr;
+    vectors[1].iov_len  = pagePtr->bodyLength;
+    vectors[2].iov_base = pagePtr->tail.dataPtr;
+    vectors[2].iov_len  = pagePtr->tail.length;
+
+    if( -1 != g_ArchiveFD )
+    {
+        writeArchiveEntry( pagePtr->webpageFilename, g_WebpageFileMode, g_ArchiveTime, vectors, 3 );
+        return;
+    }
+
+    if( pagePtr->optionsPtr->keepUnchanged && isWebpageUnchanged( pagePtr ) )
+    {
+        verbose( "Web page %s is unchanged, leaving it alone\n", pagePtr->webpageFilename );
+        return;
+    }
+
+    webpageFD = createWebpageFile( pagePtr, &tempFilenamePtr );
+
+    total += writeWebpageHead( pagePtr, webpageFD, &vectors[0] );
+    total += writeVectors( webpageFD, vectors, 3 );
+
+    finishWebpageFile( pagePtr, webpageFD, tempFilenamePtr, total );
+}
+
+/**
+ * uint64_t hashWebpage( struct Page *pagePtr )
+ * 
+ * Hash everything in a page but the datetime, which is different every run, so
+ * that a page whose content hasn't really changed has the same hash as it did
+ * last time. The whole page must be in memory, with no txt file to copy.
+ * 
+ * in       : pagePtr   -   the page, made but not necessarily written
+ * out      : the content hash of the page
+ * err      : none
+ */
+uint64_t hashWebpage( struct Page *pagePtr )
+{
+uint64_t    hash = HASH_SEED;
+size_t      datetimeEnd = pagePtr->datetimeOffset + pagePtr->datetimeLength;
+
+    hash = hashBytes( hash, pagePtr->head.dataPtr, pagePtr->datetimeOffset );
+    hash = hashBytes( hash, pagePtr->head.dataPtr + datetimeEnd, pagePtr->head.length - datetimeEnd );
+    hash = hashBytes( hash, pagePtr->bodyPtr, pagePtr->bodyLength );
+    hash = hashBytes( hash, pagePtr->tail.dataPtr, pagePtr->tail.length );
+
+    return( hash );
+}
+
+#endif
+
+/**
+ * bool isWholePageWanted( const struct Options *optionsPtr )
+ * 
+ * Work out whether pages must be made entirely in memory, rather than having 
+ * any txt file copied in by the kernel as they're written : they must be if 
+ * they're to be hashed, compressed, archived or served.
+ * 
+ * in       : optionsPtr    -   options for the run
+ * out      : true if the whole page is wanted in memory
+ * err      : none
+ */
+bool isWholePageWanted( const struct Options *optionsPtr )
+{
+    return( optionsPtr->keepUnchanged || optionsPtr->gzipOutput || optionsPtr->brotliOutput || ( NULL != optionsPtr->archiveFilename ) || optionsPtr->serveMode );
+}
+
+// Making a page into its html file and the command line's list of markdown
+// files, which the library doesn't do
+
+#ifndef WEBPAGE_LIBRARY
+
+/**
+ * bool isWebpageUnchanged( struct Page *pagePtr )
+ * 
+ * Work out whether a page is the same as its html file, leaving aside the 
+ * datetime. If the last run's manifest has the hash of the page's content, 
+ * the hashes are compared, and the html file only needs to be there. 
+ * Otherwise the html file is read and compared with the page, skipping over 
+ * its datetime line, which is wherever the page's is if nothing else has 
+ * changed.
+ * 
+ * in       : pagePtr   -   the page, made and hashed
+ * out      : true if the html file already has the page in it
+ * err      : none
+ */
+bool isWebpageUnchanged( struct Page *pagePtr )
+{
+struct stat webpageStat;
+int         webpageFD = -1;
+const char  *webpagePtr = MAP_FAILED;
+const char  *restPtr = NULL;
+size_t      datetimeEnd = pagePtr->datetimeOffset + pagePtr->datetimeLength;
+size_t      restLength = pagePtr->head.length - datetimeEnd + pagePtr->bodyLength + pagePtr->tail.length;
+bool        unchanged = false;
+
+    if( 0 != pagePtr->oldContentHash )
+    {
+        return( ( pagePtr->contentHash == pagePtr->oldContentHash ) && ( 0 == stat( pagePtr->webpageFilename, &webpageStat ) ) );
+    }
+
+    webpageFD = open( pagePtr->webpageFilename, O_RDONLY | O_CLOEXEC );
+
+    if( ( -1 == webpageFD ) || ( 0 != fstat( webpageFD, &webpageStat ) ) || ( (size_t)webpageStat.st_size < pagePtr->datetimeOffset ) || 
+        ( 0 == webpageStat.st_size ) || ( MAP_FAILED == ( webpagePtr = mmap( NULL, webpageStat.st_size, PROT_READ, MAP_PRIVATE, webpageFD, 0 ) ) ) )
+    {
+        if( -1 != webpageFD )
+        {
+            close( webpageFD );
+        }
+
+        return( false );
+    }
+
+    addCount( count_bytes_in, webpageStat.st_size );
+
+    restPtr = webpagePtr + pagePtr->datetimeOffset;
+
+    // the datetime comment is a line of its own
+
+    if( ( pagePtr->datetimeLength > 0 ) && ( NULL != ( restPtr = memchr( restPtr, '\n', webpagePtr + webpageStat.st_size - restPtr ) ) ) )
+    {
+        restPtr++;
+    }
+
+    unchanged = ( NULL != restPtr ) && ( (size_t)( webpagePtr + webpageStat.st_size - restPtr ) == restLength ) &&
+                ( 0 == memcmp( webpagePtr, pagePtr->head.dataPtr, pagePtr->datetimeOffset ) ) &&
+                ( 0 == memcmp( restPtr, pagePtr->head.dataPtr + datetimeEnd, pagePtr->head.length - datetimeEnd ) ) &&
+                ( 0 == memcmp( restPtr + pagePtr->head.length - datetimeEnd, pagePtr->bodyPtr, pagePtr->bodyLength ) ) &&
+                ( 0 == memcmp( webpagePtr + webpageStat.st_size - pagePtr->tail.length, pagePtr->tail.dataPtr, pagePtr->tail.length ) );
+
+    munmap( (void *)webpagePtr, webpageStat.st_size );
+
+    close( webpageFD );
+
+    return( unchanged );
+}
+
+/**
+ * bool isCompressedFileWanted( struct Page *pagePtr, const char *extensionPtr )
+ * 
+ * Work out whether a compressed copy of a page needs writing : it does unless
+ * the page's content hash is the same as in the last run's manifest, and the 
+ * compressed file is still there.
+ * 
+ * in       : pagePtr       -   the page, with its content hash
+ * in       : extensionPtr  -   extension added to the web page filename
+ * out      : true if the compressed file needs writing
+ * err      : none
+ */
+bool isCompressedFileWanted( struct Page *pagePtr, const char *extensionPtr )
+{
+char        *compressedFilenamePtr = NULL;
+struct stat compressedStat;
+
+    if( pagePtr->contentHash != pagePtr->oldContentHash )
+    {
+        return( true );
+    }
+
+    compressedFilenamePtr = printToArena( pagePtr->arenaPtr, "%s%s", pagePtr->webpageFilename, extensionPtr );
+
+    if( 0 != stat( compressedFilenamePtr, &compressedStat ) )
+    {
+        return( true );
+    }
+
+    verbose( "Content of %s is unchanged, keeping %s\n", pagePtr->webpageFilename, compressedFilenamePtr );
+
+    return( false );
+}
+
+/**
+ * void writeCompressedFile( struct Page *pagePtr, const char *extensionPtr, const void *dataPtr, size_t length )
+ * 
+ * Write a compressed copy of a page next to the html file, or into the 
+ * archive, in the same way as writeWebpageFile() writes the page itself.
+ * 
+ * in       : pagePtr       -   the page being made
+ * in       : extensionPtr  -   extension added to the web page filename
+ * in       : dataPtr       -   the compressed page
+ * in       : length        -   how long it is
+ * out      : The compressed file has been written.
+ * err      : assert if failed to make, write or rename the temporary file
+ */
+void writeCompressedFile( struct Page *pagePtr, const char *extensionPtr, const void *dataPtr, size_t length )
+{
+char            *compressedFilenamePtr = NULL;
+char            *tempFilenamePtr = NULL;
+int             compressedFD = -1;
+struct iovec    vector;
+size_t          total = 0;
+int             result;
+
+    compressedFilenamePtr   = printToArena( pagePtr->arenaPtr, "%s%s", pagePtr->webpageFilename, extensionPtr );
+    tempFilenamePtr         = printToArena( pagePtr->arenaPtr, "%s.%s.html%s.XXXXXX", pagePtr->webpageDirectory, pagePtr->rootFilename, extensionPtr );
+
+    vector.iov_base = (void *)dataPtr;
+    vector.iov_len  = length;
+
+    if( -1 != g_ArchiveFD )
+    {
+        writeArchiveEntry( compressedFilenamePtr, g_WebpageFileMode, g_ArchiveTime, &vector, 1 );
+        return;
+    }
+
+    compressedFD = mkstemp( tempFilenamePtr );
+
+    assert( -1 != compressedFD );
+
+    result = fchmod( compressedFD, g_WebpageFileMode );
+
+    assert( 0 == result );
+
+    total = writeVectors( compressedFD, &vector, 1 );
+
+    result = close( compressedFD );
+
+    assert( 0 == result );
+
+    result = rename( tempFilenamePtr, compressedFilenamePtr );
+
+    assert( 0 == result );
+
+    verbose( "Wrote %zu chars to %s\n", total, compressedFilenamePtr );
+
+    addCount( count_bytes_out, total );
+}
+
+/**
+ * void compressWebpage( struct Page *pagePtr )
+ * 
+ * Write gzip and brotli compressed copies of a page ( .html.gz and .html.br ) 
+ * from the page in memory, as the options ask, for a web server to serve as 
+ * they are. A copy is only written if the page's content has changed since 
+ * the last run, or the copy has gone. The compressed data comes from the 
+ * page's arena.
+ * 
+ * in       : pagePtr   -   the page, made, hashed and written
+ * out      : The compressed files are up to date.
+ * err      : assert if compression fails
+ */
+void compressWebpage( struct Page *pagePtr )
+{
+const char      *partPtrs[3] = { pagePtr->head.dataPtr, pagePtr->bodyPtr, pagePtr->tail.dataPtr };
+size_t          partLengths[3] = { pagePtr->head.length, pagePtr->bodyLength, pagePtr->tail.length };
+size_t          pageLength = partLengths[0] + partLengths[1] + partLengths[2];
+unsigned char   *compressedPtr = NULL;
+size_t          compressedLength = 0;
+int             part = 0;
+int             result = 0;
+
+    if( pagePtr->optionsPtr->gzipOutput && isCompressedFileWanted( pagePtr, ".gz" ) )
+    {
+    z_stream stream;
+
+        memset( &stream, 0, sizeof(stream) );
+
+        result = deflateInit2( &stream, GZIP_LEVEL, Z_DEFLATED, GZIP_WINDOW_BITS, GZIP_MEMORY_LEVEL, Z_DEFAULT_STRATEGY );
+
+        assert( Z_OK == result );
+
+        compressedLength    = deflateBound( &stream, pageLength );
+        compressedPtr       = (unsigned char *)allocateFromArena( pagePtr->arenaPtr, compressedLength );
+
+        stream.next_out     = compressedPtr;
+
+        // deflateBound() leaves room for everything, but zlib only takes in, 
+        // and gives out, 32 bits worth at a time, so a big part goes in in 
+        // chunks. deflate() won't take an empty part, except to finish.
+
+        for( part = 0; part < 3; part++ )
+        {
+        size_t remaining = partLengths[part];
+        bool   finish = false;
+
+            if( ( 0 == partLengths[part] ) && ( part < 2 ) )
+            {
+                continue;
+            }
+
+            stream.next_in = (unsigned char *)partPtrs[part];
+
+            do
+            {
+                stream.avail_in = ( remaining < DEFLATE_CHUNK_SIZE ) ? remaining : DEFLATE_CHUNK_SIZE;
+                remaining      -= stream.avail_in;
+                finish          = ( 2 == part ) && ( 0 == remaining );
+
+                do
+                {
+                    stream.avail_out = ( compressedLength - stream.total_out < DEFLATE_CHUNK_SIZE ) ? compressedLength - stream.total_out : DEFLATE_CHUNK_SIZE;
+
+                    result = deflate( &stream, finish ? Z_FINISH : Z_NO_FLUSH );
+
+                    assert( ( Z_OK == result ) || ( Z_STREAM_END == result ) );
+                }
+                while( ( 0 != stream.avail_in ) || ( finish && ( Z_STREAM_END != result ) ) );
+            }
+            while( 0 != remaining );
+        }
+
+        writeCompressedFile( pagePtr, ".gz", compressedPtr, stream.total_out );
+
+        deflateEnd( &stream );
+    }
+
+#ifdef WEBPAGE_BROTLI
+    if( pagePtr->optionsPtr->brotliOutput && isCompressedFileWanted( pagePtr, ".br" ) )
+    {
+    char *wholePagePtr = (char *)allocateFromArena( pagePtr->arenaPtr, pageLength );
+    char *endPtr = wholePagePtr;
+
+        // the one shot encoder wants the whole page in one piece
+
+        for( part = 0; part < 3; part++ )
+        {
+            memcpy( endPtr, partPtrs[part], partLengths[part] );
+            endPtr += partLengths[part];
+        }
+
+        compressedLength    = BrotliEncoderMaxCompressedSize( pageLength );
+        compressedPtr       = (unsigned char *)allocateFromArena( pagePtr->arenaPtr, compressedLength );
+
+        result = BrotliEncoderCompress( BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, 
+                                        pageLength, (const uint8_t *)wholePagePtr, &compressedLength, compressedPtr );
+
+        assert( BROTLI_TRUE == result );
+
+        writeCompressedFile( pagePtr, ".br", compressedPtr, compressedLength );
+    }
+#endif
+}
+
+/**
+ * bool isWebpageStreamed( struct Page *pagePtr )
+ * 
+ * Work out whether a page is to be streamed : rendered from its parsed markdown
+ * a block at a time, each block written to the html file and freed as soon as
+ * it's rendered, so that the page never has the whole tree and the whole html 
+ * in memory at once. A page is streamed if its markdown file is at least as 
+ * big as the 'stream-size' option, and nothing needs the whole page in memory.
+ * Its size is the one it was listed with, if the search of the markdown tree 
+ * listed it, so that no page needs a stat() of its own to tell.
+ * 
+ * in       : pagePtr   -   the page being made
+ * out      : true if the page is to be streamed
+ * err      : none
+ */
+bool isWebpageStreamed( struct Page *pagePtr )
+{
+struct stat         markdownStat;
+struct ListedFile   *listedPtr = NULL;
+
+    if( isWholePageWanted( pagePtr->optionsPtr ) || ( NULL != pagePtr->optionsPtr->cacheDirectory ) )
+    {
+        return( false );
+    }
+
+    if( g_FilesListed )
+    {
+        listedPtr = findListedFile( pagePtr->markdownFilename + strlen( g_Options.markdownRoot ) + 1 );
+
+        return( ( NULL != listedPtr ) && listedPtr->stamp.present && ( listedPtr->stamp.size >= pagePtr->optionsPtr->streamSize ) );
+    }
+
+    return( ( 0 == stat( pagePtr->markdownFilename, &markdownStat ) ) && 
+            S_ISREG( markdownStat.st_mode ) && ( markdownStat.st_size >= pagePtr->optionsPtr->streamSize ) );
+}
+
+/**
+ * void streamWebpage( struct Page *pagePtr )
+ * 
+ * Make a page whose head is done by streaming its body straight into the html
+ * file. The markdown is parsed as usual, then each top level block is unlinked
+ * from the tree, rendered, freed, and gathered with the blocks before it until
+ * there's enough to be worth writing. Rendering a block on its own gives the 
+ * same html as rendering it as part of the document, so the page is the same 
+ * as if it had been made in memory, but the most memory it takes is the tree, 
+ * what's left of it, and the largest block.
+ * 
+ * in       : pagePtr   -   the page being made, head added
+ * out      : Web page file has been written.
+ * err      : assert on failure to render, or to write the file
+ */
+void streamWebpage( struct Page *pagePtr )
+{
+cmark_node      *nodeTreePtr = NULL;
+cmark_node      *blockPtr = NULL;
+char            *renderBufferPtr = NULL;
+struct Buffer   stream = { NULL, 0, 0 };
+struct iovec    vectors[2];
+char            *tempFilenamePtr = NULL;
+int             webpageFD = -1;
+size_t          total = 0;
+uint64_t        startTime = 0;
+
+    verbose( "Streaming web page %s\n", pagePtr->webpageFilename );
+
+    appendString( &pagePtr->head, g_BodyOpenTag );
+    appendBuffer( &pagePtr->tail, pagePtr->contextPtr->bodyTail.dataPtr, pagePtr->contextPtr->bodyTail.length );
+    appendString( &pagePtr->tail, g_PageCloseTag );
+
+    startTime = startTiming();
+
+    nodeTreePtr = parseMarkdownFile( pagePtr );
+
+    endTiming( phase_parse, startTime );
+
+    if( pagePtr->optionsPtr->rewriteLinks )
+    {
+        startTime = startTiming();
+
+        rewriteMarkdownLinks( nodeTreePtr );
+
+        endTiming( phase_links, startTime );
+    }
+
+    if( isSiteIndexWanted() )
+    {
+        startTime = startTiming();
+
+        addIndexRecord( pagePtr, nodeTreePtr );
+
+        endTiming( phase_index, startTime );
+    }
+
+    startTime = startTiming();
+
+    webpageFD = createWebpageFile( pagePtr, &tempFilenamePtr );
+
+    total += writeWebpageHead( pagePtr, webpageFD, &vectors[0] );
+    total += writeVectors( webpageFD, vectors, 1 );
+
+    endTiming( phase_write, startTime );
+
+    while( NULL != ( blockPtr = cmark_node_first_child( nodeTreePtr ) ) )
+    {
+        startTime = startTiming();
+
+        cmark_node_unlink( blockPtr );
+
+        renderBufferPtr = cmark_render_html( blockPtr, CMARK_OPT_UNSAFE );
+
+        assert( renderBufferPtr );
+
+        cmark_node_free( blockPtr );
+
+        appendString( &stream, renderBufferPtr );
+
+        free( renderBufferPtr );
+
+        endTiming( phase_render, startTime );
+
+        if( stream.length >= STREAM_FLUSH_SIZE )
+        {
+            startTime = startTiming();
+
+            vectors[0].iov_base = stream.dataPtr;
+            vectors[0].iov_len  = stream.length;
+
+            total += writeVectors( webpageFD, vectors, 1 );
+
+            stream.length = 0;
+
+            endTiming( phase_write, startTime );
+        }
+    }
+
+    cmark_node_free( nodeTreePtr );
+
+    startTime = startTiming();
+
+    vectors[0].iov_base = stream.dataPtr;
+    vectors[0].iov_len  = stream.length;
+    vectors[1].iov_base = pagePtr->tail.dataPtr;
+    vectors[1].iov_len  = pagePtr->tail.length;
+
+    total += writeVectors( webpageFD, vectors, 2 );
+
+    finishWebpageFile( pagePtr, webpageFD, tempFilenamePtr, total );
+
+    endTiming( phase_write, startTime );
+
+    free( stream.dataPtr );
+}
+
+/**
+ * void makeWebpage( struct Page *pagePtr )
+ * 
+ * Put together the head and body information for the web page corresponding
+ * to the markdown file, and write it to the actual html file. 
+ * 
+ * in       : pagePtr   -   the page being made
+ * out      : Web page file has been written.
+ * err      : none
+ */
+void makeWebpage( struct Page *pagePtr )
+{
+uint64_t    startTime = 0;
+bool        rendered = false;
+
+    // The parts of the head shared by every page are made first
+
+    makeHeadFragments();
+
+    // A page big enough is streamed into its html file, after its head, and 
+    // so is done
+
+    pagePtr->streamed = isWebpageStreamed( pagePtr );
+
+    if( pagePtr->streamed )
+    {
+        addWebpageHead( pagePtr );
+        streamWebpage( pagePtr );
+        return;
+    }
+
+    // Otherwise the whole page is made in memory, as the library makes one
+
+    rendered = renderWebpage( pagePtr );
+
+    assert( rendered );
+
+    // Write the page out, unless it's no different
+
+    startTime = startTiming();
+
+    if( pagePtr->optionsPtr->keepUnchanged || pagePtr->optionsPtr->gzipOutput || pagePtr->optionsPtr->brotliOutput )
+    {
+        pagePtr->contentHash = hashWebpage( pagePtr );
+    }
+
+    writeWebpageFile( pagePtr );
+
+    endTiming( phase_write, startTime );
+
+    // and compressed copies of it, if wanted
+
+    if( pagePtr->optionsPtr->gzipOutput || pagePtr->optionsPtr->brotliOutput )
+    {
+        startTime = startTiming();
+
+        compressWebpage( pagePtr );
+
+        endTiming( phase_compress, startTime );
+    }
+}
+
+/**
+ * void printHelp( void )
+ * 
+ * Print help info.
+ * 
+ * in   :   none
+ * out  :   help info on stdout
+ * err  :   none
+ */
+void printHelp( void )
+{
+    printf( "Usage: webpage [-h] [-v] [--trace <file>] [-0] [--gzip] [--brotli] [--keep-unchanged] [--cache[=<dir>]] [--stream-size <size>] [-l] [-j <jobs>] [--mem-budget <size>] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] <markdown file>...\n" );
+    printf( "       webpage --site [-v] [--trace <file>] [--force] [--assets <how>] [--gzip] [--brotli] [--keep-unchanged] [--cache[=<dir>]] [--stream-size <size>] [-l] [-j <jobs>] [--mem-budget <size>] [--io-uring] [--shard <i>/<N>] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] [--sitemap <base url>] [--search-index] <markdown root> <html root>\n" );
+    printf( "       webpage --merge [-v] [--trace <file>] [--assets <how>] [-T <stats file>] [-c <abs path to html root>] [--sitemap <base url>] [--search-index] <markdown root> <html root>\n" );
+    printf( "       webpage --watch [-v] [--trace <file>] [--force] [--assets <how>] [--gzip] [--brotli] [--keep-unchanged] [--cache[=<dir>]] [--stream-size <size>] [-l] [-j <jobs>] [--mem-budget <size>] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] [--sitemap <base url>] [--search-index] <markdown root> <html root>\n" );
+    printf( "       webpage --archive <archive file> [-v] [--trace <file>] [--assets <how>] [--gzip] [--brotli] [--cache[=<dir>]] [-l] [-j <jobs>] [--mem-budget <size>] [--io-uring] [-T <stats file>] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] [--sitemap <base url>] [--search-index] <markdown root>\n" );
+    printf( "       webpage --serve [-v] [--trace <file>] [--listen [<address>:]<port>] [--serve-cache <size>] [--cache[=<dir>]] [-l] [-f <flags> ] [-c <abs path to html root>] [-n navembedcode] [--head-partial <file>] [--body-partial <file>] <markdown root>\n\n" );
+
+    printf( "Broadly speaking, the expectation is that this tool will be used as part of a script that\n" );
+    printf( "traverses a directory hierarchy containing md files and converts them to html. In particular,\n" );
+    printf( "it's expected that the markdown file resides in the current working directory, and that this\n" );
+    printf( "directory is underneath html root ( yes, html root not markdown root ).\n\n"); 
+
+    printf( " -h                        : print this help\n" );
+    printf( " -v                        : output verbose information\n" );
+    printf( " --trace <file>            : keep a trace of each thread in memory, and add it to <file> on\n" );
+    printf( "                             SIGUSR1 or a crash\n" );
+    printf( " -0                        : markdown file names read from stdin are NUL separated\n" );
+    printf( " -l                        : rewrite links to local .md files as links to .html files\n" );
+    printf( " -j <jobs>                 : make up to <jobs> web pages at once, using a thread each\n" );
+    printf( " --mem-budget <size>       : with -j, only start a page when what the pages being made are\n" );
+    printf( "                             expected to need stays within <size> ( bytes, or K, M or G )\n" );
+    printf( " --io-uring                : in site mode, read the markdown for a thread's next page while\n" );
+    printf( "                             it makes this one, if webpage was built with io_uring\n" );
+    printf( " --gzip                    : also write each web page gzip compressed, as .html.gz\n" );
+    printf( " --brotli                  : also write each web page brotli compressed, as .html.br, if\n" );
+    printf( "                             webpage was built with libbrotlienc\n" );
+    printf( " --keep-unchanged          : don't write a web page over an html file that is the same but\n" );
+    printf( "                             for the datetime, so it keeps its modification time\n" );
+    printf( " --cache[=<dir>]           : keep the html rendered from each md file in <dir>, by default\n" );
+    printf( "                             $XDG_CACHE_HOME/webpage, and use it instead of rendering again\n" );
+    printf( " --stream-size <size>      : render the body of any md file of <size> or more ( bytes, or K, M\n" );
+    printf( "                             or G ) a block at a time, straight into the html file ( 64M )\n" );
+    printf( " -T <stats file>           : write timings and counts for the run, and for each page, to\n" );
+    printf( "                             <stats file> as JSON ( '-' for stdout )\n" );
+    printf( " -f <flags>                : <flags> are bitwise as follows -\n" );
+    printf( "                           : 0x01 - omit DOCTYPE \n" );
+    printf( "                           : 0x02 - omit title \n" );
+    printf( "                           : 0x04 - omit datetime\n" );
+    printf( "                           : 0x08 - omit author\n" );
+    printf( " -c <abs path to html root>: Enables linking to css file. File linked will be first found\n" );
+    printf( "                             searching from cwd towards html root. NB Requires an absolute,\n" );
+    printf( "                             not relative, path.\n" );
+    printf( " -n <navembedcode>         : Provide for ability to tack a special embedding on to the body for\n" );
+    printf( "                             navigation purposes. -n @<file> reads the embedding from <file>.\n" );
+    printf( " --head-partial <file>     : add the html in <file> to the head of every page\n" );
+    printf( " --body-partial <file>     : add the html in <file> to the end of the body of every page\n" );
+    printf( " <markdown file>...        : File(s) containing Commonmark markdown. Each file is processed as\n" );
+    printf( "                             if webpage had been invoked in the directory containing it. If the\n" );
+    printf( "                             only file given is '-', file names are read from stdin.\n");
+    printf( " --site                    : Site mode. Make a web page in <html root> for every md file found\n" );
+    printf( "                             under <markdown root>, in the corresponding directory. The css\n" );
+    printf( "                             search is made in the markdown tree, and stops at <markdown root>.\n" );
+    printf( "                             Only web pages whose inputs have changed since the last run ( as\n" );
+    printf( "                             recorded in <html root>/.webpage_manifest ) are made again.\n" );
+    printf( " --force                   : Site mode. Make every web page, whether or not it has changed.\n" );
+    printf( " --assets <how>            : Site mode. Mirror every other file under <markdown root> ( not md,\n" );
+    printf( "                             txt, backup or hidden files ) into <html root>, where <how> is\n" );
+    printf( "                             link, reflink, copy or none ( the default ).\n" );
+    printf( " --watch                   : Watch mode. As site mode, then keep watching <markdown root> and\n" );
+    printf( "                             make again every web page whose md file, txt file or css file found\n" );
+    printf( "                             changes, and mirror any assets again, until interrupted. Any stats\n" );
+    printf( "                             report covers the first run.\n" );
+    printf( " --archive <archive file>  : Archive mode. As site mode, but every web page, and every asset, is\n" );
+    printf( "                             written to <archive file> as a tar archive ( '-' for stdout ),\n" );
+    printf( "                             instead of into an html root.\n" );
+    printf( " --sitemap <base url>      : Site mode. Write <html root>/sitemap.xml, with the url of every web\n" );
+    printf( "                             page under <base url>.\n" );
+    printf( " --search-index            : Site mode. Write <html root>/search_index.json, with the url, title,\n" );
+    printf( "                             headings, links and words of every web page.\n" );
+    printf( " --shard <i>/<N>           : Site mode. Make only the <i>th of <N> parts of the site, and write\n" );
+    printf( "                             its part of the manifest for --merge. Every shard still lists,\n" );
+    printf( "                             and stats, the whole markdown tree, to make the same cut.\n" );
+    printf( " --merge                   : Merge mode. Put the parts of the manifest written by each --shard\n" );
+    printf( "                             together, and remove web pages and assets that have gone. Give\n" );
+    printf( "                             it the same --assets as the shards.\n" );
+    printf( " --serve                   : Serve mode. Make the web page for each md file under <markdown root>\n" );
+    printf( "                             as it is asked for over HTTP, and send other files as they are.\n" );
+    printf( "                             Pages are kept until their md, txt or css file changes.\n" );
+    printf( " --listen [<addr>:]<port>  : Serve mode. Listen on <addr> ( every address if empty ) and <port>,\n" );
+    printf( "                             rather than 127.0.0.1:8080.\n" );
+    printf( " --serve-cache <size>      : Serve mode. Keep up to <size> ( bytes, or K, M or G ) of web pages\n" );
+    printf( "                             in memory ( 64M ).\n\n" );
+}
+
+/**
+ * void addMarkdownFilename( const char *filenamePtr )
+ * 
+ * Add a markdown file to the list of files to be processed by this run.
+ * 
+ * in       : filenamePtr   -   name of the markdown file
+ * out      : g_MarkdownFilenameList has grown by one
+ * err      : assert if failed to allocate the list or the filename
+ */
+void addMarkdownFilename( const char *filenamePtr )
+{
+    g_MarkdownFilenameList = (char **)realloc( g_MarkdownFilenameList, ( g_MarkdownFilenameCount + 1 ) * sizeof(char *) );
+
+    assert( g_MarkdownFilenameList );
+
+    g_MarkdownFilenameList[g_MarkdownFilenameCount] = strdup( filenamePtr );
+
+    assert( g_MarkdownFilenameList[g_MarkdownFilenameCount] );
+
+    g_MarkdownFilenameCount++;
+}
+
+/**
+ * void readMarkdownFilenames( FILE *listFilePtr )
+ * 
+ * Read markdown filenames, one per line or NUL separated according to the '0'
+ * option, and add them to the list of files to be processed. Empty entries are
+ * ignored, so a trailing separator does no harm.
+ * 
+ * in       : listFilePtr   -   FILE pointer to the list of filenames
+ * out      : g_MarkdownFilenameList contains the filenames read
+ * err      : none
+ */
+void readMarkdownFilenames( FILE *listFilePtr )
+{
+char    *linePtr = NULL;
+size_t  lineSize = 0;
+ssize_t lineLength = 0;
+int     separator = g_Options.nulSeparatedList ? '\0' : '\n';
+
+    while( -1 != ( lineLength = getdelim( &linePtr, &lineSize, separator, listFilePtr ) ) )
+    {
+        if( ( lineLength > 0 ) && ( separator == linePtr[lineLength - 1] ) )
+        {
+            linePtr[--lineLength] = '\0';
+        }
+
+        if( lineLength > 0 )
+        {
+            verbose( "Read markdown filename %s\n", linePtr );
+            addMarkdownFilename( linePtr );
+        }
+    }
+
+    free( linePtr );
+}
+
+#endif
+
+/**
+ * char *makePathname( const char *prefixPtr, const char *namePtr, size_t nameLength )
+ * 
+ * Make a new string from the prefix followed by the first nameLength characters
+ * of the name. The caller owns the result.
+ * 
+ * in       : prefixPtr     -   leading part of the path, may be empty
+ * in       : namePtr       -   trailing part of the path
+ * in       : nameLength    -   number of characters of namePtr to use
+ * out      : the new string
+ * err      : assert if failed to allocate the new string
+ */
+char *makePathname( const char *prefixPtr, const char *namePtr, size_t nameLength )
+{
+size_t  prefixLength = strlen( prefixPtr );
+char    *pathnamePtr = (char *)malloc( prefixLength + nameLength + 1 );
+
+    assert( pathnamePtr );
+
+    memcpy( pathnamePtr, prefixPtr, prefixLength );
+    memcpy( pathnamePtr + prefixLength, namePtr, nameLength );
+    pathnamePtr[prefixLength + nameLength] = '\0';
+
+    return( pathnamePtr );
+}
+
+// Finding the markdown and asset files, and setting up a page for one, which
+// the library doesn't do
+
+#ifndef WEBPAGE_LIBRARY
+
+/**
+ * bool isAssetFilename( const char *filenamePtr )
+ * 
+ * Site mode : work out whether a file found in the markdown tree is an asset,
+ * to be mirrored as it is into the html root. That is anything but the md, txt
+ * and backup files that web pages are made from, and hidden files.
+ * 
+ * in       : filenamePtr   -   name of the file, without its directory
+ * out      : true if the file is an asset
+ * err      : none
+ */
+bool isAssetFilename( const char *filenamePtr )
+{
+const char  *extensionPtr = strrchr( filenamePtr, '.' );
+
+    if( '.' == filenamePtr[0] )
+    {
+        return( false );
+    }
+
+    return( ( NULL == extensionPtr ) || ( ( 0 != strcmp( ".md", extensionPtr ) ) && 
+                                          ( 0 != strcmp( ".txt", extensionPtr ) ) && 
+                                          ( 0 != strcmp( ".backup", extensionPtr ) ) ) );
+}
+
+/**
+ * void addAssetFilename( const char *filenamePtr )
+ * 
+ * Add an asset to the list to be mirrored by this run.
+ * 
+ * in       : filenamePtr   -   name of the asset, relative to the markdown root
+ * out      : g_AssetPtr has grown by one, not stamped yet
+ * err      : assert if failed to allocate the list or the filename
+ */
+void addAssetFilename( const char *filenamePtr )
+{
+    g_AssetPtr = (struct AssetEntry *)realloc( g_AssetPtr, ( g_AssetCount + 1 ) * sizeof(struct AssetEntry) );
+
+    assert( g_AssetPtr );
+
+    memset( &g_AssetPtr[g_AssetCount], 0, sizeof(struct AssetEntry) );
+
+    g_AssetPtr[g_AssetCount].filename = strdup( filenamePtr );
+
+    assert( g_AssetPtr[g_AssetCount].filename );
+
+    g_AssetCount++;
+}
+
+/**
+ * void findMarkdownFiles( const char *relativeDirPtr, void (*foundFilePtr)( const char *filenamePtr ), void (*foundAssetPtr)( const char *filenamePtr ) )
+ * 
+ * Site mode : walk the markdown tree below the given directory, passing every
+ * .md file found on, and every asset too if asked, and making sure that each 
+ * directory also exists under the html root, if there is one. Symbolic links 
+ * to directories are not followed, as 'find' would not follow them either. In
+ * watch mode, each directory is watched before it is read, so nothing added 
+ * to it afterwards is missed, and a directory that has gone by the time it is
+ * reached is just skipped.
+ * 
+ * Each directory is only read here, once. What else the pages need to know 
+ * about it is noted as it is read : its css file, if css is being linked, goes
+ * into the css cache, and its markdown and txt files go into the file listing,
+ * so that making a page doesn't look at the directory again, or for a txt file
+ * that isn't there.
+ * 
+ * in       : relativeDirPtr    -   directory relative to the markdown root, 
+ *                                  either empty or ending in '/'
+ * in       : foundFilePtr      -   called with each .md file found, relative 
+ *                                  to the markdown root
+ * in       : foundAssetPtr     -   called likewise with each asset found, or 
+ *                                  NULL if assets are not wanted
+ * out      : every .md file found has been passed on
+ * err      : exit if a directory cannot be read
+ * err      : exit if a directory cannot be made under the html root
+ */
+void findMarkdownFiles( const char *relativeDirPtr, void (*foundFilePtr)( const char *filenamePtr ), void (*foundAssetPtr)( const char *filenamePtr ) )
+{
+DIR             *dirPtr;
+struct dirent   *contentPtr;
+char            path[PATH_MAX + 1];
+struct stat     contentStat;
+struct stat     directoryStat;
+size_t          nameLength;
+bool            isDirectory;
+char            *cssNamePtr = NULL;
+int             result = 0;
+
+    snprintf( path, sizeof(path), "%s/%s", g_Options.markdownRoot, relativeDirPtr );
+
+    verbose( "Searching %s for markdown...\n", path );
+
+    dirPtr = opendir( path );
+
+    addCount( count_opendir, 1 );
+
+    if( ( NULL == dirPtr ) && ( ENOENT == errno ) && ( -1 != g_WatchFD ) )
+    {
+        verbose( "Markdown directory %s has gone\n", path );
+        return;
+    }
+
+    if( NULL == dirPtr )
+    {
+        printf( "Cannot read markdown directory %s\n", path );
+        exit( EXIT_BAD_SITE_ROOT );
+    }
+
+    if( ( -1 != g_WatchFD ) && !watchDirectory( relativeDirPtr, path ) )
+    {
+        closedir( dirPtr );
+        return;
+    }
+
+    if( NULL != g_Options.cssRoot )
+    {
+        // as for resolveCssDirectory(), the time is taken before the directory 
+        // is read
+
+        result = fstat( dirfd( dirPtr ), &directoryStat );
+
+        assert( 0 == result );
+    }
+
+    while( NULL != ( contentPtr = readdir( dirPtr ) ) )
+    {
+        if( ( NULL != g_Options.cssRoot ) && ( NULL == cssNamePtr ) && ( NULL != strstr( contentPtr->d_name, ".css" ) ) )
+        {
+            cssNamePtr = strdup( contentPtr->d_name );
+
+            assert( cssNamePtr );
+        }
+
+        if( ( 0 == strcmp( ".", contentPtr->d_name ) ) || ( 0 == strcmp( "..", contentPtr->d_name ) ) )
+        {
+            continue;
+        }
+
+        isDirectory = ( DT_DIR == contentPtr->d_type );
+
+        if( DT_UNKNOWN == contentPtr->d_type )
+        {
+            // Not every filesystem fills in d_type
+
+            snprintf( path, sizeof(path), "%s/%s%s", g_Options.markdownRoot, relativeDirPtr, contentPtr->d_name );
+
+            isDirectory = ( 0 == lstat( path, &contentStat ) ) && S_ISDIR( contentStat.st_mode );
+        }
+
+        if( isDirectory )
+        {
+        char *subdirPtr = NULL;
+
+            snprintf( path, sizeof(path), "%s/%s%s", g_Options.webpageRoot, relativeDirPtr, contentPtr->d_name );
+
+            if( ( NULL != g_Options.webpageRoot ) && ( 0 != mkdir( path, 0777 ) ) && ( EEXIST != errno ) )
+            {
+                printf( "Cannot make html directory %s\n", path );
+                exit( EXIT_BAD_SITE_ROOT );
+            }
+
+            snprintf( path, sizeof(path), "%s%s/", relativeDirPtr, contentPtr->d_name );
+
+            subdirPtr = strdup( path );
+
+            assert( subdirPtr );
+
+            findMarkdownFiles( subdirPtr, foundFilePtr, foundAssetPtr );
+
+            free( subdirPtr );
+        }
+        else
+        {
+            nameLength = strlen( contentPtr->d_name );
+
+            if( ( nameLength > strlen( ".md" ) ) && ( 0 == strcmp( ".md", contentPtr->d_name + nameLength - strlen( ".md" ) ) ) )
+            {
+                snprintf( path, sizeof(path), "%s%s", relativeDirPtr, contentPtr->d_name );
+
+                listFile( dirfd( dirPtr ), contentPtr->d_name, path );
+
+                foundFilePtr( path );
+            }
+            else if( ( nameLength > strlen( ".txt" ) ) && ( 0 == strcmp( ".txt", contentPtr->d_name + nameLength - strlen( ".txt" ) ) ) )
+            {
+                snprintf( path, sizeof(path), "%s%s", relativeDirPtr, contentPtr->d_name );
+
+                listFile( dirfd( dirPtr ), contentPtr->d_name, path );
+            }
+            else if( ( NULL != foundAssetPtr ) && isAssetFilename( contentPtr->d_name ) )
+            {
+                snprintf( path, sizeof(path), "%s%s", relativeDirPtr, contentPtr->d_name );
+
+                foundAssetPtr( path );
+            }
+        }
+    }
+
+    closedir( dirPtr );
+
+    if( NULL != g_Options.cssRoot )
+    {
+        listMarkdownDirectory( relativeDirPtr, &directoryStat, cssNamePtr );
+    }
+
+    free( cssNamePtr );
+}
+
+/**
+ * void listMarkdownDirectory( const char *relativeDirPtr, const struct stat *directoryStatPtr, const char *cssNamePtr )
+ * 
+ * Site mode : a markdown directory has just been read, so put what was found 
+ * in it into the css cache, under its canonical name and the name its pages 
+ * give it, so that finding the css for those pages needn't look at it again. 
+ * A directory already resolved, by an earlier round in watch mode, is left as
+ * it is.
+ * 
+ * in       : relativeDirPtr    -   directory relative to the markdown root, 
+ *                                  either empty or ending in '/'
+ * in       : directoryStatPtr  -   the directory, as it was before it was read
+ * in       : cssNamePtr        -   first css file in the directory, or NULL
+ * out      : the directory's css cache entry is known and listed
+ * err      : assert if failed to allocate a name
+ */
+void listMarkdownDirectory( const char *relativeDirPtr, const struct stat *directoryStatPtr, const char *cssNamePtr )
+{
+struct CssDirectory *givenPtr = NULL;
+struct CssDirectory *entryPtr = NULL;
+char                givenName[PATH_MAX + 1];
+char                canonicalName[PATH_MAX + 1];
+size_t              length = strlen( relativeDirPtr );
+
+    // the markdown root is canonical, and symbolic links aren't followed, so 
+    // the rest of the name is too
+
+    snprintf( givenName, sizeof(givenName), "%s/%s", g_Options.markdownRoot, relativeDirPtr );
+    snprintf( canonicalName, sizeof(canonicalName), "%s%s%.*s", g_Options.markdownRoot, ( 0 == length ) ? "" : "/", 
+              (int)( ( 0 == length ) ? 0 : length - 1 ), relativeDirPtr );
+
+    pthread_mutex_lock( &g_CssDirectoryMutex );
+
+    givenPtr = findCssDirectory( givenName );
+
+    if( NULL == givenPtr->canonicalNamePtr )
+    {
+        givenPtr->canonicalNamePtr = strdup( canonicalName );
+
+        assert( givenPtr->canonicalNamePtr );
+    }
+
+    entryPtr = findCssDirectory( canonicalName );
+
+    if( !entryPtr->resolved )
+    {
+        free( entryPtr->cssNamePtr );
+
+        entryPtr->cssNamePtr        = ( NULL == cssNamePtr ) ? NULL : strdup( cssNamePtr );
+        entryPtr->parentLevels      = 0;
+        entryPtr->mtimeSeconds      = ( directoryStatPtr->st_mtim.tv_sec < ( time( NULL ) - 1 ) ) ? directoryStatPtr->st_mtim.tv_sec : 0;
+        entryPtr->mtimeNanoseconds  = ( 0 != entryPtr->mtimeSeconds ) ? directoryStatPtr->st_mtim.tv_nsec : 0;
+        entryPtr->known             = true;
+        entryPtr->listed            = true;
+
+        assert( ( NULL == cssNamePtr ) || ( NULL != entryPtr->cssNamePtr ) );
+    }
+
+    pthread_mutex_unlock( &g_CssDirectoryMutex );
+}
+
+/**
+ * void listFile( int directoryFD, const char *namePtr, const char *filenamePtr )
+ * 
+ * Site mode : stamp a markdown or txt file found by the search of the markdown
+ * tree, and put it in the file listing, or update it there if it's listed 
+ * already, from an earlier search in watch mode. Must not be called while 
+ * pages are being made.
+ * 
+ * in       : directoryFD   -   the directory being read
+ * in       : namePtr       -   name of the file in the directory
+ * in       : filenamePtr   -   filename relative to the markdown root
+ * out      : g_ListedFilePtrs has the file
+ * err      : assert if failed to allocate the entry
+ */
+void listFile( int directoryFD, const char *namePtr, const char *filenamePtr )
+{
+uint64_t            bucket = hashBytes( HASH_SEED, filenamePtr, strlen( filenamePtr ) ) % LISTED_FILE_BUCKETS;
+struct ListedFile   *entryPtr = findListedFile( filenamePtr );
+struct stat         fileStat;
+
+    if( NULL == entryPtr )
+    {
+        entryPtr = (struct ListedFile *)malloc( sizeof(struct ListedFile) );
+
+        assert( entryPtr );
+
+        entryPtr->filename  = strdup( filenamePtr );
+        entryPtr->nextPtr   = g_ListedFilePtrs[bucket];
+
+        assert( entryPtr->filename );
+
+        g_ListedFilePtrs[bucket] = entryPtr;
+    }
+
+    memset( &entryPtr->stamp, 0, sizeof(struct FileStamp) );
+
+    // as stampFile() would, following any symbolic link
+
+    if( 0 == fstatat( directoryFD, namePtr, &fileStat, 0 ) )
+    {
+        entryPtr->stamp.present             = true;
+        entryPtr->stamp.mtimeSeconds        = fileStat.st_mtim.tv_sec;
+        entryPtr->stamp.mtimeNanoseconds    = fileStat.st_mtim.tv_nsec;
+        entryPtr->stamp.size                = fileStat.st_size;
+        entryPtr->stamp.device              = fileStat.st_dev;
+        entryPtr->stamp.inode               = fileStat.st_ino;
+    }
+}
+
+/**
+ * struct ListedFile *findListedFile( const char *filenamePtr )
+ * 
+ * Site mode : find a file in the listing made by the search of the markdown 
+ * tree.
+ * 
+ * in       : filenamePtr   -   filename relative to the markdown root
+ * out      : the file's listing entry, else NULL if it wasn't found
+ * err      : none
+ */
+struct ListedFile *findListedFile( const char *filenamePtr )
+{
+uint64_t            bucket = hashBytes( HASH_SEED, filenamePtr, strlen( filenamePtr ) ) % LISTED_FILE_BUCKETS;
+struct ListedFile   *entryPtr = g_ListedFilePtrs[bucket];
+
+    while( ( NULL != entryPtr ) && ( 0 != strcmp( entryPtr->filename, filenamePtr ) ) )
+    {
+        entryPtr = entryPtr->nextPtr;
+    }
+
+    return( entryPtr );
+}
+
+/**
+ * void initPage( struct Page *pagePtr, struct Arena *arenaPtr, const char *filenamePtr )
+ * 
+ * Set up a page to be made from the supplied markdown file, and work out the 
+ * names derived from it. The directory part of the name ( including the 
+ * trailing '/' ) is kept separately, so that the root filename used for the 
+ * title is the same as it would be if webpage had been run in that directory.
+ * 
+ * In site mode, the markdown filename is relative to the markdown root, and the
+ * web page goes in the corresponding directory under the html root, or is 
+ * named relative to the top of the archive when archiving. The css search is
+ * made in the markdown tree, so it stops at the markdown root.
+ * 
+ * in       : pagePtr       -   the page to be set up
+ * in       : arenaPtr      -   arena for everything belonging to the page
+ * in       : filenamePtr   -   name of the markdown file
+ * out      : pagePtr names set, no web page file yet
+ * err      : assert if failed to allocate filenames
+ */
+void initPage( struct Page *pagePtr, struct Arena *arenaPtr, const char *filenamePtr )
+{
+char    *basenamePtr = NULL;
+char    *extensionPtr = NULL;
+char    *markdownPrefixPtr = "";
+char    *webpagePrefixPtr = "";
+int     directoryLength = 0;
+
+    memset( pagePtr, 0, sizeof(struct Page) );
+
+    pagePtr->txtFD      = -1;
+    pagePtr->optionsPtr = &g_Options;
+    pagePtr->contextPtr = &g_Context;
+    pagePtr->arenaPtr   = arenaPtr;
+    pagePtr->cssRoot    = g_Options.cssRoot;
+
+    if( g_Options.siteMode )
+    {
+        markdownPrefixPtr   = printToArena( arenaPtr, "%s/", g_Options.markdownRoot );
+        webpagePrefixPtr    = ( NULL == g_Options.webpageRoot ) ? "" : printToArena( arenaPtr, "%s/", g_Options.webpageRoot );
+
+        if( NULL != g_Options.cssRoot )
+        {
+            pagePtr->cssRoot = g_Options.markdownRoot;
+        }
+    }
+
+    basenamePtr = strrchr( filenamePtr, '/' );
+    basenamePtr = ( NULL == basenamePtr ) ? (char *)filenamePtr : basenamePtr + 1;
+
+    directoryLength = basenamePtr - filenamePtr;
+
+    pagePtr->markdownFilename   = printToArena( arenaPtr, "%s%s", markdownPrefixPtr, filenamePtr );
+    pagePtr->markdownDirectory  = printToArena( arenaPtr, "%s%.*s", markdownPrefixPtr, directoryLength, filenamePtr );
+    pagePtr->webpageDirectory   = printToArena( arenaPtr, "%s%.*s", webpagePrefixPtr, directoryLength, filenamePtr );
+
+    verbose( "Using %s as markdown filename\n", pagePtr->markdownFilename );
+
+    // Extract the root of the md filename ( i.e. filename without extension )
+
+    pagePtr->rootFilename = printToArena( arenaPtr, "%s", basenamePtr );
+    
+    // Use the part of the md filename before any extension. Don't assume there's a .md extension.
+    extensionPtr = strrchr(pagePtr->rootFilename, '.');
+
+    if( NULL != extensionPtr )
+    {
+        *extensionPtr = '\0';
+    }
+ 
+    verbose( "Root filename is %s\n", pagePtr->rootFilename );
+
+    // The html and txt files are named after the root filename
+
+    pagePtr->webpageFilename    = printToArena( arenaPtr, "%s%s.html", pagePtr->webpageDirectory, pagePtr->rootFilename );
+    pagePtr->txtFilename        = printToArena( arenaPtr, "%s%s.txt", pagePtr->markdownDirectory, pagePtr->rootFilename );
+
+    // no need to look for a txt file the search didn't find
+
+    if( g_FilesListed && ( NULL == findListedFile( pagePtr->txtFilename + strlen( markdownPrefixPtr ) ) ) )
+    {
+        verbose( "Txt file %s not listed\n", pagePtr->txtFilename );
+
+        pagePtr->txtFilename = NULL;
+    }
+}
+
+/**
+ * void freePage( struct Page *pagePtr )
+ * 
+ * Release the buffers belonging to a page that has been made. Everything
+ * else the page has is in its arena, which is reset separately.
+ * 
+ * in       : pagePtr   -   the page that has been made
+ * out      : pagePtr buffers freed, and everything NULL
+ * err      : none
+ */
+void freePage( struct Page *pagePtr )
+{
+    free( pagePtr->head.dataPtr );
+    free( pagePtr->tail.dataPtr );
+    free( pagePtr->indexRecord.dataPtr );
+
+    if( -1 != pagePtr->txtFD )
+    {
+        close( pagePtr->txtFD );
+    }
+
+    memset( pagePtr, 0, sizeof(struct Page) );
+}
+
+#endif
+
+/**
+ * uint64_t hashBytes( uint64_t hash, const void *bytesPtr, size_t length )
+ * 
+ * Add some bytes to an FNV-1a hash. Start with HASH_SEED.
+ * 
+ * in       : hash      -   hash of everything so far
+ * in       : bytesPtr  -   bytes to be added
+ * in       : length    -   number of bytes to be added
+ * out      : the new hash
+ * err      : none
+ */
+uint64_t hashBytes( uint64_t hash, const void *bytesPtr, size_t length )
+{
+const unsigned char *bytePtr = (const unsigned char *)bytesPtr;
+
+    while( length-- )
+    {
+        hash ^= *bytePtr++;
+        hash *= HASH_PRIME;
+    }
+
+    return( hash );
+}
+
+// Site, batch, watch and serve modes, and the command line options, none of
+// which are in the library
+
+#ifndef WEBPAGE_LIBRARY
+
+/**
+ * bool hashFile( const char *filenamePtr, uint64_t *hashPtr )
+ * 
+ * Work out the hash of the whole content of a file.
+ * 
+ * in       : filenamePtr   -   name of the file
+ * out      : *hashPtr      -   hash of the file content
+ * out      : true if the file could be read
+ * err      : none
+ */
+bool hashFile( const char *filenamePtr, uint64_t *hashPtr )
+{
+FILE    *filePtr = fopen( filenamePtr, "r" );
+char    readBuffer[65536];
+size_t  bytesRead = 0;
+
+    if( NULL == filePtr )
+    {
+        return( false );
+    }
+
+    *hashPtr = HASH_SEED;
+
+    while( 0 < ( bytesRead = fread( readBuffer, sizeof(char), sizeof(readBuffer), filePtr ) ) )
+    {
+        *hashPtr = hashBytes( *hashPtr, readBuffer, bytesRead );
+    }
+
+    fclose( filePtr );
+
+    return( true );
+}
+
+/**
+ * void stampFile( const char *filenamePtr, struct FileStamp *stampPtr )
+ * 
+ * Record the modification time and size of a file, if it's there. 
+ * 
+ * in       : filenamePtr   -   name of the file, or NULL if there's none
+ * out      : *stampPtr     -   stamp for the file, not yet hashed
+ * err      : none
+ */
+void stampFile( const char *filenamePtr, struct FileStamp *stampPtr )
+{
+struct stat fileStat;
+
+    memset( stampPtr, 0, sizeof(struct FileStamp) );
+
+    if( ( NULL != filenamePtr ) && ( 0 == stat( filenamePtr, &fileStat ) ) )
+    {
+        stampPtr->present           = true;
+        stampPtr->mtimeSeconds      = fileStat.st_mtim.tv_sec;
+        stampPtr->mtimeNanoseconds  = fileStat.st_mtim.tv_nsec;
+        stampPtr->size              = fileStat.st_size;
+        stampPtr->device            = fileStat.st_dev;
+        stampPtr->inode             = fileStat.st_ino;
+    }
+}
+
+/**
+ * void stampInputFile( const char *filenamePtr, struct FileStamp *stampPtr )
+ * 
+ * Site mode : stamp a page's markdown or txt file. If the listing made by the 
+ * search of the markdown tree stands for the run, the file's stamp is the one
+ * it was found with, and a file that isn't listed isn't there.
+ * 
+ * in       : filenamePtr   -   name of the file, under the markdown root, or 
+ *                              NULL if there's none
+ * out      : *stampPtr     -   stamp for the file, not yet hashed
+ * err      : none
+ */
+void stampInputFile( const char *filenamePtr, struct FileStamp *stampPtr )
+{
+struct ListedFile   *entryPtr = NULL;
+
+    if( !g_FilesListed || ( NULL == filenamePtr ) )
+    {
+        stampFile( filenamePtr, stampPtr );
+        return;
+    }
+
+    entryPtr = findListedFile( filenamePtr + strlen( g_Options.markdownRoot ) + 1 );
+
+    if( NULL == entryPtr )
+    {
+        memset( stampPtr, 0, sizeof(struct FileStamp) );
+    }
+    else
+    {
+        *stampPtr = entryPtr->stamp;
+    }
+}
+
+/**
+ * bool isSameFile( const char *filenamePtr, struct FileStamp *newStampPtr, const struct FileStamp *oldStampPtr )
+ * 
+ * Decide whether a file is the same as when the old stamp was made. If the 
+ * modification time and size match, it is. If only the size matches, the file
+ * may just have been touched or checked out again, so compare content hashes.
+ * 
+ * in       : filenamePtr   -   name of the file
+ * in       : newStampPtr   -   stamp for the file as it is now
+ * in       : oldStampPtr   -   stamp from the manifest
+ * out      : true if the file is unchanged, newStampPtr hashed if that was
+ *            worked out along the way
+ * err      : none
+ */
+bool isSameFile( const char *filenamePtr, struct FileStamp *newStampPtr, const struct FileStamp *oldStampPtr )
+{
+    if( newStampPtr->present != oldStampPtr->present )
+    {
+        return( false );
+    }
+
+    if( !newStampPtr->present )
+    {
+        return( true );
+    }
+
+    if( newStampPtr->size != oldStampPtr->size )
+    {
+        return( false );
+    }
+
+    if( ( newStampPtr->mtimeSeconds == oldStampPtr->mtimeSeconds ) && ( newStampPtr->mtimeNanoseconds == oldStampPtr->mtimeNanoseconds ) )
+    {
+        newStampPtr->hash   = oldStampPtr->hash;
+        newStampPtr->hashed = true;
+        return( true );
+    }
+
+    newStampPtr->hashed = hashFile( filenamePtr, &newStampPtr->hash );
+
+    verbose( "%s has been touched, hash is %016" PRIx64 " was %016" PRIx64 "\n", filenamePtr, newStampPtr->hash, oldStampPtr->hash );
+
+    return( newStampPtr->hashed && ( newStampPtr->hash == oldStampPtr->hash ) );
+}
+
+/**
+ * uint64_t hashOptions( struct Page *pagePtr )
+ * 
+ * Work out a hash of the options that affect the content of a web page, along 
+ * with what's in any partials, so that a change of options can be spotted.
+ * 
+ * in       : pagePtr   -   the page being made
+ * out      : the hash of the options
+ * err      : none
+ */
+uint64_t hashOptions( struct Page *pagePtr )
+{
+struct Options  *optionsPtr = pagePtr->optionsPtr;
+char            flags[8];
+uint64_t        hash = HASH_SEED;
+
+    snprintf( flags, sizeof(flags), "%d%d%d%d%d%d", optionsPtr->includeDTD, optionsPtr->includeTitle,
+              optionsPtr->includeAuthor, optionsPtr->includeDatetime, ( NULL != optionsPtr->cssRoot ),
+              optionsPtr->rewriteLinks );
+
+    hash = hashBytes( hash, flags, strlen( flags ) );
+
+    if( NULL != optionsPtr->navEmbedCode )
+    {
+        hash = hashBytes( hash, optionsPtr->navEmbedCode, strlen( optionsPtr->navEmbedCode ) + 1 );
+    }
+
+    // partials, told apart by which end of the page they go in
+
+    if( g_Context.headPartials.length > 0 )
+    {
+        hash = hashBytes( hash, "H", 1 );
+        hash = hashBytes( hash, g_Context.headPartials.dataPtr, g_Context.headPartials.length );
+    }
+
+    if( g_Context.bodyPartials.length > 0 )
+    {
+        hash = hashBytes( hash, "P", 1 );
+        hash = hashBytes( hash, g_Context.bodyPartials.dataPtr, g_Context.bodyPartials.length );
+    }
+
+    return( hash );
+}
+
+/**
+ * int compareManifestEntries( const void *firstPtr, const void *secondPtr )
+ * 
+ * qsort() and bsearch() comparison for manifest entries, by markdown filename.
+ */
+int compareManifestEntries( const void *firstPtr, const void *secondPtr )
+{
+    return( strcmp( ((const struct ManifestEntry *)firstPtr)->markdownFilename, 
+                    ((const struct ManifestEntry *)secondPtr)->markdownFilename ) );
+}
+
+/**
+ * struct ManifestEntry *findManifestEntry( const char *markdownFilenamePtr )
+ * 
+ * Look up a markdown file in the manifest loaded at the start of the run.
+ * 
+ * in       : markdownFilenamePtr   -   markdown filename relative to markdown root
+ * out      : the manifest entry, else NULL if the file wasn't in the manifest
+ * err      : none
+ */
+struct ManifestEntry *findManifestEntry( const char *markdownFilenamePtr )
+{
+struct ManifestEntry key;
+
+    key.markdownFilename = (char *)markdownFilenamePtr;
+
+    return( (struct ManifestEntry *)bsearch( &key, g_ManifestPtr, g_ManifestCount, sizeof(struct ManifestEntry), compareManifestEntries ) );
+}
+
+/**
+ * int compareAssetEntries( const void *firstPtr, const void *secondPtr )
+ * 
+ * qsort() and bsearch() comparison for asset entries, by filename.
+ */
+int compareAssetEntries( const void *firstPtr, const void *secondPtr )
+{
+    return( strcmp( ((const struct AssetEntry *)firstPtr)->filename, 
+                    ((const struct AssetEntry *)secondPtr)->filename ) );
+}
+
+/**
+ * struct AssetEntry *findManifestAsset( const char *filenamePtr )
+ * 
+ * Look up an asset in the manifest loaded at the start of the run.
+ * 
+ * in       : filenamePtr   -   asset filename relative to markdown root
+ * out      : the manifest asset entry, else NULL if it wasn't in the manifest
+ * err      : none
+ */
+struct AssetEntry *findManifestAsset( const char *filenamePtr )
+{
+struct AssetEntry key;
+
+    key.filename = (char *)filenamePtr;
+
+    return( (struct AssetEntry *)bsearch( &key, g_ManifestAssetPtr, g_ManifestAssetCount, sizeof(struct AssetEntry), compareAssetEntries ) );
+}
+
+/**
+ * bool isWebpageUpToDate( struct Page *pagePtr, const char *markdownFilenamePtr, struct ManifestEntry *newEntryPtr )
+ * 
+ * Site mode : fill in the new manifest entry for a page from its inputs as they
+ * are now - the .md file, the .txt file, the css file found, and the options - 
+ * and compare it with the entry in the old manifest. The page needs making if 
+ * any input has changed, or if the html file, or a compressed copy of it that 
+ * is wanted, has gone.
+ * 
+ * in       : pagePtr               -   the page to be made
+ * in       : markdownFilenamePtr   -   markdown filename relative to markdown root
+ * out      : newEntryPtr           -   manifest entry for the page as it is now
+ * out      : pagePtr content hash from the old manifest entry, if any
+ * out      : true if the web page does not need making
+ * err      : none
+ */
+bool isWebpageUpToDate( struct Page *pagePtr, const char *markdownFilenamePtr, struct ManifestEntry *newEntryPtr )
+{
+struct ManifestEntry    *oldEntryPtr = NULL;
+struct stat             webpageStat;
+
+    newEntryPtr->markdownFilename = strdup( markdownFilenamePtr );
+
+    assert( newEntryPtr->markdownFilename );
+
+    stampInputFile( pagePtr->markdownFilename, &newEntryPtr->markdownStamp );
+    stampInputFile( pagePtr->txtFilename, &newEntryPtr->txtStamp );
+
+    if( !newEntryPtr->markdownStamp.present )
+    {
+        // gone since the markdown tree was searched, so there's nothing to
+        // make the page from, and it will be removed next time
+
+        verbose( "Markdown file %s has gone\n", pagePtr->markdownFilename );
+
+        return( true );
+    }
+
+    if( NULL != pagePtr->cssRoot )
+    {
+        pagePtr->cssFilename = findCssFile( pagePtr );
+    }
+
+    newEntryPtr->cssFilename = ( NULL == pagePtr->cssFilename ) ? NULL : strdup( pagePtr->cssFilename );
+    newEntryPtr->optionsHash = hashOptions( pagePtr );
+
+    oldEntryPtr = findManifestEntry( markdownFilenamePtr );
+
+    if( NULL == oldEntryPtr )
+    {
+        return( false );
+    }
+
+    // carried over until the page is made again
+
+    newEntryPtr->contentHash    = oldEntryPtr->contentHash;
+    pagePtr->oldContentHash     = oldEntryPtr->contentHash;
+
+    if( NULL != oldEntryPtr->indexRecord )
+    {
+        newEntryPtr->indexRecord = strdup( oldEntryPtr->indexRecord );
+
+        assert( newEntryPtr->indexRecord );
+    }
+    else if( isSiteIndexWanted() )
+    {
+        return( false );
+    }
+
+    if( g_Options.forceRebuild )
+    {
+        verbose( "Rebuilding everything\n" );
+        return( false );
+    }
+
+    if( newEntryPtr->optionsHash != oldEntryPtr->optionsHash )
+    {
+        return( false );
+    }
+
+    if( ( NULL == newEntryPtr->cssFilename ) != ( NULL == oldEntryPtr->cssFilename ) )
+    {
+        return( false );
+    }
+
+    if( ( NULL != newEntryPtr->cssFilename ) && ( 0 != strcmp( newEntryPtr->cssFilename, oldEntryPtr->cssFilename ) ) )
+    {
+        return( false );
+    }
+
+    if( !isSameFile( pagePtr->markdownFilename, &newEntryPtr->markdownStamp, &oldEntryPtr->markdownStamp ) )
+    {
+        return( false );
+    }
+
+    if( !isSameFile( pagePtr->txtFilename, &newEntryPtr->txtStamp, &oldEntryPtr->txtStamp ) )
+    {
+        return( false );
+    }
+
+    if( pagePtr->optionsPtr->gzipOutput && ( 0 != stat( printToArena( pagePtr->arenaPtr, "%s.gz", pagePtr->webpageFilename ), &webpageStat ) ) )
+    {
+        return( false );
+    }
+
+    if( pagePtr->optionsPtr->brotliOutput && ( 0 != stat( printToArena( pagePtr->arenaPtr, "%s.br", pagePtr->webpageFilename ), &webpageStat ) ) )
+    {
+        return( false );
+    }
+
+    return( 0 == stat( pagePtr->webpageFilename, &webpageStat ) );
+}
+
+/**
+ * void completeManifestEntry( struct Page *pagePtr, struct ManifestEntry *newEntryPtr )
+ * 
+ * Site mode : a web page has been made, so make sure the hashes of its inputs 
+ * are in its manifest entry, ready for the next run, along with the hash of 
+ * its content if it was hashed.
+ * 
+ * in       : pagePtr       -   the page that has been made
+ * out      : newEntryPtr   -   manifest entry with hashes filled in
+ * err      : none
+ */
+void completeManifestEntry( struct Page *pagePtr, struct ManifestEntry *newEntryPtr )
+{
+    if( newEntryPtr->markdownStamp.present && !newEntryPtr->markdownStamp.hashed && pagePtr->markdownHashed )
+    {
+        // the markdown was hashed as it was parsed
+
+        newEntryPtr->markdownStamp.hash     = pagePtr->markdownHash;
+        newEntryPtr->markdownStamp.hashed   = true;
+    }
+
+    if( newEntryPtr->markdownStamp.present && !newEntryPtr->markdownStamp.hashed )
+    {
+        newEntryPtr->markdownStamp.hashed = hashFile( pagePtr->markdownFilename, &newEntryPtr->markdownStamp.hash );
+    }
+
+    if( newEntryPtr->txtStamp.present && !newEntryPtr->txtStamp.hashed )
+    {
+        newEntryPtr->txtStamp.hashed = hashFile( pagePtr->txtFilename, &newEntryPtr->txtStamp.hash );
+    }
+
+    newEntryPtr->contentHash = pagePtr->contentHash;
+
+    free( newEntryPtr->indexRecord );
+
+    newEntryPtr->indexRecord = ( 0 == pagePtr->indexRecord.length ) ? NULL : strndup( pagePtr->indexRecord.dataPtr, pagePtr->indexRecord.length );
+}
+
+/**
+ * void loadManifest( void )
+ * 
+ * Site mode : read the build manifest left in the html root by the last run.
+ * When told to rebuild everything, every web page is made anyway, and only the
+ * content hashes and assets are of use. Each line describes one web page as 
+ *
+ *      <md stamp> <txt stamp> <options hash> <content hash>\t<css file>\t<md file>
+ *
+ * where a stamp is 'present mtime-seconds mtime-nanoseconds size hash device 
+ * inode', and the content hash is that of the page made, if it was hashed, 
+ * else 0. If css is being linked, what was known about the css of each markdown
+ * directory is described as
+ *
+ *      d <mtime-seconds> <mtime-nanoseconds>\t<css file>\t<directory>
+ *
+ * where the directory is relative to the markdown root, and the css file is 
+ * the one in the directory itself, if any. If assets are being mirrored, each 
+ * asset in the html root is described as
+ *
+ *      a <mtime-seconds> <mtime-nanoseconds> <size>\t<asset file>
+ *
+ * A web page's line may be followed by its index record, for the site index,
+ * as
+ *
+ *      i <index record>\t<md file>
+ *
+ * The names come last, because they might contain spaces. A missing or 
+ * unreadable manifest just means that every web page gets made, and every 
+ * directory read.
+ * 
+ * A shard's manifest is the same, but for the web pages of that shard only.
+ * 
+ * in       : none
+ * out      : g_ManifestPtr and g_ManifestCount, sorted by markdown filename
+ * out      : g_ManifestAssetPtr and g_ManifestAssetCount, sorted by filename
+ * out      : the css cache knows what the manifest says about each directory
+ * err      : assert if failed to allocate manifest entries
+ */
+void loadManifest( void )
+{
+char                    manifestFilename[PATH_MAX + 1];
+FILE                    *manifestFilePtr = NULL;
+char                    *linePtr = NULL;
+size_t                  lineSize = 0;
+
+    g_NewManifestPtr = (struct ManifestEntry *)calloc( g_MarkdownFilenameCount + 1, sizeof(struct ManifestEntry) );
+
+    assert( g_NewManifestPtr );
+
+    snprintf( manifestFilename, sizeof(manifestFilename), "%s/%s", g_Options.webpageRoot, MANIFEST_FILENAME );
+
+    manifestFilePtr = fopen( manifestFilename, "r" );
+
+    if( NULL == manifestFilePtr )
+    {
+        verbose( "No manifest %s, making every web page\n", manifestFilename );
+        return;
+    }
+
+    if( ( -1 == getline( &linePtr, &lineSize, manifestFilePtr ) ) || ( 0 != strcmp( linePtr, MANIFEST_HEADER ) ) )
+    {
+        verbose( "Manifest %s is from another version, making every web page\n", manifestFilename );
+    }
+    else
+    {
+        readManifest( manifestFilePtr, &g_ManifestPtr, &g_ManifestCount, &g_ManifestAssetPtr, &g_ManifestAssetCount );
+    }
+
+    free( linePtr );
+
+    fclose( manifestFilePtr );
+
+    qsort( g_ManifestPtr, g_ManifestCount, sizeof(struct ManifestEntry), compareManifestEntries );
+    qsort( g_ManifestAssetPtr, g_ManifestAssetCount, sizeof(struct AssetEntry), compareAssetEntries );
+
+    verbose( "Loaded %zu entries and %zu assets from manifest %s\n", g_ManifestCount, g_ManifestAssetCount, manifestFilename );
+}
+
+/**
+ * void readManifest( FILE *manifestFilePtr, struct ManifestEntry **entryPtrPtr, size_t *entryCountPtr, struct AssetEntry **assetPtrPtr, size_t *assetCountPtr )
+ * 
+ * Site mode : read the lines of a build manifest after its header, as 
+ * described for loadManifest(), adding the web pages and assets to those 
+ * already read, in the order they come.
+ * 
+ * in       : manifestFilePtr   -   the manifest, just past its header
+ * out      : *entryPtrPtr      -   web pages, grown by *entryCountPtr
+ * out      : *assetPtrPtr      -   assets, grown by *assetCountPtr
+ * out      : the css cache knows what the manifest says about each directory
+ * err      : assert if failed to allocate manifest entries
+ */
+void readManifest( FILE *manifestFilePtr, struct ManifestEntry **entryPtrPtr, size_t *entryCountPtr, struct AssetEntry **assetPtrPtr, size_t *assetCountPtr )
+{
+struct ManifestEntry    *entriesPtr = *entryPtrPtr;
+size_t                  entryCount = *entryCountPtr;
+char                    *linePtr = NULL;
+size_t                  lineSize = 0;
+ssize_t                 lineLength = 0;
+struct ManifestEntry    entry;
+int                     markdownPresent, txtPresent;
+int                     consumed = 0;
+char                    *cssPtr, *markdownPtr;
+
+    while( -1 != ( lineLength = getline( &linePtr, &lineSize, manifestFilePtr ) ) )
+    {
+        memset( &entry, 0, sizeof(entry) );
+
+        if( ( lineLength > 0 ) && ( '\n' == linePtr[lineLength - 1] ) )
+        {
+            linePtr[--lineLength] = '\0';
+        }
+
+        if( 'd' == linePtr[0] )
+        {
+            if( !g_Options.forceRebuild )
+            {
+                loadManifestDirectory( linePtr );
+            }
+            continue;
+        }
+
+        if( 'a' == linePtr[0] )
+        {
+            loadManifestAsset( linePtr, assetPtrPtr, assetCountPtr );
+            continue;
+        }
+
+        if( 'i' == linePtr[0] )
+        {
+            // the index record of the page just read
+
+            if( ( entryCount > 0 ) && ( NULL != ( markdownPtr = strchr( linePtr, '\t' ) ) ) && 
+                ( 0 == strcmp( markdownPtr + 1, entriesPtr[entryCount - 1].markdownFilename ) ) )
+            {
+                entriesPtr[entryCount - 1].indexRecord = strndup( linePtr + 2, markdownPtr - linePtr - 2 );
+
+                assert( entriesPtr[entryCount - 1].indexRecord );
+            }
+            continue;
+        }
+
+        consumed = 0;
+
+        sscanf( linePtr, "%d %lld %ld %lld %" SCNx64 " %lld %lld %d %lld %ld %lld %" SCNx64 " %lld %lld %" SCNx64 " %" SCNx64 "%n",
+                &markdownPresent, &entry.markdownStamp.mtimeSeconds, &entry.markdownStamp.mtimeNanoseconds,
+                &entry.markdownStamp.size, &entry.markdownStamp.hash, 
+                &entry.markdownStamp.device, &entry.markdownStamp.inode,
+                &txtPresent, &entry.txtStamp.mtimeSeconds, &entry.txtStamp.mtimeNanoseconds,
+                &entry.txtStamp.size, &entry.txtStamp.hash,
+                &entry.txtStamp.device, &entry.txtStamp.inode,
+                &entry.optionsHash, &entry.contentHash, &consumed );
+
+        cssPtr = linePtr + consumed;
+
+        if( ( 0 == consumed ) || ( '\t' != *cssPtr ) || ( NULL == ( markdownPtr = strchr( ++cssPtr, '\t' ) ) ) )
+        {
+            verbose( "Ignoring bad manifest line %s\n", linePtr );
+            continue;
+        }
+
+        *markdownPtr++ = '\0';
+
+        entry.markdownStamp.present = markdownPresent;
+        entry.markdownStamp.hashed  = markdownPresent;
+        entry.txtStamp.present      = txtPresent;
+        entry.txtStamp.hashed       = txtPresent;
+        entry.markdownFilename      = strdup( markdownPtr );
+        entry.cssFilename           = ( '\0' == *cssPtr ) ? NULL : strdup( cssPtr );
+
+        entriesPtr = (struct ManifestEntry *)realloc( entriesPtr, ( entryCount + 1 ) * sizeof(struct ManifestEntry) );
+
+        assert( entriesPtr && entry.markdownFilename );
+
+        entriesPtr[entryCount++] = entry;
+    }
+
+    free( linePtr );
+
+    *entryPtrPtr    = entriesPtr;
+    *entryCountPtr  = entryCount;
+}
+
+/**
+ * void loadManifestDirectory( char *linePtr )
+ * 
+ * Site mode : put what a line of the build manifest says about the css of a 
+ * markdown directory into the css cache, so that the directory needn't be read
+ * again if it hasn't changed. Nothing is put in the cache unless css is being
+ * linked, and a directory already listed by the search is left as it is. A
+ * merge reads no directories, so takes what the manifests say as known, for
+ * the merged manifest; a line of the last merge is replaced by a shard's.
+ * 
+ * in       : linePtr   -   manifest line, as described for loadManifest()
+ * out      : the css cache has an entry for the directory, not yet resolved
+ * err      : assert if failed to allocate the css name
+ */
+void loadManifestDirectory( char *linePtr )
+{
+struct CssDirectory *entryPtr = NULL;
+long long           mtimeSeconds = 0;
+long                mtimeNanoseconds = 0;
+int                 consumed = 0;
+char                *cssPtr, *directoryPtr;
+char                canonicalName[PATH_MAX + 1];
+size_t              length = 0;
+
+    if( NULL == g_Options.cssRoot )
+    {
+        return;
+    }
+
+    sscanf( linePtr, "d %lld %ld%n", &mtimeSeconds, &mtimeNanoseconds, &consumed );
+
+    cssPtr = linePtr + consumed;
+
+    if( ( 0 == consumed ) || ( '\t' != *cssPtr ) || ( NULL == ( directoryPtr = strchr( ++cssPtr, '\t' ) ) ) )
+    {
+        verbose( "Ignoring bad manifest line %s\n", linePtr );
+        return;
+    }
+
+    *directoryPtr++ = '\0';
+
+    // the cache is keyed by canonical name, without the trailing '/'
+
+    length = strlen( directoryPtr );
+
+    snprintf( canonicalName, sizeof(canonicalName), "%s%s%.*s", g_Options.markdownRoot, ( 0 == length ) ? "" : "/", 
+              (int)( ( 0 == length ) ? 0 : length - 1 ), directoryPtr );
+
+    entryPtr = findCssDirectory( canonicalName );
+
+    if( entryPtr->listed )
+    {
+        // already read by the search of the markdown tree, so known better
+
+        return;
+    }
+
+    free( entryPtr->cssNamePtr );
+
+    entryPtr->mtimeSeconds      = mtimeSeconds;
+    entryPtr->mtimeNanoseconds  = mtimeNanoseconds;
+    entryPtr->cssNamePtr        = ( '\0' == *cssPtr ) ? NULL : strdup( cssPtr );
+    entryPtr->parentLevels      = 0;
+    entryPtr->known             = g_Options.mergeMode;
+
+    assert( ( '\0' == *cssPtr ) || ( NULL != entryPtr->cssNamePtr ) );
+}
+
+/**
+ * void saveManifestDirectories( FILE *manifestFilePtr )
+ * 
+ * Site mode : write what is known about the css of each markdown directory to 
+ * the build manifest, as described for loadManifest(). Directories that have 
+ * changed too recently to be sure of are left out, so they are read again.
+ * 
+ * in       : manifestFilePtr   -   the manifest being written
+ * out      : directory lines written to the manifest
+ * err      : none
+ */
+void saveManifestDirectories( FILE *manifestFilePtr )
+{
+struct CssDirectory *entryPtr = NULL;
+size_t              rootLength = strlen( g_Options.markdownRoot );
+int                 bucket = 0;
+const char          *relativePtr = NULL;
+const char          *cssNamePtr = NULL;
+
+    for( bucket = 0; bucket < CSS_DIRECTORY_BUCKETS; bucket++ )
+    {
+        for( entryPtr = g_CssDirectoryPtrs[bucket]; NULL != entryPtr; entryPtr = entryPtr->nextPtr )
+        {
+            if( !entryPtr->known || ( 0 == entryPtr->mtimeSeconds ) || ( 0 != strncmp( entryPtr->directoryNamePtr, g_Options.markdownRoot, rootLength ) ) )
+            {
+                continue;
+            }
+
+            relativePtr = entryPtr->directoryNamePtr + rootLength;
+
+            // only a css file in the directory itself, not one inherited
+
+            cssNamePtr = ( ( 0 == entryPtr->parentLevels ) && ( NULL != entryPtr->cssNamePtr ) ) ? entryPtr->cssNamePtr : "";
+
+            if( ( ( '\0' != *relativePtr ) && ( '/' != *relativePtr ) ) || ( NULL != strpbrk( relativePtr, "\t\n" ) ) || ( NULL != strpbrk( cssNamePtr, "\t\n" ) ) )
+            {
+                continue;
+            }
+
+            fprintf( manifestFilePtr, "d %lld %ld\t%s\t%s%s\n", entryPtr->mtimeSeconds, entryPtr->mtimeNanoseconds, cssNamePtr,
+                     ( '\0' == *relativePtr ) ? "" : relativePtr + 1, ( '\0' == *relativePtr ) ? "" : "/" );
+        }
+    }
+}
+
+/**
+ * void loadManifestAsset( char *linePtr, struct AssetEntry **assetPtrPtr, size_t *assetCountPtr )
+ * 
+ * Site mode : add an asset named by a line of the build manifest to a list 
+ * of assets mirrored, normally those of the last run, so it can be removed 
+ * from the html root if it has gone. Nothing is loaded unless assets are being
+ * mirrored, so none are removed either.
+ * 
+ * in       : linePtr       -   manifest line, as described for loadManifest()
+ * out      : *assetPtrPtr  -   assets, grown by one in *assetCountPtr
+ * err      : assert if failed to allocate the entry
+ */
+void loadManifestAsset( char *linePtr, struct AssetEntry **assetPtrPtr, size_t *assetCountPtr )
+{
+struct AssetEntry   entry;
+int                 consumed = 0;
+
+    if( asset_none == g_Options.assetMode )
+    {
+        return;
+    }
+
+    memset( &entry, 0, sizeof(entry) );
+
+    sscanf( linePtr, "a %lld %ld %lld%n", &entry.stamp.mtimeSeconds, &entry.stamp.mtimeNanoseconds, &entry.stamp.size, &consumed );
+
+    if( ( 0 == consumed ) || ( '\t' != linePtr[consumed] ) || ( '\0' == linePtr[consumed + 1] ) )
+    {
+        verbose( "Ignoring bad manifest line %s\n", linePtr );
+        return;
+    }
+
+    entry.stamp.present = true;
+    entry.filename      = strdup( linePtr + consumed + 1 );
+
+    *assetPtrPtr = (struct AssetEntry *)realloc( *assetPtrPtr, ( *assetCountPtr + 1 ) * sizeof(struct AssetEntry) );
+
+    assert( *assetPtrPtr && entry.filename );
+
+    (*assetPtrPtr)[(*assetCountPtr)++] = entry;
+}
+
+/**
+ * void mirrorAsset( struct AssetEntry *assetPtr )
+ * 
+ * Site mode : mirror an asset from the markdown tree into the html root, by
+ * a hard link, a reflink ( the copy shares the blocks of the asset, where the 
+ * filesystem allows it ) or a copy, as the 'assets' option says. Nothing is 
+ * done if the html root already has the asset : the same file for a link, or a
+ * file of the same size and modification time for a copy, which is given the 
+ * asset's modification time to make that so. A link or reflink that can't be 
+ * made, e.g. because the html root is on another filesystem, falls back to a 
+ * copy. The asset is mirrored to a temporary file first, which is then renamed
+ * over the old one, just as for web pages. When archiving, the asset is just 
+ * copied into the archive.
+ * 
+ * in       : assetPtr  -   the asset, relative to the markdown root
+ * out      : assetPtr stamped as it is now, and mirrored if it was present
+ * err      : a message if the asset can't be read, and it is skipped
+ * err      : assert if failed to make, write or rename the temporary file
+ */
+void mirrorAsset( struct AssetEntry *assetPtr )
+{
+char                sourceFilename[PATH_MAX + 1];
+char                targetFilename[PATH_MAX + 1];
+char                tempFilename[PATH_MAX + 1];
+char                *basenamePtr = NULL;
+struct FileStamp    targetStamp;
+struct stat         sourceStat;
+struct timespec     times[2];
+int                 sourceFD = -1;
+int                 tempFD = -1;
+enum assetValues    mirroredBy = g_Options.assetMode;
+off_t               total = 0;
+int                 result = 0;
+
+    snprintf( sourceFilename, sizeof(sourceFilename), "%s/%s", g_Options.markdownRoot, assetPtr->filename );
+    snprintf( targetFilename, sizeof(targetFilename), "%s/%s", g_Options.webpageRoot, assetPtr->filename );
+
+    stampFile( sourceFilename, &assetPtr->stamp );
+
+    if( !assetPtr->stamp.present )
+    {
+        verbose( "Asset %s has gone\n", sourceFilename );
+        return;
+    }
+
+    // when archiving, there is nothing there already, and nothing to link to
+
+    if( -1 != g_ArchiveFD )
+    {
+        sourceFD = open( sourceFilename, O_RDONLY | O_CLOEXEC );
+
+        if( ( -1 == sourceFD ) || ( 0 != fstat( sourceFD, &sourceStat ) ) )
+        {
+            printf( "Cannot read asset %s, skipping it\n", sourceFilename );
+        }
+        else
+        {
+            writeArchiveFile( assetPtr->filename, sourceFD, &sourceStat );
+        }
+
+        if( -1 != sourceFD )
+        {
+            close( sourceFD );
+        }
+
+        return;
+    }
+
+    stampFile( targetFilename, &targetStamp );
+
+    if( targetStamp.present && ( ( ( targetStamp.device == assetPtr->stamp.device ) && ( targetStamp.inode == assetPtr->stamp.inode ) ) ||
+                                 ( ( asset_link != g_Options.assetMode ) && ( targetStamp.size == assetPtr->stamp.size ) &&
+                                   ( targetStamp.mtimeSeconds == assetPtr->stamp.mtimeSeconds ) && 
+                                   ( targetStamp.mtimeNanoseconds == assetPtr->stamp.mtimeNanoseconds ) ) ) )
+    {
+        verbose( "Asset %s is up to date\n", targetFilename );
+        return;
+    }
+
+    basenamePtr = strrchr( targetFilename, '/' ) + 1;
+
+    snprintf( tempFilename, sizeof(tempFilename), "%.*s.%s.XXXXXX", (int)( basenamePtr - targetFilename ), targetFilename, basenamePtr );
+
+    tempFD = mkstemp( tempFilename );
+
+    assert( -1 != tempFD );
+
+    if( asset_link == g_Options.assetMode )
+    {
+        // link() won't replace a file, so the temporary name is only reserved
+
+        close( tempFD );
+        unlink( tempFilename );
+
+        tempFD = -1;
+
+        if( 0 != link( sourceFilename, tempFilename ) )
+        {
+            verbose( "Cannot link %s, copying it instead\n", sourceFilename );
+
+            tempFD = mkstemp( tempFilename );
+
+            assert( -1 != tempFD );
+
+            mirroredBy = asset_copy;
+        }
+    }
+
+    if( -1 != tempFD )
+    {
+        sourceFD = open( sourceFilename, O_RDONLY | O_CLOEXEC );
+
+        if( ( -1 == sourceFD ) || ( 0 != fstat( sourceFD, &sourceStat ) ) )
+        {
+            printf( "Cannot read asset %s, skipping it\n", sourceFilename );
+
+            if( -1 != sourceFD )
+            {
+                close( sourceFD );
+            }
+
+            close( tempFD );
+            unlink( tempFilename );
+
+            return;
+        }
+
+        // mkstemp() makes the file readable by its owner only
+
+        result = fchmod( tempFD, sourceStat.st_mode & g_AssetFileMask );
+
+        assert( 0 == result );
+
+        if( ( asset_reflink == mirroredBy ) && ( 0 != ioctl( tempFD, FICLONE, sourceFD ) ) )
+        {
+            verbose( "Cannot reflink %s, copying it instead\n", sourceFilename );
+
+            mirroredBy = asset_copy;
+        }
+
+        if( asset_copy == mirroredBy )
+        {
+            total = copyFile( sourceFD, tempFD );
+        }
+
+        times[0].tv_sec     = 0;
+        times[0].tv_nsec    = UTIME_OMIT;
+        times[1]            = sourceStat.st_mtim;
+
+        result = futimens( tempFD, times );
+
+        assert( 0 == result );
+
+        close( sourceFD );
+
+        result = close( tempFD );
+
+        assert( 0 == result );
+    }
+
+    result = rename( tempFilename, targetFilename );
+
+    assert( 0 == result );
+
+    addCount( count_bytes_out, total );
+
+    verbose( "Mirrored %s to %s by %s\n", sourceFilename, targetFilename, g_AssetModeNames[mirroredBy] );
+}
+
+/**
+ * void mirrorAssets( void )
+ * 
+ * Site mode : mirror every asset found in the markdown tree into the html root,
+ * then sort them by filename for the manifest.
+ * 
+ * in       : none
+ * out      : assets mirrored, g_AssetPtr sorted by filename
+ * err      : none
+ */
+void mirrorAssets( void )
+{
+size_t assetIndex = 0;
+
+    for( assetIndex = 0; assetIndex < g_AssetCount; assetIndex++ )
+    {
+        mirrorAsset( &g_AssetPtr[assetIndex] );
+    }
+
+    qsort( g_AssetPtr, g_AssetCount, sizeof(struct AssetEntry), compareAssetEntries );
+
+    verbose( "Mirrored %zu assets\n", g_AssetCount );
+}
+
+/**
+ * void removeWebpage( const char *markdownFilenamePtr )
+ * 
+ * Site mode : a markdown file named in the old manifest has gone, so remove the
+ * web page that was made from it, and any compressed copies.
+ * 
+ * in       : markdownFilenamePtr   -   markdown filename relative to markdown root
+ * out      : the web page file has been removed
+ * err      : none
+ */
+void removeWebpage( const char *markdownFilenamePtr )
+{
+struct Page     page;
+struct Arena    arena = { NULL, NULL };
+
+    initPage( &page, &arena, markdownFilenamePtr );
+
+    verbose( "Markdown file %s has gone, removing %s\n", page.markdownFilename, page.webpageFilename );
+
+    unlink( page.webpageFilename );
+    unlink( printToArena( &arena, "%s.gz", page.webpageFilename ) );
+    unlink( printToArena( &arena, "%s.br", page.webpageFilename ) );
+
+    freePage( &page );
+
+    releaseArena( &arena );
+}
+
+/**
+ * void saveManifest( void )
+ * 
+ * Site mode : write the new build manifest into the html root, along with what
+ * is known about the css of each markdown directory and the assets mirrored, 
+ * and remove any web pages whose markdown files have gone since the last run,
+ * and any assets that have gone. The manifest is
+ * written to a temporary file first, so an interrupted run leaves the old one.
+ * Markdown files with tabs or newlines in their names can't be described in the
+ * manifest, so they are left out, and their web pages are always made. A shard
+ * writes its own shard manifest instead, and removes nothing, since what has 
+ * gone can only be told from every shard's pages, by the merge.
+ * 
+ * in       : none
+ * out      : manifest written to the html root
+ * err      : assert if the manifest cannot be written
+ */
+void saveManifest( void )
+{
+char                    manifestFilename[PATH_MAX + 1];
+char                    shardFilename[NAME_MAX + 1];
+char                    tempFilename[PATH_MAX + sizeof(".XXXXXX")];
+FILE                    *manifestFilePtr = NULL;
+struct ManifestEntry    *entryPtr = NULL;
+size_t                  entryIndex = 0;
+int                     manifestFD = -1;
+int                     result = 0;
+
+    snprintf( shardFilename, sizeof(shardFilename), SHARD_MANIFEST_FORMAT, MANIFEST_FILENAME, g_Options.shardIndex, g_Options.shardCount );
+    snprintf( manifestFilename, sizeof(manifestFilename), "%s/%s", g_Options.webpageRoot, 
+              ( 0 != g_Options.shardCount ) ? shardFilename : MANIFEST_FILENAME );
+
+    snprintf( tempFilename, sizeof(tempFilename), "%s.XXXXXX", manifestFilename );
+
+    manifestFD = mkstemp( tempFilename );
+
+    assert( -1 != manifestFD );
+
+    // mkstemp() makes the file readable by its owner only
+
+    result = fchmod( manifestFD, g_WebpageFileMode );
+
+    assert( 0 == result );
+
+    manifestFilePtr = fdopen( manifestFD, "w" );
+
+    assert( manifestFilePtr );
+
+    fputs( MANIFEST_HEADER, manifestFilePtr );
+
+    if( 0 != g_Options.shardCount )
+    {
+        fprintf( manifestFilePtr, SHARD_ASSETS_FORMAT, g_AssetModeNames[g_Options.assetMode] );
+    }
+
+    qsort( g_NewManifestPtr, g_MarkdownFilenameCount, sizeof(struct ManifestEntry), compareManifestEntries );
+
+    for( entryIndex = 0; entryIndex < g_MarkdownFilenameCount; entryIndex++ )
+    {
+        entryPtr = &g_NewManifestPtr[entryIndex];
+
+        if( ( NULL != strpbrk( entryPtr->markdownFilename, "\t\n" ) ) || 
+            ( ( NULL != entryPtr->cssFilename ) && ( NULL != strpbrk( entryPtr->cssFilename, "\t\n" ) ) ) )
+        {
+            continue;
+        }
+
+        fprintf( manifestFilePtr, "%d %lld %ld %lld %016" PRIx64 " %lld %lld %d %lld %ld %lld %016" PRIx64 " %lld %lld %016" PRIx64 " %016" PRIx64 "\t%s\t%s\n",
+                 entryPtr->markdownStamp.present, entryPtr->markdownStamp.mtimeSeconds, entryPtr->markdownStamp.mtimeNanoseconds,
+                 entryPtr->markdownStamp.size, entryPtr->markdownStamp.hash,
+                 entryPtr->markdownStamp.device, entryPtr->markdownStamp.inode,
+                 entryPtr->txtStamp.present, entryPtr->txtStamp.mtimeSeconds, entryPtr->txtStamp.mtimeNanoseconds,
+                 entryPtr->txtStamp.size, entryPtr->txtStamp.hash,
+                 entryPtr->txtStamp.device, entryPtr->txtStamp.inode,
+                 entryPtr->optionsHash, entryPtr->contentHash,
+                 ( NULL == entryPtr->cssFilename ) ? "" : entryPtr->cssFilename,
+                 entryPtr->markdownFilename );
+
+        if( NULL != entryPtr->indexRecord )
+        {
+            fprintf( manifestFilePtr, "i %s\t%s\n", entryPtr->indexRecord, entryPtr->markdownFilename );
+        }
+    }
+
+    saveManifestDirectories( manifestFilePtr );
+
+    for( entryIndex = 0; entryIndex < g_AssetCount; entryIndex++ )
+    {
+        if( g_AssetPtr[entryIndex].stamp.present && ( NULL == strpbrk( g_AssetPtr[entryIndex].filename, "\t\n" ) ) )
+        {
+            fprintf( manifestFilePtr, "a %lld %ld %lld\t%s\n", g_AssetPtr[entryIndex].stamp.mtimeSeconds, 
+                     g_AssetPtr[entryIndex].stamp.mtimeNanoseconds, g_AssetPtr[entryIndex].stamp.size, g_AssetPtr[entryIndex].filename );
+        }
+    }
+
+    result = fclose( manifestFilePtr );
+
+    assert( 0 == result );
+
+    result = rename( tempFilename, manifestFilename );
+
+    assert( 0 == result );
+
+    verbose( "Saved %zu entries to manifest %s\n", g_MarkdownFilenameCount, manifestFilename );
+
+    if( 0 != g_Options.shardCount )
+    {
+        return;
+    }
+
+    // Anything in the old manifest that isn't in the new one has gone
+
+    for( entryIndex = 0; entryIndex < g_ManifestCount; entryIndex++ )
+    {
+        if( NULL == bsearch( &g_ManifestPtr[entryIndex], g_NewManifestPtr, g_MarkdownFilenameCount, sizeof(struct ManifestEntry), compareManifestEntries ) )
+        {
+            removeWebpage( g_ManifestPtr[entryIndex].markdownFilename );
+        }
+    }
+
+    for( entryIndex = 0; entryIndex < g_ManifestAssetCount; entryIndex++ )
+    {
+    struct AssetEntry *assetPtr = (struct AssetEntry *)bsearch( &g_ManifestAssetPtr[entryIndex], g_AssetPtr, g_AssetCount, 
+                                                                sizeof(struct AssetEntry), compareAssetEntries );
+
+        if( ( NULL == assetPtr ) || !assetPtr->stamp.present )
+        {
+            snprintf( tempFilename, sizeof(tempFilename), "%s/%s", g_Options.webpageRoot, g_ManifestAssetPtr[entryIndex].filename );
+
+            verbose( "Asset %s has gone, removing %s\n", g_ManifestAssetPtr[entryIndex].filename, tempFilename );
+
+            unlink( tempFilename );
+        }
+    }
+}
+
+/**
+ * void appendUrlPath( struct Buffer *bufferPtr, const char *markdownFilenamePtr )
+ * 
+ * Add the path of a web page, relative to the html root, to the end of a 
+ * buffer, percent encoded for use in a url.
+ * 
+ * in       : bufferPtr             -   the buffer
+ * in       : markdownFilenamePtr   -   the page's markdown file, relative to 
+ *                                      the markdown root
+ * out      : the web page's url path is at the end of the buffer
+ * err      : assert if failed to grow the buffer
+ */
+void appendUrlPath( struct Buffer *bufferPtr, const char *markdownFilenamePtr )
+{
+const char  *basenamePtr = strrchr( markdownFilenamePtr, '/' );
+const char  *extensionPtr = NULL;
+const char  *namePtr = NULL;
+char        encoded[4];
+
+    // the html file is named for the part of the markdown filename before any
+    // extension, as initPage() names it
+
+    basenamePtr     = ( NULL == basenamePtr ) ? markdownFilenamePtr : basenamePtr + 1;
+    extensionPtr    = strrchr( basenamePtr, '.' );
+    extensionPtr    = ( NULL == extensionPtr ) ? basenamePtr + strlen( basenamePtr ) : extensionPtr;
+
+    for( namePtr = markdownFilenamePtr; namePtr < extensionPtr; namePtr++ )
+    {
+        if( NULL != strchr( URL_PATH_CHARACTERS, *namePtr ) )
+        {
+            appendBuffer( bufferPtr, namePtr, 1 );
+        }
+        else
+        {
+            snprintf( encoded, sizeof(encoded), "%%%02X", (unsigned char)*namePtr );
+            appendString( bufferPtr, encoded );
+        }
+    }
+
+    appendString( bufferPtr, ".html" );
+}
+
+/**
+ * void writeSiteFile( const char *filenamePtr, struct Buffer *contentPtr )
+ * 
+ * Write a file for the whole site into the html root, or into the archive, in
+ * the same way as writeWebpageFile() writes a web page.
+ * 
+ * in       : filenamePtr   -   name of the file, relative to the html root
+ * in       : contentPtr    -   what goes in it
+ * out      : The file has been written.
+ * err      : assert if failed to make, write or rename the temporary file
+ */
+void writeSiteFile( const char *filenamePtr, struct Buffer *contentPtr )
+{
+char            siteFilename[PATH_MAX + 1];
+char            tempFilename[PATH_MAX + 1];
+int             siteFD = -1;
+struct iovec    vector;
+size_t          total = 0;
+int             result;
+
+    vector.iov_base = contentPtr->dataPtr;
+    vector.iov_len  = contentPtr->length;
+
+    if( -1 != g_ArchiveFD )
+    {
+        writeArchiveEntry( filenamePtr, g_WebpageFileMode, g_ArchiveTime, &vector, 1 );
+        return;
+    }
+
+    snprintf( siteFilename, sizeof(siteFilename), "%s/%s", g_Options.webpageRoot, filenamePtr );
+    snprintf( tempFilename, sizeof(tempFilename), "%s/.%s.XXXXXX", g_Options.webpageRoot, filenamePtr );
+
+    siteFD = mkstemp( tempFilename );
+
+    assert( -1 != siteFD );
+
+    result = fchmod( siteFD, g_WebpageFileMode );
+
+    assert( 0 == result );
+
+    total = writeVectors( siteFD, &vector, 1 );
+
+    result = close( siteFD );
+
+    assert( 0 == result );
+
+    result = rename( tempFilename, siteFilename );
+
+    assert( 0 == result );
+
+    verbose( "Wrote %zu chars to %s\n", total, siteFilename );
+
+    addCount( count_bytes_out, total );
+}
+
+/**
+ * void saveSiteIndex( void )
+ * 
+ * Site mode : write the sitemap and the search index, as asked for, from the
+ * index records of every page in the new manifest. Pages that weren't made 
+ * this time have their index records carried over from the last run, so the 
+ * html tree is never read. The sitemap gives each page's url under the url 
+ * given, and the date its markdown was last changed. The search index is a 
+ * JSON object with a list of pages, one a line, each with its url ( relative 
+ * to the html root ), its title and its index record.
+ * 
+ * in       : none
+ * out      : sitemap.xml and search_index.json are in the html root, or the
+ *            archive
+ * err      : assert if failed to write them
+ */
+void saveSiteIndex( void )
+{
+struct Buffer           sitemap = { NULL, 0, 0 };
+struct Buffer           searchIndex = { NULL, 0, 0 };
+struct Buffer           url = { NULL, 0, 0 };
+struct ManifestEntry    *entryPtr = NULL;
+size_t                  entryIndex = 0;
+size_t                  pageCount = 0;
+const char              *basenamePtr = NULL;
+const char              *extensionPtr = NULL;
+const char              *urlPtr = g_Options.sitemapUrl;
+size_t                  urlLength = 0;
+time_t                  mtime = 0;
+struct tm               tm;
+char                    date[16];
+
+    if( NULL != g_Options.sitemapUrl )
+    {
+        appendString( &sitemap, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" );
+        appendString( &sitemap, "<urlset xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n" );
+
+        // the site's url, escaped for xml once, and without any trailing '/'
+
+        for( urlLength = strlen( urlPtr ); ( urlLength > 0 ) && ( '/' == urlPtr[urlLength - 1] ); urlLength-- );
+
+        for( ; urlLength > 0; urlPtr++, urlLength-- )
+        {
+            switch( *urlPtr )
+            {
+                case '&'    : appendString( &url, "&amp;" );     break;
+                case '<'    : appendString( &url, "&lt;" );      break;
+                case '>'    : appendString( &url, "&gt;" );      break;
+                case '"'    : appendString( &url, "&quot;" );    break;
+                case '\''   : appendString( &url, "&apos;" );    break;
+                default     : appendBuffer( &url, urlPtr, 1 );   break;
+            }
+        }
+
+        appendString( &url, "/" );
+    }
+
+    if( g_Options.searchIndex )
+    {
+        appendString( &searchIndex, "{\"pages\":[\n" );
+    }
+
+    qsort( g_NewManifestPtr, g_MarkdownFilenameCount, sizeof(struct ManifestEntry), compareManifestEntries );
+
+    for( entryIndex = 0; entryIndex < g_MarkdownFilenameCount; entryIndex++ )
+    {
+        entryPtr = &g_NewManifestPtr[entryIndex];
+
+        // a page whose markdown has gone is on its way out
+
+        if( ( NULL == entryPtr->indexRecord ) || ( ( -1 == g_ArchiveFD ) && !entryPtr->markdownStamp.present ) )
+        {
+            continue;
+        }
+
+        if( NULL != g_Options.sitemapUrl )
+        {
+            mtime = ( -1 == g_ArchiveFD ) ? (time_t)entryPtr->markdownStamp.mtimeSeconds : g_ArchiveTime;
+
+            gmtime_r( &mtime, &tm );
+            strftime( date, sizeof(date), "%Y-%m-%d", &tm );
+
+            appendString( &sitemap, "  <url><loc>" );
+            appendBuffer( &sitemap, url.dataPtr, url.length );
+            appendUrlPath( &sitemap, entryPtr->markdownFilename );
+            appendString( &sitemap, "</loc><lastmod>" );
+            appendString( &sitemap, date );
+            appendString( &sitemap, "</lastmod></url>\n" );
+        }
+
+        if( g_Options.searchIndex )
+        {
+            basenamePtr     = strrchr( entryPtr->markdownFilename, '/' );
+            basenamePtr     = ( NULL == basenamePtr ) ? entryPtr->markdownFilename : basenamePtr + 1;
+            extensionPtr    = strrchr( basenamePtr, '.' );
+
+            appendString( &searchIndex, ( 0 == pageCount ) ? "{\"url\":\"" : ",\n{\"url\":\"" );
+            appendUrlPath( &searchIndex, entryPtr->markdownFilename );
+            appendString( &searchIndex, "\",\"title\":" );
+            appendJsonString( &searchIndex, basenamePtr, ( NULL == extensionPtr ) ? strlen( basenamePtr ) : (size_t)( extensionPtr - basenamePtr ) );
+            appendString( &searchIndex, "," );
+            appendString( &searchIndex, entryPtr->indexRecord );
+            appendString( &searchIndex, "}" );
+        }
+
+        pageCount++;
+    }
+
+    if( NULL != g_Options.sitemapUrl )
+    {
+        appendString( &sitemap, "</urlset>\n" );
+
+        writeSiteFile( SITEMAP_FILENAME, &sitemap );
+    }
+
+    if( g_Options.searchIndex )
+    {
+        appendString( &searchIndex, "\n]}\n" );
+
+        writeSiteFile( SEARCH_INDEX_FILENAME, &searchIndex );
+    }
+
+    verbose( "Saved site index of %zu web pages\n", pageCount );
+
+    free( sitemap.dataPtr );
+    free( searchIndex.dataPtr );
+    free( url.dataPtr );
+}
+
+/**
+ * int compareShardPages( const void *firstPtr, const void *secondPtr )
+ * 
+ * qsort() comparison for pages to be given to shards, by the hash of their 
+ * names, and then by name, so that every shard puts them in the same order.
+ */
+int compareShardPages( const void *firstPtr, const void *secondPtr )
+{
+const struct ShardPage *firstPagePtr    = (const struct ShardPage *)firstPtr;
+const struct ShardPage *secondPagePtr   = (const struct ShardPage *)secondPtr;
+
+    if( firstPagePtr->hash != secondPagePtr->hash )
+    {
+        return( ( firstPagePtr->hash > secondPagePtr->hash ) ? 1 : -1 );
+    }
+
+    return( strcmp( g_MarkdownFilenameList[firstPagePtr->fileIndex], g_MarkdownFilenameList[secondPagePtr->fileIndex] ) );
+}
+
+/**
+ * void selectShard( void )
+ * 
+ * Site mode : keep only this shard's part of the markdown files and assets 
+ * found by the search. Every shard searches the same tree, and the pages are 
+ * put in the order of the hashes of their names, then cut into as many runs 
+ * as there are shards, of about the same total size of markdown, so every 
+ * shard makes the same cut without any word from the others. A page goes to 
+ * the run its middle falls in. Assets are dealt out by the hashes of their 
+ * names alone. Everything else about the search, the css found for each 
+ * directory in particular, is kept whole, so it is the same in every shard.
+ * 
+ * in       : none
+ * out      : g_MarkdownFilenameList and g_AssetPtr have this shard's part only
+ * err      : assert if failed to allocate the pages
+ */
+void selectShard( void )
+{
+struct ShardPage    *pagesPtr = NULL;
+struct ListedFile   *listedPtr = NULL;
+size_t              pageCount = g_MarkdownFilenameCount;
+size_t              fileIndex = 0;
+size_t              keptCount = 0;
+long long           total = 0;
+long long           before = 0;
+long                shard = 0;
+
+    pagesPtr = (struct ShardPage *)malloc( ( pageCount + 1 ) * sizeof(struct ShardPage) );
+
+    assert( pagesPtr );
+
+    for( fileIndex = 0; fileIndex < pageCount; fileIndex++ )
+    {
+        listedPtr = findListedFile( g_MarkdownFilenameList[fileIndex] );
+
+        pagesPtr[fileIndex].fileIndex   = fileIndex;
+        pagesPtr[fileIndex].hash        = hashBytes( HASH_SEED, g_MarkdownFilenameList[fileIndex], strlen( g_MarkdownFilenameList[fileIndex] ) );
+        pagesPtr[fileIndex].weight      = ( ( NULL == listedPtr ) ? 0 : listedPtr->stamp.size ) + 1;
+
+        total += pagesPtr[fileIndex].weight;
+    }
+
+    qsort( pagesPtr, pageCount, sizeof(struct ShardPage), compareShardPages );
+
+    for( fileIndex = 0; fileIndex < pageCount; fileIndex++ )
+    {
+        shard   = (long)( ( 2 * before + pagesPtr[fileIndex].weight ) * g_Options.shardCount / ( 2 * total ) );
+        before += pagesPtr[fileIndex].weight;
+
+        if( shard + 1 != g_Options.shardIndex )
+        {
+            free( g_MarkdownFilenameList[pagesPtr[fileIndex].fileIndex] );
+
+            g_MarkdownFilenameList[pagesPtr[fileIndex].fileIndex] = NULL;
+        }
+    }
+
+    free( pagesPtr );
+
+    for( fileIndex = 0; fileIndex < pageCount; fileIndex++ )
+    {
+        if( NULL != g_MarkdownFilenameList[fileIndex] )
+        {
+            g_MarkdownFilenameList[keptCount++] = g_MarkdownFilenameList[fileIndex];
+        }
+    }
+
+    g_MarkdownFilenameCount = keptCount;
+
+    keptCount = 0;
+
+    for( fileIndex = 0; fileIndex < g_AssetCount; fileIndex++ )
+    {
+        if( (long)( hashBytes( HASH_SEED, g_AssetPtr[fileIndex].filename, strlen( g_AssetPtr[fileIndex].filename ) ) % g_Options.shardCount ) + 1 == g_Options.shardIndex )
+        {
+            g_AssetPtr[keptCount++] = g_AssetPtr[fileIndex];
+        }
+        else
+        {
+            free( g_AssetPtr[fileIndex].filename );
+        }
+    }
+
+    g_AssetCount = keptCount;
+
+    verbose( "Shard %ld of %ld makes %zu of %zu web pages\n", g_Options.shardIndex, g_Options.shardCount, g_MarkdownFilenameCount, pageCount );
+}
+
+/**
+ * void mergeShardManifests( void )
+ * 
+ * Merge mode : put together the shard manifests left in the html root by the
+ * shards of a site, as the new manifest, as if one site mode run had made 
+ * every page. They must all be there, and all from the same number of shards. 
+ * The markdown file list becomes the pages in them, so that saveManifest() and
+ * saveSiteIndex() work as they do for a site mode run. A page in more than one
+ * is taken from the first. The shards must have mirrored assets as the merge 
+ * is asked to, so that their assets aren't lost from the manifest.
+ * 
+ * in       : none
+ * out      : g_NewManifestPtr and g_MarkdownFilenameList have every page
+ * out      : g_AssetPtr has every asset, sorted by filename
+ * err      : a message and exit if there aren't the shard manifests of a site,
+ *            or they mirrored assets another way
+ * err      : assert if failed to allocate the manifest entries
+ */
+void mergeShardManifests( void )
+{
+char                    manifestFilename[PATH_MAX + 1];
+char                    shardFilename[PATH_MAX + 1];
+char                    assetsLine[32];
+DIR                     *directoryPtr = NULL;
+struct dirent           *contentPtr = NULL;
+FILE                    *manifestFilePtr = NULL;
+char                    *linePtr = NULL;
+size_t                  lineSize = 0;
+struct ManifestEntry    *entriesPtr = NULL;
+size_t                  entryCount = 0;
+size_t                  entryIndex = 0;
+size_t                  keptCount = 0;
+bool                    *foundPtr = NULL;
+long                    shardIndex = 0;
+long                    shardCount = 0;
+long                    count = 0;
+
+    // how many shards there were is in the names of their manifests, which 
+    // go on from the manifest's own name as the format does after its "%s"
+
+    directoryPtr = opendir( g_Options.webpageRoot );
+
+    assert( directoryPtr );
+
+    while( NULL != ( contentPtr = readdir( directoryPtr ) ) )
+    {
+        if( ( 0 != strncmp( contentPtr->d_name, MANIFEST_FILENAME, strlen( MANIFEST_FILENAME ) ) ) ||
+            ( 2 != sscanf( contentPtr->d_name + strlen( MANIFEST_FILENAME ), SHARD_MANIFEST_FORMAT + strlen( "%s" ), &shardIndex, &count ) ) )
+        {
+            continue;
+        }
+
+        snprintf( shardFilename, sizeof(shardFilename), SHARD_MANIFEST_FORMAT, MANIFEST_FILENAME, shardIndex, count );
+
+        if( ( 0 != strcmp( shardFilename, contentPtr->d_name ) ) || ( shardIndex < 1 ) || ( shardIndex > count ) )
+        {
+            continue;
+        }
+
+        if( 0 == shardCount )
+        {
+            shardCount  = count;
+            foundPtr    = (bool *)calloc( shardCount + 1, sizeof(bool) );
+
+            assert( foundPtr );
+        }
+        else if( count != shardCount )
+        {
+            printf( "Shard manifests in %s are from different numbers of shards\n", g_Options.webpageRoot );
+            exit( EXIT_BAD_SHARD );
+        }
+
+        foundPtr[shardIndex] = true;
+    }
+
+    closedir( directoryPtr );
+
+    if( 0 == shardCount )
+    {
+        printf( "No shard manifests in %s to merge\n", g_Options.webpageRoot );
+        exit( EXIT_BAD_SHARD );
+    }
+
+    snprintf( manifestFilename, sizeof(manifestFilename), "%s/%s", g_Options.webpageRoot, MANIFEST_FILENAME );
+
+    for( shardIndex = 1; shardIndex <= shardCount; shardIndex++ )
+    {
+        snprintf( shardFilename, sizeof(shardFilename), SHARD_MANIFEST_FORMAT, manifestFilename, shardIndex, shardCount );
+
+        manifestFilePtr = foundPtr[shardIndex] ? fopen( shardFilename, "r" ) : NULL;
+
+        if( NULL == manifestFilePtr )
+        {
+            printf( "Shard manifest %ld of %ld is missing from %s\n", shardIndex, shardCount, g_Options.webpageRoot );
+            exit( EXIT_BAD_SHARD );
+        }
+
+        if( ( -1 == getline( &linePtr, &lineSize, manifestFilePtr ) ) || ( 0 != strcmp( linePtr, MANIFEST_HEADER ) ) )
+        {
+            printf( "Shard manifest %s is from another version\n", shardFilename );
+            exit( EXIT_BAD_SHARD );
+        }
+
+        snprintf( assetsLine, sizeof(assetsLine), SHARD_ASSETS_FORMAT, g_AssetModeNames[g_Options.assetMode] );
+
+        if( ( -1 == getline( &linePtr, &lineSize, manifestFilePtr ) ) || ( 0 != strcmp( linePtr, assetsLine ) ) )
+        {
+            printf( "Shard manifest %s was made with another 'assets' option than the merge\n", shardFilename );
+            exit( EXIT_BAD_SHARD );
+        }
+
+        readManifest( manifestFilePtr, &entriesPtr, &entryCount, &g_AssetPtr, &g_AssetCount );
+
+        fclose( manifestFilePtr );
+
+        verbose( "Loaded shard manifest %s\n", shardFilename );
+    }
+
+    free( linePtr );
+    free( foundPtr );
+
+    qsort( entriesPtr, entryCount, sizeof(struct ManifestEntry), compareManifestEntries );
+
+    for( entryIndex = 0; entryIndex < entryCount; entryIndex++ )
+    {
+        if( ( keptCount > 0 ) && ( 0 == strcmp( entriesPtr[keptCount - 1].markdownFilename, entriesPtr[entryIndex].markdownFilename ) ) )
+        {
+            verbose( "Web page for %s is in more than one shard manifest\n", entriesPtr[entryIndex].markdownFilename );
+
+            forgetManifestEntry( &entriesPtr[entryIndex] );
+            continue;
+        }
+
+        entriesPtr[keptCount++] = entriesPtr[entryIndex];
+    }
+
+    // the new manifest, and the markdown file list to go with it, in place of
+    // those from loadManifest() and the search
+
+    free( g_NewManifestPtr );
+
+    g_NewManifestPtr = (struct ManifestEntry *)realloc( entriesPtr, ( keptCount + 1 ) * sizeof(struct ManifestEntry) );
+
+    assert( g_NewManifestPtr );
+
+    for( entryIndex = 0; entryIndex < keptCount; entryIndex++ )
+    {
+        addMarkdownFilename( g_NewManifestPtr[entryIndex].markdownFilename );
+    }
+
+    qsort( g_AssetPtr, g_AssetCount, sizeof(struct AssetEntry), compareAssetEntries );
+
+    // nothing is made, but the stats report still lists every page
+
+    if( NULL != g_PageStatsPtr )
+    {
+        free( g_PageStatsPtr );
+
+        g_PageStatsPtr = (struct PageStats *)calloc( g_MarkdownFilenameCount + 1, sizeof(struct PageStats) );
+
+        assert( g_PageStatsPtr );
+    }
+
+    g_ShardManifestCount = shardCount;
+
+    verbose( "Merged %zu web pages and %zu assets from %ld shard manifests\n", g_MarkdownFilenameCount, g_AssetCount, shardCount );
+}
+
+/**
+ * void removeShardManifests( void )
+ * 
+ * Merge mode : remove the shard manifests once the merged manifest has been 
+ * saved, so that the next merge isn't given any left over.
+ * 
+ * in       : none
+ * out      : the shard manifests have gone
+ * err      : none
+ */
+void removeShardManifests( void )
+{
+char    manifestFilename[PATH_MAX + 1];
+char    shardFilename[PATH_MAX + 1];
+long    shardIndex = 0;
+
+    snprintf( manifestFilename, sizeof(manifestFilename), "%s/%s", g_Options.webpageRoot, MANIFEST_FILENAME );
+
+    for( shardIndex = 1; shardIndex <= g_ShardManifestCount; shardIndex++ )
+    {
+        snprintf( shardFilename, sizeof(shardFilename), SHARD_MANIFEST_FORMAT, manifestFilename, shardIndex, g_ShardManifestCount );
+
+        verbose( "Removing shard manifest %s\n", shardFilename );
+
+        unlink( shardFilename );
+    }
+}
+
+/**
+ * int compareNanoseconds( const void *firstPtr, const void *secondPtr )
+ * 
+ * qsort() comparison for times.
+ * 
+ * in       : firstPtr      -   a uint64_t
+ * in       : secondPtr     -   another uint64_t
+ * out      : <0, 0 or >0 as for strcmp
+ * err      : none
+ */
+int compareNanoseconds( const void *firstPtr, const void *secondPtr )
+{
+uint64_t first  = *(const uint64_t *)firstPtr;
+uint64_t second = *(const uint64_t *)secondPtr;
+
+    return( ( first > second ) - ( first < second ) );
+}
+
+/**
+ * void writeJsonString( FILE *statsFilePtr, const char *stringPtr )
+ * 
+ * Write a string as a quoted JSON string, escaping anything that needs it.
+ * 
+ * in       : statsFilePtr  -   where to write it
+ * in       : stringPtr     -   the string
+ * out      : the string has been written
+ * err      : none
+ */
+void writeJsonString( FILE *statsFilePtr, const char *stringPtr )
+{
+    fputc( '"', statsFilePtr );
+
+    for( ; '\0' != *stringPtr; stringPtr++ )
+    {
+    unsigned char c = (unsigned char)*stringPtr;
+
+        if( ( '"' == c ) || ( '\\' == c ) )
+        {
+            fprintf( statsFilePtr, "\\%c", c );
+        }
+        else if( c < 0x20 )
+        {
+            fprintf( statsFilePtr, "\\u%04x", c );
+        }
+        else
+        {
+            fputc( c, statsFilePtr );
+        }
+    }
+
+    fputc( '"', statsFilePtr );
+}
+
+/**
+ * void writeSummary( FILE *statsFilePtr, const char *namePtr, uint64_t *valuesPtr, size_t count, bool last )
+ * 
+ * Write a summary of the times taken by a phase for every page made : the 
+ * total, the median, the 99th percentile and the slowest. The percentiles are
+ * by nearest rank.
+ * 
+ * in       : statsFilePtr  -   where to write it
+ * in       : namePtr       -   name of the phase
+ * in       : valuesPtr     -   the time taken for each page, sorted by this
+ * in       : count         -   how many pages
+ * in       : last          -   true if this is the last summary
+ * out      : the summary has been written
+ * err      : none
+ */
+void writeSummary( FILE *statsFilePtr, const char *namePtr, uint64_t *valuesPtr, size_t count, bool last )
+{
+uint64_t    total = 0;
+size_t      index = 0;
+
+    qsort( valuesPtr, count, sizeof(uint64_t), compareNanoseconds );
+
+    for( index = 0; index < count; index++ )
+    {
+        total += valuesPtr[index];
+    }
+
+    fprintf( statsFilePtr, "    \"%s\": { \"total_ns\": %" PRIu64 ", \"p50_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 " }%s\n",
+             namePtr,
+             total,
+             ( 0 == count ) ? 0 : valuesPtr[( count * 50 + 99 ) / 100 - 1],
+             ( 0 == count ) ? 0 : valuesPtr[( count * 99 + 99 ) / 100 - 1],
+             ( 0 == count ) ? 0 : valuesPtr[count - 1],
+             last ? "" : "," );
+}
+
+/**
+ * void saveStats( uint64_t runStartTime )
+ * 
+ * Write the stats report, as JSON, to the file given with 'T' ( stdout if
+ * that's '-' ). It has the peak resident set size, how long each part of the 
+ * run took, the run totals of the counts, a summary of each phase over the 
+ * pages that were made, and the times and counts for every page.
+ * 
+ * in       : runStartTime  -   when the run started, from getNanoseconds()
+ * out      : the stats report has been written
+ * err      : exit if the stats file cannot be written
+ * err      : assert if failed to allocate space to sort the times
+ */
+void saveStats( uint64_t runStartTime )
+{
+FILE        *statsFilePtr = stdout;
+uint64_t    *valuesPtr = NULL;
+size_t      madeCount = 0;
+size_t      fileIndex = 0;
+int         phase = 0;
+int         count = 0;
+struct rusage usage;
+
+    g_RunNanoseconds[run_total] = getNanoseconds() - runStartTime;
+
+    getrusage( RUSAGE_SELF, &usage );
+
+    if( 0 != strcmp( "-", g_Options.statsFilename ) )
+    {
+        statsFilePtr = fopen( g_Options.statsFilename, "w" );
+
+        if( NULL == statsFilePtr )
+        {
+            printf( "Cannot write stats file %s\n", g_Options.statsFilename );
+            exit( EXIT_BAD_STATS_FILE );
+        }
+    }
+
+    valuesPtr = (uint64_t *)malloc( ( g_MarkdownFilenameCount + 1 ) * sizeof(uint64_t) );
+
+    assert( valuesPtr );
+
+    for( fileIndex = 0; fileIndex < g_MarkdownFilenameCount; fileIndex++ )
+    {
+        madeCount += g_PageStatsPtr[fileIndex].made ? 1 : 0;
+    }
+
+    fprintf( statsFilePtr, "{\n  \"jobs\": %ld,\n  \"pages\": %zu,\n  \"made\": %zu,\n  \"peak_rss_kb\": %ld,\n  \"mem_budget_kb\": %lld,\n  \"peak_reserved_kb\": %lld,\n  \"run\": {", 
+             g_Options.jobCount, g_MarkdownFilenameCount, madeCount, usage.ru_maxrss, g_Options.memoryBudget / 1024, g_MemoryPeakReserved / 1024 );
+
+    for( phase = 0; phase < run_end; phase++ )
+    {
+        fprintf( statsFilePtr, "%s \"%s_ns\": %" PRIu64, ( 0 == phase ) ? "" : ",", g_RunPhaseNames[phase], g_RunNanoseconds[phase] );
+    }
+
+    fprintf( statsFilePtr, " },\n  \"counts\": {" );
+
+    for( count = 0; count < count_end; count++ )
+    {
+        fprintf( statsFilePtr, "%s \"%s\": %" PRIu64, ( 0 == count ) ? "" : ",", g_CountNames[count], g_RunCounts[count] );
+    }
+
+    // Summaries of each phase, then of whole pages, over the pages made
+
+    fprintf( statsFilePtr, " },\n  \"phases\": {\n" );
+
+    for( phase = 0; phase <= phase_end; phase++ )
+    {
+    size_t valueCount = 0;
+
+        for( fileIndex = 0; fileIndex < g_MarkdownFilenameCount; fileIndex++ )
+        {
+            if( g_PageStatsPtr[fileIndex].made )
+            {
+                valuesPtr[valueCount++] = ( phase_end == phase ) ? g_PageStatsPtr[fileIndex].totalNanoseconds : g_PageStatsPtr[fileIndex].phaseNanoseconds[phase];
+            }
+        }
+
+        writeSummary( statsFilePtr, ( phase_end == phase ) ? "page" : g_PhaseNames[phase], valuesPtr, valueCount, phase_end == phase );
+    }
+
+    fprintf( statsFilePtr, "  },\n  \"per_page\": [\n" );
+
+    for( fileIndex = 0; fileIndex < g_MarkdownFilenameCount; fileIndex++ )
+    {
+    struct PageStats *statsPtr = &g_PageStatsPtr[fileIndex];
+
+        fprintf( statsFilePtr, "    { \"markdown\": " );
+        writeJsonString( statsFilePtr, g_MarkdownFilenameList[fileIndex] );
+        fprintf( statsFilePtr, ", \"made\": %s, \"page_ns\": %" PRIu64, statsPtr->made ? "true" : "false", statsPtr->totalNanoseconds );
+
+        for( phase = 0; phase < phase_end; phase++ )
+        {
+            fprintf( statsFilePtr, ", \"%s_ns\": %" PRIu64, g_PhaseNames[phase], statsPtr->phaseNanoseconds[phase] );
+        }
+
+        for( count = 0; count < count_end; count++ )
+        {
+            fprintf( statsFilePtr, ", \"%s\": %" PRIu64, g_CountNames[count], statsPtr->counts[count] );
+        }
+
+        fprintf( statsFilePtr, " }%s\n", ( fileIndex + 1 == g_MarkdownFilenameCount ) ? "" : "," );
+    }
+
+    fprintf( statsFilePtr, "  ]\n}\n" );
+
+    free( valuesPtr );
+
+    if( stdout == statsFilePtr )
+    {
+        fflush( stdout );
+    }
+    else
+    {
+        fclose( statsFilePtr );
+    }
+}
+
+/**
+ * int compareWorkItems( const void *firstPtr, const void *secondPtr )
+ * 
+ * qsort() comparison for pages to be dealt out, largest first, and otherwise 
+ * in the order they are listed.
+ */
+int compareWorkItems( const void *firstPtr, const void *secondPtr )
+{
+const struct WorkItem *firstItemPtr = (const struct WorkItem *)firstPtr;
+const struct WorkItem *secondItemPtr = (const struct WorkItem *)secondPtr;
+
+    if( firstItemPtr->size != secondItemPtr->size )
+    {
+        return( ( firstItemPtr->size > secondItemPtr->size ) ? -1 : 1 );
+    }
+
+    return( ( firstItemPtr->workIndex < secondItemPtr->workIndex ) ? -1 : ( firstItemPtr->workIndex > secondItemPtr->workIndex ) );
+}
+
+/**
+ * void queueWebpages( size_t pageCount, long queueCount )
+ * 
+ * Deal the pages to be made out to a work queue for each worker thread, in 
+ * turn. With more than one queue, the largest markdown files are dealt first, 
+ * going by the sizes the site mode search found ( pages not listed count as 
+ * empty ), so each worker starts on the biggest pages it has. Outside site 
+ * mode, the markdown files are only stat()ed for their sizes if there's a 
+ * memory budget to keep to. With one queue, the pages are made in the order 
+ * they are listed.
+ * 
+ * in       : pageCount     -   number of pages to be made
+ * in       : queueCount    -   number of worker threads
+ * out      : g_WorkQueuePtr has the queues
+ * err      : assert if failed to allocate the queues
+ */
+void queueWebpages( size_t pageCount, long queueCount )
+{
+struct WorkItem     *itemsPtr = NULL;
+struct WorkQueue    *queuePtr = NULL;
+struct ListedFile   *listedPtr = NULL;
+struct stat         markdownStat;
+size_t              workIndex = 0;
+size_t              fileIndex = 0;
+long                queueIndex = 0;
+int                 result = 0;
+
+    g_WorkQueuePtr      = (struct WorkQueue *)calloc( queueCount, sizeof(struct WorkQueue) );
+    g_WorkQueueCount    = queueCount;
+    itemsPtr            = (struct WorkItem *)malloc( ( pageCount + 1 ) * sizeof(struct WorkItem) );
+
+    assert( g_WorkQueuePtr && itemsPtr );
+
+    for( queueIndex = 0; queueIndex < queueCount; queueIndex++ )
+    {
+        result = pthread_mutex_init( &g_WorkQueuePtr[queueIndex].mutex, NULL );
+
+        assert( 0 == result );
+
+        // pages left over go to the first queues
+
+        g_WorkQueuePtr[queueIndex].itemsPtr = (struct WorkItem *)malloc( ( pageCount / queueCount + 1 ) * sizeof(struct WorkItem) );
+
+        assert( g_WorkQueuePtr[queueIndex].itemsPtr );
+    }
+
+    for( workIndex = 0; workIndex < pageCount; workIndex++ )
+    {
+        fileIndex = ( NULL == g_PageIndexList ) ? workIndex : g_PageIndexList[workIndex];
+
+        itemsPtr[workIndex].workIndex   = workIndex;
+        itemsPtr[workIndex].size        = 0;
+        itemsPtr[workIndex].reserved    = 0;
+
+        if( queueCount <= 1 )
+        {
+            continue;
+        }
+
+        if( g_Options.siteMode )
+        {
+            listedPtr = findListedFile( g_MarkdownFilenameList[fileIndex] );
+
+            itemsPtr[workIndex].size = ( NULL == listedPtr ) ? 0 : listedPtr->stamp.size;
+        }
+        else if( ( 0 != g_Options.memoryBudget ) && ( 0 == stat( g_MarkdownFilenameList[fileIndex], &markdownStat ) ) )
+        {
+            itemsPtr[workIndex].size = markdownStat.st_size;
+        }
+    }
+
+    if( queueCount > 1 )
+    {
+        qsort( itemsPtr, pageCount, sizeof(struct WorkItem), compareWorkItems );
+    }
+
+    for( workIndex = 0; workIndex < pageCount; workIndex++ )
+    {
+        queuePtr = &g_WorkQueuePtr[workIndex % queueCount];
+
+        queuePtr->itemsPtr[queuePtr->tail++] = itemsPtr[workIndex];
+    }
+
+    free( itemsPtr );
+}
+
+/**
+ * bool reserveMemory( struct WorkItem *itemPtr )
+ * 
+ * Reserve enough of the memory budget to make a page, if there's room for it.
+ * There's always room when nothing else is reserved, so that a page bigger 
+ * than the whole budget is made, on its own. Without a budget, there's room 
+ * for anything.
+ * 
+ * in       : itemPtr   -   the page
+ * out      : true if reserved, with itemPtr->reserved set
+ * err      : none
+ */
+bool reserveMemory( struct WorkItem *itemPtr )
+{
+long long   estimate = 0;
+bool        reserved = false;
+
+    if( 0 == g_Options.memoryBudget )
+    {
+        return( true );
+    }
+
+    pthread_mutex_lock( &g_MemoryMutex );
+
+    estimate = (long long)ARENA_BLOCK_SIZE + itemPtr->size * g_MemoryExpansion;
+
+    if( ( 0 == g_MemoryReserved ) || ( g_MemoryReserved + estimate <= g_Options.memoryBudget ) )
+    {
+        itemPtr->reserved   = estimate;
+        g_MemoryReserved   += estimate;
+        reserved            = true;
+
+        if( g_MemoryReserved > g_MemoryPeakReserved )
+        {
+            g_MemoryPeakReserved = g_MemoryReserved;
+        }
+    }
+
+    pthread_mutex_unlock( &g_MemoryMutex );
+
+    return( reserved );
+}
+
+/**
+ * void releaseMemory( const struct WorkItem *itemPtr, long long measured )
+ * 
+ * A page has been made, so give back the memory reserved for it, and wake any
+ * worker waiting for some. What the page was measured to take raises the 
+ * expansion ratio, if it's more than expected.
+ * 
+ * in       : itemPtr   -   the page
+ * in       : measured  -   the memory the page took
+ * out      : the page's memory is no longer reserved
+ * err      : none
+ */
+void releaseMemory( const struct WorkItem *itemPtr, long long measured )
+{
+long long   expansion = 0;
+
+    if( 0 == g_Options.memoryBudget )
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &g_MemoryMutex );
+
+    g_MemoryReserved -= itemPtr->reserved;
+
+    if( itemPtr->size >= MEMORY_MEASURED_SIZE )
+    {
+        expansion = ( measured + itemPtr->size - 1 ) / itemPtr->size;
+
+        if( expansion > g_MemoryExpansion )
+        {
+            verbose( "Memory expansion ratio is now %lld\n", expansion );
+
+            g_MemoryExpansion = expansion;
+        }
+    }
+
+    g_MemoryReleaseCount++;
+
+    pthread_cond_broadcast( &g_MemoryCondition );
+
+    pthread_mutex_unlock( &g_MemoryMutex );
+}
+
+/**
+ * bool takeWork( long queueIndex, struct WorkItem *itemPtr )
+ * 
+ * Worker thread : take the next page to make from the front of this worker's
+ * own queue, or once that's empty, steal the largest page not yet started 
+ * from the front of another queue, trying each in turn. Nothing is queued 
+ * once the workers have started, so when every queue is empty, the work is 
+ * done.
+ * 
+ * With a memory budget, a page is only taken once memory is reserved for it.
+ * If the page at the front of a queue doesn't fit, the smallest at the back is
+ * tried instead, and then the other queues. If there are pages left but none 
+ * of them fit, the worker waits for memory to be given back.
+ * 
+ * in       : queueIndex    -   this worker's queue
+ * out      : *itemPtr      -   the page to make, if there is one
+ * out      : true if there was a page to make
+ * err      : none
+ */
+bool takeWork( long queueIndex, struct WorkItem *itemPtr )
+{
+struct WorkQueue    *queuePtr = NULL;
+long                victimIndex = 0;
+size_t              fileIndex = 0;
+uint64_t            releaseCount = 0;
+bool                taken = false;
+bool                remaining = false;
+
+    while( true )
+    {
+        pthread_mutex_lock( &g_MemoryMutex );
+
+        releaseCount = g_MemoryReleaseCount;
+
+        pthread_mutex_unlock( &g_MemoryMutex );
+
+        remaining = false;
+
+        for( victimIndex = 0; !taken && ( victimIndex < g_WorkQueueCount ); victimIndex++ )
+        {
+            queuePtr = &g_WorkQueuePtr[( queueIndex + victimIndex ) % g_WorkQueueCount];
+
+            pthread_mutex_lock( &queuePtr->mutex );
+
+            if( queuePtr->head < queuePtr->tail )
+            {
+                remaining = true;
+
+                if( reserveMemory( &queuePtr->itemsPtr[queuePtr->head] ) )
+                {
+                    *itemPtr    = queuePtr->itemsPtr[queuePtr->head++];
+                    taken       = true;
+                }
+                else if( reserveMemory( &queuePtr->itemsPtr[queuePtr->tail - 1] ) )
+                {
+                    *itemPtr    = queuePtr->itemsPtr[--queuePtr->tail];
+                    taken       = true;
+                }
+
+                if( taken )
+                {
+                    fileIndex = ( NULL == g_PageIndexList ) ? itemPtr->workIndex : g_PageIndexList[itemPtr->workIndex];
+                }
+
+                // with one worker there's nothing to say
+
+                if( taken && ( 0 == victimIndex ) && ( g_WorkQueueCount > 1 ) )
+                {
+                    verbose( "Worker %ld took %s\n", queueIndex, g_MarkdownFilenameList[fileIndex] );
+                }
+                else if( taken && ( 0 != victimIndex ) )
+                {
+                    verbose( "Worker %ld took %s from worker %ld\n", queueIndex, g_MarkdownFilenameList[fileIndex], ( queueIndex + victimIndex ) % g_WorkQueueCount );
+                    TRACE( TRACE_PAGES, trace_work_stolen, itemPtr->workIndex, ( queueIndex + victimIndex ) % g_WorkQueueCount );
+                }
+            }
+
+            pthread_mutex_unlock( &queuePtr->mutex );
+        }
+
+        if( taken || !remaining )
+        {
+            return( taken );
+        }
+
+        // every page left needs more memory than there is just now
+
+        pthread_mutex_lock( &g_MemoryMutex );
+
+        while( releaseCount == g_MemoryReleaseCount )
+        {
+            pthread_cond_wait( &g_MemoryCondition, &g_MemoryMutex );
+        }
+
+        pthread_mutex_unlock( &g_MemoryMutex );
+    }
+}
+
+/**
+ * bool peekWork( long queueIndex, struct WorkItem *itemPtr )
+ * 
+ * Worker thread : look at the page at the front of this worker's own queue, 
+ * which it will most likely take next, without taking it.
+ * 
+ * in       : queueIndex    -   this worker's queue
+ * out      : *itemPtr      -   the page at the front of the queue, if any
+ * out      : true if the queue isn't empty
+ * err      : none
+ */
+bool peekWork( long queueIndex, struct WorkItem *itemPtr )
+{
+struct WorkQueue    *queuePtr = &g_WorkQueuePtr[queueIndex];
+bool                found = false;
+
+    pthread_mutex_lock( &queuePtr->mutex );
+
+    if( queuePtr->head < queuePtr->tail )
+    {
+        *itemPtr    = queuePtr->itemsPtr[queuePtr->head];
+        found       = true;
+    }
+
+    pthread_mutex_unlock( &queuePtr->mutex );
+
+    return( found );
+}
+
+#ifdef WEBPAGE_IO_URING
+/**
+ * bool openUringReader( struct UringReader *readerPtr )
+ * 
+ * Worker thread : set up an io_uring to read markdown ahead with, if the 
+ * 'io-uring' option is on and the markdown tree was listed by the site mode 
+ * search, which gives the size of each file. The kernel has to be able to 
+ * open a file straight into a fixed file slot and read it in the same chain 
+ * ( IORING_FEAT_LINKED_FILE, Linux 5.17 ), otherwise the reader is left closed
+ * and markdown is read as it's needed, as it is without the option.
+ * 
+ * in       : readerPtr     -   the reader
+ * out      : true if the reader is open
+ * err      : none
+ */
+bool openUringReader( struct UringReader *readerPtr )
+{
+struct io_uring_params  params;
+int                     files[URING_SLOTS] = { -1, -1 };
+char                    *sqRingPtr = NULL;
+char                    *cqRingPtr = NULL;
+
+    memset( readerPtr, 0, sizeof(struct UringReader) );
+
+    readerPtr->ringFD       = -1;
+    readerPtr->sqRingPtr    = MAP_FAILED;
+    readerPtr->cqRingPtr    = MAP_FAILED;
+    readerPtr->sqesPtr      = MAP_FAILED;
+
+    if( !g_Options.ioUring || !g_FilesListed )
+    {
+        return( false );
+    }
+
+    memset( &params, 0, sizeof(params) );
+
+    readerPtr->ringFD = (int)syscall( __NR_io_uring_setup, URING_ENTRIES, &params );
+
+    if( -1 == readerPtr->ringFD )
+    {
+        verbose( "No io_uring ( %s ), so markdown is read as it's needed\n", strerror( errno ) );
+        return( false );
+    }
+
+    readerPtr->sqRingSize   = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    readerPtr->cqRingSize   = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    readerPtr->sqesSize     = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if( 0 != ( params.features & IORING_FEAT_LINKED_FILE ) )
+    {
+        readerPtr->sqRingPtr    = mmap( NULL, readerPtr->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, readerPtr->ringFD, IORING_OFF_SQ_RING );
+        readerPtr->cqRingPtr    = mmap( NULL, readerPtr->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, readerPtr->ringFD, IORING_OFF_CQ_RING );
+        readerPtr->sqesPtr      = mmap( NULL, readerPtr->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, readerPtr->ringFD, IORING_OFF_SQES );
+    }
+
+    if( ( MAP_FAILED == readerPtr->sqRingPtr ) || ( MAP_FAILED == readerPtr->cqRingPtr ) || ( MAP_FAILED == readerPtr->sqesPtr ) ||
+        ( 0 != syscall( __NR_io_uring_register, readerPtr->ringFD, IORING_REGISTER_FILES, files, URING_SLOTS ) ) )
+    {
+        verbose( "io_uring can't read ahead on this kernel, so markdown is read as it's needed\n" );
+
+        closeUringReader( readerPtr );
+
+        return( false );
+    }
+
+    sqRingPtr = (char *)readerPtr->sqRingPtr;
+    cqRingPtr = (char *)readerPtr->cqRingPtr;
+
+    readerPtr->sqTailPtr    = (unsigned int *)( sqRingPtr + params.sq_off.tail );
+    readerPtr->sqMask       = *(unsigned int *)( sqRingPtr + params.sq_off.ring_mask );
+    readerPtr->sqArrayPtr   = (unsigned int *)( sqRingPtr + params.sq_off.array );
+    readerPtr->cqHeadPtr    = (unsigned int *)( cqRingPtr + params.cq_off.head );
+    readerPtr->cqTailPtr    = (unsigned int *)( cqRingPtr + params.cq_off.tail );
+    readerPtr->cqMask       = *(unsigned int *)( cqRingPtr + params.cq_off.ring_mask );
+    readerPtr->cqesPtr      = (struct io_uring_cqe *)( cqRingPtr + params.cq_off.cqes );
+
+    verbose( "Reading markdown ahead using io_uring\n" );
+
+    return( true );
+}
+
+/**
+ * void closeUringReader( struct UringReader *readerPtr )
+ * 
+ * Worker thread : wait for any read still going, then free the buffers and 
+ * close the ring. A reader that was never opened, or only partly, is fine.
+ * 
+ * in       : readerPtr     -   the reader
+ * out      : the reader is closed
+ * err      : none
+ */
+void closeUringReader( struct UringReader *readerPtr )
+{
+int slot = 0;
+
+    for( slot = 0; slot < URING_SLOTS; slot++ )
+    {
+        waitUringRead( readerPtr, slot );
+
+        free( readerPtr->reads[slot].bufferPtr );
+
+        readerPtr->reads[slot].bufferPtr    = NULL;
+        readerPtr->reads[slot].bufferSize   = 0;
+    }
+
+    if( MAP_FAILED != readerPtr->sqesPtr )
+    {
+        munmap( readerPtr->sqesPtr, readerPtr->sqesSize );
+    }
+
+    if( MAP_FAILED != readerPtr->cqRingPtr )
+    {
+        munmap( readerPtr->cqRingPtr, readerPtr->cqRingSize );
+    }
+
+    if( MAP_FAILED != readerPtr->sqRingPtr )
+    {
+        munmap( readerPtr->sqRingPtr, readerPtr->sqRingSize );
+    }
+
+    if( -1 != readerPtr->ringFD )
+    {
+        close( readerPtr->ringFD );
+    }
+
+    readerPtr->ringFD       = -1;
+    readerPtr->sqRingPtr    = MAP_FAILED;
+    readerPtr->cqRingPtr    = MAP_FAILED;
+    readerPtr->sqesPtr      = MAP_FAILED;
+}
+
+/**
+ * void startUringRead( struct UringReader *readerPtr, int slot, size_t workIndex, const char *filenamePtr, size_t size )
+ * 
+ * Worker thread : start reading a markdown file into a slot that isn't in use,
+ * as a chain of open, read and close, submitted together. The read goes on 
+ * while the worker gets on with something else. The open can't be O_CLOEXEC, 
+ * as the file goes into the ring's fixed file table rather than the process's.
+ * 
+ * in       : readerPtr     -   the reader
+ * in       : slot          -   the slot to read into
+ * in       : workIndex     -   the page the markdown is for
+ * in       : filenamePtr   -   markdown filename relative to markdown root
+ * in       : size          -   the size the file was listed as having
+ * out      : the read is pending in the slot
+ * err      : assert on failure to submit the read
+ */
+void startUringRead( struct UringReader *readerPtr, int slot, size_t workIndex, const char *filenamePtr, size_t size )
+{
+struct UringRead    *readPtr = &readerPtr->reads[slot];
+struct io_uring_sqe *sqePtr[URING_OPS];
+unsigned int        tail = *readerPtr->sqTailPtr;
+unsigned int        index = 0;
+int                 op = 0;
+int                 submitted = 0;
+
+    if( readPtr->bufferSize < size + 1 )
+    {
+        free( readPtr->bufferPtr );
+
+        readPtr->bufferPtr  = (char *)malloc( size + 1 );
+        readPtr->bufferSize = size + 1;
+
+        assert( readPtr->bufferPtr );
+    }
+
+    snprintf( readPtr->filename, sizeof(readPtr->filename), "%s/%s", g_Options.markdownRoot, filenamePtr );
+
+    readPtr->workIndex      = workIndex;
+    readPtr->expected       = size;
+    readPtr->completions    = 0;
+
+    for( op = 0; op < URING_OPS; op++ )
+    {
+        index       = ( tail + op ) & readerPtr->sqMask;
+        sqePtr[op]  = &readerPtr->sqesPtr[index];
+
+        memset( sqePtr[op], 0, sizeof(struct io_uring_sqe) );
+
+        sqePtr[op]->user_data           = (uint64_t)( slot * URING_OPS + op );
+        readerPtr->sqArrayPtr[index]    = index;
+        readPtr->results[op]            = 0;
+    }
+
+    sqePtr[0]->opcode       = IORING_OP_OPENAT;
+    sqePtr[0]->flags        = IOSQE_IO_LINK;
+    sqePtr[0]->fd           = AT_FDCWD;
+    sqePtr[0]->addr         = (uint64_t)(uintptr_t)readPtr->filename;
+    sqePtr[0]->open_flags   = O_RDONLY;
+    sqePtr[0]->file_index   = slot + 1;
+
+    // a short read breaks a link, and this read is always short, so the close
+    // is hard linked to it
+
+    sqePtr[1]->opcode       = IORING_OP_READ;
+    sqePtr[1]->flags        = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqePtr[1]->fd           = slot;
+    sqePtr[1]->addr         = (uint64_t)(uintptr_t)readPtr->bufferPtr;
+    sqePtr[1]->len          = (uint32_t)( size + 1 );
+    sqePtr[1]->off          = 0;
+
+    sqePtr[2]->opcode       = IORING_OP_CLOSE;
+    sqePtr[2]->file_index   = slot + 1;
+
+    __atomic_store_n( readerPtr->sqTailPtr, tail + URING_OPS, __ATOMIC_RELEASE );
+
+    submitted = (int)syscall( __NR_io_uring_enter, readerPtr->ringFD, URING_OPS, 0, 0, NULL, 0 );
+
+    assert( URING_OPS == submitted );
+
+    readPtr->pending = true;
+
+    verbose( "Reading markdown file %s ahead\n", readPtr->filename );
+    TRACE( TRACE_PAGES, trace_read_ahead, readPtr->workIndex, readPtr->expected );
+}
+
+/**
+ * void waitUringRead( struct UringReader *readerPtr, int slot )
+ * 
+ * Worker thread : wait for the read in a slot, if there is one, to finish. 
+ * Completions for the other slot met along the way are recorded there.
+ * 
+ * in       : readerPtr     -   the reader
+ * in       : slot          -   the slot to wait for
+ * out      : the slot's read is no longer pending, and its results are in
+ * err      : assert on failure to wait
+ */
+void waitUringRead( struct UringReader *readerPtr, int slot )
+{
+struct UringRead    *readPtr = NULL;
+struct io_uring_cqe *cqePtr = NULL;
+unsigned int        head = 0;
+int                 result = 0;
+
+    while( readerPtr->reads[slot].pending )
+    {
+        head = *readerPtr->cqHeadPtr;
+
+        if( head == __atomic_load_n( readerPtr->cqTailPtr, __ATOMIC_ACQUIRE ) )
+        {
+            result = (int)syscall( __NR_io_uring_enter, readerPtr->ringFD, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0 );
+
+            assert( ( 0 <= result ) || ( EINTR == errno ) );
+
+            continue;
+        }
+
+        cqePtr  = &readerPtr->cqesPtr[head & readerPtr->cqMask];
+        readPtr = &readerPtr->reads[cqePtr->user_data / URING_OPS];
+
+        readPtr->results[cqePtr->user_data % URING_OPS] = cqePtr->res;
+
+        if( URING_OPS == ++readPtr->completions )
+        {
+            readPtr->pending = false;
+        }
+
+        __atomic_store_n( readerPtr->cqHeadPtr, head + 1, __ATOMIC_RELEASE );
+    }
+}
+
+/**
+ * bool isReadAheadWanted( size_t workIndex, const char **filenamePtrPtr, size_t *sizePtr )
+ * 
+ * Worker thread : should a page's markdown be read ahead of the page being 
+ * made? Only a listed file of up to MARKDOWN_READ_SIZE is, and in site mode 
+ * only one that has changed since the manifest was written, or isn't in it, 
+ * since an up to date page isn't made, and its markdown isn't read at all.
+ * 
+ * in       : workIndex         -   the page
+ * out      : *filenamePtrPtr   -   markdown filename relative to markdown root
+ * out      : *sizePtr          -   the size the file was listed as having
+ * out      : true if the markdown should be read ahead
+ * err      : none
+ */
+bool isReadAheadWanted( size_t workIndex, const char **filenamePtrPtr, size_t *sizePtr )
+{
+size_t                  fileIndex = ( NULL == g_PageIndexList ) ? workIndex : g_PageIndexList[workIndex];
+struct ListedFile       *listedPtr = findListedFile( g_MarkdownFilenameList[fileIndex] );
+struct ManifestEntry    *entryPtr = NULL;
+
+    if( ( NULL == listedPtr ) || !listedPtr->stamp.present || ( listedPtr->stamp.size <= 0 ) || ( listedPtr->stamp.size > (long long)MARKDOWN_READ_SIZE ) )
+    {
+        return( false );
+    }
+
+    *filenamePtrPtr = g_MarkdownFilenameList[fileIndex];
+    *sizePtr        = (size_t)listedPtr->stamp.size;
+
+    if( g_Options.forceRebuild || ( -1 != g_ArchiveFD ) )
+    {
+        return( true );
+    }
+
+    entryPtr = findManifestEntry( g_MarkdownFilenameList[fileIndex] );
+
+    return( ( NULL == entryPtr ) || 
+            ( entryPtr->markdownStamp.mtimeSeconds != listedPtr->stamp.mtimeSeconds ) ||
+            ( entryPtr->markdownStamp.mtimeNanoseconds != listedPtr->stamp.mtimeNanoseconds ) ||
+            ( entryPtr->markdownStamp.size != listedPtr->stamp.size ) );
+}
+
+/**
+ * void readAhead( struct UringReader *readerPtr, long queueIndex, const struct WorkItem *itemPtr, struct Page *pagePtr )
+ * 
+ * Worker thread : start reading the markdown of the page at the front of this
+ * worker's queue, in the slot not holding this page's, then wait for this 
+ * page's, if it was read ahead last time. The page's markdown is only used if
+ * the whole file was read, at the size it was listed as having; otherwise it's
+ * read as it's needed. A page read ahead but stolen by another worker just has
+ * its read thrown away when the slot is next used.
+ * 
+ * in       : readerPtr     -   the reader
+ * in       : queueIndex    -   this worker's queue
+ * in       : itemPtr       -   the page about to be made
+ * out      : pagePtr       -   the page, with its markdown in memory if it was
+ *                              read ahead
+ * err      : none
+ */
+void readAhead( struct UringReader *readerPtr, long queueIndex, const struct WorkItem *itemPtr, struct Page *pagePtr )
+{
+struct UringRead    *readPtr = NULL;
+struct WorkItem     next;
+const char          *filenamePtr = NULL;
+size_t              size = 0;
+int                 current = -1;
+int                 other = 0;
+int                 slot = 0;
+
+    if( -1 == readerPtr->ringFD )
+    {
+        return;
+    }
+
+    for( slot = 0; slot < URING_SLOTS; slot++ )
+    {
+        if( readerPtr->reads[slot].pending && ( readerPtr->reads[slot].workIndex == itemPtr->workIndex ) )
+        {
+            current = slot;
+        }
+    }
+
+    other = ( 0 == current ) ? 1 : 0;
+
+    if( peekWork( queueIndex, &next ) && isReadAheadWanted( next.workIndex, &filenamePtr, &size ) )
+    {
+        waitUringRead( readerPtr, other );
+        startUringRead( readerPtr, other, next.workIndex, filenamePtr, size );
+    }
+
+    if( -1 == current )
+    {
+        return;
+    }
+
+    readPtr = &readerPtr->reads[current];
+
+    waitUringRead( readerPtr, current );
+
+    if( ( 0 <= readPtr->results[0] ) && ( (int)readPtr->expected == readPtr->results[1] ) )
+    {
+        pagePtr->markdownDataPtr    = readPtr->bufferPtr;
+        pagePtr->markdownDataLength = readPtr->expected;
+
+        addCount( count_read_ahead, 1 );
+    }
+    else
+    {
+        verbose( "Markdown file %s wasn't read ahead as listed, so it's read as it's needed\n", readPtr->filename );
+    }
+}
+#endif
+
+/**
+ * void *makeWebpages( void *queueIndexPtr )
+ * 
+ * Worker thread : keep taking a markdown file from the work queues ( see 
+ * takeWork() ) and making its web page until there are none left. Each worker
+ * has an arena that is reset between pages. With a memory budget, what the 
+ * page took is measured, and an arena grown beyond its first block is freed
+ * rather than kept for the next page. If stats are being kept, the page's 
+ * entry in g_PageStatsPtr is this thread's while it makes the page. With the
+ * 'io-uring' option, the markdown of the next page in the worker's queue is 
+ * read while this one is made ( see readAhead() ).
+ * 
+ * in       : queueIndexPtr -   pthread argument, the index of this worker's 
+ *                              queue
+ * out      : web pages made for the markdown files this worker picked up
+ * err      : none
+ */
+void *makeWebpages( void *queueIndexPtr )
+{
+struct Page     page;
+struct Arena    arena = { NULL, NULL };
+long            queueIndex = (long)(intptr_t)queueIndexPtr;
+struct WorkItem item;
+size_t          fileIndex = 0;
+size_t          measured = 0;
+uint64_t        startTime = 0;
+bool            made = false;
+bool            tracing = startTracing();
+#ifdef WEBPAGE_IO_URING
+struct UringReader  reader;
+
+    openUringReader( &reader );
+#endif
+
+    while( takeWork( queueIndex, &item ) )
+    {
+        fileIndex = ( NULL == g_PageIndexList ) ? item.workIndex : g_PageIndexList[item.workIndex];
+
+        if( NULL != g_PageStatsPtr )
+        {
+            g_ThreadStatsPtr    = &g_PageStatsPtr[fileIndex];
+            startTime           = getNanoseconds();
+        }
+
+        initPage( &page, &arena, g_MarkdownFilenameList[fileIndex] );
+
+        TRACE( TRACE_PAGES, trace_page_start, fileIndex, queueIndex );
+
+#ifdef WEBPAGE_IO_URING
+        readAhead( &reader, queueIndex, &item, &page );
+#endif
+
+        made = true;
+
+        if( !g_Options.siteMode || ( -1 != g_ArchiveFD ) )
+        {
+            makeWebpage( &page );
+
+            // archiving keeps no manifest, only the index records for the site
+            // index
+
+            if( NULL != g_NewManifestPtr )
+            {
+                g_NewManifestPtr[fileIndex].markdownFilename = strdup( g_MarkdownFilenameList[fileIndex] );
+
+                assert( g_NewManifestPtr[fileIndex].markdownFilename );
+
+                completeManifestEntry( &page, &g_NewManifestPtr[fileIndex] );
+            }
+        }
+        else if( isWebpageUpToDate( &page, g_MarkdownFilenameList[fileIndex], &g_NewManifestPtr[fileIndex] ) )
+        {
+            verbose( "Web page %s is up to date\n", page.webpageFilename );
+
+            made = false;
+        }
+        else
+        {
+            makeWebpage( &page );
+
+            completeManifestEntry( &page, &g_NewManifestPtr[fileIndex] );
+        }
+
+        measured = getArenaSize( &arena ) + page.head.size + page.tail.size + page.indexRecord.size;
+
+        TRACE( TRACE_PAGES, made ? trace_page_made : trace_page_kept, fileIndex, measured );
+
+        freePage( &page );
+
+        if( NULL != g_ThreadStatsPtr )
+        {
+            g_ThreadStatsPtr->made              = made;
+            g_ThreadStatsPtr->totalNanoseconds  = getNanoseconds() - startTime;
+            g_ThreadStatsPtr                    = NULL;
+        }
+
+        if( ( 0 != g_Options.memoryBudget ) && ( getArenaSize( &arena ) > ARENA_BLOCK_HEADER_SIZE + ARENA_BLOCK_SIZE ) )
+        {
+            releaseArena( &arena );
+        }
+        else
+        {
+            resetArena( &arena );
+        }
+
+        releaseMemory( &item, (long long)measured );
+    }
+
+#ifdef WEBPAGE_IO_URING
+    closeUringReader( &reader );
+#endif
+
+    releaseArena( &arena );
+
+    if( tracing )
+    {
+        stopTracing();
+    }
+
+    return( NULL );
+}
+
+/**
+ * void makeAllWebpages( void )
+ * 
+ * Make a web page for every markdown file in the list, or for those in 
+ * g_PageIndexList if there is one, using as many worker threads as the 'j' 
+ * option allows, each with its own work queue. With one job, the pages are 
+ * made in order on the main thread.
+ * 
+ * in       : none
+ * out      : all web pages made
+ * err      : assert if failed to start or join a worker thread
+ */
+void makeAllWebpages( void )
+{
+pthread_t   *threadsPtr = NULL;
+long        threadCount = g_Options.jobCount;
+long        threadIndex = 0;
+int         result = 0;
+size_t      pageCount = ( NULL == g_PageIndexList ) ? g_MarkdownFilenameCount : g_PageIndexCount;
+
+    if( threadCount > (long)pageCount )
+    {
+        threadCount = (long)pageCount;
+    }
+
+    if( threadCount < 1 )
+    {
+        threadCount = 1;
+    }
+
+    queueWebpages( pageCount, threadCount );
+
+    if( 1 == threadCount )
+    {
+        makeWebpages( (void *)(intptr_t)0 );
+
+        forgetWorkQueues();
+        return;
+    }
+
+    verbose( "Making %zu web pages using %ld threads\n", pageCount, threadCount );
+
+    threadsPtr = (pthread_t *)calloc( threadCount, sizeof(pthread_t) );
+
+    assert( threadsPtr );
+
+    for( threadIndex = 0; threadIndex < threadCount; threadIndex++ )
+    {
+        result = pthread_create( &threadsPtr[threadIndex], NULL, makeWebpages, (void *)(intptr_t)threadIndex );
+
+        assert( 0 == result );
+    }
+
+    for( threadIndex = 0; threadIndex < threadCount; threadIndex++ )
+    {
+        result = pthread_join( threadsPtr[threadIndex], NULL );
+
+        assert( 0 == result );
+    }
+
+    free( threadsPtr );
+
+    forgetWorkQueues();
+}
+
+/**
+ * void forgetWorkQueues( void )
+ * 
+ * Free the work queues, once the workers have finished with them.
+ * 
+ * in       : none
+ * out      : g_WorkQueuePtr is NULL
+ * err      : none
+ */
+void forgetWorkQueues( void )
+{
+long    queueIndex = 0;
+
+    for( queueIndex = 0; queueIndex < g_WorkQueueCount; queueIndex++ )
+    {
+        pthread_mutex_destroy( &g_WorkQueuePtr[queueIndex].mutex );
+
+        free( g_WorkQueuePtr[queueIndex].itemsPtr );
+    }
+
+    free( g_WorkQueuePtr );
+
+    g_WorkQueuePtr      = NULL;
+    g_WorkQueueCount    = 0;
+}
+
+/**
+ * int compareFilenames( const void *firstPtr, const void *secondPtr )
+ * 
+ * qsort() and bsearch() comparison for lists of filenames.
+ */
+int compareFilenames( const void *firstPtr, const void *secondPtr )
+{
+    return( strcmp( *(char * const *)firstPtr, *(char * const *)secondPtr ) );
+}
+
+/**
+ * void forgetManifestEntry( struct ManifestEntry *entryPtr )
+ * 
+ * Free what a manifest entry holds, and empty it.
+ * 
+ * in       : entryPtr  -   the manifest entry
+ * out      : the entry is all zeroes
+ * err      : none
+ */
+void forgetManifestEntry( struct ManifestEntry *entryPtr )
+{
+    free( entryPtr->markdownFilename );
+    free( entryPtr->cssFilename );
+    free( entryPtr->indexRecord );
+
+    memset( entryPtr, 0, sizeof(struct ManifestEntry) );
+}
+
+/**
+ * void refreshManifest( void )
+ * 
+ * Watch mode : the manifest just saved becomes the one that changes are looked
+ * for against. g_NewManifestPtr and g_MarkdownFilenameList must be in the same,
+ * sorted, order.
+ * 
+ * in       : none
+ * out      : g_ManifestPtr is a copy of g_NewManifestPtr
+ * err      : assert if failed to allocate the copy
+ */
+void refreshManifest( void )
+{
+size_t entryIndex = 0;
+
+    for( entryIndex = 0; entryIndex < g_ManifestCount; entryIndex++ )
+    {
+        forgetManifestEntry( &g_ManifestPtr[entryIndex] );
+    }
+
+    g_ManifestPtr = (struct ManifestEntry *)realloc( g_ManifestPtr, ( g_MarkdownFilenameCount + 1 ) * sizeof(struct ManifestEntry) );
+
+    assert( g_ManifestPtr );
+
+    for( entryIndex = 0; entryIndex < g_MarkdownFilenameCount; entryIndex++ )
+    {
+        g_ManifestPtr[entryIndex] = g_NewManifestPtr[entryIndex];
+
+        g_ManifestPtr[entryIndex].markdownFilename = strdup( g_NewManifestPtr[entryIndex].markdownFilename );
+
+        assert( g_ManifestPtr[entryIndex].markdownFilename );
+
+        if( NULL != g_NewManifestPtr[entryIndex].cssFilename )
+        {
+            g_ManifestPtr[entryIndex].cssFilename = strdup( g_NewManifestPtr[entryIndex].cssFilename );
+
+            assert( g_ManifestPtr[entryIndex].cssFilename );
+        }
+
+        if( NULL != g_NewManifestPtr[entryIndex].indexRecord )
+        {
+            g_ManifestPtr[entryIndex].indexRecord = strdup( g_NewManifestPtr[entryIndex].indexRecord );
+
+            assert( g_ManifestPtr[entryIndex].indexRecord );
+        }
+    }
+
+    g_ManifestCount = g_MarkdownFilenameCount;
+
+    for( entryIndex = 0; entryIndex < g_ManifestAssetCount; entryIndex++ )
+    {
+        free( g_ManifestAssetPtr[entryIndex].filename );
+    }
+
+    g_ManifestAssetPtr = (struct AssetEntry *)realloc( g_ManifestAssetPtr, ( g_AssetCount + 1 ) * sizeof(struct AssetEntry) );
+
+    assert( g_ManifestAssetPtr );
+
+    for( entryIndex = 0; entryIndex < g_AssetCount; entryIndex++ )
+    {
+        g_ManifestAssetPtr[entryIndex] = g_AssetPtr[entryIndex];
+
+        g_ManifestAssetPtr[entryIndex].filename = strdup( g_AssetPtr[entryIndex].filename );
+
+        assert( g_ManifestAssetPtr[entryIndex].filename );
+    }
+
+    g_ManifestAssetCount = g_AssetCount;
+}
+
+/**
+ * void forgetCssDirectories( void )
+ * 
+ * Watch mode : empty the css cache, because a css file or a directory has come
+ * or gone. Must not be called while pages are being made.
+ * 
+ * in       : none
+ * out      : g_CssDirectoryPtrs is empty
+ * err      : none
+ */
+void forgetCssDirectories( void )
+{
+struct CssDirectory *entryPtr = NULL;
+struct CssDirectory *nextPtr = NULL;
+int                 bucket = 0;
+
+    for( bucket = 0; bucket < CSS_DIRECTORY_BUCKETS; bucket++ )
+    {
+        for( entryPtr = g_CssDirectoryPtrs[bucket]; NULL != entryPtr; entryPtr = nextPtr )
+        {
+            nextPtr = entryPtr->nextPtr;
+
+            // an inherited css name belongs to the parent's entry
+
+            if( 0 == entryPtr->parentLevels )
+            {
+                free( entryPtr->cssNamePtr );
+            }
+
+            free( entryPtr->directoryNamePtr );
+            free( entryPtr->canonicalNamePtr );
+            free( entryPtr );
+        }
+
+        g_CssDirectoryPtrs[bucket] = NULL;
+    }
+}
+
+/**
+ * void invalidateCssDirectories( void )
+ * 
+ * Watch mode : a css file has come or gone, so the css that applies to each 
+ * directory has to be worked out again. What is known about the directories 
+ * themselves is kept, so only the directories that have changed are read 
+ * again, though any listed by the search are no longer taken on trust. Serve 
+ * mode does the same before making a page whose way up to the markdown root 
+ * goes through a link. Must be called with g_CssDirectoryMutex held, or while
+ * no pages are being made.
+ * 
+ * in       : none
+ * out      : every entry in the css cache is unresolved
+ * err      : none
+ */
+void invalidateCssDirectories( void )
+{
+struct CssDirectory *entryPtr = NULL;
+int                 bucket = 0;
+
+    for( bucket = 0; bucket < CSS_DIRECTORY_BUCKETS; bucket++ )
+    {
+        for( entryPtr = g_CssDirectoryPtrs[bucket]; NULL != entryPtr; entryPtr = entryPtr->nextPtr )
+        {
+            if( 0 != entryPtr->parentLevels )
+            {
+                // inherited, so the parent's to worry about
+
+                entryPtr->cssNamePtr    = NULL;
+                entryPtr->parentLevels  = 0;
+            }
+
+            entryPtr->resolved  = false;
+            entryPtr->listed    = false;
+            entryPtr->generation++;
+        }
+    }
+}
+
+/**
+ * void invalidateCssDirectory( const char *directoryNamePtr )
+ * 
+ * Serve mode : a directory has changed, so the css that applies to it, and to
+ * every directory below it that may have inherited its css, has to be worked
+ * out again. The rest of the css cache is left alone. Must be called with
+ * g_CssDirectoryMutex held.
+ * 
+ * in       : directoryNamePtr  -   the directory, canonical and absolute
+ * out      : the entries for the directory and those below it are unresolved
+ * err      : none
+ */
+void invalidateCssDirectory( const char *directoryNamePtr )
+{
+struct CssDirectory *entryPtr = NULL;
+size_t              length = strlen( directoryNamePtr );
+int                 bucket = 0;
+
+    for( bucket = 0; bucket < CSS_DIRECTORY_BUCKETS; bucket++ )
+    {
+        for( entryPtr = g_CssDirectoryPtrs[bucket]; NULL != entryPtr; entryPtr = entryPtr->nextPtr )
+        {
+            if( ( 0 != strncmp( entryPtr->directoryNamePtr, directoryNamePtr, length ) ) ||
+                ( ( '\0' != entryPtr->directoryNamePtr[length] ) && ( '/' != entryPtr->directoryNamePtr[length] ) && ( length > 1 ) ) )
+            {
+                continue;
+            }
+
+            if( 0 != entryPtr->parentLevels )
+            {
+                // inherited, so the name is the parent's, which may be freed
+
+                entryPtr->cssNamePtr    = NULL;
+                entryPtr->parentLevels  = 0;
+            }
+
+            entryPtr->resolved  = false;
+            entryPtr->listed    = false;
+            entryPtr->generation++;
+        }
+    }
+}
+
+/**
+ * void invalidateServedCssDirectories( const struct ServedPage *entryPtr )
+ * 
+ * Serve mode : before a page is made, forget the css of only those
+ * directories on its way up to the markdown root that have changed since they
+ * were read, going by the stamps the page has just taken of them, and so
+ * without a stat() of the rest. A directory read within a second of changing
+ * can't be trusted, and is always worked out again. The stamps name the
+ * directories as the cache does only when none is linked from elsewhere, so
+ * the caller must check that. Must be called with g_CssDirectoryMutex held.
+ * 
+ * in       : entryPtr  -   the page about to be made, its inputs stamped
+ * out      : the changed directories, and those below them, are unresolved
+ * err      : none
+ */
+void invalidateServedCssDirectories( const struct ServedPage *entryPtr )
+{
+const struct FileStamp  *stampPtr = NULL;
+struct CssDirectory     *cssPtr = NULL;
+char                    directoryName[PATH_MAX];
+size_t                  length = 0;
+uint64_t                bucket = 0;
+int                     input = 0;
+int                     level = 0;
+
+    // from the markdown root down, as a change there covers all below it
+
+    for( input = entryPtr->stampCount - 1; input >= 2; input-- )
+    {
+        stampPtr    = &entryPtr->stampsPtr[input];
+        length      = strlen( entryPtr->markdownFilename );
+
+        for( level = 1; level < input; level++ )
+        {
+            while( ( length > 0 ) && ( '/' != entryPtr->markdownFilename[length - 1] ) )
+            {
+                length--;
+            }
+
+            length -= ( length > 0 ) ? 1 : 0;
+        }
+
+        if( 0 == length )
+        {
+            snprintf( directoryName, sizeof(directoryName), "%s", g_Options.markdownRoot );
+        }
+        else
+        {
+            snprintf( directoryName, sizeof(directoryName), "%s/%.*s", g_Options.markdownRoot, (int)length, entryPtr->markdownFilename );
+        }
+
+        bucket = hashBytes( HASH_SEED, directoryName, strlen( directoryName ) ) % CSS_DIRECTORY_BUCKETS;
+
+        for( cssPtr = g_CssDirectoryPtrs[bucket]; NULL != cssPtr; cssPtr = cssPtr->nextPtr )
+        {
+            if( 0 == strcmp( cssPtr->directoryNamePtr, directoryName ) )
+            {
+                break;
+            }
+        }
+
+        // not yet in the cache, or not yet worked out, so nothing to forget
+
+        if( ( NULL == cssPtr ) || !cssPtr->resolved )
+        {
+            continue;
+        }
+
+        if( !stampPtr->present || ( 0 == cssPtr->mtimeSeconds ) || ( stampPtr->mtimeSeconds != cssPtr->mtimeSeconds ) ||
+            ( stampPtr->mtimeNanoseconds != cssPtr->mtimeNanoseconds ) )
+        {
+            verbose( "Directory %s has changed, so its css is worked out again\n", directoryName );
+
+            invalidateCssDirectory( directoryName );
+
+            break;
+        }
+    }
+}
+
+/**
+ * void resetHeadFragments( void )
+ * 
+ * Watch mode : each round of changes is a run of its own, so the shared parts 
+ * of the head are made again, with a new datetime, by the first page that 
+ * needs them. Must not be called while pages are being made.
+ * 
+ * in       : none
+ * out      : g_Context's head prefix, comments, datetime and body tail are 
+ *            empty, and will be made again
+ * err      : none
+ */
+void resetHeadFragments( void )
+{
+    pthread_mutex_lock( &g_HeadFragmentsMutex );
+
+    g_Context.headPrefix.length     = 0;
+    g_Context.headComments.length   = 0;
+    g_Context.headDatetime.length   = 0;
+    g_Context.bodyTail.length       = 0;
+    g_HeadFragmentsMade             = false;
+
+    pthread_mutex_unlock( &g_HeadFragmentsMutex );
+}
+
+/**
+ * bool watchDirectory( const char *relativeDirPtr, const char *pathPtr )
+ * 
+ * Watch mode : ask inotify for changes to a markdown directory, and remember 
+ * which directory its watch descriptor stands for.
+ * 
+ * in       : relativeDirPtr    -   directory relative to the markdown root, 
+ *                                  either empty or ending in '/'
+ * in       : pathPtr           -   the directory's full path
+ * out      : true if the directory is being watched, false if it has gone
+ * err      : exit if the directory cannot be watched ( e.g. too many watches,
+ *            see /proc/sys/fs/inotify/max_user_watches )
+ * err      : assert if failed to allocate the directory list or name
+ */
+bool watchDirectory( const char *relativeDirPtr, const char *pathPtr )
+{
+int watchDescriptor = inotify_add_watch( g_WatchFD, pathPtr, WATCH_EVENTS );
+
+    if( ( -1 == watchDescriptor ) && ( ( ENOENT == errno ) || ( ENOTDIR == errno ) ) )
+    {
+        verbose( "Markdown directory %s has gone\n", pathPtr );
+        return( false );
+    }
+
+    if( -1 == watchDescriptor )
+    {
+        printf( "Cannot watch markdown directory %s\n", pathPtr );
+        exit( EXIT_BAD_WATCH );
+    }
+
+    if( (size_t)watchDescriptor >= g_WatchDirectoryCount )
+    {
+        g_WatchDirectoryList = (char **)realloc( g_WatchDirectoryList, ( watchDescriptor + 1 ) * sizeof(char *) );
+
+        assert( g_WatchDirectoryList );
+
+        memset( &g_WatchDirectoryList[g_WatchDirectoryCount], 0, ( watchDescriptor + 1 - g_WatchDirectoryCount ) * sizeof(char *) );
+
+        g_WatchDirectoryCount = watchDescriptor + 1;
+    }
+
+    // watching a directory again gives the same watch descriptor
+
+    free( g_WatchDirectoryList[watchDescriptor] );
+
+    g_WatchDirectoryList[watchDescriptor] = strdup( relativeDirPtr );
+
+    assert( g_WatchDirectoryList[watchDescriptor] );
+
+    verbose( "Watching markdown directory %s\n", pathPtr );
+
+    return( true );
+}
+
+/**
+ * void unwatchDirectories( const char *relativeDirPtr )
+ * 
+ * Watch mode : stop watching a directory that has been moved away, and every
+ * directory below it. 
+ * 
+ * in       : relativeDirPtr    -   directory relative to the markdown root, 
+ *                                  ending in '/'
+ * out      : none of the directories is watched
+ * err      : none
+ */
+void unwatchDirectories( const char *relativeDirPtr )
+{
+size_t watchDescriptor = 0;
+size_t length = strlen( relativeDirPtr );
+
+    for( watchDescriptor = 0; watchDescriptor < g_WatchDirectoryCount; watchDescriptor++ )
+    {
+        if( ( NULL != g_WatchDirectoryList[watchDescriptor] ) && ( 0 == strncmp( g_WatchDirectoryList[watchDescriptor], relativeDirPtr, length ) ) )
+        {
+            inotify_rm_watch( g_WatchFD, watchDescriptor );
+
+            free( g_WatchDirectoryList[watchDescriptor] );
+
+            g_WatchDirectoryList[watchDescriptor] = NULL;
+        }
+    }
+}
+
+/**
+ * void addWatchCandidate( const char *filenamePtr )
+ * 
+ * Watch mode : a markdown file may need its web page making again, or removing.
+ * 
+ * in       : filenamePtr   -   markdown filename relative to markdown root
+ * out      : g_WatchCandidateList has grown by one
+ * err      : assert if failed to allocate the list or the filename
+ */
+void addWatchCandidate( const char *filenamePtr )
+{
+    g_WatchCandidateList = (char **)realloc( g_WatchCandidateList, ( g_WatchCandidateCount + 1 ) * sizeof(char *) );
+
+    assert( g_WatchCandidateList );
+
+    g_WatchCandidateList[g_WatchCandidateCount] = strdup( filenamePtr );
+
+    assert( g_WatchCandidateList[g_WatchCandidateCount] );
+
+    g_WatchCandidateCount++;
+}
+
+/**
+ * void addWatchCandidatesUnder( const char *relativeDirPtr )
+ * 
+ * Watch mode : every markdown file in or below a directory may need its web 
+ * page making again, or removing.
+ * 
+ * in       : relativeDirPtr    -   directory relative to the markdown root, 
+ *                                  either empty or ending in '/'
+ * out      : g_WatchCandidateList has the markdown files in the directory
+ * err      : none
+ */
+void addWatchCandidatesUnder( const char *relativeDirPtr )
+{
+size_t fileIndex = 0;
+size_t length = strlen( relativeDirPtr );
+
+    for( fileIndex = 0; fileIndex < g_MarkdownFilenameCount; fileIndex++ )
+    {
+        if( 0 == strncmp( g_MarkdownFilenameList[fileIndex], relativeDirPtr, length ) )
+        {
+            addWatchCandidate( g_MarkdownFilenameList[fileIndex] );
+        }
+    }
+}
+
+/**
+ * void addCssCandidatesUnder( const char *relativeDirPtr )
+ * 
+ * Watch mode : a css file has come or gone in a directory, so every markdown
+ * file in or below it whose css link is now different needs its web page 
+ * making again. The css cache must have been invalidated first.
+ * 
+ * in       : relativeDirPtr    -   directory relative to the markdown root, 
+ *                                  either empty or ending in '/'
+ * out      : g_WatchCandidateList has the markdown files affected
+ * err      : none
+ */
+void addCssCandidatesUnder( const char *relativeDirPtr )
+{
+struct Page             page;
+struct Arena            arena = { NULL, NULL };
+struct ManifestEntry    *entryPtr = NULL;
+size_t                  fileIndex = 0;
+size_t                  length = strlen( relativeDirPtr );
+char                    *cssFilenamePtr = NULL;
+char                    path[PATH_MAX + 1];
+struct stat             markdownStat;
+
+    if( NULL == g_Options.cssRoot )
+    {
+        return;
+    }
+
+    for( fileIndex = 0; fileIndex < g_MarkdownFilenameCount; fileIndex++ )
+    {
+        if( 0 != strncmp( g_MarkdownFilenameList[fileIndex], relativeDirPtr, length ) )
+        {
+            continue;
+        }
+
+        // a page whose markdown has gone, directory and all, is removed
+
+        snprintf( path, sizeof(path), "%s/%s", g_Options.markdownRoot, g_MarkdownFilenameList[fileIndex] );
+
+        if( 0 != stat( path, &markdownStat ) )
+        {
+            addWatchCandidate( g_MarkdownFilenameList[fileIndex] );
+            continue;
+        }
+
+        initPage( &page, &arena, g_MarkdownFilenameList[fileIndex] );
+
+        cssFilenamePtr  = findCssFile( &page );
+        entryPtr        = findManifestEntry( g_MarkdownFilenameList[fileIndex] );
+
+        if( ( NULL == entryPtr ) || ( ( NULL == cssFilenamePtr ) != ( NULL == entryPtr->cssFilename ) ) || 
+            ( ( NULL != cssFilenamePtr ) && ( 0 != strcmp( cssFilenamePtr, entryPtr->cssFilename ) ) ) )
+        {
+            addWatchCandidate( g_MarkdownFilenameList[fileIndex] );
+        }
+
+        freePage( &page );
+
+        resetArena( &arena );
+    }
+
+    releaseArena( &arena );
+}
+
+/**
+ * void addLinkedTxtCandidates( const char *txtFilenamePtr )
+ * 
+ * Watch mode : a txt file has changed, so if it is linked to other txt files, 
+ * the markdown files they belong to need their web pages making again too. 
+ * inotify only reports the change under the name it was made by.
+ * 
+ * in       : txtFilenamePtr    -   txt filename relative to markdown root
+ * out      : g_WatchCandidateList has the markdown files affected
+ * err      : none
+ */
+void addLinkedTxtCandidates( const char *txtFilenamePtr )
+{
+char        path[PATH_MAX + 1];
+struct stat txtStat;
+size_t      entryIndex = 0;
+
+    snprintf( path, sizeof(path), "%s/%s", g_Options.markdownRoot, txtFilenamePtr );
+
+    if( ( 0 != stat( path, &txtStat ) ) || ( txtStat.st_nlink < 2 ) )
+    {
+        return;
+    }
+
+    for( entryIndex = 0; entryIndex < g_ManifestCount; entryIndex++ )
+    {
+        if( g_ManifestPtr[entryIndex].txtStamp.present && 
+            ( (long long)txtStat.st_dev == g_ManifestPtr[entryIndex].txtStamp.device ) && ( (long long)txtStat.st_ino == g_ManifestPtr[entryIndex].txtStamp.inode ) )
+        {
+            verbose( "Txt file %s is shared with %s\n", txtFilenamePtr, g_ManifestPtr[entryIndex].markdownFilename );
+
+            addWatchCandidate( g_ManifestPtr[entryIndex].markdownFilename );
+        }
+    }
+}
+
+/**
+ * void addWatchAssetCandidate( const char *filenamePtr )
+ * 
+ * Watch mode : note an asset that may need mirroring again.
+ * 
+ * in       : filenamePtr   -   asset filename relative to markdown root
+ * out      : g_WatchAssetList has grown by one
+ * err      : assert if failed to allocate the list or the filename
+ */
+void addWatchAssetCandidate( const char *filenamePtr )
+{
+    g_WatchAssetList = (char **)realloc( g_WatchAssetList, ( g_WatchAssetCount + 1 ) * sizeof(char *) );
+
+    assert( g_WatchAssetList );
+
+    g_WatchAssetList[g_WatchAssetCount] = strdup( filenamePtr );
+
+    assert( g_WatchAssetList[g_WatchAssetCount] );
+
+    g_WatchAssetCount++;
+}
+
+/**
+ * void addWatchAssetCandidatesUnder( const char *relativeDirPtr )
+ * 
+ * Watch mode : note every asset mirrored from in or below a directory, which 
+ * has gone, as needing mirroring again, i.e. removing.
+ * 
+ * in       : relativeDirPtr    -   directory relative to the markdown root, 
+ *                                  either empty or ending in '/'
+ * out      : g_WatchAssetList has the assets in or below the directory
+ * err      : none
+ */
+void addWatchAssetCandidatesUnder( const char *relativeDirPtr )
+{
+size_t assetIndex = 0;
+size_t length = strlen( relativeDirPtr );
+
+    for( assetIndex = 0; assetIndex < g_AssetCount; assetIndex++ )
+    {
+        if( 0 == strncmp( g_AssetPtr[assetIndex].filename, relativeDirPtr, length ) )
+        {
+            addWatchAssetCandidate( g_AssetPtr[assetIndex].filename );
+        }
+    }
+}
+
+/**
+ * bool remirrorWatchedAssets( void )
+ * 
+ * Watch mode : mirror again each asset noted as changed. New assets join the
+ * list, and assets that have gone leave it, so they are removed from the html
+ * root when the manifest is saved.
+ * 
+ * in       : none
+ * out      : g_AssetPtr up to date and sorted, g_WatchAssetList cleared
+ * out      : true if any asset was noted
+ * err      : assert if failed to allocate the asset list
+ */
+bool remirrorWatchedAssets( void )
+{
+struct AssetEntry   key;
+struct AssetEntry   *assetPtr = NULL;
+size_t              candidateIndex = 0;
+size_t              keptCount = 0;
+size_t              knownCount = g_AssetCount;
+bool                changed = ( g_WatchAssetCount > 0 );
+
+    for( candidateIndex = 0; candidateIndex < g_WatchAssetCount; candidateIndex++ )
+    {
+        key.filename = g_WatchAssetList[candidateIndex];
+
+        assetPtr = (struct AssetEntry *)bsearch( &key, g_AssetPtr, knownCount, sizeof(struct AssetEntry), compareAssetEntries );
+
+        if( NULL == assetPtr )
+        {
+            addAssetFilename( g_WatchAssetList[candidateIndex] );
+
+            assetPtr = &g_AssetPtr[g_AssetCount - 1];
+        }
+
+        mirrorAsset( assetPtr );
+
+        free( g_WatchAssetList[candidateIndex] );
+    }
+
+    g_WatchAssetCount = 0;
+
+    // a new asset noted more than once only joins once, and those that have 
+    // gone leave
+
+    qsort( g_AssetPtr, g_AssetCount, sizeof(struct AssetEntry), compareAssetEntries );
+
+    for( candidateIndex = 0; candidateIndex < g_AssetCount; candidateIndex++ )
+    {
+        if( !g_AssetPtr[candidateIndex].stamp.present || 
+            ( ( keptCount > 0 ) && ( 0 == strcmp( g_AssetPtr[keptCount - 1].filename, g_AssetPtr[candidateIndex].filename ) ) ) )
+        {
+            free( g_AssetPtr[candidateIndex].filename );
+        }
+        else
+        {
+            g_AssetPtr[keptCount++] = g_AssetPtr[candidateIndex];
+        }
+    }
+
+    g_AssetCount = keptCount;
+
+    return( changed );
+}
+
+/**
+ * void noteWatchEvent( const struct inotify_event *eventPtr )
+ * 
+ * Watch mode : work out which web pages a change to the markdown tree affects. 
+ * A change to a .md file affects its page, and a change to a .txt file affects
+ * the page of the same name, and the pages of any txt files linked to it. A css
+ * file coming or going affects the pages in or below its directory whose css 
+ * link changes, which is worked out once all the changes are in. A directory 
+ * being removed affects every page in or below it, and a new directory is 
+ * searched for markdown, and watched. Any change to an asset, or an asset 
+ * directory being removed, means mirroring the asset again. If inotify has 
+ * lost track, the whole tree is searched again.
+ * 
+ * in       : eventPtr  -   the change, as reported by inotify
+ * out      : g_WatchCandidateList has the pages affected
+ * out      : g_WatchCssDirectoryList has the directory, for a css file
+ * out      : g_WatchAssetList has the assets affected
+ * out      : g_WatchTreeChanged set if directories have come or gone
+ * err      : assert if failed to allocate the css directory list
+ */
+void noteWatchEvent( const struct inotify_event *eventPtr )
+{
+char        path[PATH_MAX + 1];
+const char  *directoryPtr = NULL;
+size_t      nameLength = 0;
+
+    if( IN_Q_OVERFLOW & eventPtr->mask )
+    {
+        verbose( "Too many changes to follow, checking every web page\n" );
+
+        addWatchCandidatesUnder( "" );
+        addWatchAssetCandidatesUnder( "" );
+        findMarkdownFiles( "", addWatchCandidate, ( asset_none == g_Options.assetMode ) ? NULL : addWatchAssetCandidate );
+
+        g_WatchTreeChanged = true;
+        return;
+    }
+
+    if( ( eventPtr->wd < 0 ) || ( (size_t)eventPtr->wd >= g_WatchDirectoryCount ) || ( NULL == ( directoryPtr = g_WatchDirectoryList[eventPtr->wd] ) ) )
+    {
+        return;
+    }
+
+    if( IN_IGNORED & eventPtr->mask )
+    {
+        // the directory has gone, and is reported by its parent
+
+        free( g_WatchDirectoryList[eventPtr->wd] );
+
+        g_WatchDirectoryList[eventPtr->wd] = NULL;
+
+        return;
+    }
+
+    if( 0 == eventPtr->len )
+    {
+        return;
+    }
+
+    verbose( "Change 0x%x to %s%s\n", eventPtr->mask, directoryPtr, eventPtr->name );
+    TRACE( TRACE_PAGES, trace_change, eventPtr->wd, eventPtr->mask );
+
+    if( IN_ISDIR & eventPtr->mask )
+    {
+        if( ( IN_CREATE | IN_MOVED_TO ) & eventPtr->mask )
+        {
+            snprintf( path, sizeof(path), "%s/%s%s", g_Options.webpageRoot, directoryPtr, eventPtr->name );
+
+            if( ( 0 != mkdir( path, 0777 ) ) && ( EEXIST != errno ) )
+            {
+                printf( "Cannot make html directory %s\n", path );
+            }
+
+            snprintf( path, sizeof(path), "%s%s/", directoryPtr, eventPtr->name );
+
+            findMarkdownFiles( path, addWatchCandidate, ( asset_none == g_Options.assetMode ) ? NULL : addWatchAssetCandidate );
+        }
+        else
+        {
+            snprintf( path, sizeof(path), "%s%s/", directoryPtr, eventPtr->name );
+
+            unwatchDirectories( path );
+            addWatchCandidatesUnder( path );
+            addWatchAssetCandidatesUnder( path );
+        }
+
+        g_WatchTreeChanged = true;
+        return;
+    }
+
+    nameLength = strlen( eventPtr->name );
+
+    if( ( nameLength > strlen( ".md" ) ) && ( 0 == strcmp( ".md", eventPtr->name + nameLength - strlen( ".md" ) ) ) )
+    {
+        snprintf( path, sizeof(path), "%s%s", directoryPtr, eventPtr->name );
+
+        addWatchCandidate( path );
+    }
+    else if( ( nameLength > strlen( ".txt" ) ) && ( 0 == strcmp( ".txt", eventPtr->name + nameLength - strlen( ".txt" ) ) ) )
+    {
+        snprintf( path, sizeof(path), "%s%.*s.md", directoryPtr, (int)( nameLength - strlen( ".txt" ) ), eventPtr->name );
+
+        addWatchCandidate( path );
+
+        snprintf( path, sizeof(path), "%s%s", directoryPtr, eventPtr->name );
+
+        addLinkedTxtCandidates( path );
+    }
+    else if( ( NULL != strstr( eventPtr->name, ".css" ) ) && !( IN_CLOSE_WRITE & eventPtr->mask ) )
+    {
+        // as for resolveCssDirectory(), any name with .css in it counts, but
+        // what is in the file doesn't matter, only whether it's there
+
+        g_WatchCssDirectoryList = (char **)realloc( g_WatchCssDirectoryList, ( g_WatchCssDirectoryCount + 1 ) * sizeof(char *) );
+
+        assert( g_WatchCssDirectoryList );
+
+        g_WatchCssDirectoryList[g_WatchCssDirectoryCount] = strdup( directoryPtr );
+
+        assert( g_WatchCssDirectoryList[g_WatchCssDirectoryCount] );
+
+        g_WatchCssDirectoryCount++;
+    }
+
+    if( ( asset_none != g_Options.assetMode ) && isAssetFilename( eventPtr->name ) )
+    {
+        snprintf( path, sizeof(path), "%s%s", directoryPtr, eventPtr->name );
+
+        addWatchAssetCandidate( path );
+    }
+}
+
+/**
+ * void readWatchEvents( void )
+ * 
+ * Watch mode : take every change inotify has to report so far.
+ * 
+ * in       : none
+ * out      : the changes noted, as for noteWatchEvent()
+ * err      : none
+ */
+void readWatchEvents( void )
+{
+char                        events[WATCH_READ_SIZE] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+const struct inotify_event  *eventPtr = NULL;
+ssize_t                     length = 0;
+ssize_t                     offset = 0;
+
+    while( 0 < ( length = read( g_WatchFD, events, sizeof(events) ) ) )
+    {
+        for( offset = 0; offset < length; offset += sizeof(struct inotify_event) + eventPtr->len )
+        {
+            eventPtr = (const struct inotify_event *)&events[offset];
+
+            noteWatchEvent( eventPtr );
+        }
+    }
+}
+
+/**
+ * void remakeWatchedPages( void )
+ * 
+ * Watch mode : bring the web pages affected by the latest changes up to date.
+ * Pages whose markdown has gone are removed, pages for new markdown files are 
+ * added, and everything else affected is checked against the manifest as in
+ * any site mode run, so only pages whose inputs really changed are made. The
+ * assets affected are mirrored again. Then the manifest is saved, and becomes
+ * the one to look for the next changes against.
+ * 
+ * in       : none
+ * out      : the affected web pages are up to date, the changes noted are 
+ *            cleared
+ * err      : assert if failed to allocate the page lists
+ */
+void remakeWatchedPages( void )
+{
+char        path[PATH_MAX + 1];
+struct stat markdownStat;
+char        **foundPtr = NULL;
+size_t      candidateIndex = 0;
+size_t      keptCount = 0;
+size_t      fileIndex = 0;
+bool        removed = false;
+bool        assetsChanged = remirrorWatchedAssets();
+uint64_t    startTime = getNanoseconds();
+
+    // Directories coming or going can change any canonical name, otherwise 
+    // only what inherits from where css files came or went
+
+    if( g_WatchTreeChanged )
+    {
+        forgetCssDirectories();
+    }
+    else if( g_WatchCssDirectoryCount > 0 )
+    {
+        invalidateCssDirectories();
+    }
+
+    for( candidateIndex = 0; candidateIndex < g_WatchCssDirectoryCount; candidateIndex++ )
+    {
+        addCssCandidatesUnder( g_WatchCssDirectoryList[candidateIndex] );
+
+        free( g_WatchCssDirectoryList[candidateIndex] );
+    }
+
+    g_WatchCssDirectoryCount    = 0;
+    g_WatchTreeChanged          = false;
+
+    g_PageIndexList = (size_t *)realloc( g_PageIndexList, ( g_WatchCandidateCount + 1 ) * sizeof(size_t) );
+
+    assert( g_PageIndexList );
+
+    g_PageIndexCount = 0;
+
+    // Each candidate only once
+
+    qsort( g_WatchCandidateList, g_WatchCandidateCount, sizeof(char *), compareFilenames );
+
+    for( candidateIndex = 0; candidateIndex < g_WatchCandidateCount; candidateIndex++ )
+    {
+        if( ( keptCount > 0 ) && ( 0 == strcmp( g_WatchCandidateList[keptCount - 1], g_WatchCandidateList[candidateIndex] ) ) )
+        {
+            free( g_WatchCandidateList[candidateIndex] );
+        }
+        else
+        {
+            g_WatchCandidateList[keptCount++] = g_WatchCandidateList[candidateIndex];
+        }
+    }
+
+    g_WatchCandidateCount = keptCount;
+
+    // Pages whose markdown has gone are dropped, and removed when the manifest
+    // is saved. Only the markdown files still there stay candidates.
+
+    for( candidateIndex = 0, keptCount = 0; candidateIndex < g_WatchCandidateCount; candidateIndex++ )
+    {
+        snprintf( path, sizeof(path), "%s/%s", g_Options.markdownRoot, g_WatchCandidateList[candidateIndex] );
+
+        if( ( 0 == stat( path, &markdownStat ) ) && !S_ISDIR( markdownStat.st_mode ) )
+        {
+            g_WatchCandidateList[keptCount++] = g_WatchCandidateList[candidateIndex];
+            continue;
+        }
+
+        foundPtr = (char **)bsearch( &g_WatchCandidateList[candidateIndex], g_MarkdownFilenameList, g_MarkdownFilenameCount, sizeof(char *), compareFilenames );
+
+        if( NULL != foundPtr )
+        {
+            g_PageIndexList[g_PageIndexCount++] = foundPtr - g_MarkdownFilenameList;
+        }
+
+        free( g_WatchCandidateList[candidateIndex] );
+    }
+
+    g_WatchCandidateCount = keptCount;
+
+    if( g_PageIndexCount > 0 )
+    {
+        removed = true;
+
+        for( candidateIndex = 0; candidateIndex < g_PageIndexCount; candidateIndex++ )
+        {
+            fileIndex = g_PageIndexList[candidateIndex];
+
+            free( g_MarkdownFilenameList[fileIndex] );
+            forgetManifestEntry( &g_NewManifestPtr[fileIndex] );
+
+            g_MarkdownFilenameList[fileIndex] = NULL;
+        }
+
+        for( fileIndex = 0, keptCount = 0; fileIndex < g_MarkdownFilenameCount; fileIndex++ )
+        {
+            if( NULL != g_MarkdownFilenameList[fileIndex] )
+            {
+                g_MarkdownFilenameList[keptCount] = g_MarkdownFilenameList[fileIndex];
+                g_NewManifestPtr[keptCount++]     = g_NewManifestPtr[fileIndex];
+            }
+        }
+
+        g_MarkdownFilenameCount = keptCount;
+    }
+
+    // Then each candidate is either a page already known, or a new one
+
+    g_PageIndexCount = 0;
+    keptCount        = g_MarkdownFilenameCount;
+
+    for( candidateIndex = 0; candidateIndex < g_WatchCandidateCount; candidateIndex++ )
+    {
+        foundPtr = (char **)bsearch( &g_WatchCandidateList[candidateIndex], g_MarkdownFilenameList, keptCount, sizeof(char *), compareFilenames );
+
+        if( NULL != foundPtr )
+        {
+            fileIndex = foundPtr - g_MarkdownFilenameList;
+
+            forgetManifestEntry( &g_NewManifestPtr[fileIndex] );
+        }
+        else
+        {
+            addMarkdownFilename( g_WatchCandidateList[candidateIndex] );
+
+            g_NewManifestPtr = (struct ManifestEntry *)realloc( g_NewManifestPtr, ( g_MarkdownFilenameCount + 1 ) * sizeof(struct ManifestEntry) );
+
+            assert( g_NewManifestPtr );
+
+            fileIndex = g_MarkdownFilenameCount - 1;
+
+            memset( &g_NewManifestPtr[fileIndex], 0, sizeof(struct ManifestEntry) );
+        }
+
+        g_PageIndexList[g_PageIndexCount++] = fileIndex;
+
+        free( g_WatchCandidateList[candidateIndex] );
+    }
+
+    g_WatchCandidateCount = 0;
+
+    if( ( 0 == g_PageIndexCount ) && !removed && !assetsChanged )
+    {
+        return;
+    }
+
+    if( g_PageIndexCount > 0 )
+    {
+        resetHeadFragments();
+
+        makeAllWebpages();
+    }
+
+    saveManifest();
+
+    if( isSiteIndexWanted() )
+    {
+        saveSiteIndex();
+    }
+
+    qsort( g_MarkdownFilenameList, g_MarkdownFilenameCount, sizeof(char *), compareFilenames );
+
+    refreshManifest();
+
+    verbose( "Checked %zu web pages in %" PRIu64 " microseconds\n", g_PageIndexCount, ( getNanoseconds() - startTime ) / 1000 );
+}
+
+/**
+ * void stopWatching( int signalNumber )
+ * 
+ * Watch mode : signal handler for SIGINT and SIGTERM, so that any pages being
+ * made are finished, and the manifest saved, before webpage exits.
+ * 
+ * in       : signalNumber  -   not used
+ * out      : g_WatchStopping is set
+ * err      : none
+ */
+void stopWatching( int signalNumber )
+{
+    ( void )signalNumber;
+
+    g_WatchStopping = 1;
+}
+
+/**
+ * void watchSite( void )
+ * 
+ * Watch mode : once the whole site has been made, wait for changes to the 
+ * markdown tree and keep the affected web pages up to date, until told to 
+ * stop. Changes that come in a burst are dealt with together. SIGINT and 
+ * SIGTERM are blocked but for the wait itself, so that one coming just before
+ * it still ends the wait, rather than being missed until the next change.
+ * 
+ * in       : none
+ * out      : web pages kept up to date
+ * err      : assert if failed to wait for changes
+ */
+void watchSite( void )
+{
+struct pollfd       pollFD = { g_WatchFD, POLLIN, 0 };
+struct sigaction    action;
+sigset_t            stopSignals;
+sigset_t            savedSignals;
+sigset_t            waitSignals;
+uint64_t            firstTime = 0;
+int                 result = 0;
+
+    memset( &action, 0, sizeof(action) );
+
+    action.sa_handler = stopWatching;
+
+    sigaction( SIGINT, &action, NULL );
+    sigaction( SIGTERM, &action, NULL );
+
+    sigemptyset( &stopSignals );
+    sigaddset( &stopSignals, SIGINT );
+    sigaddset( &stopSignals, SIGTERM );
+
+    pthread_sigmask( SIG_BLOCK, &stopSignals, &savedSignals );
+
+    waitSignals = savedSignals;
+
+    sigdelset( &waitSignals, SIGINT );
+    sigdelset( &waitSignals, SIGTERM );
+
+    // saveManifest() sorted the new manifest, so sort the list to match
+
+    qsort( g_MarkdownFilenameList, g_MarkdownFilenameCount, sizeof(char *), compareFilenames );
+
+    refreshManifest();
+
+    verbose( "Watching %s for changes\n", g_Options.markdownRoot );
+
+    while( !g_WatchStopping )
+    {
+        result = ppoll( &pollFD, 1, NULL, &waitSignals );
+
+        if( -1 == result )
+        {
+            assert( EINTR == errno );
+            continue;
+        }
+
+        firstTime = getNanoseconds();
+
+        do
+        {
+            readWatchEvents();
+        }
+        while( ( ( getNanoseconds() - firstTime ) < WATCH_DELAY_LIMIT_NS ) && ( 0 < poll( &pollFD, 1, WATCH_SETTLE_MS ) ) );
+
+        remakeWatchedPages();
+    }
+
+    pthread_sigmask( SIG_SETMASK, &savedSignals, NULL );
+
+    verbose( "Stopped watching %s\n", g_Options.markdownRoot );
+
+    close( g_WatchFD );
+}
+
+/**
+ * void stopServing( int signalNumber )
+ *
+ * Serve mode : SIGINT and SIGTERM handler. No more connections are accepted,
+ * and webpage exits, leaving any connection still open to be closed with it.
+ *
+ * in       : signalNumber  -   not used
+ * out      : g_ServeStopping is set
+ * err      : none
+ */
+void stopServing( int signalNumber )
+{
+    ( void )signalNumber;
+
+    g_ServeStopping = 1;
+}
+
+/**
+ * void stampServedInput( const char *markdownFilenamePtr, int input, struct FileStamp *stampPtr )
+ *
+ * Serve mode : stamp one of the things a web page is made from. Input 0 is the
+ * markdown file, input 1 its txt file, and inputs 2 onwards are the directories
+ * from the markdown file's up to the markdown root, any of which may have had
+ * a css file come or go.
+ *
+ * in       : markdownFilenamePtr   -   the markdown file, relative to the
+ *                                      markdown root, always ending in .md
+ * in       : input                 -   which input to stamp
+ * out      : *stampPtr             -   the input's stamp
+ * err      : none
+ */
+void stampServedInput( const char *markdownFilenamePtr, int input, struct FileStamp *stampPtr )
+{
+char    pathname[PATH_MAX];
+size_t  length = strlen( markdownFilenamePtr );
+int     level = 0;
+
+    if( 0 == input )
+    {
+        snprintf( pathname, sizeof(pathname), "%s/%s", g_Options.markdownRoot, markdownFilenamePtr );
+    }
+    else if( 1 == input )
+    {
+        snprintf( pathname, sizeof(pathname), "%s/%.*s.txt", g_Options.markdownRoot, (int)( length - strlen( ".md" ) ), markdownFilenamePtr );
+    }
+    else
+    {
+        // each level up drops the last part of the name, and the '/' before it
+
+        for( level = 1; level < input; level++ )
+        {
+            while( ( length > 0 ) && ( '/' != markdownFilenamePtr[length - 1] ) )
+            {
+                length--;
+            }
+
+            length -= ( length > 0 ) ? 1 : 0;
+        }
+
+        snprintf( pathname, sizeof(pathname), "%s/%.*s", g_Options.markdownRoot, (int)length, markdownFilenamePtr );
+    }
+
+    stampFile( pathname, stampPtr );
+}
+
+/**
+ * bool isServedPageCurrent( const struct ServedPage *entryPtr )
+ *
+ * Serve mode : work out whether a cached web page is still the page its inputs
+ * would make, which it is if none of them has changed since it was made. Each
+ * input is just stat()ed, and the first change found is enough.
+ *
+ * in       : entryPtr  -   the cached page
+ * out      : true if the page is current
+ * err      : none
+ */
+bool isServedPageCurrent( const struct ServedPage *entryPtr )
+{
+struct FileStamp        stamp;
+const struct FileStamp  *oldStampPtr = NULL;
+int                     input = 0;
+
+    for( input = 0; input < entryPtr->stampCount; input++ )
+    {
+        stampServedInput( entryPtr->markdownFilename, input, &stamp );
+
+        oldStampPtr = &entryPtr->stampsPtr[input];
+
+        if( ( stamp.present != oldStampPtr->present ) ||
+            ( stamp.present && ( ( stamp.mtimeSeconds != oldStampPtr->mtimeSeconds ) || ( stamp.mtimeNanoseconds != oldStampPtr->mtimeNanoseconds ) ||
+                                 ( stamp.size != oldStampPtr->size ) || ( stamp.inode != oldStampPtr->inode ) || ( stamp.device != oldStampPtr->device ) ) ) )
+        {
+            return( false );
+        }
+    }
+
+    return( true );
+}
+
+/**
+ * void freeServedPage( struct ServedPage *entryPtr )
+ *
+ * Serve mode : free a web page that is neither cached nor being sent.
+ *
+ * in       : entryPtr  -   the page
+ * out      : the page is gone
+ * err      : none
+ */
+void freeServedPage( struct ServedPage *entryPtr )
+{
+    free( entryPtr->markdownFilename );
+    free( entryPtr->stampsPtr );
+    free( entryPtr->dataPtr );
+    free( entryPtr );
+}
+
+/**
+ * void listServedPage( struct ServedPage *entryPtr )
+ *
+ * Serve mode : put a cached web page at the most recently served end of the
+ * list. Must be called with g_ServedPageMutex held.
+ *
+ * in       : entryPtr  -   the page, not in the list
+ * out      : the page is the newest in the list
+ * err      : none
+ */
+void listServedPage( struct ServedPage *entryPtr )
+{
+    entryPtr->newerPtr  = NULL;
+    entryPtr->olderPtr  = g_NewestServedPagePtr;
+
+    if( NULL != g_NewestServedPagePtr )
+    {
+        g_NewestServedPagePtr->newerPtr = entryPtr;
+    }
+    else
+    {
+        g_OldestServedPagePtr = entryPtr;
+    }
+
+    g_NewestServedPagePtr = entryPtr;
+}
+
+/**
+ * void unlistServedPage( struct ServedPage *entryPtr )
+ *
+ * Serve mode : take a cached web page out of the list. Must be called with
+ * g_ServedPageMutex held.
+ *
+ * in       : entryPtr  -   the page, in the list
+ * out      : the page is not in the list
+ * err      : none
+ */
+void unlistServedPage( struct ServedPage *entryPtr )
+{
+    if( NULL != entryPtr->newerPtr )
+    {
+        entryPtr->newerPtr->olderPtr = entryPtr->olderPtr;
+    }
+    else
+    {
+        g_NewestServedPagePtr = entryPtr->olderPtr;
+    }
+
+    if( NULL != entryPtr->olderPtr )
+    {
+        entryPtr->olderPtr->newerPtr = entryPtr->newerPtr;
+    }
+    else
+    {
+        g_OldestServedPagePtr = entryPtr->newerPtr;
+    }
+
+    entryPtr->newerPtr  = NULL;
+    entryPtr->olderPtr  = NULL;
+}
+
+/**
+ * void uncacheServedPage( struct ServedPage *entryPtr )
+ *
+ * Serve mode : take a web page out of the cache, freeing it unless it's being
+ * sent. Must be called with g_ServedPageMutex held.
+ *
+ * in       : entryPtr  -   the page, cached
+ * out      : the page is not cached
+ * err      : none
+ */
+void uncacheServedPage( struct ServedPage *entryPtr )
+{
+uint64_t            bucket = hashBytes( HASH_SEED, entryPtr->markdownFilename, strlen( entryPtr->markdownFilename ) ) % SERVED_PAGE_BUCKETS;
+struct ServedPage   **entryPtrPtr = &g_ServedPagePtrs[bucket];
+
+    while( *entryPtrPtr != entryPtr )
+    {
+        entryPtrPtr = &(*entryPtrPtr)->nextPtr;
+    }
+
+    *entryPtrPtr = entryPtr->nextPtr;
+
+    unlistServedPage( entryPtr );
+
+    g_ServedPageBytes  -= entryPtr->memorySize;
+    entryPtr->cached    = false;
+
+    verbose( "Web page for %s is no longer cached\n", entryPtr->markdownFilename );
+
+    if( 0 == entryPtr->useCount )
+    {
+        freeServedPage( entryPtr );
+    }
+}
+
+/**
+ * struct ServedPage *findServedPage( const char *markdownFilenamePtr )
+ *
+ * Serve mode : find the cached web page for a markdown file, if there is one,
+ * and make it the most recently served. It's in use until it's released.
+ *
+ * in       : markdownFilenamePtr   -   the markdown file, relative to the
+ *                                      markdown root
+ * out      : the page, in use, or NULL if there isn't one
+ * err      : none
+ */
+struct ServedPage *findServedPage( const char *markdownFilenamePtr )
+{
+uint64_t            bucket = hashBytes( HASH_SEED, markdownFilenamePtr, strlen( markdownFilenamePtr ) ) % SERVED_PAGE_BUCKETS;
+struct ServedPage   *entryPtr = NULL;
+
+    pthread_mutex_lock( &g_ServedPageMutex );
+
+    entryPtr = g_ServedPagePtrs[bucket];
+
+    while( ( NULL != entryPtr ) && ( 0 != strcmp( entryPtr->markdownFilename, markdownFilenamePtr ) ) )
+    {
+        entryPtr = entryPtr->nextPtr;
+    }
+
+    if( NULL != entryPtr )
+    {
+        unlistServedPage( entryPtr );
+        listServedPage( entryPtr );
+
+        entryPtr->useCount++;
+    }
+
+    pthread_mutex_unlock( &g_ServedPageMutex );
+
+    return( entryPtr );
+}
+
+/**
+ * void cacheServedPage( struct ServedPage *entryPtr )
+ *
+ * Serve mode : cache a newly made web page, in place of any page cached for
+ * the same markdown file, and push the least recently served pages out of the
+ * cache until they all fit in the size given to the 'serve-cache' option. A
+ * page too big for the cache on its own isn't cached.
+ *
+ * in       : entryPtr  -   the page, not cached
+ * out      : the page is cached, and the newest in the list
+ * err      : none
+ */
+void cacheServedPage( struct ServedPage *entryPtr )
+{
+uint64_t            bucket = hashBytes( HASH_SEED, entryPtr->markdownFilename, strlen( entryPtr->markdownFilename ) ) % SERVED_PAGE_BUCKETS;
+struct ServedPage   *oldEntryPtr = NULL;
+
+    if( entryPtr->memorySize > (size_t)g_Options.serveCacheSize )
+    {
+        verbose( "Web page for %s is too big to cache\n", entryPtr->markdownFilename );
+        return;
+    }
+
+    pthread_mutex_lock( &g_ServedPageMutex );
+
+    for( oldEntryPtr = g_ServedPagePtrs[bucket]; NULL != oldEntryPtr; oldEntryPtr = oldEntryPtr->nextPtr )
+    {
+        if( 0 == strcmp( oldEntryPtr->markdownFilename, entryPtr->markdownFilename ) )
+        {
+            uncacheServedPage( oldEntryPtr );
+            break;
+        }
+    }
+
+    entryPtr->nextPtr           = g_ServedPagePtrs[bucket];
+    entryPtr->cached            = true;
+    g_ServedPagePtrs[bucket]    = entryPtr;
+    g_ServedPageBytes          += entryPtr->memorySize;
+
+    listServedPage( entryPtr );
+
+    // the new page fits on its own, so is never pushed out itself
+
+    while( g_ServedPageBytes > (size_t)g_Options.serveCacheSize )
+    {
+        uncacheServedPage( g_OldestServedPagePtr );
+    }
+
+    pthread_mutex_unlock( &g_ServedPageMutex );
+}
+
+/**
+ * void releaseServedPage( struct ServedPage *entryPtr, bool stale )
+ *
+ * Serve mode : finish with a web page found in the cache or newly made, taking
+ * it out of the cache if it's stale. A page that isn't cached is freed by
+ * whichever connection finishes with it last.
+ *
+ * in       : entryPtr  -   the page, in use
+ * in       : stale     -   true if the page's inputs have changed
+ * out      : the page is one use fewer, and may be gone
+ * err      : none
+ */
+void releaseServedPage( struct ServedPage *entryPtr, bool stale )
+{
+    pthread_mutex_lock( &g_ServedPageMutex );
+
+    entryPtr->useCount--;
+
+    if( stale && entryPtr->cached )
+    {
+        uncacheServedPage( entryPtr );
+    }
+    else if( ( 0 == entryPtr->useCount ) && !entryPtr->cached )
+    {
+        freeServedPage( entryPtr );
+    }
+
+    pthread_mutex_unlock( &g_ServedPageMutex );
+}
+
+/**
+ * struct ServedPage *makeServedPage( const char *markdownFilenamePtr, struct Arena *arenaPtr )
+ *
+ * Serve mode : make the web page for a markdown file in memory, just as site
+ * mode would make it, with any txt file in the head. The inputs are stamped
+ * before the page is made, so that a change made while it's being made is seen
+ * the next time it's asked for. Css files may have come or gone since the last
+ * page was made, so the css is worked out again for the directories on its
+ * way up whose stamps show they have changed, and those below them. A page 
+ * with no css file to be found has no css link, rather than the server 
+ * stopping.
+ *
+ * in       : markdownFilenamePtr   -   the markdown file, relative to the
+ *                                      markdown root, always ending in .md
+ * in       : arenaPtr              -   arena to make the page in, reset after
+ * out      : the page, in use, not cached, or NULL if there's no such markdown
+ *            file under the markdown root
+ * err      : assert if failed to allocate the page
+ */
+struct ServedPage *makeServedPage( const char *markdownFilenamePtr, struct Arena *arenaPtr )
+{
+struct ServedPage   *entryPtr = NULL;
+struct Page         page;
+struct stat         markdownStat;
+char                *canonicalNamePtr = NULL;
+const char          *slashPtr = NULL;
+size_t              rootLength = strlen( g_Options.markdownRoot );
+time_t              settledTime = time( NULL ) - 1;
+int                 input = 0;
+bool                linked = false;
+bool                rendered = false;
+
+    entryPtr = (struct ServedPage *)calloc( 1, sizeof(struct ServedPage) );
+
+    assert( entryPtr );
+
+    entryPtr->markdownFilename  = strdup( markdownFilenamePtr );
+    entryPtr->stampCount        = 3;
+    entryPtr->settled           = true;
+    entryPtr->useCount          = 1;
+
+    assert( entryPtr->markdownFilename );
+
+    for( slashPtr = strchr( markdownFilenamePtr, '/' ); NULL != slashPtr; slashPtr = strchr( slashPtr + 1, '/' ) )
+    {
+        entryPtr->stampCount++;
+    }
+
+    entryPtr->stampsPtr = (struct FileStamp *)calloc( entryPtr->stampCount, sizeof(struct FileStamp) );
+
+    assert( entryPtr->stampsPtr );
+
+    // an input changed within the last second may change again without its
+    // modification time changing, so the page can't be kept
+
+    for( input = 0; input < entryPtr->stampCount; input++ )
+    {
+        stampServedInput( markdownFilenamePtr, input, &entryPtr->stampsPtr[input] );
+
+        if( entryPtr->stampsPtr[input].present && ( entryPtr->stampsPtr[input].mtimeSeconds >= settledTime ) )
+        {
+            entryPtr->settled = false;
+        }
+    }
+
+    initPage( &page, arenaPtr, markdownFilenamePtr );
+
+    // The markdown file has to be a file really under the markdown root, not
+    // just linked from there, for the css search to end at the root
+
+    if( entryPtr->stampsPtr[0].present )
+    {
+        canonicalNamePtr = canonicalize_file_name( page.markdownFilename );
+
+        addCount( count_canonicalize, 1 );
+    }
+
+    if( ( NULL == canonicalNamePtr ) || ( 0 != strncmp( canonicalNamePtr, g_Options.markdownRoot, rootLength ) ) ||
+        ( ( rootLength > 1 ) && ( '/' != canonicalNamePtr[rootLength] ) ) ||
+        ( 0 != stat( canonicalNamePtr, &markdownStat ) ) || !S_ISREG( markdownStat.st_mode ) )
+    {
+        verbose( "No markdown file %s under %s\n", markdownFilenamePtr, g_Options.markdownRoot );
+
+        free( canonicalNamePtr );
+        freePage( &page );
+        resetArena( arenaPtr );
+        freeServedPage( entryPtr );
+
+        return( NULL );
+    }
+
+    // a directory on the way up that's linked from elsewhere is cached under
+    // its canonical name, which its stamp doesn't give
+
+    linked = ( 0 != strcmp( canonicalNamePtr, page.markdownFilename ) );
+
+    free( canonicalNamePtr );
+
+    verbose( "Making web page for %s\n", page.markdownFilename );
+
+    if( NULL != page.cssRoot )
+    {
+        pthread_mutex_lock( &g_CssDirectoryMutex );
+
+        if( linked )
+        {
+            invalidateCssDirectories();
+        }
+        else
+        {
+            invalidateServedCssDirectories( entryPtr );
+        }
+
+        pthread_mutex_unlock( &g_CssDirectoryMutex );
+
+        page.cssFilename = findCssFile( &page );
+
+        if( NULL == page.cssFilename )
+        {
+            verbose( "No css file found for %s, so no link to one\n", page.markdownFilename );
+
+            page.cssRoot = NULL;
+        }
+    }
+
+    makeHeadFragments();
+
+    rendered = renderWebpage( &page );
+
+    assert( rendered );
+
+    entryPtr->length    = page.head.length + page.bodyLength + page.tail.length;
+    entryPtr->dataPtr   = (char *)malloc( entryPtr->length );
+
+    assert( entryPtr->dataPtr );
+
+    memcpy( entryPtr->dataPtr, page.head.dataPtr, page.head.length );
+    memcpy( entryPtr->dataPtr + page.head.length, page.bodyPtr, page.bodyLength );
+    memcpy( entryPtr->dataPtr + page.head.length + page.bodyLength, page.tail.dataPtr, page.tail.length );
+
+    entryPtr->memorySize = sizeof(struct ServedPage) + strlen( markdownFilenamePtr ) + 1 +
+                           ( entryPtr->stampCount * sizeof(struct FileStamp) ) + entryPtr->length;
+
+    freePage( &page );
+    resetArena( arenaPtr );
+
+    return( entryPtr );
+}
+
+/**
+ * struct ServedPage *getServedPage( const char *markdownFilenamePtr, struct Arena *arenaPtr )
+ *
+ * Serve mode : get the web page for a markdown file, from the cache if it's
+ * there and still current, otherwise newly made, and cached if it's settled.
+ *
+ * in       : markdownFilenamePtr   -   the markdown file, relative to the
+ *                                      markdown root, always ending in .md
+ * in       : arenaPtr              -   arena to make the page in, if need be
+ * out      : the page, in use until released, or NULL if there's no such
+ *            markdown file
+ * err      : none
+ */
+struct ServedPage *getServedPage( const char *markdownFilenamePtr, struct Arena *arenaPtr )
+{
+struct ServedPage *entryPtr = findServedPage( markdownFilenamePtr );
+
+    if( NULL != entryPtr )
+    {
+        if( isServedPageCurrent( entryPtr ) )
+        {
+            verbose( "Serving cached web page for %s\n", markdownFilenamePtr );
+
+            return( entryPtr );
+        }
+
+        verbose( "Cached web page for %s is stale\n", markdownFilenamePtr );
+
+        releaseServedPage( entryPtr, true );
+    }
+
+    entryPtr = makeServedPage( markdownFilenamePtr, arenaPtr );
+
+    if( ( NULL != entryPtr ) && entryPtr->settled )
+    {
+        cacheServedPage( entryPtr );
+    }
+
+    return( entryPtr );
+}
+
+/**
+ * const char *getContentType( const char *filenamePtr )
+ *
+ * Serve mode : work out the content type of a file from its extension.
+ *
+ * in       : filenamePtr   -   name of the file
+ * out      : the content type
+ * err      : none
+ */
+const char *getContentType( const char *filenamePtr )
+{
+const char  *extensionPtr = strrchr( filenamePtr, '.' );
+int         type = 0;
+
+    for( type = 0; ( NULL != extensionPtr ) && ( NULL != g_ContentTypes[type][0] ); type++ )
+    {
+        if( 0 == strcasecmp( extensionPtr, g_ContentTypes[type][0] ) )
+        {
+            return( g_ContentTypes[type][1] );
+        }
+    }
+
+    return( "application/octet-stream" );
+}
+
+/**
+ * const char *getStatusText( int status )
+ *
+ * Serve mode : the reason phrase for each status sent.
+ *
+ * in       : status    -   HTTP status code
+ * out      : what it means
+ * err      : none
+ */
+const char *getStatusText( int status )
+{
+    switch( status )
+    {
+        case 200    :   return( "OK" );
+        case 301    :   return( "Moved Permanently" );
+        case 400    :   return( "Bad Request" );
+        case 404    :   return( "Not Found" );
+        case 405    :   return( "Method Not Allowed" );
+        default     :   return( "Internal Server Error" );
+    }
+}
+
+/**
+ * bool sendServeResponse( int connectionFD, int status, const char *typePtr, size_t length, const char *extraPtr, bool keepAlive, const void *bodyPtr )
+ *
+ * Serve mode : send the head of a response, and its body, if that's given, in
+ * one go as far as possible. Pages are made again whenever they change, so
+ * browsers are asked to check every time. Whether the connection stays open
+ * is always said, as an HTTP/1.0 client that asked for it to stay open only
+ * keeps it open if told so. The other end may go at any time, so failing to
+ * send is not an error.
+ *
+ * in       : connectionFD  -   the connection
+ * in       : status        -   HTTP status code
+ * in       : typePtr       -   content type
+ * in       : length        -   content length
+ * in       : extraPtr      -   any more header lines, each ending in CRLF
+ * in       : keepAlive     -   false if the connection is closed after this
+ * in       : bodyPtr       -   length bytes of body, or NULL to send none
+ * out      : true if it was all sent
+ * err      : none
+ */
+bool sendServeResponse( int connectionFD, int status, const char *typePtr, size_t length, const char *extraPtr, bool keepAlive, const void *bodyPtr )
+{
+char            head[1024];
+struct iovec    vectors[2];
+struct iovec    *vectorPtr = vectors;
+int             vectorCount = ( NULL == bodyPtr ) ? 1 : 2;
+ssize_t         written = 0;
+
+    vectors[0].iov_base = head;
+    vectors[0].iov_len  = snprintf( head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nCache-Control: no-cache\r\n%s%s\r\n",
+                                    status, getStatusText( status ), typePtr, length, extraPtr, keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n" );
+    vectors[1].iov_base = (void *)bodyPtr;
+    vectors[1].iov_len  = length;
+
+    TRACE( TRACE_PAGES, trace_served, status, length );
+
+    while( vectorCount > 0 )
+    {
+        written = writev( connectionFD, vectorPtr, vectorCount );
+
+        if( -1 == written && EINTR == errno )
+        {
+            continue;
+        }
+
+        if( written <= 0 )
+        {
+            return( false );
+        }
+
+        while( vectorCount > 0 && (size_t)written >= vectorPtr->iov_len )
+        {
+            written -= vectorPtr->iov_len;
+            vectorPtr++;
+            vectorCount--;
+        }
+
+        if( vectorCount > 0 )
+        {
+            vectorPtr->iov_base = (char *)vectorPtr->iov_base + written;
+            vectorPtr->iov_len -= written;
+        }
+    }
+
+    return( true );
+}
+
+/**
+ * bool sendServeError( int connectionFD, int status, bool keepAlive, bool headOnly )
+ *
+ * Serve mode : send a response saying what went wrong, in a line of text.
+ *
+ * in       : connectionFD  -   the connection
+ * in       : status        -   HTTP status code
+ * in       : keepAlive     -   false if the connection is closed after this
+ * in       : headOnly      -   true if there's to be no body, for HEAD
+ * out      : true if the connection is still to be kept open
+ * err      : none
+ */
+bool sendServeError( int connectionFD, int status, bool keepAlive, bool headOnly )
+{
+char    body[64];
+size_t  length = snprintf( body, sizeof(body), "%d %s\n", status, getStatusText( status ) );
+
+    return( sendServeResponse( connectionFD, status, "text/plain", length, "", keepAlive, headOnly ? NULL : body ) && keepAlive );
+}
+
+/**
+ * bool decodeServePath( const char *targetPtr, char *pathPtr, size_t size )
+ *
+ * Serve mode : work out the file in the markdown tree that a request is for,
+ * from the path of the request target, percent decoded, without the leading
+ * '/' and leaving room for index.html to be added. Nothing outside the markdown
+ * tree may be asked for, so no part of the path may start with '.', which also
+ * keeps hidden files hidden, as they are from the assets.
+ *
+ * in       : targetPtr -   the request target
+ * in       : size      -   most the path may take up, including the NUL
+ * out      : pathPtr   -   the path, relative to the markdown root
+ * out      : true if the path is good
+ * err      : none
+ */
+bool decodeServePath( const char *targetPtr, char *pathPtr, size_t size )
+{
+size_t          length = 0;
+unsigned int    character = 0;
+
+    if( '/' != *targetPtr++ )
+    {
+        return( false );
+    }
+
+    for( ; ( '\0' != *targetPtr ) && ( '?' != *targetPtr ) && ( '#' != *targetPtr ); targetPtr++ )
+    {
+        character = (unsigned char)*targetPtr;
+
+        if( '%' == character )
+        {
+            if( !isxdigit( (unsigned char)targetPtr[1] ) || !isxdigit( (unsigned char)targetPtr[2] ) )
+            {
+                return( false );
+            }
+
+            sscanf( targetPtr + 1, "%2x", &character );
+
+            targetPtr += 2;
+        }
+
+        if( ( '\0' == character ) || ( ( length + strlen( "index.html" ) + 1 ) >= size ) )
+        {
+            return( false );
+        }
+
+        if( ( '.' == character ) && ( ( 0 == length ) || ( '/' == pathPtr[length - 1] ) ) )
+        {
+            return( false );
+        }
+
+        pathPtr[length++] = (char)character;
+    }
+
+    pathPtr[length] = '\0';
+
+    return( true );
+}
+
+/**
+ * bool serveAsset( int connectionFD, const char *pathPtr, const char *targetPtr, bool keepAlive, bool headOnly )
+ *
+ * Serve mode : send a file from the markdown tree as it is, as site mode would
+ * have mirrored it, copied by the kernel. A directory asked for without a
+ * trailing '/' is redirected to one, so that links from its index page work.
+ *
+ * in       : connectionFD  -   the connection
+ * in       : pathPtr       -   the file, relative to the markdown root
+ * in       : targetPtr     -   the request target, for a redirect
+ * in       : keepAlive     -   false if the connection is closed after this
+ * in       : headOnly      -   true if there's to be no body, for HEAD
+ * out      : true if the connection is still to be kept open
+ * err      : none
+ */
+bool serveAsset( int connectionFD, const char *pathPtr, const char *targetPtr, bool keepAlive, bool headOnly )
+{
+char        filename[PATH_MAX];
+char        location[PATH_MAX + 32];
+const char  *basenamePtr = strrchr( pathPtr, '/' );
+struct stat assetStat;
+int         assetFD = -1;
+off_t       offset = 0;
+size_t      remaining = 0;
+ssize_t     copied = 0;
+bool        sent = false;
+
+    basenamePtr = ( NULL == basenamePtr ) ? pathPtr : basenamePtr + 1;
+
+    snprintf( filename, sizeof(filename), "%s/%s", g_Options.markdownRoot, pathPtr );
+
+    assetFD = open( filename, O_RDONLY | O_CLOEXEC );
+
+    if( ( -1 == assetFD ) || ( 0 != fstat( assetFD, &assetStat ) ) )
+    {
+        verbose( "No file %s to serve\n", filename );
+
+        if( -1 != assetFD )
+        {
+            close( assetFD );
+        }
+
+        return( sendServeError( connectionFD, 404, keepAlive, headOnly ) );
+    }
+
+    if( S_ISDIR( assetStat.st_mode ) )
+    {
+        close( assetFD );
+
+        snprintf( location, sizeof(location), "Location: %.*s/\r\n", (int)strcspn( targetPtr, "?#" ), targetPtr );
+
+        return( sendServeResponse( connectionFD, 301, "text/plain", 0, location, keepAlive, NULL ) && keepAlive );
+    }
+
+    if( !S_ISREG( assetStat.st_mode ) || !isAssetFilename( basenamePtr ) )
+    {
+        verbose( "%s is not an asset to serve\n", filename );
+
+        close( assetFD );
+
+        return( sendServeError( connectionFD, 404, keepAlive, headOnly ) );
+    }
+
+    verbose( "Serving %s\n", filename );
+
+    sent = sendServeResponse( connectionFD, 200, getContentType( basenamePtr ), assetStat.st_size, "", keepAlive, NULL );
+
+    // a file cut short as it's sent leaves the response short, so the
+    // connection has to go
+
+    while( sent && !headOnly && ( offset < assetStat.st_size ) )
+    {
+        // offset is short of the size, so what's left is more than nothing
+
+        remaining   = (size_t)( assetStat.st_size - offset );
+        copied      = sendfile( connectionFD, assetFD, &offset, ( remaining < KERNEL_COPY_SIZE ) ? remaining : KERNEL_COPY_SIZE );
+
+        if( -1 == copied && EINTR == errno )
+        {
+            continue;
+        }
+
+        sent = ( copied > 0 );
+    }
+
+    close( assetFD );
+
+    return( sent && keepAlive );
+}
+
+/**
+ * bool serveRequest( int connectionFD, struct Arena *arenaPtr, char *requestPtr )
+ *
+ * Serve mode : answer a GET or HEAD request. A request for a directory is for
+ * its index.html, and a request for an .html file is for the web page made
+ * from the .md file of the same name, if there is one. Anything else is an
+ * asset. HTTP/1.1 connections are kept open unless the request says not to.
+ *
+ * in       : connectionFD  -   the connection
+ * in       : arenaPtr      -   arena to make any page in
+ * in       : requestPtr    -   the request's head, NUL terminated, which is
+ *                              changed
+ * out      : true if the connection is to be kept open for another request
+ * err      : none
+ */
+bool serveRequest( int connectionFD, struct Arena *arenaPtr, char *requestPtr )
+{
+char                *targetPtr = strchr( requestPtr, ' ' );
+char                *versionPtr = ( NULL == targetPtr ) ? NULL : strchr( targetPtr + 1, ' ' );
+char                *linePtr = strstr( requestPtr, "\r\n" );
+char                *valuePtr = NULL;
+char                path[PATH_MAX];
+size_t              length = 0;
+bool                keepAlive = false;
+bool                headOnly = false;
+bool                sent = false;
+struct ServedPage   *entryPtr = NULL;
+
+    // the request line is <method> <target> HTTP/1.<minor>
+
+    if( ( NULL == versionPtr ) || ( versionPtr > linePtr ) || ( 0 != strncmp( versionPtr + 1, "HTTP/1.", strlen( "HTTP/1." ) ) ) )
+    {
+        return( sendServeError( connectionFD, 400, false, false ) );
+    }
+
+    *targetPtr++    = '\0';
+    *versionPtr++   = '\0';
+    *linePtr        = '\0';
+
+    verbose( "Request %s %s %s\n", requestPtr, targetPtr, versionPtr );
+
+    keepAlive   = ( 0 == strcmp( "HTTP/1.1", versionPtr ) );
+    headOnly    = ( 0 == strcmp( "HEAD", requestPtr ) );
+
+    // of the header lines, only Connection matters; the head ends in a blank
+    // line
+
+    for( linePtr += strlen( "\r\n" ); '\r' != *linePtr; linePtr = strstr( linePtr, "\r\n" ) + strlen( "\r\n" ) )
+    {
+        if( 0 == strncasecmp( linePtr, "Connection:", strlen( "Connection:" ) ) )
+        {
+            valuePtr = linePtr + strlen( "Connection:" ) + strspn( linePtr + strlen( "Connection:" ), " \t" );
+
+            if( 0 == strncasecmp( valuePtr, "close", strlen( "close" ) ) )
+            {
+                keepAlive = false;
+            }
+            else if( 0 == strncasecmp( valuePtr, "keep-alive", strlen( "keep-alive" ) ) )
+            {
+                keepAlive = true;
+            }
+        }
+    }
+
+    // anything else may have a body, which isn't read, so the connection goes
+
+    if( !headOnly && ( 0 != strcmp( "GET", requestPtr ) ) )
+    {
+        sendServeResponse( connectionFD, 405, "text/plain", 0, "Allow: GET, HEAD\r\n", false, NULL );
+        return( false );
+    }
+
+    if( !decodeServePath( targetPtr, path, sizeof(path) - strlen( g_Options.markdownRoot ) - strlen( "/.html" ) ) )
+    {
+        return( sendServeError( connectionFD, 400, keepAlive, headOnly ) );
+    }
+
+    length = strlen( path );
+
+    if( ( 0 == length ) || ( '/' == path[length - 1] ) )
+    {
+        length = stpcpy( path + length, "index.html" ) - path;
+    }
+
+    if( ( length > strlen( ".html" ) ) && ( 0 == strcmp( path + length - strlen( ".html" ), ".html" ) ) )
+    {
+        // ask for the page by its markdown file, then put the path back as it
+        // was, in case it's an asset after all
+
+        strcpy( path + length - strlen( ".html" ), ".md" );
+
+        entryPtr = getServedPage( path, arenaPtr );
+
+        strcpy( path + length - strlen( ".html" ), ".html" );
+
+        if( NULL != entryPtr )
+        {
+            sent = sendServeResponse( connectionFD, 200, "text/html; charset=utf-8", entryPtr->length, "", keepAlive, headOnly ? NULL : entryPtr->dataPtr );
+
+            releaseServedPage( entryPtr, false );
+
+            return( sent && keepAlive );
+        }
+    }
+
+    return( serveAsset( connectionFD, path, targetPtr, keepAlive, headOnly ) );
+}
+
+/**
+ * size_t readServeRequest( int connectionFD, char *requestPtr, size_t *lengthPtr )
+ *
+ * Serve mode : read from a connection until there's a whole request head,
+ * which ends in a blank line. Anything read after the head is the start of
+ * the next request, so is kept, and is already in place when this is called
+ * again.
+ *
+ * in       : connectionFD  -   the connection
+ * in       : requestPtr    -   room for SERVE_REQUEST_SIZE bytes and a NUL
+ * in/out   : lengthPtr     -   how much has been read into it so far
+ * out      : the length of the request head, or 0 if the connection was
+ *            closed or timed out, or the head was too big
+ * err      : none
+ */
+size_t readServeRequest( int connectionFD, char *requestPtr, size_t *lengthPtr )
+{
+char    *endPtr = NULL;
+ssize_t bytesRead = 0;
+
+    while( true )
+    {
+        requestPtr[*lengthPtr] = '\0';
+
+        endPtr = strstr( requestPtr, "\r\n\r\n" );
+
+        if( NULL != endPtr )
+        {
+            return( endPtr + strlen( "\r\n\r\n" ) - requestPtr );
+        }
+
+        if( *lengthPtr >= SERVE_REQUEST_SIZE )
+        {
+            verbose( "Request too big\n" );
+            return( 0 );
+        }
+
+        bytesRead = read( connectionFD, requestPtr + *lengthPtr, SERVE_REQUEST_SIZE - *lengthPtr );
+
+        if( -1 == bytesRead && EINTR == errno )
+        {
+            continue;
+        }
+
+        if( bytesRead <= 0 )
+        {
+            return( 0 );
+        }
+
+        *lengthPtr += bytesRead;
+    }
+}
+
+/**
+ * void *serveConnection( void *connectionPtr )
+ *
+ * Serve mode : thread answering the requests on one connection, in turn, until
+ * it's closed, or nothing happens on it for SERVE_IDLE_SECONDS. Pages are made
+ * in the thread's own arena.
+ *
+ * in       : connectionPtr -   the connection's file descriptor
+ * out      : the connection is closed
+ * err      : none
+ */
+void *serveConnection( void *connectionPtr )
+{
+int             connectionFD = (int)(intptr_t)connectionPtr;
+struct Arena    arena = { NULL, NULL };
+struct timeval  timeout = { SERVE_IDLE_SECONDS, 0 };
+char            request[SERVE_REQUEST_SIZE + 1];
+size_t          length = 0;
+size_t          headLength = 0;
+char            following = '\0';
+bool            keepOpen = true;
+bool            tracing = startTracing();
+
+    setsockopt( connectionFD, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+    setsockopt( connectionFD, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+
+    while( keepOpen && ( 0 != ( headLength = readServeRequest( connectionFD, request, &length ) ) ) )
+    {
+        following           = request[headLength];
+        request[headLength] = '\0';
+
+        keepOpen = serveRequest( connectionFD, &arena, request );
+
+        request[headLength] = following;
+        length             -= headLength;
+
+        memmove( request, request + headLength, length );
+    }
+
+    close( connectionFD );
+
+    releaseArena( &arena );
+
+    if( tracing )
+    {
+        stopTracing();
+    }
+
+    return( NULL );
+}
+
+/**
+ * void openServeSocket( void )
+ *
+ * Serve mode : listen on the address given to the 'listen' option, as
+ * [<address>:]<port>. The address may be a name, or an IPv6 address in
+ * brackets; without one, only the loopback address is listened on, and with
+ * an empty one, every address is. Where it's listening goes on stdout, which
+ * gives the port when port 0 ( any port ) was asked for.
+ *
+ * in       : none
+ * out      : g_ServeFD is listening
+ * err      : exit if the address can't be listened on
+ * err      : assert if failed to allocate a copy of the address
+ */
+void openServeSocket( void )
+{
+char                    *addressPtr = strdup( g_Options.listenAddress );
+char                    *hostPtr = "127.0.0.1";
+char                    *portPtr = NULL;
+struct addrinfo         hints;
+struct addrinfo         *addressListPtr = NULL;
+struct addrinfo         *infoPtr = NULL;
+struct sockaddr_storage boundAddress;
+socklen_t               boundLength = sizeof(boundAddress);
+char                    boundHost[NI_MAXHOST];
+char                    boundPort[NI_MAXSERV];
+int                     reuse = 1;
+
+    assert( addressPtr );
+
+    portPtr = strrchr( addressPtr, ':' );
+
+    if( NULL == portPtr )
+    {
+        portPtr = addressPtr;
+    }
+    else
+    {
+        *portPtr++  = '\0';
+        hostPtr     = addressPtr;
+
+        if( ( '[' == hostPtr[0] ) && ( ']' == hostPtr[strlen( hostPtr ) - 1] ) )
+        {
+            hostPtr[strlen( hostPtr ) - 1] = '\0';
+            hostPtr++;
+        }
+
+        hostPtr = ( '\0' == hostPtr[0] ) ? NULL : hostPtr;
+    }
+
+    memset( &hints, 0, sizeof(hints) );
+
+    hints.ai_family     = AF_UNSPEC;
+    hints.ai_socktype   = SOCK_STREAM;
+    hints.ai_flags      = AI_PASSIVE;
+
+    if( 0 == getaddrinfo( hostPtr, portPtr, &hints, &addressListPtr ) )
+    {
+        for( infoPtr = addressListPtr; ( NULL != infoPtr ) && ( -1 == g_ServeFD ); infoPtr = infoPtr->ai_next )
+        {
+            g_ServeFD = socket( infoPtr->ai_family, infoPtr->ai_socktype | SOCK_CLOEXEC, infoPtr->ai_protocol );
+
+            if( -1 == g_ServeFD )
+            {
+                continue;
+            }
+
+            setsockopt( g_ServeFD, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse) );
+
+            if( ( 0 != bind( g_ServeFD, infoPtr->ai_addr, infoPtr->ai_addrlen ) ) || ( 0 != listen( g_ServeFD, SERVE_BACKLOG ) ) )
+            {
+                close( g_ServeFD );
+                g_ServeFD = -1;
+            }
+        }
+
+        freeaddrinfo( addressListPtr );
+    }
+
+    if( -1 == g_ServeFD )
+    {
+        printf( "Cannot listen on %s\n", g_Options.listenAddress );
+        exit( EXIT_BAD_SERVE );
+    }
+
+    free( addressPtr );
+
+    if( ( 0 == getsockname( g_ServeFD, (struct sockaddr *)&boundAddress, &boundLength ) ) &&
+        ( 0 == getnameinfo( (struct sockaddr *)&boundAddress, boundLength, boundHost, sizeof(boundHost), boundPort, sizeof(boundPort), NI_NUMERICHOST | NI_NUMERICSERV ) ) )
+    {
+        printf( "Serving %s at http://%s%s%s:%s/\n", g_Options.markdownRoot,
+                ( AF_INET6 == boundAddress.ss_family ) ? "[" : "", boundHost, ( AF_INET6 == boundAddress.ss_family ) ? "]" : "", boundPort );
+        fflush( stdout );
+    }
+}
+
+/**
+ * void serveSite( void )
+ *
+ * Serve mode : make web pages from the markdown tree as they're asked for,
+ * over HTTP, until told to stop. Each connection has a thread of its own, and
+ * the pages are cached between them.
+ *
+ * in       : none
+ * out      : web pages served
+ * err      : exit if the address can't be listened on
+ */
+void serveSite( void )
+{
+struct sigaction    action;
+pthread_attr_t      threadAttributes;
+pthread_t           thread;
+int                 connectionFD = -1;
+
+    memset( &action, 0, sizeof(action) );
+
+    // no SA_RESTART, so a signal gets accept() to give up
+
+    action.sa_handler = stopServing;
+
+    sigaction( SIGINT, &action, NULL );
+    sigaction( SIGTERM, &action, NULL );
+
+    // a browser may go before its page has been sent
+
+    action.sa_handler = SIG_IGN;
+
+    sigaction( SIGPIPE, &action, NULL );
+
+    openServeSocket();
+
+    pthread_attr_init( &threadAttributes );
+    pthread_attr_setdetachstate( &threadAttributes, PTHREAD_CREATE_DETACHED );
+
+    while( !g_ServeStopping )
+    {
+        connectionFD = accept4( g_ServeFD, NULL, NULL, SOCK_CLOEXEC );
+
+        if( -1 == connectionFD )
+        {
+            // out of file descriptors, say, so give the connections there are
+            // a moment to finish
+
+            if( ( EINTR != errno ) && ( ECONNABORTED != errno ) )
+            {
+                poll( NULL, 0, SERVE_RETRY_MS );
+            }
+
+            continue;
+        }
+
+        if( 0 != pthread_create( &thread, &threadAttributes, serveConnection, (void *)(intptr_t)connectionFD ) )
+        {
+            verbose( "Cannot start a thread for a connection\n" );
+
+            close( connectionFD );
+        }
+    }
+
+    pthread_attr_destroy( &threadAttributes );
+
+    verbose( "Stopped serving %s\n", g_Options.markdownRoot );
+
+    close( g_ServeFD );
+}
+
+/**
+ * void getSiteRoots( int rootCount, char **rootsPtr )
+ * 
+ * Site mode : the naked arguments are the markdown root and the html root. Make
+ * the html root if it doesn't exist yet, and then find all the markdown files.
+ * Archive mode has no html root, just the markdown root.
+ * Both roots are held as absolute paths, so that the markdown root can serve as 
+ * the end of the css search.
+ * 
+ * in       : rootCount -   count of naked command line arguments
+ * in       : rootsPtr  -   array of naked command line arguments
+ * out      : g_Options roots set, g_MarkdownFilenameList filled
+ * err      : exit if not given exactly two roots, or one when archiving
+ * err      : exit if asked to watch and archive
+ * err      : exit if either root cannot be found or made
+ */
+void getSiteRoots( int rootCount, char **rootsPtr )
+{
+    if( g_Options.mergeMode && ( g_Options.watchMode || g_Options.serveMode || ( NULL != g_Options.archiveFilename ) || ( 0 != g_Options.shardCount ) ) )
+    {
+        printf( "A merge only puts together what the shards of a site made\n" );
+        exit( EXIT_BAD_SHARD );
+    }
+
+    if( ( 0 != g_Options.shardCount ) && ( g_Options.watchMode || g_Options.serveMode || ( NULL != g_Options.archiveFilename ) ) )
+    {
+        printf( "Cannot make a site in shards when it is being watched, served or archived\n" );
+        exit( EXIT_BAD_SHARD );
+    }
+
+    if( g_Options.serveMode && ( g_Options.watchMode || ( NULL != g_Options.archiveFilename ) ) )
+    {
+        printf( "Cannot serve a site that is being watched or archived\n" );
+        exit( EXIT_BAD_SERVE );
+    }
+
+    if( g_Options.serveMode && isSiteIndexWanted() )
+    {
+        printf( "A sitemap or search index is only made in site, watch or archive mode\n" );
+        exit( EXIT_BAD_SITE_INDEX );
+    }
+
+    if( g_Options.serveMode && ( 1 != rootCount ) )
+    {
+        printf( "Expecting just a markdown root to be specified when serving\n" );
+        exit( EXIT_BAD_SITE_ROOT );
+    }
+
+    if( ( NULL != g_Options.archiveFilename ) && g_Options.watchMode )
+    {
+        printf( "Cannot watch a site that is being archived\n" );
+        exit( EXIT_BAD_ARCHIVE );
+    }
+
+    if( ( NULL != g_Options.archiveFilename ) && ( 1 != rootCount ) )
+    {
+        printf( "Expecting just a markdown root to be specified when archiving\n" );
+        exit( EXIT_BAD_SITE_ROOT );
+    }
+
+    if( ( NULL == g_Options.archiveFilename ) && !g_Options.serveMode && ( 2 != rootCount ) )
+    {
+        printf( "Expecting a markdown root and an html root to be specified\n" );
+        exit( EXIT_BAD_SITE_ROOT );
+    }
+
+    g_Options.markdownRoot = canonicalize_file_name( rootsPtr[0] );
+
+    addCount( count_canonicalize, 1 );
+
+    if( NULL == g_Options.markdownRoot )
+    {
+        printf( "Cannot find markdown root %s\n", rootsPtr[0] );
+        exit( EXIT_BAD_SITE_ROOT );
+    }
+
+    if( g_Options.serveMode )
+    {
+        verbose( "Markdown root is %s, serving it\n", g_Options.markdownRoot );
+        return;
+    }
+
+    if( NULL != g_Options.archiveFilename )
+    {
+        verbose( "Markdown root is %s, archiving to %s\n", g_Options.markdownRoot, g_Options.archiveFilename );
+
+        g_FilesListed = true;
+
+        findMarkdownFiles( "", addMarkdownFilename, ( asset_none == g_Options.assetMode ) ? NULL : addAssetFilename );
+        return;
+    }
+
+    if( ( 0 != mkdir( rootsPtr[1], 0777 ) ) && ( EEXIST != errno ) )
+    {
+        printf( "Cannot make html root %s\n", rootsPtr[1] );
+        exit( EXIT_BAD_SITE_ROOT );
+    }
+
+    g_Options.webpageRoot = canonicalize_file_name( rootsPtr[1] );
+
+    addCount( count_canonicalize, 1 );
+
+    if( NULL == g_Options.webpageRoot )
+    {
+        printf( "Cannot find html root %s\n", rootsPtr[1] );
+        exit( EXIT_BAD_SITE_ROOT );
+    }
+
+    verbose( "Markdown root is %s, html root is %s\n", g_Options.markdownRoot, g_Options.webpageRoot );
+
+    // a merge finds the pages in the shard manifests rather than the markdown
+    // tree
+
+    if( g_Options.mergeMode )
+    {
+        return;
+    }
+
+    if( g_Options.watchMode )
+    {
+        g_WatchFD = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+        if( -1 == g_WatchFD )
+        {
+            printf( "Cannot watch markdown root %s\n", g_Options.markdownRoot );
+            exit( EXIT_BAD_WATCH );
+        }
+    }
+
+    g_FilesListed = ( -1 == g_WatchFD );
+
+    findMarkdownFiles( "", addMarkdownFilename, ( asset_none == g_Options.assetMode ) ? NULL : addAssetFilename );
+
+    if( 0 != g_Options.shardCount )
+    {
+        selectShard();
+    }
+}
+
+/**
+ * long long parseSize( const char *sizePtr )
+ * 
+ * Read a size given as an option : a number of bytes, or of KB, MB or GB if it
+ * ends in K, M or G ( in either case ).
+ * 
+ * in   :   sizePtr -   the size as given
+ * out  :   the size in bytes, or -1 if it isn't a size
+ * err  :   none
+ */
+long long parseSize( const char *sizePtr )
+{
+char        *endPtr = NULL;
+long long   size = strtoll( sizePtr, &endPtr, 10 );
+int         shift = 0;
+
+    if( ( endPtr == sizePtr ) || ( size < 0 ) )
+    {
+        return( -1 );
+    }
+
+    switch( toupper( (unsigned char)*endPtr ) )
+    {
+        case 'G' :  shift += 10;    // fall through
+        case 'M' :  shift += 10;    // fall through
+        case 'K' :  shift += 10;    endPtr++;   break;
+        default  :  break;
+    }
+
+    if( ( '\0' != *endPtr ) || ( size > ( LLONG_MAX >> shift ) ) )
+    {
+        return( -1 );
+    }
+
+    return( size << shift );
+}
+
+/**
+ * void getOptions( int argc, char **argv )
+ * 
+ * Work out what the user supplied parameters are.  
+ * 
+ * in       : argc  -   count of command line arguments
+ * in       : argv  -   array of command line arguments
+ * out      : g_Options values set if specified on command line
  * err      : exit if help requested.
  * err      : exit if c path not absolute.
  * err      : exit if missing option value.
  * err      : exit if unknown option specified. 
  * err      : assert on failure to parse command line.
  * err      : exit if no markdown filename provided.
- * err      : assert on excess arguments.
+ * err      : exit if job count is not a positive number.
  */
 void getOptions( int argc, char **argv )
 {
 int     option = 0;
-char    *extensionPtr = NULL;
 
     // we will handle errors explicitly
     opterr = 0;
@@ -791,7 +10955,7 @@ char    *extensionPtr = NULL;
     // first, just see if we are verbose because we want to 
     // be verbose about option processing too...
 
-    while( -1 != ( option = getopt(argc, argv, "v") ) )
+    while( -1 != ( option = getopt_long(argc, argv, g_ShortOptions, g_LongOptions, NULL) ) )
     {
         switch(option)
         {
@@ -810,7 +10974,7 @@ char    *extensionPtr = NULL;
 
     // extract values of options
 
-    while( -1 != ( option = getopt(argc, argv, "hvf:c:n:") ) )
+    while( -1 != ( option = getopt_long(argc, argv, g_ShortOptions, g_LongOptions, NULL) ) )
     {
         verbose( "Processing option %c\n", option );
         switch(option)
@@ -820,55 +10984,285 @@ char    *extensionPtr = NULL;
                 printHelp();
                 exit( EXIT_NORMAL );
             }
-            case 'v' :  
+            case 'v' :  
+            {
+                // This option already handled if present
+                break;
+            }
+            case '0' :  
+            {
+                verbose( "Markdown file list is NUL separated\n" );
+                g_Options.nulSeparatedList = true;
+                break;
+            }
+            case 'l' :  
+            {
+                verbose( "Rewrite links to markdown files ON\n" );
+                g_Options.rewriteLinks = true;
+                break;
+            }
+            case 's' :  
+            {
+                verbose( "Site mode ON\n" );
+                g_Options.siteMode = true;
+                break;
+            }
+            case 'F' :  
+            {
+                verbose( "Rebuild everything\n" );
+                g_Options.forceRebuild = true;
+                break;
+            }
+            case 'W' :  
+            {
+                verbose( "Watch mode ON\n" );
+                g_Options.siteMode  = true;
+                g_Options.watchMode = true;
+                break;
+            }
+            case 'A' :  
+            {
+            int mode = 0;
+
+                verbose( "Read asset mirroring as %s\n", optarg );
+
+                for( mode = asset_none; ( mode < asset_end ) && ( 0 != strcmp( optarg, g_AssetModeNames[mode] ) ); mode++ );
+
+                if( asset_end == mode )
+                {
+                    printf( "Assets for 'assets' option must be none, copy, reflink or link\n" );
+                    exit( EXIT_BAD_ASSET_MODE );
+                }
+
+                g_Options.assetMode = (enum assetValues)mode;
+                break;
+            }
+            case 'X' :  
+            {
+                verbose( "Read archive as %s\n", optarg );
+                g_Options.siteMode          = true;
+                g_Options.archiveFilename   = strdup( optarg );
+                break;
+            }
+            case 'C' :  
+            {
+                verbose( "Body cache ON\n" );
+                g_Options.cacheDirectory = ( NULL == optarg ) ? getCacheDirectory() : strdup( optarg );
+                break;
+            }
+            case 'K' :  
+            {
+                verbose( "Keep unchanged web pages ON\n" );
+                g_Options.keepUnchanged = true;
+                break;
+            }
+            case 'Z' :  
+            {
+                verbose( "Gzip compressed web pages ON\n" );
+                g_Options.gzipOutput = true;
+                break;
+            }
+            case 'B' :  
+            {
+#ifdef WEBPAGE_BROTLI
+                verbose( "Brotli compressed web pages ON\n" );
+                g_Options.brotliOutput = true;
+                break;
+#else
+                printf( "webpage was built without brotli, so the 'brotli' option is not available\n" );
+                exit( EXIT_NO_BROTLI );
+#endif
+            }
+            case 'j' :  
+            {
+                verbose( "Read job count as %s\n", optarg );
+
+                g_Options.jobCount = strtol( optarg, NULL, 10 );
+
+                if( g_Options.jobCount < 1 )
+                {
+                    printf( "Job count for 'j' option must be at least 1\n" );
+                    exit( EXIT_BAD_JOB_COUNT );
+                }
+                break;
+            }
+            case 'f' :  
+            {
+                long flags = 0;
+
+                verbose( "Read Flags as %s\n", optarg );
+
+                flags = strtol( optarg, NULL, 16 );
+
+                verbose( "Converted Flags as %ld\n", flags );
+
+                if( flag_dtd & flags )g_Options.includeDTD = false;
+                verbose( "dtd is %d\n",g_Options.includeDTD );
+                if( flag_title & flags )g_Options.includeTitle = false;
+                verbose( "title is %d\n",g_Options.includeTitle );
+                if( flag_author & flags )g_Options.includeAuthor = false;
+                verbose( "author is %d\n",g_Options.includeAuthor );
+                if( flag_datetime & flags )g_Options.includeDatetime = false;
+                verbose( "datetime is %d\n",g_Options.includeDatetime );
+
+                break;
+            }
+            case 'c' : 
+            {
+                verbose( "Read css root as %s\n", optarg );
+
+                /********************************************/
+                /* NB - the cssRoot is an absolute path     */
+                /* to the root of a hierarchy that will be  */
+                /* searched for .css files.                 */
+                /********************************************/
+
+                if( '/' != optarg[0] )
+                {
+                    printf("Absolute path required for 'c' option\n");
+                    exit( EXIT_ABS_PATH_REQUIRED );
+                }
+
+                g_Options.cssRoot = strdup( optarg );
+                break;
+            }
+            case 'T' :
+            {
+                verbose( "Read stats file as %s\n", optarg );
+                g_Options.statsFilename = strdup( optarg );
+                break;
+            }
+            case 'n' :
+            {
+                verbose( "Read navigation embedding as %s\n", optarg );
+
+                if( '@' == optarg[0] )
+                {
+                struct Buffer navEmbedFile = { NULL, 0, 0 };
+
+                    loadPartial( &navEmbedFile, optarg + 1 );
+                    appendBuffer( &navEmbedFile, "", 1 );
+
+                    g_Options.navEmbedCode = navEmbedFile.dataPtr;
+                }
+                else
+                {
+                    g_Options.navEmbedCode = strdup( optarg );
+                }
+                break;
+            }
+            case 'M' :  
+            {
+                verbose( "Read sitemap url as %s\n", optarg );
+                g_Options.sitemapUrl = strdup( optarg );
+                break;
+            }
+            case 'I' :  
+            {
+                verbose( "Search index ON\n" );
+                g_Options.searchIndex = true;
+                break;
+            }
+            case 'S' :  
+            {
+                verbose( "Read stream size as %s\n", optarg );
+
+                g_Options.streamSize = parseSize( optarg );
+
+                if( g_Options.streamSize < 0 )
+                {
+                    printf( "Stream size for 'stream-size' option must be a number of bytes, optionally followed by K, M or G\n" );
+                    exit( EXIT_BAD_STREAM_SIZE );
+                }
+                break;
+            }
+            case 'E' :  
             {
-                // This option already handled if present
+                verbose( "Serve mode ON\n" );
+                g_Options.siteMode  = true;
+                g_Options.serveMode = true;
                 break;
             }
-            case 'f' :  
+            case 'R' :  
             {
-                long flags = 0;
-
-                verbose( "Read Flags as %s\n", optarg );
+            int consumed = 0;
 
-                flags = strtol( optarg, NULL, 16 );
+                verbose( "Read shard as %s\n", optarg );
 
-                verbose( "Converted Flags as %ld\n", flags );
+                if( ( 2 != sscanf( optarg, "%ld/%ld%n", &g_Options.shardIndex, &g_Options.shardCount, &consumed ) ) || ( '\0' != optarg[consumed] ) ||
+                    ( g_Options.shardIndex < 1 ) || ( g_Options.shardIndex > g_Options.shardCount ) )
+                {
+                    printf( "Shard for 'shard' option must be <i>/<N>, with <i> from 1 to <N>\n" );
+                    exit( EXIT_BAD_SHARD );
+                }
+                break;
+            }
+            case 'G' :  
+            {
+                verbose( "Merge mode ON\n" );
+                g_Options.siteMode  = true;
+                g_Options.mergeMode = true;
+                break;
+            }
+            case 'D' :  
+            {
+                verbose( "Read trace file as %s\n", optarg );
+                g_Options.traceFilename = optarg;
+                break;
+            }
+            case 'L' :  
+            {
+                verbose( "Read listen address as %s\n", optarg );
+                g_Options.listenAddress = strdup( optarg );
+                break;
+            }
+            case 'Y' :  
+            {
+                verbose( "Read serve cache size as %s\n", optarg );
 
-                if( flag_dtd & flags )g_Options.includeDTD = false;
-                verbose( "dtd is %d\n",g_Options.includeDTD );
-                if( flag_title & flags )g_Options.includeTitle = false;
-                verbose( "title is %d\n",g_Options.includeTitle );
-                if( flag_author & flags )g_Options.includeAuthor = false;
-                verbose( "author is %d\n",g_Options.includeAuthor );
-                if( flag_datetime & flags )g_Options.includeDatetime = false;
-                verbose( "datetime is %d\n",g_Options.includeDatetime );
+                g_Options.serveCacheSize = parseSize( optarg );
 
+                if( g_Options.serveCacheSize < 0 )
+                {
+                    printf( "Cache size for 'serve-cache' option must be a number of bytes, optionally followed by K, M or G\n" );
+                    exit( EXIT_BAD_SERVE );
+                }
                 break;
             }
-            case 'c' : 
+            case 'Q' :  
             {
-                verbose( "Read css root as %s\n", optarg );
+#ifdef WEBPAGE_IO_URING
+                verbose( "io_uring read ahead ON\n" );
+                g_Options.ioUring = true;
+                break;
+#else
+                printf( "webpage was built without io_uring, so the 'io-uring' option is not available\n" );
+                exit( EXIT_NO_IO_URING );
+#endif
+            }
+            case 'U' :  
+            {
+                verbose( "Read memory budget as %s\n", optarg );
 
-                /********************************************/
-                /* NB - the cssRoot is an absolute path     */
-                /* to the root of a hierarchy that will be  */
-                /* searched for .css files.                 */
-                /********************************************/
+                g_Options.memoryBudget = parseSize( optarg );
 
-                if( '/' != optarg[0] )
+                if( g_Options.memoryBudget <= 0 )
                 {
-                    printf("Absolute path required for 'c' option\n");
-                    exit( EXIT_ABS_PATH_REQUIRED );
+                    printf( "Memory budget for 'mem-budget' option must be a number of bytes, optionally followed by K, M or G\n" );
+                    exit( EXIT_BAD_MEM_BUDGET );
                 }
-
-                g_Options.cssRoot = strdup( optarg );
                 break;
             }
-            case 'n' :
+            case 'H' :
             {
-                verbose( "Read navigation embedding as %s\n", optarg );
-                g_Options.navEmbedCode = strdup( optarg );
+                verbose( "Read head partial as %s\n", optarg );
+                loadPartial( &g_Context.headPartials, optarg );
+                break;
+            }
+            case 'P' :
+            {
+                verbose( "Read body partial as %s\n", optarg );
+                loadPartial( &g_Context.bodyPartials, optarg );
                 break;
             }
             case ':' :  
@@ -891,54 +11285,461 @@ char    *extensionPtr = NULL;
         }
     }
 
-    // We are expecting a markdown filename to be supplied as the last
-    // command line arg.
+    // We are expecting markdown filenames to be supplied as the last
+    // command line args.
 
     verbose( "optind is %d, argc is %d\n", optind, argc );
 
+    if( g_Options.siteMode )
+    {
+        getSiteRoots( argc - optind, argv + optind );
+        return;
+    }
+
+    if( isSiteIndexWanted() )
+    {
+        printf( "A sitemap or search index is only made in site, watch or archive mode\n" );
+        exit( EXIT_BAD_SITE_INDEX );
+    }
+
+    if( 0 != g_Options.shardCount )
+    {
+        printf( "Only a site is made in shards\n" );
+        exit( EXIT_BAD_SHARD );
+    }
+
     if ( optind == argc )
     {
         printf("Expecting a markdown file to be specified\n");
         exit(EXIT_NO_MARKDOWN);
     }
 
-    // There should only be one naked argument on the command line
-    assert( (optind + 1) == argc );
+    // A lone '-' means the markdown filenames are to be read from stdin
+
+    if( ( (optind + 1) == argc ) && ( 0 == strcmp( "-", argv[optind] ) ) )
+    {
+        readMarkdownFilenames( stdin );
+    }
+    else
+    {
+        for( ; optind < argc; optind++ )
+        {
+            addMarkdownFilename( argv[optind] );
+        }
+    }
+
+    if( 0 == g_MarkdownFilenameCount )
+    {
+        printf("Expecting a markdown file to be specified\n");
+        exit(EXIT_NO_MARKDOWN);
+    }
+}
+
+#endif
+
+/**
+ * int webpage_ctx_new( const struct webpage_options *optionsPtr, struct webpage_ctx **ctxPtrPtr )
+ * 
+ * Library : make a context for making web pages, as described in webpage.h. 
+ * Its head fragments are made at once, in the same way as the program's own.
+ * 
+ * in       : optionsPtr    -   options for the pages made in the context
+ * out      : ctxPtrPtr     -   the context, to be freed by webpage_ctx_free()
+ * out      : WEBPAGE_OK, or what went wrong
+ * err      : WEBPAGE_BAD_ARGUMENT if there is no options or context pointer
+ * err      : WEBPAGE_NO_MEMORY if the context can't be allocated
+ */
+int webpage_ctx_new( const struct webpage_options *optionsPtr, struct webpage_ctx **ctxPtrPtr )
+{
+struct webpage_ctx *contextPtr = NULL;
+
+    if( ( NULL == optionsPtr ) || ( NULL == ctxPtrPtr ) )
+    {
+        return( WEBPAGE_BAD_ARGUMENT );
+    }
 
-    verbose( "Using %s as markdown filename\n", argv[optind] );
+    contextPtr = (struct webpage_ctx *)calloc( 1, sizeof(struct webpage_ctx) );
 
-    g_MarkdownFilename = strdup( argv[optind] );
+    if( NULL == contextPtr )
+    {
+        return( WEBPAGE_NO_MEMORY );
+    }
 
-    // Extract the root of the md filename ( i.e. filename without extension )
+    contextPtr->options.includeDTD      = !( WEBPAGE_OMIT_DOCTYPE & optionsPtr->omit );
+    contextPtr->options.includeTitle    = !( WEBPAGE_OMIT_TITLE & optionsPtr->omit );
+    contextPtr->options.includeDatetime = !( WEBPAGE_OMIT_DATETIME & optionsPtr->omit );
+    contextPtr->options.includeAuthor   = !( WEBPAGE_OMIT_AUTHOR & optionsPtr->omit );
+    contextPtr->options.rewriteLinks    = optionsPtr->rewrite_links;
+    contextPtr->options.jobCount        = 1;
+    contextPtr->options.streamSize      = DEFAULT_STREAM_SIZE;
 
-    g_RootFilename = strdup( g_MarkdownFilename );
-    
-    // Use the part of the md filename before any extension. Don't assume there's a .md extension.
-    extensionPtr = strrchr(g_RootFilename, '.');
+    if( NULL != optionsPtr->nav_embed )
+    {
+        contextPtr->options.navEmbedCode = strdup( optionsPtr->nav_embed );
+    }
 
-    if( NULL != extensionPtr )
+    if( NULL != optionsPtr->css_filename )
     {
-        *extensionPtr = '\0';
+        contextPtr->cssFilename = strdup( optionsPtr->css_filename );
+    }
+
+    if( ( ( NULL != optionsPtr->nav_embed ) && ( NULL == contextPtr->options.navEmbedCode ) ) ||
+        ( ( NULL != optionsPtr->css_filename ) && ( NULL == contextPtr->cssFilename ) ) )
+    {
+        webpage_ctx_free( contextPtr );
+        return( WEBPAGE_NO_MEMORY );
+    }
+
+    if( NULL != optionsPtr->head_html )
+    {
+        appendString( &contextPtr->headPartials, optionsPtr->head_html );
+    }
+
+    if( NULL != optionsPtr->body_html )
+    {
+        appendString( &contextPtr->bodyPartials, optionsPtr->body_html );
+    }
+
+    makeContext( contextPtr, &contextPtr->options, optionsPtr->author );
+
+    *ctxPtrPtr = contextPtr;
+
+    return( WEBPAGE_OK );
+}
+
+/**
+ * int webpage_render( const struct webpage_ctx *ctxPtr, const char *titlePtr, const char *markdownPtr, size_t length, struct webpage_buffer *outputPtr )
+ * 
+ * Library : make a web page from markdown in memory, as described in webpage.h.
+ * The page is made by renderWebpage(), just as the program makes one, in an 
+ * arena of its own, and then copied whole into the caller's buffer.
+ * 
+ * in       : ctxPtr        -   the context to make the page in
+ * in       : titlePtr      -   the page's title, or NULL for none
+ * in       : markdownPtr   -   the markdown
+ * in       : length        -   how long it is
+ * out      : outputPtr     -   the page's html
+ * out      : WEBPAGE_OK, or what went wrong
+ * err      : WEBPAGE_BAD_ARGUMENT if there is no context, markdown or buffer
+ * err      : WEBPAGE_NO_MEMORY if the buffer can't be grown for the page
+ * err      : WEBPAGE_BAD_RENDER if cmark fails to parse or render the markdown
+ */
+int webpage_render( const struct webpage_ctx *ctxPtr, const char *titlePtr, const char *markdownPtr, size_t length, struct webpage_buffer *outputPtr )
+{
+struct Arena    arena = { NULL, NULL };
+struct Arena    *callerArenaPtr = g_ThreadArenaPtr;
+struct Page     page;
+size_t          pageLength = 0;
+char            *dataPtr = NULL;
+int             status = WEBPAGE_OK;
+
+    if( ( NULL == ctxPtr ) || ( NULL == outputPtr ) || ( ( NULL == markdownPtr ) && ( 0 != length ) ) )
+    {
+        return( WEBPAGE_BAD_ARGUMENT );
+    }
+
+    memset( &page, 0, sizeof(struct Page) );
+
+    page.txtFD          = -1;
+    page.optionsPtr     = (struct Options *)&ctxPtr->options;
+    page.contextPtr     = ctxPtr;
+    page.arenaPtr       = &arena;
+    page.rootFilename   = (char *)titlePtr;
+    page.cssFilename    = ctxPtr->cssFilename;
+
+    // the markdown is already in memory, as if read ahead, so no file is
+    // opened
+
+    page.markdownDataPtr    = ( NULL == markdownPtr ) ? "" : markdownPtr;
+    page.markdownDataLength = length;
+
+    // The parser and the tree come from the page's arena, as they do for the
+    // program, so whatever arena the calling thread uses for itself is put
+    // back after
+
+    if( !renderWebpage( &page ) )
+    {
+        status = WEBPAGE_BAD_RENDER;
+    }
+    else
+    {
+        pageLength  = page.head.length + page.bodyLength + page.tail.length;
+        dataPtr     = ( pageLength > outputPtr->size ) ? (char *)realloc( outputPtr->data, pageLength ) : outputPtr->data;
+
+        if( NULL == dataPtr )
+        {
+            status = WEBPAGE_NO_MEMORY;
+        }
+        else
+        {
+            outputPtr->data = dataPtr;
+            outputPtr->size = ( pageLength > outputPtr->size ) ? pageLength : outputPtr->size;
+
+            memcpy( dataPtr, page.head.dataPtr, page.head.length );
+            memcpy( dataPtr + page.head.length, page.bodyPtr, page.bodyLength );
+            memcpy( dataPtr + page.head.length + page.bodyLength, page.tail.dataPtr, page.tail.length );
+
+            outputPtr->length = pageLength;
+        }
+    }
+
+    g_ThreadArenaPtr = callerArenaPtr;
+
+    free( page.head.dataPtr );
+    free( page.tail.dataPtr );
+    releaseArena( &arena );
+
+    return( status );
+}
+
+/**
+ * void webpage_buffer_free( struct webpage_buffer *bufferPtr )
+ * 
+ * Library : free a page buffer's memory.
+ * 
+ * in       : bufferPtr -   the buffer
+ * out      : the buffer is empty
+ * err      : none
+ */
+void webpage_buffer_free( struct webpage_buffer *bufferPtr )
+{
+    if( NULL != bufferPtr )
+    {
+        free( bufferPtr->data );
+
+        bufferPtr->data     = NULL;
+        bufferPtr->length   = 0;
+        bufferPtr->size     = 0;
+    }
+}
+
+/**
+ * void webpage_ctx_free( struct webpage_ctx *ctxPtr )
+ * 
+ * Library : free a context made by webpage_ctx_new().
+ * 
+ * in       : ctxPtr    -   the context, or NULL
+ * out      : the context is gone
+ * err      : none
+ */
+void webpage_ctx_free( struct webpage_ctx *ctxPtr )
+{
+    if( NULL != ctxPtr )
+    {
+        free( ctxPtr->options.navEmbedCode );
+        free( ctxPtr->cssFilename );
+        free( ctxPtr->headPrefix.dataPtr );
+        free( ctxPtr->headComments.dataPtr );
+        free( ctxPtr->headDatetime.dataPtr );
+        free( ctxPtr->headPartials.dataPtr );
+        free( ctxPtr->bodyPartials.dataPtr );
+        free( ctxPtr->bodyTail.dataPtr );
+        free( ctxPtr );
     }
- 
-    verbose( "Root filename is %s\n", g_RootFilename );
 }
 
+/**
+ * const char *webpage_strerror( int status )
+ * 
+ * Library : say what a status means.
+ * 
+ * in       : status    -   a status given back by the library
+ * out      : what it means
+ * err      : none
+ */
+const char *webpage_strerror( int status )
+{
+    switch( status )
+    {
+        case WEBPAGE_OK             :   return( "success" );
+        case WEBPAGE_BAD_ARGUMENT   :   return( "missing or bad argument" );
+        case WEBPAGE_NO_MEMORY      :   return( "out of memory" );
+        case WEBPAGE_BAD_RENDER     :   return( "markdown could not be rendered" );
+        default                     :   return( "unknown status" );
+    }
+}
+
+// The program itself, which the library is built without
+
+#ifndef WEBPAGE_LIBRARY
+
 /**
  * void main( int argc, char** argv )
  * 
- * Get user options and make webpage.
+ * Get user options and make a webpage for each markdown file, timing each 
+ * part of the run for the stats report.
  * 
  */
 void main( int argc, char** argv )
 {
-    // Get g_Options, and g_MarkdownFilename, and g_RootFilename
+mode_t      umaskValue;
+uint64_t    runStartTime = getNanoseconds();
+uint64_t    startTime = runStartTime;
+
+    // Get g_Options, and g_MarkdownFilenameList
 
     getOptions( argc, argv );
 
-    // Assemble web page
+    g_RunNanoseconds[run_options] = getNanoseconds() - startTime;
+
+    if( NULL != g_Options.traceFilename )
+    {
+        openTrace();
+    }
+
+    if( NULL != g_Options.statsFilename )
+    {
+        g_PageStatsPtr = (struct PageStats *)calloc( g_MarkdownFilenameCount, sizeof(struct PageStats) );
+
+        assert( g_PageStatsPtr );
+    }
+
+    // Web page files get the permissions fopen() would have given them. The
+    // umask can only be read by setting it, so put it straight back.
+
+    umaskValue = umask( 0 );
+    umask( umaskValue );
+
+    g_WebpageFileMode = 0666 & ~umaskValue;
+    g_AssetFileMask   = 0777 & ~umaskValue;
+
+    if( NULL != g_Options.cacheDirectory )
+    {
+        openBodyCache();
+    }
+
+    // Serve mode makes web pages as they're asked for, and nothing else
+
+    if( g_Options.serveMode )
+    {
+        serveSite();
+        exit( EXIT_NORMAL );
+    }
+
+    // Archive mode writes a whole site, and nothing else, so there's no
+    // manifest of what was there before, just somewhere to keep index records
+
+    if( NULL != g_Options.archiveFilename )
+    {
+        openArchive();
+
+        if( isSiteIndexWanted() )
+        {
+            g_NewManifestPtr = (struct ManifestEntry *)calloc( g_MarkdownFilenameCount + 1, sizeof(struct ManifestEntry) );
+
+            assert( g_NewManifestPtr );
+        }
+    }
+
+    // Merge mode puts together the manifests of the shards of a site, and 
+    // makes the site index from them, and nothing else
+
+    if( g_Options.mergeMode )
+    {
+        startTime = getNanoseconds();
+
+        loadManifest();
+        mergeShardManifests();
+
+        g_RunNanoseconds[run_load_manifest] = getNanoseconds() - startTime;
+
+        startTime = getNanoseconds();
+
+        saveManifest();
+
+        g_RunNanoseconds[run_save_manifest] = getNanoseconds() - startTime;
+
+        startTime = getNanoseconds();
+
+        if( isSiteIndexWanted() )
+        {
+            saveSiteIndex();
+        }
+
+        g_RunNanoseconds[run_save_index] = getNanoseconds() - startTime;
+
+        removeShardManifests();
+
+        if( NULL != g_Options.statsFilename )
+        {
+            saveStats( runStartTime );
+        }
+
+        exit( EXIT_NORMAL );
+    }
+
+    // Assemble web pages, only remaking those that have changed in site mode
+
+    if( g_Options.siteMode )
+    {
+        startTime = getNanoseconds();
+
+        if( -1 == g_ArchiveFD )
+        {
+            loadManifest();
+        }
+
+        g_RunNanoseconds[run_load_manifest] = getNanoseconds() - startTime;
 
-    makeWebpage();
+        startTime = getNanoseconds();
+
+        mirrorAssets();
+
+        g_RunNanoseconds[run_assets] = getNanoseconds() - startTime;
+    }
+
+    startTime = getNanoseconds();
+
+    makeAllWebpages();
+
+    g_RunNanoseconds[run_pages] = getNanoseconds() - startTime;
+
+    if( g_Options.siteMode )
+    {
+        startTime = getNanoseconds();
+
+        if( -1 == g_ArchiveFD )
+        {
+            saveManifest();
+        }
+
+        g_RunNanoseconds[run_save_manifest] = getNanoseconds() - startTime;
+
+        startTime = getNanoseconds();
+
+        // a shard's index records are in its shard manifest, for the merge
+
+        if( isSiteIndexWanted() && ( 0 == g_Options.shardCount ) )
+        {
+            saveSiteIndex();
+        }
+
+        g_RunNanoseconds[run_save_index] = getNanoseconds() - startTime;
+
+        if( -1 != g_ArchiveFD )
+        {
+            finishArchive();
+        }
+    }
+
+    if( NULL != g_Options.statsFilename )
+    {
+        saveStats( runStartTime );
+    }
+
+    // In watch mode, the stats report is for making the whole site, and what
+    // follows isn't timed
+
+    if( g_Options.watchMode )
+    {
+        free( g_PageStatsPtr );
+
+        g_PageStatsPtr = NULL;
+
+        watchSite();
+    }
 
     exit(EXIT_NORMAL);
 }
+
+#endif
@@ -0,0 +1,144 @@
+/*
+webpage library
+===============
+
+The web page making part of webpage, for a program that wants web pages made
+in process, a preview server say, rather than running webpage for each one.
+Build it with make.sh, which makes libwebpage.a and libwebpage.so alongside
+the webpage program, and link with -lwebpage -lcmark -lz -lpthread ( and
+-lbrotlienc, if make.sh found it ).
+
+A context holds everything that is the same for every page made in it : the
+options, the author and datetime, any css link, head and body partials and
+navigation embedding. It is made once, and doesn't change after that, so any
+number of threads can make pages in the same context at once. Each page is
+rendered from markdown in memory into a buffer the caller owns, and which can
+be used again for the next page.
+
+    struct webpage_options  options = { 0 };
+    struct webpage_ctx      *ctxPtr = NULL;
+    struct webpage_buffer   page = { NULL, 0, 0 };
+
+    options.css_filename = "/style.css";
+
+    if( ( WEBPAGE_OK == webpage_ctx_new( &options, &ctxPtr ) ) &&
+        ( WEBPAGE_OK == webpage_render( ctxPtr, "index", markdownPtr, markdownLength, &page ) ) )
+    {
+        ... page.data has page.length chars of html ...
+    }
+
+    webpage_buffer_free( &page );
+    webpage_ctx_free( ctxPtr );
+
+Nothing here exits or prints; what goes wrong is given back as a status. The
+files the webpage program reads for itself - the .txt file, the css search,
+the partials - are given as strings instead.
+*/
+
+#ifndef WEBPAGE_H
+#define WEBPAGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Only the library interface is visible outside the library; make.sh makes the
+ * rest local to the static library too
+ */
+#define WEBPAGE_API __attribute__(( visibility( "default" ) ))
+
+/**
+ * Parts of a page that can be left out, as for webpage's -f option
+ */
+#define WEBPAGE_OMIT_DOCTYPE    0x01
+#define WEBPAGE_OMIT_TITLE      0x02
+#define WEBPAGE_OMIT_DATETIME   0x04
+#define WEBPAGE_OMIT_AUTHOR     0x08
+
+/**
+ * What a library call gives back
+ */
+enum webpage_status
+{
+    WEBPAGE_OK              = 0,
+    WEBPAGE_BAD_ARGUMENT    = -1,
+    WEBPAGE_NO_MEMORY       = -2,
+    WEBPAGE_BAD_RENDER      = -3
+};
+
+/**
+ * Options for the pages made in a context. Strings are copied, so needn't last
+ * beyond webpage_ctx_new(). Any of them may be NULL.
+ *
+ *  omit            -   WEBPAGE_OMIT_ flags for the parts left out
+ *  rewrite_links   -   links to local .md files become links to .html files
+ *  author          -   author named in every page, if not omitted
+ *  css_filename    -   css file linked from every page
+ *  head_html       -   added to the head of every page ( a head partial )
+ *  body_html       -   added to the end of the body ( a body partial )
+ *  nav_embed       -   navigation embedding, added after the body partial
+ */
+struct webpage_options
+{
+    unsigned int    omit;
+    bool            rewrite_links;
+    const char      *author;
+    const char      *css_filename;
+    const char      *head_html;
+    const char      *body_html;
+    const char      *nav_embed;
+};
+
+/**
+ * A page's html, not NUL terminated. length says how much there is, and size
+ * how much has been allocated. Start with all of it 0, and free it with
+ * webpage_buffer_free().
+ */
+struct webpage_buffer
+{
+    char    *data;
+    size_t  length;
+    size_t  size;
+};
+
+/**
+ * A context for making web pages, made by webpage_ctx_new()
+ */
+struct webpage_ctx;
+
+/**
+ * Make a context for making web pages, with the options given. The datetime in
+ * every page made in it is the time the context was made.
+ */
+WEBPAGE_API int webpage_ctx_new( const struct webpage_options *optionsPtr, struct webpage_ctx **ctxPtrPtr );
+
+/**
+ * Make a web page from some Commonmark markdown, titled titlePtr if that isn't
+ * NULL. The page replaces whatever was in the buffer.
+ */
+WEBPAGE_API int webpage_render( const struct webpage_ctx *ctxPtr, const char *titlePtr, const char *markdownPtr, size_t length, struct webpage_buffer *outputPtr );
+
+/**
+ * Free a buffer's memory, leaving it empty, ready to be used again
+ */
+WEBPAGE_API void webpage_buffer_free( struct webpage_buffer *bufferPtr );
+
+/**
+ * Free a context, once no page is being made in it. NULL is ignored.
+ */
+WEBPAGE_API void webpage_ctx_free( struct webpage_ctx *ctxPtr );
+
+/**
+ * What a status means, in words
+ */
+WEBPAGE_API const char *webpage_strerror( int status );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
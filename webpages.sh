@@ -43,7 +43,9 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 # because the assumption is that you've developed the whole site in markdown using
 # something like ghostwriter, and those files may be cross linked. 
 #
-# Some tidy up is done to remove unwanted files from the html directory tree. 
+# The other files the site needs ( images, css and so on ) are mirrored into the
+# html tree by webpage as it goes, so md, txt and backup files never get there, and
+# there is nothing to tidy up afterwards. 
 #
 # opt n is a navigation embed code ( defaults to none )
 # opt m is the root of the markdown tree ( default is . )
@@ -52,6 +54,21 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 # opt F is flags options - specify special behaviors to webpage program, see 
 #                          webpage -h .
 # opt v is to turn on verbose output ( default is false ).
+# opt i is to build incrementally into the existing HTML tree ( default is false ).
+#                          Only pages whose inputs have changed are made again.
+# opt j is the number of pages webpage makes at once ( default is the number of 
+#                          processors ).
+# opt y is to go ahead without asking first ( default is false ).
+# opt w is to keep watching the markdown tree once the HTML tree is built, and
+#                          remake pages as their markdown changes, until
+#                          interrupted ( default is false ). Implies opt y.
+# opt a is how the other files the site needs are mirrored into the HTML tree :
+#                          link, reflink or copy ( default is link ). A hard
+#                          link shares the file, so nothing is copied.
+# opt k is to not keep the html rendered from each md file in webpage's body cache
+#                          ( default is false ). The cache is outside the HTML tree,
+#                          so a new HTML tree is made without rendering again any md
+#                          file that hasn't changed.
 #
 # NB - do not confuse options as supplied to this script with the options this
 # script provides to the webpage utility. They are related, but not identical.
@@ -66,13 +83,20 @@ htmlroot="../${PWD##*/}_html"
 css=false
 verbose=false
 flags=""
+jobs=$(nproc)
+incremental=false
+yes=false
+watch=false
+assets=link
+nocache=false
 
 navembedcodeOption=""
 cssOption=""
 verboseOption=""
 flagsOption=""
+cacheOption=""
 
-while getopts ":cvn:m:h:F:" opt; do
+while getopts ":civywkn:m:h:F:j:a:" opt; do
   case ${opt} in
     n )
       navembedcode=${OPTARG}
@@ -92,6 +116,25 @@ while getopts ":cvn:m:h:F:" opt; do
     F )
       flags=${OPTARG}
       ;;
+    j )
+      jobs=${OPTARG}
+      ;;
+    a )
+      assets=${OPTARG}
+      ;;
+    i )
+      incremental=true
+      ;;
+    k )
+      nocache=true
+      ;;
+    y )
+      yes=true
+      ;;
+    w )
+      watch=true
+      yes=true
+      ;;
     \? )
       echo "Invalid option: ${OPTARG}" 1>&2
       exit
@@ -110,8 +153,13 @@ echo "Using HTML root             : ${htmlroot} "
 echo "Using CSS option            : ${css} "
 echo "Using verbose option        : ${verbose} "
 echo "Using Flags                 : ${flags} "
+echo "Using jobs                  : ${jobs} "
+echo "Using incremental option    : ${incremental} "
+echo "Using watch option          : ${watch} "
+echo "Using assets                : ${assets} "
+echo "Using no cache option       : ${nocache} "
 
-while true; do
+while [[ ${yes} != true ]]; do
     echo ===================================================================
     read -p "Do you wish to continue?" yn
     case $yn in
@@ -135,7 +183,12 @@ fi
 
 if [[ ${flags} != "" ]]
 then
-    flagsOption=" -F ${flags} "
+    flagsOption=" -f ${flags} "
+fi
+
+if [[ ${nocache} != true ]]
+then
+    cacheOption=" --cache "
 fi
 
 # Make sure we're located *in markdown root*
@@ -144,9 +197,12 @@ cd ${markdownroot}
 absmarkdownroot=${PWD}
 echo "Absolute markdown root is ${absmarkdownroot}" 
 
-# Create a new html root. 
+# Create a new html root, unless building incrementally into the existing one. 
 
-if [[ -d ${htmlroot} ]] 
+if [[ ${incremental} == true ]] && [[ -d ${htmlroot} ]]
+then
+    echo "Building into existing HTML root"
+elif [[ -d ${htmlroot} ]] 
 then 
 # Backup html root
 
@@ -159,7 +215,10 @@ fi
 
 # Should now be no html root, so create new one
 
-if [ ! -d ${htmlroot} ]
+if [[ ${incremental} == true ]] && [[ -d ${htmlroot} ]]
+then
+    echo "Using HTML root"
+elif [ ! -d ${htmlroot} ]
 then
     echo "Making HTML root"
     mkdir ${htmlroot} 
@@ -168,11 +227,6 @@ else
     exit -1
 fi
 
-# Recursively copy the content of markdown root ( we're in the markdown root ) to 
-# html root. Here, we grab everything. Later on, we try to tidy up. 
-
-cp -r * ${htmlroot}
-
 # Switch to the html root
 
 cd ${htmlroot}
@@ -188,44 +242,54 @@ fi
 
 # Make HTML with my webpage tool. 
 # 
-# Note that when webpage executes, it's directory context is the context of the md file. 
-# This is very important. If the 'c' option is given, it will find css files by searching
-# upwards in the directory hierarchy. It will use the first css file that it encounters. 
-# By putting different css files at different levels of the hierarchy, a site default css 
-# can be overridden in a flexible manner. If the 'c' option is not provided, no css search 
-# will be performed.
+# Note that webpage runs in site mode, and only makes pages whose inputs ( md file, txt 
+# file, css file found, options ) have changed since the last run, according to the 
+# manifest it keeps in html root. In a new html root, that means every page. 
+#
+# Also note that webpage runs in site mode : it walks the markdown tree itself, and writes each 
+# html file into the corresponding directory of the html tree, making several pages at once.
+# The directory context of each page is the context of its md file. This is very important. 
+# If the 'c' option is given, it will find css files by searching upwards in the markdown 
+# hierarchy. It will use the first css file that it encounters. By putting different css 
+# files at different levels of the hierarchy, a site default css can be overridden in a 
+# flexible manner. If the 'c' option is not provided, no css search will be performed.
 # 
-# However, the css search needs an end condition - this is provided by assuming that the 
-# search starts somewhere beneath html root, and will stop when it gets to html root. An
-# unambiguous ( absolute ) value of html root must therefore be provided. 
+# However, the css search needs an end condition - in site mode the search stops when it 
+# gets to markdown root, which mirrors html root. 
 #
 # The webpage tool implements another customisation technique - if a file of the same name
 # as the .md file but with a .txt extension is present in the directory, it is loaded 
 # into the html file 'as is' in the head section. 
 #
 # NB webpage uses the cmark html renderer. 
-
-find . -name "*.md" -execdir webpage ${verboseOption} ${flagsOption} ${cssOption} ${navembedcodeOption} '{}' \; 
-
-# Recursively replace references to .md files in .html files to references to .html
-# files. This situation exists because building the whole site in markdown may mean
-# having links that point to markdown files, not html files. 
 #
-# This replacement is dangerous if the web page is talking about .md files :). Try to 
-# limit the potential damage by using '">' for context. It would really be nicer to do 
-# this in the renderer, when we would have more context. Of course, it's very likely 
-# there's a smarter way to use sed regex's. I'm thinking about that. 
+# References to .md files in links are replaced by references to .html files ( the 'l' 
+# option ). This situation exists because building the whole site in markdown may mean
+# having links that point to markdown files, not html files. webpage does this to the 
+# link destinations in the parsed markdown, so web pages that talk about .md files are 
+# left alone.
+#
+# Every other file in the markdown tree, other than .md, .txt, .backup and hidden 
+# files, is an asset the website needs ( e.g. images, css ), and webpage mirrors it 
+# into the html tree ( the 'assets' option ). Only assets that have changed are 
+# mirrored again, and those that have gone are removed, so the html tree is left in
+# a state where it can just be copied to the web server.
+#
+# Unless the 'k' option is given, webpage keeps the html it renders from each md file
+# in its body cache ( under ${XDG_CACHE_HOME:-~/.cache}/webpage ), keyed by what's in
+# the md file, so a page whose markdown hasn't changed isn't rendered again, even
+# into a new html root.
 
-find . -name "*.html" -execdir sed -i 's/\.md\">/\.html\">/g' '{}' \;
+webpage ${verboseOption} ${flagsOption} ${cssOption} ${navembedcodeOption} -l -j ${jobs} --assets=${assets} ${cacheOption} --site ${absmarkdownroot} ${abshtmlroot}
 
-# Tidy up - try to leave the HTML tree in a state where it can just be copied to 
-# the web server. Be careful about deleting files from the HTML tree, because the 
-# website needs files other than just HTML files ( e.g. images ), and it's hard to
-# be confident what they are ahead of time. 
+# Keep the HTML tree up to date as the markdown changes. The pages and assets are 
+# all up to date, so webpage goes straight to watching.
 
-find . -name "*.md" -delete
-find . -name "*.backup" -delete
-find . -name "*.txt" -delete
+if [[ ${watch} == true ]]
+then
+    echo "Watching ${absmarkdownroot} for changes"
+    exec webpage ${verboseOption} ${flagsOption} ${cssOption} ${navembedcodeOption} -l -j ${jobs} --assets=${assets} ${cacheOption} --watch ${absmarkdownroot} ${abshtmlroot}
+fi
 
 <<'###BLOCK-COMMENT'
 ###BLOCK-COMMENT